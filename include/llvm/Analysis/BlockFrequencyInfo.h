@@ -34,6 +34,7 @@ public:
   BlockFrequencyInfo();
   BlockFrequencyInfo(const Function &F, const BranchProbabilityInfo &BPI,
                      const LoopInfo &LI);
+  ~BlockFrequencyInfo();
 
   const Function *getFunction() const;
   void view() const;
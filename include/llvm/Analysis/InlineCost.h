@@ -14,7 +14,9 @@
 #ifndef LLVM_ANALYSIS_INLINECOST_H
 #define LLVM_ANALYSIS_INLINECOST_H
 
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Analysis/CallGraphSCCPass.h"
+#include "llvm/IR/ValueMap.h"
 #include <cassert>
 #include <climits>
 
@@ -23,6 +25,7 @@ class AssumptionCacheTracker;
 class CallSite;
 class DataLayout;
 class Function;
+class TargetTransformInfo;
 class TargetTransformInfoWrapperPass;
 
 namespace InlineConstants {
@@ -98,11 +101,53 @@ public:
   int getCostDelta() const { return Threshold - getCost(); }
 };
 
+/// \brief Get an InlineCost object representing the cost of inlining this
+/// callsite with the callee explicitly specified.
+///
+/// This is the core of \c InlineCostAnalysis::getInlineCost, exposed so that
+/// inliners which are not call graph SCC passes (such as the module-level
+/// priority inliner) can query inline costs using the TTI and assumption
+/// cache they already hold.
+InlineCost getInlineCost(CallSite CS, Function *Callee, int Threshold,
+                         TargetTransformInfo &CalleeTTI,
+                         AssumptionCacheTracker *ACT);
+
+/// \brief Minimal filter to detect invalid constructs for inlining.
+bool isInlineViable(Function &Callee);
+
 /// \brief Cost analyzer used by inliner.
+///
+/// Costs are cached per callee, keyed by a signature of everything the
+/// analysis reads from the call site: the threshold, the attributes involved,
+/// and which arguments are constants or constant offsets from allocas and
+/// other pointers. A later query for an unmodified callee with the same
+/// signature is answered without walking the callee body again.
+///
+/// Cached costs for a callee are dropped when the callee is deleted, when the
+/// SCC containing it is visited or was the previous SCC visited (the function
+/// passes interleaved with the inliner may have changed it), and whenever a
+/// client reports a change via \c invalidateCachedCosts.
 class InlineCostAnalysis : public CallGraphSCCPass {
   TargetTransformInfoWrapperPass *TTIWP;
   AssumptionCacheTracker *ACT;
 
+  /// \brief Signature of a call site; see \c getCallSiteSignature.
+  typedef SmallVector<uint64_t, 16> CallSiteSignature;
+
+  /// \brief Keep cached costs with the function they were computed for, even
+  /// when the function is replaced by another one.
+  struct CostCacheConfig : ValueMapConfig<const Function *> {
+    enum { FollowRAUW = false };
+  };
+  typedef std::vector<std::pair<CallSiteSignature, InlineCost>> CachedCosts;
+  ValueMap<const Function *, CachedCosts, CostCacheConfig> CostCache;
+
+  /// \brief The functions of the SCC visited last.
+  SmallVector<Function *, 4> LastSCCFunctions;
+
+  bool getCallSiteSignature(CallSite CS, Function *Callee, int Threshold,
+                            CallSiteSignature &Signature);
+
 public:
   static char ID;
 
@@ -112,6 +157,14 @@ public:
   // Pass interface implementation.
   void getAnalysisUsage(AnalysisUsage &AU) const override;
   bool runOnSCC(CallGraphSCC &SCC) override;
+  using llvm::Pass::doFinalization;
+  bool doFinalization(CallGraph &CG) override;
+
+  /// \brief Drop every cached cost of calls to \p F.
+  ///
+  /// This must be called after \p F is modified while the analysis is live,
+  /// for example after a call site in \p F has been inlined.
+  void invalidateCachedCosts(const Function &F);
 
   /// \brief Get an InlineCost object representing the cost of inlining this
   /// callsite.
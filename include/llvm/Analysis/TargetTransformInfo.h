@@ -315,6 +315,12 @@ public:
   bool isLegalMaskedStore(Type *DataType, int Consecutive) const;
   bool isLegalMaskedLoad(Type *DataType, int Consecutive) const;
 
+  /// \brief Return true if the target supports masked gather/scatter of
+  /// vectors of the given type, i.e. loads and stores through a vector of
+  /// arbitrary pointers.
+  bool isLegalMaskedGather(Type *DataType) const;
+  bool isLegalMaskedScatter(Type *DataType) const;
+
   /// \brief Return the cost of the scaling factor used in the addressing
   /// mode represented by AM for this target, for a load/store
   /// of the specified type.
@@ -409,6 +415,18 @@ public:
   /// and the number of execution units in the CPU.
   unsigned getMaxInterleaveFactor(unsigned VF) const;
 
+  /// \brief The data cache levels a transform may size its working set for.
+  enum class CacheLevel {
+    L1D, // The L1 data cache.
+    L2D  // The L2 data cache.
+  };
+
+  /// \return The size in bytes of the given cache level, if it is known.
+  Optional<unsigned> getCacheSize(CacheLevel Level) const;
+
+  /// \return The size in bytes of a cache line, or 0 if it is not known.
+  unsigned getCacheLineSize() const;
+
   /// \return The expected cost of arithmetic ops, such as mul, xor, fsub, etc.
   unsigned
   getArithmeticInstrCost(unsigned Opcode, Type *Ty,
@@ -448,6 +466,16 @@ public:
   unsigned getMaskedMemoryOpCost(unsigned Opcode, Type *Src, unsigned Alignment,
                                  unsigned AddressSpace) const;
 
+  /// \return The cost of a gather or scatter.
+  /// \p Opcode is Load for a gather and Store for a scatter.
+  /// \p DataTy is the vector type of the data that is loaded or stored.
+  /// \p Ptr is the vector of pointers (or the scalar pointer it is computed
+  ///    from) that is accessed.
+  /// \p VariableMask is true if the mask is not known at compile time.
+  /// \p Alignment is the alignment of a single element.
+  unsigned getGatherScatterOpCost(unsigned Opcode, Type *DataTy, Value *Ptr,
+                                  bool VariableMask, unsigned Alignment) const;
+
   /// \return The cost of the interleaved memory operation.
   /// \p Opcode is the memory operation code
   /// \p VecTy is the vector type of the interleaved access.
@@ -566,6 +594,8 @@ public:
                                      unsigned AddrSpace) = 0;
   virtual bool isLegalMaskedStore(Type *DataType, int Consecutive) = 0;
   virtual bool isLegalMaskedLoad(Type *DataType, int Consecutive) = 0;
+  virtual bool isLegalMaskedGather(Type *DataType) = 0;
+  virtual bool isLegalMaskedScatter(Type *DataType) = 0;
   virtual int getScalingFactorCost(Type *Ty, GlobalValue *BaseGV,
                                    int64_t BaseOffset, bool HasBaseReg,
                                    int64_t Scale, unsigned AddrSpace) = 0;
@@ -587,6 +617,8 @@ public:
   virtual unsigned getNumberOfRegisters(bool Vector) = 0;
   virtual unsigned getRegisterBitWidth(bool Vector) = 0;
   virtual unsigned getMaxInterleaveFactor(unsigned VF) = 0;
+  virtual Optional<unsigned> getCacheSize(CacheLevel Level) = 0;
+  virtual unsigned getCacheLineSize() = 0;
   virtual unsigned
   getArithmeticInstrCost(unsigned Opcode, Type *Ty, OperandValueKind Opd1Info,
                          OperandValueKind Opd2Info,
@@ -606,6 +638,9 @@ public:
   virtual unsigned getMaskedMemoryOpCost(unsigned Opcode, Type *Src,
                                          unsigned Alignment,
                                          unsigned AddressSpace) = 0;
+  virtual unsigned getGatherScatterOpCost(unsigned Opcode, Type *DataTy,
+                                          Value *Ptr, bool VariableMask,
+                                          unsigned Alignment) = 0;
   virtual unsigned getInterleavedMemoryOpCost(unsigned Opcode, Type *VecTy,
                                               unsigned Factor,
                                               ArrayRef<unsigned> Indices,
@@ -694,6 +729,12 @@ public:
   bool isLegalMaskedLoad(Type *DataType, int Consecutive) override {
     return Impl.isLegalMaskedLoad(DataType, Consecutive);
   }
+  bool isLegalMaskedGather(Type *DataType) override {
+    return Impl.isLegalMaskedGather(DataType);
+  }
+  bool isLegalMaskedScatter(Type *DataType) override {
+    return Impl.isLegalMaskedScatter(DataType);
+  }
   int getScalingFactorCost(Type *Ty, GlobalValue *BaseGV, int64_t BaseOffset,
                            bool HasBaseReg, int64_t Scale,
                            unsigned AddrSpace) override {
@@ -744,6 +785,10 @@ public:
   unsigned getMaxInterleaveFactor(unsigned VF) override {
     return Impl.getMaxInterleaveFactor(VF);
   }
+  Optional<unsigned> getCacheSize(CacheLevel Level) override {
+    return Impl.getCacheSize(Level);
+  }
+  unsigned getCacheLineSize() override { return Impl.getCacheLineSize(); }
   unsigned
   getArithmeticInstrCost(unsigned Opcode, Type *Ty, OperandValueKind Opd1Info,
                          OperandValueKind Opd2Info,
@@ -778,6 +823,12 @@ public:
                                  unsigned AddressSpace) override {
     return Impl.getMaskedMemoryOpCost(Opcode, Src, Alignment, AddressSpace);
   }
+  unsigned getGatherScatterOpCost(unsigned Opcode, Type *DataTy, Value *Ptr,
+                                  bool VariableMask,
+                                  unsigned Alignment) override {
+    return Impl.getGatherScatterOpCost(Opcode, DataTy, Ptr, VariableMask,
+                                       Alignment);
+  }
   unsigned getInterleavedMemoryOpCost(unsigned Opcode, Type *VecTy,
                                       unsigned Factor,
                                       ArrayRef<unsigned> Indices,
@@ -203,6 +203,10 @@ public:
 
   bool isLegalMaskedLoad(Type *DataType, int Consecutive) { return false; }
 
+  bool isLegalMaskedGather(Type *DataType) { return false; }
+
+  bool isLegalMaskedScatter(Type *DataType) { return false; }
+
   int getScalingFactorCost(Type *Ty, GlobalValue *BaseGV, int64_t BaseOffset,
                            bool HasBaseReg, int64_t Scale, unsigned AddrSpace) {
     // Guess that all legal addressing mode are free.
@@ -252,6 +256,10 @@ public:
 
   unsigned getMaxInterleaveFactor(unsigned VF) { return 1; }
 
+  Optional<unsigned> getCacheSize(TTI::CacheLevel Level) { return None; }
+
+  unsigned getCacheLineSize() { return 0; }
+
   unsigned getArithmeticInstrCost(unsigned Opcode, Type *Ty,
                                   TTI::OperandValueKind Opd1Info,
                                   TTI::OperandValueKind Opd2Info,
@@ -287,6 +295,11 @@ public:
     return 1;
   }
 
+  unsigned getGatherScatterOpCost(unsigned Opcode, Type *DataTy, Value *Ptr,
+                                  bool VariableMask, unsigned Alignment) {
+    return 1;
+  }
+
   unsigned getInterleavedMemoryOpCost(unsigned Opcode, Type *VecTy,
                                       unsigned Factor,
                                       ArrayRef<unsigned> Indices,
@@ -227,6 +227,16 @@ namespace llvm {
                                 const Instruction *CtxI = nullptr,
                                 const DominatorTree *DT = nullptr,
                                 const TargetLibraryInfo *TLI = nullptr);
+
+  /// isDereferenceableBytes - Return true if the \p Size bytes starting at
+  /// \p V are always dereferenceable, e.g. because they are known to lie
+  /// within an alloca, a global or an argument with a dereferenceable
+  /// attribute. The context arguments are used as in isDereferenceablePointer.
+  bool isDereferenceableBytes(const Value *V, uint64_t Size,
+                              const DataLayout &DL,
+                              const Instruction *CtxI = nullptr,
+                              const DominatorTree *DT = nullptr,
+                              const TargetLibraryInfo *TLI = nullptr);
   
   /// isSafeToSpeculativelyExecute - Return true if the instruction does not
   /// have any effects besides calculating the result and does not have
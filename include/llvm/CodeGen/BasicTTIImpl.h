@@ -689,6 +689,13 @@ public:
     case Intrinsic::masked_load:
       return static_cast<T *>(this)
           ->getMaskedMemoryOpCost(Instruction::Load, RetTy, 0, 0);
+    case Intrinsic::masked_scatter:
+      return static_cast<T *>(this)
+          ->getGatherScatterOpCost(Instruction::Store, Tys[0], nullptr, true,
+                                   0);
+    case Intrinsic::masked_gather:
+      return static_cast<T *>(this)
+          ->getGatherScatterOpCost(Instruction::Load, RetTy, nullptr, true, 0);
     }
 
     const TargetLoweringBase *TLI = getTLI();
@@ -639,6 +639,10 @@ namespace llvm {
   /// the intrinsic for later emission to the StackMap.
   extern char &StackMapLivenessID;
 
+  /// MachineOutliner - This pass replaces repeated sequences of instructions
+  /// with calls to a single copy of the sequence.
+  extern char &MachineOutlinerID;
+
   /// createJumpInstrTables - This pass creates jump-instruction tables.
   ModulePass *createJumpInstrTablesPass();
 
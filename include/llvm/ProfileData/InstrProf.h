@@ -16,12 +16,18 @@
 #ifndef LLVM_PROFILEDATA_INSTRPROF_H_
 #define LLVM_PROFILEDATA_INSTRPROF_H_
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include <cstdint>
+#include <string>
 #include <system_error>
 #include <vector>
 
 namespace llvm {
+class Function;
+class Instruction;
+
 const std::error_category &instrprof_category();
 
 enum class instrprof_error {
@@ -44,6 +50,24 @@ inline std::error_code make_error_code(instrprof_error E) {
   return std::error_code(static_cast<int>(E), instrprof_category());
 }
 
+/// The kinds of values recorded by value profiling.
+enum InstrProfValueKind : uint32_t {
+  IPVK_IndirectCallTarget = 0,
+
+  IPVK_Last = IPVK_IndirectCallTarget
+};
+
+/// A value seen at a value profiling site and the number of times it was seen.
+/// Indirect call targets are recorded as the hash of the profile name of the
+/// callee, see getPGOFuncNameHash.
+struct InstrProfValueData {
+  uint64_t Value;
+  uint64_t Count;
+};
+
+/// The values seen at a single value profiling site.
+typedef std::vector<InstrProfValueData> InstrProfValueSite;
+
 /// Profiling information for a single function.
 struct InstrProfRecord {
   InstrProfRecord() {}
@@ -52,8 +76,38 @@ struct InstrProfRecord {
   StringRef Name;
   uint64_t Hash;
   std::vector<uint64_t> Counts;
+  /// The targets of the indirect calls of the function, in the order the
+  /// instrumentation numbered the call sites.
+  std::vector<InstrProfValueSite> IndirectCallSites;
+
+  /// Merge the value profile of Other into this one. The sites of both
+  /// records must match.
+  std::error_code mergeValueProfData(const InstrProfRecord &Other);
 };
 
+/// Return the name under which IR level instrumentation records the profile
+/// of F. Local functions are qualified by the module name, like the front end
+/// does.
+std::string getPGOFuncName(const Function &F);
+
+/// Return the value recorded by value profiling for a call to the function
+/// with the given profile name.
+uint64_t getPGOFuncNameHash(StringRef FuncName);
+
+/// Attach the value profile of a site to Inst as !prof metadata holding the
+/// value kind, the total count Sum of the site, and the MaxNumValues most
+/// frequent values of VDs with their counts.
+void annotateValueSite(Instruction &Inst, InstrProfValueKind ValueKind,
+                       ArrayRef<InstrProfValueData> VDs, uint64_t Sum,
+                       uint32_t MaxNumValues);
+
+/// Read the value profile of kind ValueKind attached to Inst by
+/// annotateValueSite. Return false if there is none.
+bool getValueProfDataFromInst(const Instruction &Inst,
+                              InstrProfValueKind ValueKind,
+                              SmallVectorImpl<InstrProfValueData> &ValueData,
+                              uint64_t &TotalCount);
+
 } // end namespace llvm
 
 namespace std {
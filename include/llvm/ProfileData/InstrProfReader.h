@@ -97,7 +97,10 @@ public:
 /// new lines.
 ///
 /// Each record consists of a function name, a function hash, a number of
-/// counters, and then each counter value, in that order.
+/// counters, and then each counter value, in that order. It is optionally
+/// followed by the value profile: the number of indirect call sites, and for
+/// each site the number of targets followed by one "name:count" line per
+/// target.
 class TextInstrProfReader : public InstrProfReader {
 private:
   /// The profile data file contents.
@@ -258,6 +261,9 @@ public:
   /// Read a single record.
   std::error_code readNextRecord(InstrProfRecord &Record) override;
 
+  /// Return the counts and the value profile of the given function.
+  ErrorOr<InstrProfRecord> getInstrProfRecord(StringRef FuncName,
+                                              uint64_t FuncHash);
   /// Fill Counts with the profile data for the given function name.
   std::error_code getFunctionCounts(StringRef FuncName, uint64_t FuncHash,
                                     std::vector<uint64_t> &Counts);
@@ -29,9 +29,9 @@ namespace llvm {
 /// Writer for instrumentation based profile data.
 class InstrProfWriter {
 public:
-  typedef SmallDenseMap<uint64_t, std::vector<uint64_t>, 1> CounterData;
+  typedef SmallDenseMap<uint64_t, InstrProfRecord, 1> ProfilingData;
 private:
-  StringMap<CounterData> FunctionData;
+  StringMap<ProfilingData> FunctionData;
   uint64_t MaxFunctionCount;
 public:
   InstrProfWriter() : MaxFunctionCount(0) {}
@@ -42,6 +42,10 @@ public:
   std::error_code addFunctionCounts(StringRef FunctionName,
                                     uint64_t FunctionHash,
                                     ArrayRef<uint64_t> Counters);
+  /// Add the counts and the value profile of a function. If there is already
+  /// a record for this function and the hash, number of counts and number of
+  /// value sites match, the counts of both are summed.
+  std::error_code addRecord(const InstrProfRecord &I);
   /// Write the profile to \c OS
   void write(raw_fd_ostream &OS);
   /// Write the profile, returning the raw data. For testing.
@@ -57,7 +57,16 @@ static inline uint64_t SPMagic() {
          uint64_t('2') << (64 - 56) | uint64_t(0xff);
 }
 
-static inline uint64_t SPVersion() { return 100; }
+static inline uint64_t SPVersion() { return 101; }
+
+static inline uint64_t SPCompactMagic() {
+  return uint64_t('S') << (64 - 8) | uint64_t('P') << (64 - 16) |
+         uint64_t('R') << (64 - 24) | uint64_t('O') << (64 - 32) |
+         uint64_t('F') << (64 - 40) | uint64_t('C') << (64 - 48) |
+         uint64_t('2') << (64 - 56) | uint64_t(0xff);
+}
+
+static inline uint64_t SPCompactVersion() { return 1; }
 
 /// Represents the relative location of an instruction.
 ///
@@ -158,16 +167,24 @@ private:
 };
 
 typedef DenseMap<LineLocation, SampleRecord> BodySampleMap;
+class FunctionSamples;
+typedef StringMap<FunctionSamples> FunctionSamplesMap;
+typedef DenseMap<LineLocation, FunctionSamplesMap> CallsiteSampleMap;
 
 /// Representation of the samples collected for a function.
 ///
 /// This data structure contains all the collected samples for the body
 /// of a function. Each sample corresponds to a LineLocation instance
 /// within the body of the function.
+///
+/// Functions that were inlined in the profiled binary keep their own
+/// samples, nested under the call site they were inlined at. This is the
+/// inline stack used to replay the inlining decisions of the profiled
+/// binary.
 class FunctionSamples {
 public:
   FunctionSamples() : TotalSamples(0), TotalHeadSamples(0) {}
-  void print(raw_ostream &OS = dbgs());
+  void print(raw_ostream &OS = dbgs(), unsigned Indent = 0) const;
   void addTotalSamples(unsigned Num) { TotalSamples += Num; }
   void addHeadSamples(unsigned Num) { TotalHeadSamples += Num; }
   void addBodySamples(int LineOffset, unsigned Discriminator, unsigned Num) {
@@ -199,7 +216,26 @@ public:
     return sampleRecordAt(LineLocation(LineOffset, Discriminator)).getSamples();
   }
 
-  bool empty() const { return BodySamples.empty(); }
+  /// Return the profiles of the functions inlined at the given location,
+  /// by callee name.
+  FunctionSamplesMap &functionSamplesAt(const LineLocation &Loc) {
+    return CallsiteSamples[Loc];
+  }
+
+  /// Return the profile of \p CalleeName inlined at \p Loc, or nullptr if
+  /// \p CalleeName was not inlined there in the profiled binary.
+  const FunctionSamples *findFunctionSamplesAt(const LineLocation &Loc,
+                                               StringRef CalleeName) const {
+    auto I = CallsiteSamples.find(Loc);
+    if (I == CallsiteSamples.end())
+      return nullptr;
+    auto FS = I->second.find(CalleeName);
+    if (FS == I->second.end())
+      return nullptr;
+    return &FS->second;
+  }
+
+  bool empty() const { return BodySamples.empty() && CallsiteSamples.empty(); }
 
   /// Return the total number of samples collected inside the function.
   unsigned getTotalSamples() const { return TotalSamples; }
@@ -211,6 +247,11 @@ public:
   /// Return all the samples collected in the body of the function.
   const BodySampleMap &getBodySamples() const { return BodySamples; }
 
+  /// Return all the profiles of the functions inlined in this one.
+  const CallsiteSampleMap &getCallsiteSamples() const {
+    return CallsiteSamples;
+  }
+
   /// Merge the samples in \p Other into this one.
   void merge(const FunctionSamples &Other) {
     addTotalSamples(Other.getTotalSamples());
@@ -220,6 +261,11 @@ public:
       const SampleRecord &Rec = I.second;
       sampleRecordAt(Loc).merge(Rec);
     }
+    for (const auto &I : Other.getCallsiteSamples()) {
+      FunctionSamplesMap &Callees = functionSamplesAt(I.first);
+      for (const auto &J : I.second)
+        Callees[J.first()].merge(J.second);
+    }
   }
 
 private:
@@ -240,6 +286,12 @@ private:
   /// collected at the corresponding line offset. All line locations
   /// are an offset from the start of the function.
   BodySampleMap BodySamples;
+
+  /// Map call site locations to the profiles of the functions inlined there.
+  ///
+  /// The line locations in the inlined profiles are an offset from the start
+  /// of the inlined function.
+  CallsiteSampleMap CallsiteSamples;
 };
 
 } // End namespace sampleprof
@@ -20,6 +20,7 @@
 #include "llvm/IR/DiagnosticInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
 #include "llvm/ProfileData/SampleProf.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
@@ -55,9 +56,16 @@ namespace sampleprof {
 ///      protection against source code shuffling, line numbers should
 ///      be relative to the start of the function.
 ///
-/// The reader supports two file formats: text and binary. The text format
-/// is useful for debugging and testing, while the binary format is more
-/// compact. They can both be used interchangeably.
+///   3. The profiles of the functions that were inlined in F in the
+///      profiled binary, keyed by the location of the call site they were
+///      inlined at (relative to the start of F) and by their name.
+///
+/// The reader supports three file formats: text, binary and compact
+/// binary. The text format is useful for debugging and testing, while the
+/// binary formats are more compact. The compact binary format also indexes
+/// the function profiles, so that only the profiles of the functions
+/// defined in the module being compiled need to be decoded. They can all be
+/// used interchangeably.
 class SampleProfileReader {
 public:
   SampleProfileReader(std::unique_ptr<MemoryBuffer> B, LLVMContext &C)
@@ -71,6 +79,13 @@ public:
   /// \brief Read sample profiles from the associated file.
   virtual std::error_code read() = 0;
 
+  /// \brief Restrict the profiles loaded by read() to the functions defined
+  /// in \p M.
+  ///
+  /// This is only a hint: formats that cannot load the profile of a single
+  /// function separately ignore it and load all the profiles.
+  virtual void collectFuncsToUse(const Module &M) {}
+
   /// \brief Print the profile for \p FName on stream \p OS.
   void dumpFunctionProfile(StringRef FName, raw_ostream &OS = dbgs());
 
@@ -125,7 +140,8 @@ public:
 class SampleProfileReaderBinary : public SampleProfileReader {
 public:
   SampleProfileReaderBinary(std::unique_ptr<MemoryBuffer> B, LLVMContext &C)
-      : SampleProfileReader(std::move(B), C), Data(nullptr), End(nullptr) {}
+      : SampleProfileReader(std::move(B), C), Data(nullptr), End(nullptr),
+        HasInlineStacks(false) {}
 
   /// \brief Read and validate the file header.
   std::error_code readHeader() override;
@@ -153,6 +169,13 @@ protected:
   /// \returns the read value.
   ErrorOr<StringRef> readString();
 
+  /// \brief Read a function name from the profile.
+  virtual ErrorOr<StringRef> readName() { return readString(); }
+
+  /// \brief Read the samples of a function, and of the functions inlined in
+  /// it, into \p FProfile.
+  std::error_code readProfile(FunctionSamples &FProfile);
+
   /// \brief Return true if we've reached the end of file.
   bool at_eof() const { return Data >= End; }
 
@@ -161,6 +184,58 @@ protected:
 
   /// \brief Points to the end of the buffer.
   const uint8_t *End;
+
+  /// \brief True if the profiles record the functions inlined in them.
+  ///
+  /// Profiles of version 100 predate inline stacks.
+  bool HasInlineStacks;
+};
+
+/// \brief Reader of the compact binary format.
+///
+/// The file starts with a table of all the function names used in the
+/// profile, which the profiles refer to by index, followed by the offset of
+/// the profile of each function. This lets read() decode only the profiles
+/// of the functions collected by collectFuncsToUse().
+class SampleProfileReaderCompactBinary : public SampleProfileReaderBinary {
+public:
+  SampleProfileReaderCompactBinary(std::unique_ptr<MemoryBuffer> B,
+                                   LLVMContext &C)
+      : SampleProfileReaderBinary(std::move(B), C), ProfilesStart(nullptr),
+        UseAllFuncs(true) {}
+
+  /// \brief Read and validate the file header and the function index.
+  std::error_code readHeader() override;
+
+  /// \brief Read the sample profiles of the functions to use.
+  std::error_code read() override;
+
+  void collectFuncsToUse(const Module &M) override;
+
+  /// \brief Return true if \p Buffer is in the format supported by this class.
+  static bool hasFormat(const MemoryBuffer &Buffer);
+
+protected:
+  ErrorOr<StringRef> readName() override;
+
+private:
+  /// \brief Read the profile of \p FName, starting at \p Offset.
+  std::error_code readFunctionProfile(StringRef FName, uint64_t Offset);
+
+  /// \brief The function names referenced in the profiles.
+  std::vector<StringRef> NameTable;
+
+  /// \brief Offset of the profile of each function from ProfilesStart.
+  DenseMap<StringRef, uint64_t> FuncOffsets;
+
+  /// \brief Points to the start of the function profiles.
+  const uint8_t *ProfilesStart;
+
+  /// \brief The functions whose profile read() loads, unless UseAllFuncs.
+  std::vector<StringRef> FuncsToUse;
+
+  /// \brief True if read() loads the profiles of all the functions.
+  bool UseAllFuncs;
 };
 
 } // End namespace sampleprof
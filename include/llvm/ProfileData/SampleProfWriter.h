@@ -25,7 +25,13 @@ namespace llvm {
 
 namespace sampleprof {
 
-enum SampleProfileFormat { SPF_None = 0, SPF_Text, SPF_Binary, SPF_GCC };
+enum SampleProfileFormat {
+  SPF_None = 0,
+  SPF_Text,
+  SPF_Binary,
+  SPF_Compact_Binary,
+  SPF_GCC
+};
 
 /// \brief Sample-based profile writer. Base class.
 class SampleProfileWriter {
@@ -90,6 +96,10 @@ public:
   bool write(const Module &M, StringMap<FunctionSamples> &P) {
     return SampleProfileWriter::write(M, P);
   }
+
+private:
+  /// \brief Write the body of \p S, with its lines indented by \p Indent.
+  void writeBody(const FunctionSamples &S, unsigned Indent);
 };
 
 /// \brief Sample-based profile writer (binary format).
@@ -101,6 +111,55 @@ public:
   bool write(const Module &M, StringMap<FunctionSamples> &P) {
     return SampleProfileWriter::write(M, P);
   }
+
+protected:
+  /// \brief Create a writer whose file starts with \p Magic and \p Version.
+  SampleProfileWriterBinary(StringRef F, std::error_code &EC, uint64_t Magic,
+                            uint64_t Version);
+
+  /// \brief Write the samples of \p S, and of the functions inlined in it,
+  /// to \p Out.
+  void writeProfile(raw_ostream &Out, const FunctionSamples &S);
+
+  /// \brief Write a function name to \p Out.
+  virtual void writeName(raw_ostream &Out, StringRef FName);
+};
+
+/// \brief Sample-based profile writer (compact binary format).
+///
+/// Since the name table and the function index precede the function
+/// profiles, the profiles are buffered and only written out when the writer
+/// is destroyed.
+class SampleProfileWriterCompactBinary : public SampleProfileWriterBinary {
+public:
+  SampleProfileWriterCompactBinary(StringRef F, std::error_code &EC)
+      : SampleProfileWriterBinary(F, EC, SPCompactMagic(),
+                                  SPCompactVersion()) {}
+  ~SampleProfileWriterCompactBinary() override;
+
+  bool write(StringRef F, const FunctionSamples &S) override;
+  bool write(const Module &M, StringMap<FunctionSamples> &P) {
+    return SampleProfileWriter::write(M, P);
+  }
+
+protected:
+  void writeName(raw_ostream &Out, StringRef FName) override;
+
+private:
+  /// \brief Return the index of \p FName in NameTable, adding it if needed.
+  unsigned getNameIndex(StringRef FName);
+
+  /// \brief Index of every name in NameTable.
+  StringMap<unsigned> NameIndex;
+
+  /// \brief The function names referenced in the profiles.
+  std::vector<std::string> NameTable;
+
+  /// \brief The name index and offset in Profiles of every function.
+  std::vector<std::pair<unsigned, uint64_t>> FuncOffsets;
+
+  /// \brief The encoded function profiles.
+  std::string Profiles;
 };
 
 } // End namespace sampleprof
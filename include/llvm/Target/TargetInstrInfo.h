@@ -31,6 +31,7 @@ class MachineRegisterInfo;
 class MDNode;
 class MCInst;
 struct MCSchedModel;
+class MCSymbol;
 class MCSymbolRefExpr;
 class SDNode;
 class ScheduleHazardRecognizer;
@@ -1262,6 +1263,76 @@ public:
     return 5;
   }
 
+  /// Classes of instructions for the machine outliner.
+  enum MachineOutlinerInstrType {
+    /// The instruction may be moved into outlined code.
+    MOT_Legal,
+    /// The instruction returns from the function. It may only end a sequence,
+    /// which is then reached with a tail call instead of a call.
+    MOT_LegalTerminator,
+    /// The instruction must stay where it is.
+    MOT_Illegal
+  };
+
+  /// Return true if the machine outliner may outline code from \p MF. The
+  /// other outlining hooks are only called for functions accepted here.
+  virtual bool isFunctionSafeToOutlineFrom(const MachineFunction &MF) const {
+    return false;
+  }
+
+  /// Classify \p MI for the machine outliner.
+  virtual MachineOutlinerInstrType
+  getOutliningType(const MachineInstr &MI) const {
+    llvm_unreachable("Target didn't implement getOutliningType!");
+  }
+
+  /// Return true if the instructions [\p Begin, \p End) of \p MBB may be
+  /// replaced by a call to an outlined copy of them. Sequences that end in a
+  /// return are reached with a tail call instead and are not checked here.
+  virtual bool
+  isLegalToOutlineWithCall(const MachineBasicBlock &MBB,
+                           MachineBasicBlock::const_iterator Begin,
+                           MachineBasicBlock::const_iterator End) const {
+    llvm_unreachable("Target didn't implement isLegalToOutlineWithCall!");
+  }
+
+  /// Return the size of \p MI in bytes, or an estimate of it, for weighing
+  /// outlining candidates.
+  virtual unsigned getOutliningInstrSize(const MachineInstr &MI) const {
+    llvm_unreachable("Target didn't implement getOutliningInstrSize!");
+  }
+
+  /// Return the number of bytes each call (or tail call) to an outlined
+  /// sequence costs at the place the sequence was taken from.
+  virtual unsigned getOutliningCallOverhead(bool IsTailCall) const {
+    llvm_unreachable("Target didn't implement getOutliningCallOverhead!");
+  }
+
+  /// Return the number of bytes buildOutlinedFrame adds to an outlined
+  /// sequence.
+  virtual unsigned getOutliningFrameOverhead(bool IsTailCall) const {
+    llvm_unreachable("Target didn't implement getOutliningFrameOverhead!");
+  }
+
+  /// Insert a call to the outlined sequence \p Outlined before \p It, and
+  /// return it. A call reaches the sequence through \p Sym, a label at its
+  /// start; a tail call is a branch to the block. The caller adds the implicit
+  /// register operands.
+  virtual MachineInstr *insertOutlinedCall(MachineBasicBlock &MBB,
+                                           MachineBasicBlock::iterator It,
+                                           MachineBasicBlock &Outlined,
+                                           MCSymbol *Sym,
+                                           bool IsTailCall) const {
+    llvm_unreachable("Target didn't implement insertOutlinedCall!");
+  }
+
+  /// Finish the outlined sequence in \p MBB, e.g. by adding a return to a
+  /// sequence that is reached with a call.
+  virtual void buildOutlinedFrame(MachineBasicBlock &MBB,
+                                  bool IsTailCall) const {
+    llvm_unreachable("Target didn't implement buildOutlinedFrame!");
+  }
+
 private:
   unsigned CallFrameSetupOpcode, CallFrameDestroyOpcode;
 };
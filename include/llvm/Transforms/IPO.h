@@ -103,6 +103,12 @@ Pass *createFunctionInliningPass(unsigned OptLevel, unsigned SizeOptLevel);
 Pass *createAlwaysInlinerPass();
 Pass *createAlwaysInlinerPass(bool InsertLifetime);
 
+//===----------------------------------------------------------------------===//
+/// createPriorityInlinerPass - Return a new pass object that ranks every call
+/// site in the module by its profile-weighted benefit per unit of code growth
+/// and inlines them in that order under a whole-module growth budget.
+ModulePass *createPriorityInlinerPass();
+
 //===----------------------------------------------------------------------===//
 /// createPruneEHPass - Return a new pass object which transforms invoke
 /// instructions into calls, if the callee can _not_ unwind the stack.
@@ -195,6 +201,12 @@ ModulePass *createMergeFunctionsPass();
 ///
 ModulePass *createPartialInliningPass();
 
+//===----------------------------------------------------------------------===//
+/// createHotColdSplittingPass - This pass outlines the cold regions of
+/// functions, using profile data when it is available.
+///
+ModulePass *createHotColdSplittingPass();
+
 //===----------------------------------------------------------------------===//
 // createMetaRenamerPass - Rename everything with metasyntatic names.
 //
@@ -22,6 +22,7 @@
 namespace llvm {
   class CallSite;
   class DataLayout;
+  class Function;
   class InlineCost;
   template<class PtrType, unsigned SmallSize>
   class SmallPtrSet;
@@ -86,6 +87,11 @@ private:
   bool shouldInline(CallSite CS);
 };
 
+/// AdjustCallerSSPLevel - If the inlined function had a higher stack
+/// protection level than the calling function, then bump up the caller's
+/// stack protection level.
+void AdjustCallerSSPLevel(Function *Caller, Function *Callee);
+
 } // End llvm namespace
 
 #endif
@@ -15,6 +15,7 @@
 #ifndef LLVM_TRANSFORMS_IPO_PASSMANAGERBUILDER_H
 #define LLVM_TRANSFORMS_IPO_PASSMANAGERBUILDER_H
 
+#include <string>
 #include <vector>
 
 namespace llvm {
@@ -128,6 +129,13 @@ public:
   bool MergeFunctions;
   bool PrepareForLTO;
 
+  /// Path of the profile data file to write with IR level PGO
+  /// instrumentation, or empty to not instrument.
+  std::string PGOInstrGen;
+  /// Path of the profile data file to read with IR level PGO, or empty to not
+  /// use one.
+  std::string PGOInstrUse;
+
 private:
   /// ExtensionList - This is list of all of the extensions that are registered.
   std::vector<std::pair<ExtensionPointTy, ExtensionFn> > Extensions;
@@ -147,6 +155,7 @@ private:
   void addInitialAliasAnalysisPasses(legacy::PassManagerBase &PM) const;
   void addLTOOptimizationPasses(legacy::PassManagerBase &PM);
   void addLateLTOOptimizationPasses(legacy::PassManagerBase &PM);
+  void addPGOInstrPasses(legacy::PassManagerBase &MPM);
 
 public:
   /// populateFunctionPassManager - This fills in the function pass manager,
@@ -70,15 +70,29 @@ ModulePass *createGCOVProfilerPass(const GCOVOptions &Options =
 
 /// Options for the frontend instrumentation based profiling pass.
 struct InstrProfOptions {
-  InstrProfOptions() : NoRedZone(false) {}
+  InstrProfOptions()
+      : NoRedZone(false), DoCounterPromotion(false), Atomic(false) {}
 
   // Add the 'noredzone' attribute to added runtime library calls.
   bool NoRedZone;
 
+  // Keep counter updates in registers inside loops and flush them to memory
+  // at the loop exits.
+  bool DoCounterPromotion;
+
+  // Update the counters with atomic instructions, for multithreaded programs.
+  bool Atomic;
+
   // Name of the profile file to use as output
   std::string InstrProfileOutput;
 };
 
+// PGO Instrumention
+ModulePass *createPGOInstrumentationGenPass();
+ModulePass *
+createPGOInstrumentationUsePass(StringRef Filename = StringRef(""));
+ModulePass *createPGOIndirectCallPromotionPass();
+
 /// Insert frontend instrumentation based profiling.
 ModulePass *createInstrProfilingPass(
     const InstrProfOptions &Options = InstrProfOptions());
@@ -102,7 +116,7 @@ ModulePass *createDataFlowSanitizerPass(
 struct SanitizerCoverageOptions {
   SanitizerCoverageOptions()
       : CoverageType(SCK_None), IndirectCalls(false), TraceBB(false),
-        TraceCmp(false), Use8bitCounters(false) {}
+        TraceCmp(false), Use8bitCounters(false), Inline8bitCounters(false) {}
 
   enum Type {
     SCK_None = 0,
@@ -114,6 +128,7 @@ struct SanitizerCoverageOptions {
   bool TraceBB;
   bool TraceCmp;
   bool Use8bitCounters;
+  bool Inline8bitCounters;
 };
 
 // Insert SanitizerCoverage instrumentation.
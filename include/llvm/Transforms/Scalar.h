@@ -409,8 +409,8 @@ FunctionPass *createPartiallyInlineLibCallsPass();
 //
 // SampleProfilePass - Loads sample profile data from disk and generates
 // IR metadata to reflect the profile.
-FunctionPass *createSampleProfileLoaderPass();
-FunctionPass *createSampleProfileLoaderPass(StringRef Name);
+ModulePass *createSampleProfileLoaderPass();
+ModulePass *createSampleProfileLoaderPass(StringRef Name);
 
 //===----------------------------------------------------------------------===//
 //
@@ -486,6 +486,18 @@ FunctionPass *createNaryReassociatePass();
 //
 FunctionPass *createLoopDistributePass();
 
+//===----------------------------------------------------------------------===//
+//
+// LoopFuse - Fuse adjacent loops with the same trip count.
+//
+FunctionPass *createLoopFusePass();
+
+//===----------------------------------------------------------------------===//
+//
+// LoopTile - Tile perfect loop nests for cache locality.
+//
+FunctionPass *createLoopTilePass();
+
 } // End llvm namespace
 
 #endif
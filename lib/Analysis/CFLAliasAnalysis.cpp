@@ -25,15 +25,24 @@
 // in order to transform the graph into sets of variables that may alias in
 // ~nlogn time (n = number of variables.), which makes queries take constant
 // time.
+//
+// Calls are modeled with function summaries: once the sets of a function are
+// built, the relations between its parameters and its return values, and the
+// parameters and returned values that may reach globals or unknown memory,
+// are kept in a FunctionSummary, which is all a call site needs. When a
+// function is first queried, the uncached functions it transitively calls are
+// summarized bottom-up, one call graph level at a time. The functions of a
+// level only depend on the summaries of lower levels, so they can be built in
+// parallel.
 //===----------------------------------------------------------------------===//
 
 #include "StratifiedSets.h"
-#include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/None.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/Passes.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InstVisitor.h"
@@ -41,6 +50,7 @@
 #include "llvm/IR/ValueHandle.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/Allocator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
@@ -50,11 +60,24 @@
 #include <forward_list>
 #include <memory>
 #include <tuple>
+#if LLVM_ENABLE_THREADS
+#include <thread>
+#endif
 
 using namespace llvm;
 
 #define DEBUG_TYPE "cfl-aa"
 
+static cl::opt<bool> BottomUpSummaries(
+    "cfl-aa-bottom-up", cl::init(true), cl::Hidden,
+    cl::desc("Summarize the callees of a function bottom-up over the call "
+             "graph before building its sets"));
+
+static cl::opt<unsigned> SummaryThreads(
+    "cfl-aa-threads", cl::init(1), cl::Hidden,
+    cl::desc("Number of threads used to build the sets of the functions of "
+             "one call graph level (default = 1)"));
+
 // Try to go from a Value* to a Function*. Never returns nullptr.
 static Optional<Function *> parentFunctionOfValue(Value *);
 
@@ -77,6 +100,10 @@ static Optional<Value *> getTargetValue(Instruction *);
 // This notes that we should ignore those.
 static bool hasUsefulEdges(Instruction *);
 
+// Whether calls to the given function can be modeled with its summary. This
+// requires the definition we see to be the one that is called.
+static bool isSummarizable(Function *);
+
 const StratifiedIndex StratifiedLink::SetSentinel =
     std::numeric_limits<StratifiedIndex>::max();
 
@@ -94,6 +121,10 @@ LLVM_CONSTEXPR unsigned AttrMaxNumArgs = AttrLastArgIndex - AttrFirstArgIndex;
 LLVM_CONSTEXPR StratifiedAttr AttrNone = 0;
 LLVM_CONSTEXPR StratifiedAttr AttrUnknown = 1 << AttrUnknownIndex;
 LLVM_CONSTEXPR StratifiedAttr AttrAll = ~AttrNone;
+// The attributes of values that may be seen or changed outside of the
+// function: globals, unknown memory, and values passed to opaque calls.
+LLVM_CONSTEXPR StratifiedAttr AttrEscaped =
+    (1 << AttrAllIndex) | (1 << AttrGlobalIndex) | AttrUnknown;
 
 // \brief StratifiedSets call for knowledge of "direction", so this is how we
 // represent that locally.
@@ -141,14 +172,54 @@ struct Edge {
       : From(From), To(To), Weight(W), AdditionalAttrs(A) {}
 };
 
+// \brief The effects of a function that are visible to its callers: which
+// parameters may alias a returned value, which pairs of parameters may alias
+// each other, and which parameters are exposed to memory the caller can't see.
+struct FunctionSummary {
+  SmallVector<unsigned, 4> ParamsAliasingReturn;
+  // Parameters that may be stored to globals or to unknown memory, passed to
+  // calls the function can't see through, or that may end up pointing to
+  // such memory. The values passed for them interact with memory outside of
+  // the caller.
+  SmallVector<unsigned, 4> EscapingParams;
+  // Whether a returned value may point to globals or unknown memory, which
+  // the caller has to treat as coming from outside of it.
+  bool ReturnsEscaped = false;
+
+  struct ParamPair {
+    unsigned First;
+    unsigned Second;
+    StratifiedAttrs Attrs;
+
+    ParamPair(unsigned First, unsigned Second, StratifiedAttrs Attrs)
+        : First(First), Second(Second), Attrs(Attrs) {}
+  };
+  SmallVector<ParamPair, 4> AliasingParams;
+};
+
 // \brief Information we have about a function and would like to keep around
 struct FunctionInfo {
   StratifiedSets<Value *> Sets;
   // Lots of functions have < 4 returns. Adjust as necessary.
   SmallVector<Value *, 4> ReturnedValues;
+  // None if a parameter somehow didn't make it into the sets.
+  Optional<FunctionSummary> Summary;
 
-  FunctionInfo(StratifiedSets<Value *> &&S, SmallVector<Value *, 4> &&RV)
-      : Sets(std::move(S)), ReturnedValues(std::move(RV)) {}
+  FunctionInfo(StratifiedSets<Value *> &&S, SmallVector<Value *, 4> &&RV,
+               Optional<FunctionSummary> &&FS)
+      : Sets(std::move(S)), ReturnedValues(std::move(RV)),
+        Summary(std::move(FS)) {}
+};
+
+// \brief Where the summaries of callees come from while building the sets of
+// a function.
+class SummaryLookup {
+public:
+  virtual ~SummaryLookup() {}
+
+  // \brief Returns the summary of the given function, or nullptr if there is
+  // none we can use.
+  virtual const FunctionSummary *getSummary(Function *Fn) = 0;
 };
 
 struct CFLAliasAnalysis;
@@ -171,7 +242,9 @@ private:
   void removeSelfFromCache();
 };
 
-struct CFLAliasAnalysis : public ImmutablePass, public AliasAnalysis {
+struct CFLAliasAnalysis : public ImmutablePass,
+                          public AliasAnalysis,
+                          public SummaryLookup {
 private:
   /// \brief Cached mapping of Functions to their StratifiedSets.
   /// If a function's sets are currently being built, it is marked
@@ -181,6 +254,14 @@ private:
   DenseMap<Function *, Optional<FunctionInfo>> Cache;
   std::forward_list<FunctionHandle> Handles;
 
+  /// \brief Inserts freshly built sets for the given Function into the cache.
+  void insertIntoCache(Function *Fn, FunctionInfo &&Info);
+
+  /// \brief Inserts the given Function into the cache, along with every
+  /// uncached function it transitively calls. Callees are built first, so
+  /// that their summaries are available to their callers.
+  void scanBottomUp(Function *Fn);
+
 public:
   static char ID;
 
@@ -210,7 +291,10 @@ public:
   const Optional<FunctionInfo> &ensureCached(Function *Fn) {
     auto Iter = Cache.find(Fn);
     if (Iter == Cache.end()) {
-      scan(Fn);
+      if (BottomUpSummaries)
+        scanBottomUp(Fn);
+      else
+        scan(Fn);
       Iter = Cache.find(Fn);
       assert(Iter != Cache.end());
       assert(Iter->second.hasValue());
@@ -218,10 +302,21 @@ public:
     return Iter->second;
   }
 
+  const FunctionSummary *getSummary(Function *Fn) override {
+    auto &MaybeInfo = ensureCached(Fn);
+    if (!MaybeInfo.hasValue() || !MaybeInfo->Summary.hasValue())
+      return nullptr;
+    return MaybeInfo->Summary.getPointer();
+  }
+
   AliasResult query(const MemoryLocation &LocA, const MemoryLocation &LocB);
 
   AliasResult alias(const MemoryLocation &LocA,
                     const MemoryLocation &LocB) override {
+    // Zero-sized accesses can't alias anything.
+    if (LocA.Size == 0 || LocB.Size == 0)
+      return NoAlias;
+
     if (LocA.Ptr == LocB.Ptr) {
       if (LocA.Size == LocB.Size) {
         return MustAlias;
@@ -259,12 +354,12 @@ void FunctionHandle::removeSelfFromCache() {
 
 // \brief Gets the edges our graph should have, based on an Instruction*
 class GetEdgesVisitor : public InstVisitor<GetEdgesVisitor, void> {
-  CFLAliasAnalysis &AA;
+  SummaryLookup &Summaries;
   SmallVectorImpl<Edge> &Output;
 
 public:
-  GetEdgesVisitor(CFLAliasAnalysis &AA, SmallVectorImpl<Edge> &Output)
-      : AA(AA), Output(Output) {}
+  GetEdgesVisitor(SummaryLookup &Summaries, SmallVectorImpl<Edge> &Output)
+      : Summaries(Summaries), Output(Output) {}
 
   void visitInstruction(Instruction &) {
     llvm_unreachable("Unsupported instruction encountered");
@@ -354,35 +449,6 @@ public:
     Output.push_back(Edge(Val, Val, EdgeType::Assign, AttrAll));
   }
 
-  static bool isFunctionExternal(Function *Fn) {
-    return Fn->isDeclaration() || !Fn->hasLocalLinkage();
-  }
-
-  // Gets whether the sets at Index1 above, below, or equal to the sets at
-  // Index2. Returns None if they are not in the same set chain.
-  static Optional<Level> getIndexRelation(const StratifiedSets<Value *> &Sets,
-                                          StratifiedIndex Index1,
-                                          StratifiedIndex Index2) {
-    if (Index1 == Index2)
-      return Level::Same;
-
-    const auto *Current = &Sets.getLink(Index1);
-    while (Current->hasBelow()) {
-      if (Current->Below == Index2)
-        return Level::Below;
-      Current = &Sets.getLink(Current->Below);
-    }
-
-    Current = &Sets.getLink(Index1);
-    while (Current->hasAbove()) {
-      if (Current->Above == Index2)
-        return Level::Above;
-      Current = &Sets.getLink(Current->Above);
-    }
-
-    return NoneType();
-  }
-
   bool
   tryInterproceduralAnalysis(const SmallVectorImpl<Function *> &Fns,
                              Value *FuncValue,
@@ -396,60 +462,34 @@ public:
     if (std::distance(Args.begin(), Args.end()) > (int)MaxSupportedArgs)
       return false;
 
+    SmallVector<Value *, ExpectedMaxArgs> Arguments(Args.begin(), Args.end());
+
     // Exit early if we'll fail anyway
+    SmallVector<const FunctionSummary *, 4> FnSummaries;
     for (auto *Fn : Fns) {
-      if (isFunctionExternal(Fn) || Fn->isVarArg())
+      if (!isSummarizable(Fn) || Fn->arg_size() != Arguments.size())
         return false;
-      auto &MaybeInfo = AA.ensureCached(Fn);
-      if (!MaybeInfo.hasValue())
+      auto *Summary = Summaries.getSummary(Fn);
+      if (!Summary)
         return false;
+      FnSummaries.push_back(Summary);
     }
 
-    SmallVector<Value *, ExpectedMaxArgs> Arguments(Args.begin(), Args.end());
-    SmallVector<StratifiedInfo, ExpectedMaxArgs> Parameters;
-    for (auto *Fn : Fns) {
-      auto &Info = *AA.ensureCached(Fn);
-      auto &Sets = Info.Sets;
-      auto &RetVals = Info.ReturnedValues;
-
-      Parameters.clear();
-      for (auto &Param : Fn->args()) {
-        auto MaybeInfo = Sets.find(&Param);
-        // Did a new parameter somehow get added to the function/slip by?
-        if (!MaybeInfo.hasValue())
-          return false;
-        Parameters.push_back(*MaybeInfo);
-      }
+    for (auto *Summary : FnSummaries) {
+      // The values passed for escaping parameters and the returned value may
+      // alias memory the caller doesn't see, so mark them as such.
+      for (unsigned I : Summary->EscapingParams)
+        Output.push_back(Edge(Arguments[I], Arguments[I], EdgeType::Assign,
+                              AttrUnknown));
+      if (Summary->ReturnsEscaped)
+        Output.push_back(
+            Edge(FuncValue, FuncValue, EdgeType::Assign, AttrUnknown));
 
       // Adding an edge from argument -> return value for each parameter that
       // may alias the return value
-      for (unsigned I = 0, E = Parameters.size(); I != E; ++I) {
-        auto &ParamInfo = Parameters[I];
-        auto &ArgVal = Arguments[I];
-        bool AddEdge = false;
-        StratifiedAttrs Externals;
-        for (unsigned X = 0, XE = RetVals.size(); X != XE; ++X) {
-          auto MaybeInfo = Sets.find(RetVals[X]);
-          if (!MaybeInfo.hasValue())
-            return false;
-
-          auto &RetInfo = *MaybeInfo;
-          auto RetAttrs = Sets.getLink(RetInfo.Index).Attrs;
-          auto ParamAttrs = Sets.getLink(ParamInfo.Index).Attrs;
-          auto MaybeRelation =
-              getIndexRelation(Sets, ParamInfo.Index, RetInfo.Index);
-          if (MaybeRelation.hasValue()) {
-            AddEdge = true;
-            Externals |= RetAttrs | ParamAttrs;
-          }
-        }
-        if (AddEdge)
-          Output.push_back(Edge(FuncValue, ArgVal, EdgeType::Assign,
-                                StratifiedAttrs().flip()));
-      }
-
-      if (Parameters.size() != Arguments.size())
-        return false;
+      for (unsigned I : Summary->ParamsAliasingReturn)
+        Output.push_back(Edge(FuncValue, Arguments[I], EdgeType::Assign,
+                              StratifiedAttrs().flip()));
 
       // Adding edges between arguments for arguments that may end up aliasing
       // each other. This is necessary for functions such as
@@ -457,24 +497,9 @@ public:
       // (Technically, the proper sets for this would be those below
       // Arguments[I] and Arguments[X], but our algorithm will produce
       // extremely similar, and equally correct, results either way)
-      for (unsigned I = 0, E = Arguments.size(); I != E; ++I) {
-        auto &MainVal = Arguments[I];
-        auto &MainInfo = Parameters[I];
-        auto &MainAttrs = Sets.getLink(MainInfo.Index).Attrs;
-        for (unsigned X = I + 1; X != E; ++X) {
-          auto &SubInfo = Parameters[X];
-          auto &SubVal = Arguments[X];
-          auto &SubAttrs = Sets.getLink(SubInfo.Index).Attrs;
-          auto MaybeRelation =
-              getIndexRelation(Sets, MainInfo.Index, SubInfo.Index);
-
-          if (!MaybeRelation.hasValue())
-            continue;
-
-          auto NewAttrs = SubAttrs | MainAttrs;
-          Output.push_back(Edge(MainVal, SubVal, EdgeType::Assign, NewAttrs));
-        }
-      }
+      for (auto &Pair : Summary->AliasingParams)
+        Output.push_back(Edge(Arguments[Pair.First], Arguments[Pair.Second],
+                              EdgeType::Assign, Pair.Attrs));
     }
     return true;
   }
@@ -751,11 +776,11 @@ static Optional<StratifiedAttr> valueToAttrIndex(Value *Val);
 static EdgeType flipWeight(EdgeType);
 
 // Gets edges of the given Instruction*, writing them to the SmallVector*.
-static void argsToEdges(CFLAliasAnalysis &, Instruction *,
+static void argsToEdges(SummaryLookup &, Instruction *,
                         SmallVectorImpl<Edge> &);
 
 // Gets edges of the given ConstantExpr*, writing them to the SmallVector*.
-static void argsToEdges(CFLAliasAnalysis &, ConstantExpr *,
+static void argsToEdges(SummaryLookup &, ConstantExpr *,
                         SmallVectorImpl<Edge> &);
 
 // Gets the "Level" that one should travel in StratifiedSets
@@ -764,13 +789,13 @@ static Level directionOfEdgeType(EdgeType);
 
 // Builds the graph needed for constructing the StratifiedSets for the
 // given function
-static void buildGraphFrom(CFLAliasAnalysis &, Function *,
+static void buildGraphFrom(SummaryLookup &, Function *,
                            SmallVectorImpl<Value *> &, NodeMapT &, GraphT &);
 
 // Gets the edges of a ConstantExpr as if it was an Instruction. This
 // function also acts on any nested ConstantExprs, adding the edges
 // of those to the given SmallVector as well.
-static void constexprToEdges(CFLAliasAnalysis &, ConstantExpr &,
+static void constexprToEdges(SummaryLookup &, ConstantExpr &,
                              SmallVectorImpl<Edge> &);
 
 // Given an Instruction, this will add it to the graph, along with any
@@ -779,7 +804,7 @@ static void constexprToEdges(CFLAliasAnalysis &, ConstantExpr &,
 //   %0 = load i16* getelementptr ([1 x i16]* @a, 0, 0), align 2
 // addInstructionToGraph would add both the `load` and `getelementptr`
 // instructions to the graph appropriately.
-static void addInstructionToGraph(CFLAliasAnalysis &, Instruction &,
+static void addInstructionToGraph(SummaryLookup &, Instruction &,
                                   SmallVectorImpl<Value *> &, NodeMapT &,
                                   GraphT &);
 
@@ -787,7 +812,17 @@ static void addInstructionToGraph(CFLAliasAnalysis &, Instruction &,
 static bool canSkipAddingToSets(Value *Val);
 
 // Builds the graph + StratifiedSets for a function.
-static FunctionInfo buildSetsFrom(CFLAliasAnalysis &, Function *);
+static FunctionInfo buildSetsFrom(SummaryLookup &, Function *);
+
+// Gets whether the sets at Index1 above, below, or equal to the sets at
+// Index2. Returns None if they are not in the same set chain.
+static Optional<Level> getIndexRelation(const StratifiedSets<Value *> &,
+                                        StratifiedIndex, StratifiedIndex);
+
+// Computes the summary of a function from its StratifiedSets.
+static Optional<FunctionSummary>
+summarizeFunction(Function *, const StratifiedSets<Value *> &,
+                  const SmallVectorImpl<Value *> &);
 
 static Optional<Function *> parentFunctionOfValue(Value *Val) {
   if (auto *Inst = dyn_cast<Instruction>(Val)) {
@@ -862,7 +897,7 @@ static EdgeType flipWeight(EdgeType Initial) {
   llvm_unreachable("Incomplete coverage of EdgeType enum");
 }
 
-static void argsToEdges(CFLAliasAnalysis &Analysis, Instruction *Inst,
+static void argsToEdges(SummaryLookup &Analysis, Instruction *Inst,
                         SmallVectorImpl<Edge> &Output) {
   assert(hasUsefulEdges(Inst) &&
          "Expected instructions to have 'useful' edges");
@@ -870,7 +905,7 @@ static void argsToEdges(CFLAliasAnalysis &Analysis, Instruction *Inst,
   v.visit(Inst);
 }
 
-static void argsToEdges(CFLAliasAnalysis &Analysis, ConstantExpr *CE,
+static void argsToEdges(SummaryLookup &Analysis, ConstantExpr *CE,
                         SmallVectorImpl<Edge> &Output) {
   assert(hasUsefulEdges(CE) && "Expected constant expr to have 'useful' edges");
   GetEdgesVisitor v(Analysis, Output);
@@ -889,7 +924,7 @@ static Level directionOfEdgeType(EdgeType Weight) {
   llvm_unreachable("Incomplete switch coverage");
 }
 
-static void constexprToEdges(CFLAliasAnalysis &Analysis,
+static void constexprToEdges(SummaryLookup &Analysis,
                              ConstantExpr &CExprToCollapse,
                              SmallVectorImpl<Edge> &Results) {
   SmallVector<ConstantExpr *, 4> Worklist;
@@ -919,7 +954,7 @@ static void constexprToEdges(CFLAliasAnalysis &Analysis,
   }
 }
 
-static void addInstructionToGraph(CFLAliasAnalysis &Analysis, Instruction &Inst,
+static void addInstructionToGraph(SummaryLookup &Analysis, Instruction &Inst,
                                   SmallVectorImpl<Value *> &ReturnedValues,
                                   NodeMapT &Map, GraphT &Graph) {
   const auto findOrInsertNode = [&Map, &Graph](Value *Val) {
@@ -934,8 +969,10 @@ static void addInstructionToGraph(CFLAliasAnalysis &Analysis, Instruction &Inst,
 
   // We don't want the edges of most "return" instructions, but we *do* want
   // to know what can be returned.
-  if (isa<ReturnInst>(&Inst))
-    ReturnedValues.push_back(&Inst);
+  if (auto *RetInst = dyn_cast<ReturnInst>(&Inst))
+    if (auto *RetVal = RetInst->getReturnValue())
+      if (RetVal->getType()->isPointerTy())
+        ReturnedValues.push_back(RetVal);
 
   if (!hasUsefulEdges(&Inst))
     return;
@@ -982,7 +1019,7 @@ static void addInstructionToGraph(CFLAliasAnalysis &Analysis, Instruction &Inst,
 // buy us much that we don't already have. I'd like to add interprocedural
 // analysis prior to this however, in case that somehow requires the graph
 // produced by this for efficient execution
-static void buildGraphFrom(CFLAliasAnalysis &Analysis, Function *Fn,
+static void buildGraphFrom(SummaryLookup &Analysis, Function *Fn,
                            SmallVectorImpl<Value *> &ReturnedValues,
                            NodeMapT &Map, GraphT &Graph) {
   for (auto &Bb : Fn->getBasicBlockList())
@@ -1012,7 +1049,7 @@ static bool canSkipAddingToSets(Value *Val) {
   return false;
 }
 
-static FunctionInfo buildSetsFrom(CFLAliasAnalysis &Analysis, Function *Fn) {
+static FunctionInfo buildSetsFrom(SummaryLookup &Analysis, Function *Fn) {
   NodeMapT Map;
   GraphT Graph;
   SmallVector<Value *, 4> ReturnedValues;
@@ -1038,6 +1075,12 @@ static FunctionInfo buildSetsFrom(CFLAliasAnalysis &Analysis, Function *Fn) {
 
     auto *Value = Pair.first;
     Builder.add(Value);
+    // Values only related to constants get no attributes below.
+    if (auto AttrIndex = valueToAttrIndex(Value)) {
+      StratifiedAttrs Attrs;
+      Attrs.set(*AttrIndex);
+      Builder.noteAttributes(Value, Attrs);
+    }
     auto InitialNode = Pair.second;
     Worklist.push_back(InitialNode);
     while (!Worklist.empty()) {
@@ -1090,12 +1133,145 @@ static FunctionInfo buildSetsFrom(CFLAliasAnalysis &Analysis, Function *Fn) {
     if (!Builder.add(&Arg))
       continue;
 
-    auto Attrs = valueToAttrIndex(&Arg);
-    if (Attrs.hasValue())
-      Builder.noteAttributes(&Arg, *Attrs);
+    if (auto AttrIndex = valueToAttrIndex(&Arg)) {
+      StratifiedAttrs Attrs;
+      Attrs.set(*AttrIndex);
+      Builder.noteAttributes(&Arg, Attrs);
+    }
+  }
+
+  auto Sets = Builder.build();
+  auto Summary = summarizeFunction(Fn, Sets, ReturnedValues);
+  return FunctionInfo(std::move(Sets), std::move(ReturnedValues),
+                      std::move(Summary));
+}
+
+static bool isSummarizable(Function *Fn) {
+  return !Fn->isDeclaration() && !Fn->mayBeOverridden() && !Fn->isVarArg();
+}
+
+static Optional<Level> getIndexRelation(const StratifiedSets<Value *> &Sets,
+                                        StratifiedIndex Index1,
+                                        StratifiedIndex Index2) {
+  if (Index1 == Index2)
+    return Level::Same;
+
+  const auto *Current = &Sets.getLink(Index1);
+  while (Current->hasBelow()) {
+    if (Current->Below == Index2)
+      return Level::Below;
+    Current = &Sets.getLink(Current->Below);
+  }
+
+  Current = &Sets.getLink(Index1);
+  while (Current->hasAbove()) {
+    if (Current->Above == Index2)
+      return Level::Above;
+    Current = &Sets.getLink(Current->Above);
+  }
+
+  return NoneType();
+}
+
+// \brief Returns true if the set at \p Index or a set below it may point to
+// memory outside of the function. Attributes only propagate downwards, so the
+// sets below have to be checked as well.
+static bool mayReachEscaped(const StratifiedSets<Value *> &Sets,
+                            StratifiedIndex Index) {
+  const StratifiedAttrs Escaped(AttrEscaped);
+  const auto *Current = &Sets.getLink(Index);
+  while (true) {
+    if ((Current->Attrs & Escaped).any())
+      return true;
+    if (!Current->hasBelow())
+      return false;
+    Current = &Sets.getLink(Current->Below);
+  }
+}
+
+static Optional<FunctionSummary>
+summarizeFunction(Function *Fn, const StratifiedSets<Value *> &Sets,
+                  const SmallVectorImpl<Value *> &ReturnedValues) {
+  SmallVector<StratifiedInfo, 8> Parameters;
+  for (auto &Param : Fn->args()) {
+    auto MaybeInfo = Sets.find(&Param);
+    // Did a new parameter somehow get added to the function/slip by?
+    if (!MaybeInfo.hasValue())
+      return NoneType();
+    Parameters.push_back(*MaybeInfo);
+  }
+
+  // Returned values that aren't in the sets are constants that can't hold
+  // mutable data, so they can't make a parameter alias the return value.
+  SmallVector<StratifiedIndex, 4> ReturnIndices;
+  for (auto *RetVal : ReturnedValues)
+    if (auto MaybeInfo = Sets.find(RetVal))
+      ReturnIndices.push_back(MaybeInfo->Index);
+
+  FunctionSummary Summary;
+  for (auto RetIndex : ReturnIndices)
+    if (mayReachEscaped(Sets, RetIndex))
+      Summary.ReturnsEscaped = true;
+
+  for (unsigned I = 0, E = Parameters.size(); I != E; ++I) {
+    auto ParamIndex = Parameters[I].Index;
+    if (mayReachEscaped(Sets, ParamIndex))
+      Summary.EscapingParams.push_back(I);
+
+    // A returned value may alias the parameter if they are in related sets,
+    // or if the returned value was derived from it.
+    auto ParamAttr = valueToAttrIndex(&*std::next(Fn->arg_begin(), I));
+    for (auto RetIndex : ReturnIndices) {
+      if (getIndexRelation(Sets, ParamIndex, RetIndex).hasValue() ||
+          (ParamAttr && Sets.getLink(RetIndex).Attrs.test(*ParamAttr))) {
+        Summary.ParamsAliasingReturn.push_back(I);
+        break;
+      }
+    }
+  }
+
+  for (unsigned I = 0, E = Parameters.size(); I != E; ++I) {
+    auto MainIndex = Parameters[I].Index;
+    auto &MainAttrs = Sets.getLink(MainIndex).Attrs;
+    for (unsigned X = I + 1; X != E; ++X) {
+      auto SubIndex = Parameters[X].Index;
+      if (!getIndexRelation(Sets, MainIndex, SubIndex).hasValue())
+        continue;
+
+      auto &SubAttrs = Sets.getLink(SubIndex).Attrs;
+      Summary.AliasingParams.push_back(
+          FunctionSummary::ParamPair(I, X, SubAttrs | MainAttrs));
+    }
+  }
+
+  return std::move(Summary);
+}
+
+namespace {
+// \brief Hands out the summaries of functions built on lower call graph
+// levels. It never builds anything itself, so that it can be shared by the
+// threads that build a level; a missing summary makes the call site fall back
+// to the conservative answer.
+class LevelSummaryLookup : public SummaryLookup {
+  const DenseMap<Function *, Optional<FunctionInfo>> &Cache;
+
+public:
+  LevelSummaryLookup(const DenseMap<Function *, Optional<FunctionInfo>> &Cache)
+      : Cache(Cache) {}
+
+  const FunctionSummary *getSummary(Function *Fn) override {
+    auto Iter = Cache.find(Fn);
+    if (Iter == Cache.end() || !Iter->second.hasValue() ||
+        !Iter->second->Summary.hasValue())
+      return nullptr;
+    return Iter->second->Summary.getPointer();
   }
+};
+}
 
-  return FunctionInfo(Builder.build(), std::move(ReturnedValues));
+void CFLAliasAnalysis::insertIntoCache(Function *Fn, FunctionInfo &&Info) {
+  Cache[Fn] = std::move(Info);
+  Handles.push_front(FunctionHandle(Fn, this));
 }
 
 void CFLAliasAnalysis::scan(Function *Fn) {
@@ -1104,9 +1280,107 @@ void CFLAliasAnalysis::scan(Function *Fn) {
   assert(InsertPair.second &&
          "Trying to scan a function that has already been cached");
 
-  FunctionInfo Info(buildSetsFrom(*this, Fn));
-  Cache[Fn] = std::move(Info);
-  Handles.push_front(FunctionHandle(Fn, this));
+  insertIntoCache(Fn, buildSetsFrom(*this, Fn));
+}
+
+void CFLAliasAnalysis::scanBottomUp(Function *Root) {
+  // Compute the call graph level of every uncached function reachable from
+  // Root through direct calls: callees that can be summarized are one level
+  // below their callers. Calls that close a cycle are ignored here, which
+  // only means that the callee's summary won't be available to the caller.
+  DenseMap<Function *, unsigned> Levels;
+  SmallVector<std::pair<Function *, SmallVector<Function *, 8>>, 16> Stack;
+  const auto getCallees = [this](Function *Fn) {
+    SmallVector<Function *, 8> Callees;
+    for (auto &Bb : *Fn)
+      for (auto &Inst : Bb) {
+        CallSite CS(&Inst);
+        if (!CS)
+          continue;
+        auto *Callee = CS.getCalledFunction();
+        if (Callee && isSummarizable(Callee) && !Cache.count(Callee))
+          Callees.push_back(Callee);
+      }
+    return Callees;
+  };
+
+  // Levels doubles as the visited set; a function is on the stack until its
+  // level is final.
+  const unsigned OnStack = ~0U;
+  Levels[Root] = OnStack;
+  Stack.push_back(std::make_pair(Root, getCallees(Root)));
+  SmallVector<SmallVector<Function *, 8>, 8> Buckets;
+  while (!Stack.empty()) {
+    auto &Callees = Stack.back().second;
+    if (!Callees.empty()) {
+      auto *Callee = Callees.pop_back_val();
+      if (Levels.insert(std::make_pair(Callee, OnStack)).second)
+        Stack.push_back(std::make_pair(Callee, getCallees(Callee)));
+      continue;
+    }
+
+    auto *Fn = Stack.back().first;
+    Stack.pop_back();
+    unsigned Level = 0;
+    for (auto &Bb : *Fn)
+      for (auto &Inst : Bb) {
+        CallSite CS(&Inst);
+        if (!CS || !CS.getCalledFunction())
+          continue;
+        auto Iter = Levels.find(CS.getCalledFunction());
+        if (Iter != Levels.end() && Iter->second != OnStack)
+          Level = std::max(Level, Iter->second + 1);
+      }
+    Levels[Fn] = Level;
+    if (Buckets.size() <= Level)
+      Buckets.resize(Level + 1);
+    Buckets[Level].push_back(Fn);
+  }
+
+  for (auto &Bucket : Buckets) {
+    // Mark the functions of this level as being built, so that recursive
+    // calls among them are handled conservatively.
+    for (auto *Fn : Bucket) {
+      auto InsertPair =
+          Cache.insert(std::make_pair(Fn, Optional<FunctionInfo>()));
+      (void)InsertPair;
+      assert(InsertPair.second &&
+             "Trying to scan a function that has already been cached");
+    }
+
+    LevelSummaryLookup Lookup(Cache);
+    SmallVector<Optional<FunctionInfo>, 8> Results;
+    Results.resize(Bucket.size());
+    unsigned NumThreads = std::min<unsigned>(SummaryThreads, Bucket.size());
+#if LLVM_ENABLE_THREADS
+    if (NumThreads > 1) {
+      // Lazily created arguments aren't safe to create concurrently, so
+      // materialize them up front. Everything else the workers do is
+      // read-only or local to the function they build.
+      for (auto *Fn : Bucket)
+        (void)Fn->arg_begin();
+
+      std::vector<std::thread> Workers;
+      for (unsigned T = 0; T != NumThreads; ++T)
+        Workers.emplace_back([&, T] {
+          for (unsigned I = T, E = Bucket.size(); I < E; I += NumThreads)
+            Results[I] = buildSetsFrom(Lookup, Bucket[I]);
+        });
+      for (auto &Worker : Workers)
+        Worker.join();
+    } else
+#endif
+    {
+      (void)NumThreads;
+      for (unsigned I = 0, E = Bucket.size(); I != E; ++I)
+        Results[I] = buildSetsFrom(Lookup, Bucket[I]);
+    }
+
+    // Publish the results in a fixed order, so that the cache doesn't depend
+    // on how the work was scheduled.
+    for (unsigned I = 0, E = Bucket.size(); I != E; ++I)
+      insertIntoCache(Bucket[I], std::move(*Results[I]));
+  }
 }
 
 AliasResult CFLAliasAnalysis::query(const MemoryLocation &LocA,
@@ -12,10 +12,17 @@
 // read or write memory (are "pure").  For this simple (but very common) case,
 // we can provide pretty accurate and useful information.
 //
+// The globals without their address taken are numbered, and the globals each
+// function reads or writes are kept as sparse bit vectors over these numbers.
+// The call graph SCCs are grouped in levels such that an SCC only calls SCCs
+// of lower levels. The SCCs of one level are independent, so their mod/ref
+// information can be computed in parallel.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Analysis/Passes.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SparseBitVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/CallGraph.h"
@@ -30,6 +37,9 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/CommandLine.h"
 #include <set>
+#if LLVM_ENABLE_THREADS
+#include <thread>
+#endif
 using namespace llvm;
 
 #define DEBUG_TYPE "globalsmodref-aa"
@@ -55,29 +65,41 @@ STATISTIC(NumIndirectGlobalVars, "Number of indirect global objects");
 static cl::opt<bool> EnableUnsafeGlobalsModRefAliasResults(
     "enable-unsafe-globalsmodref-alias-results", cl::init(false), cl::Hidden);
 
+static cl::opt<unsigned> GlobalsModRefThreads(
+    "globalsmodref-aa-threads", cl::init(1), cl::Hidden,
+    cl::desc("Number of threads used to analyze the independent call graph "
+             "SCCs of one level (default = 1)"));
+
 namespace {
 /// FunctionRecord - One instance of this structure is stored for every
 /// function in the program.  Later, the entries for these functions are
 /// removed if the function is found to call an external function (in which
 /// case we know nothing about it.
 struct FunctionRecord {
-  /// GlobalInfo - Maintain mod/ref info for all of the globals without
-  /// addresses taken that are read or written (transitively) by this
-  /// function.
-  std::map<const GlobalValue *, unsigned> GlobalInfo;
+  /// ReadGlobals, ModGlobals - The numbers of the globals without addresses
+  /// taken that are read or written (transitively) by this function.
+  SparseBitVector<> ReadGlobals;
+  SparseBitVector<> ModGlobals;
 
   /// MayReadAnyGlobal - May read global variables, but it is not known which.
   bool MayReadAnyGlobal;
 
-  unsigned getInfoForGlobal(const GlobalValue *GV) const {
+  unsigned getInfoForGlobal(unsigned GlobalNo) {
     unsigned Effect = MayReadAnyGlobal ? AliasAnalysis::Ref : 0;
-    std::map<const GlobalValue *, unsigned>::const_iterator I =
-        GlobalInfo.find(GV);
-    if (I != GlobalInfo.end())
-      Effect |= I->second;
+    if (ReadGlobals.test(GlobalNo))
+      Effect |= AliasAnalysis::Ref;
+    if (ModGlobals.test(GlobalNo))
+      Effect |= AliasAnalysis::Mod;
     return Effect;
   }
 
+  /// addCalleeInfo - Incorporate the effects of a callee on globals.
+  void addCalleeInfo(const FunctionRecord &Callee) {
+    ReadGlobals |= Callee.ReadGlobals;
+    ModGlobals |= Callee.ModGlobals;
+    MayReadAnyGlobal |= Callee.MayReadAnyGlobal;
+  }
+
   /// FunctionEffect - Capture whether or not this function reads or writes to
   /// ANY memory.  If not, we can do a lot of aggressive analysis on it.
   unsigned FunctionEffect;
@@ -88,8 +110,8 @@ struct FunctionRecord {
 /// GlobalsModRef - The actual analysis pass.
 class GlobalsModRef : public ModulePass, public AliasAnalysis {
   /// NonAddressTakenGlobals - The globals that do not have their addresses
-  /// taken.
-  std::set<const GlobalValue *> NonAddressTakenGlobals;
+  /// taken, mapped to the numbers used for them in the FunctionRecords.
+  DenseMap<const GlobalValue *, unsigned> NonAddressTakenGlobals;
 
   /// IndirectGlobals - The memory pointed to by this global is known to be
   /// 'owned' by the global.
@@ -196,6 +218,7 @@ private:
 
   void AnalyzeGlobals(Module &M);
   void AnalyzeCallGraph(CallGraph &CG, Module &M);
+  bool AnalyzeSCC(CallGraph &CG, const std::vector<CallGraphNode *> &SCC);
   bool AnalyzeUsesOfPointer(Value *V, std::vector<Function *> &Readers,
                             std::vector<Function *> &Writers,
                             GlobalValue *OkayStoreDest = nullptr);
@@ -224,7 +247,8 @@ void GlobalsModRef::AnalyzeGlobals(Module &M) {
     if (F.hasLocalLinkage()) {
       if (!AnalyzeUsesOfPointer(&F, Readers, Writers)) {
         // Remember that we are tracking this global.
-        NonAddressTakenGlobals.insert(&F);
+        NonAddressTakenGlobals.insert(
+            std::make_pair(&F, NonAddressTakenGlobals.size()));
         ++NumNonAddrTakenFunctions;
       }
       Readers.clear();
@@ -235,14 +259,15 @@ void GlobalsModRef::AnalyzeGlobals(Module &M) {
     if (GV.hasLocalLinkage()) {
       if (!AnalyzeUsesOfPointer(&GV, Readers, Writers)) {
         // Remember that we are tracking this global, and the mod/ref fns
-        NonAddressTakenGlobals.insert(&GV);
+        unsigned GlobalNo = NonAddressTakenGlobals.size();
+        NonAddressTakenGlobals.insert(std::make_pair(&GV, GlobalNo));
 
         for (Function *Reader : Readers)
-          FunctionInfo[Reader].GlobalInfo[&GV] |= Ref;
+          FunctionInfo[Reader].ReadGlobals.set(GlobalNo);
 
         if (!GV.isConstant()) // No need to keep track of writers to constants
           for (Function *Writer : Writers)
-            FunctionInfo[Writer].GlobalInfo[&GV] |= Mod;
+            FunctionInfo[Writer].ModGlobals.set(GlobalNo);
         ++NumNonAddrTakenGlobalVars;
 
         // If this global holds a pointer type, see if it is an indirect global.
@@ -374,129 +399,190 @@ bool GlobalsModRef::AnalyzeIndirectGlobalMemory(GlobalValue *GV) {
 /// function.
 void GlobalsModRef::AnalyzeCallGraph(CallGraph &CG, Module &M) {
   // We do a bottom-up SCC traversal of the call graph.  In other words, we
-  // visit all callees before callers (leaf-first).
+  // visit all callees before callers (leaf-first).  Each SCC is put in the
+  // level just above the highest level of the SCCs it calls, so that all the
+  // SCCs of a level only depend on the results of lower levels.
+  std::vector<std::vector<CallGraphNode *>> SCCs;
+  std::vector<std::vector<unsigned>> Levels;
+  DenseMap<const CallGraphNode *, unsigned> LevelOfNode;
   for (scc_iterator<CallGraph *> I = scc_begin(&CG); !I.isAtEnd(); ++I) {
     const std::vector<CallGraphNode *> &SCC = *I;
     assert(!SCC.empty() && "SCC with no functions?");
 
-    if (!SCC[0]->getFunction()) {
-      // Calls externally - can't say anything useful.  Remove any existing
-      // function records (may have been created when scanning globals).
-      for (auto *Node : SCC)
-        FunctionInfo.erase(Node->getFunction());
-      continue;
-    }
+    unsigned Level = 0;
+    for (auto *Node : SCC)
+      for (auto &CallRecord : *Node) {
+        auto It = LevelOfNode.find(CallRecord.second);
+        if (It != LevelOfNode.end())
+          Level = std::max(Level, It->second + 1);
+      }
+    for (auto *Node : SCC)
+      LevelOfNode[Node] = Level;
 
-    FunctionRecord &FR = FunctionInfo[SCC[0]->getFunction()];
+    if (Levels.size() <= Level)
+      Levels.resize(Level + 1);
+    Levels[Level].push_back(SCCs.size());
+    SCCs.push_back(SCC);
+  }
 
-    bool KnowNothing = false;
-    unsigned FunctionEffect = 0;
+  for (auto &Level : Levels) {
+    // Create the records up front: the SCCs of this level only ever touch
+    // their own records, and read the records of lower levels.
+    for (unsigned SCCNo : Level)
+      if (Function *F = SCCs[SCCNo][0]->getFunction())
+        (void)FunctionInfo[F];
+
+    std::vector<char> KnowNothing(Level.size());
+    unsigned NumThreads = std::min<unsigned>(GlobalsModRefThreads, Level.size());
+#if LLVM_ENABLE_THREADS
+    if (NumThreads > 1) {
+      std::vector<std::thread> Workers;
+      for (unsigned T = 0; T != NumThreads; ++T)
+        Workers.emplace_back([&, T] {
+          for (unsigned I = T, E = Level.size(); I < E; I += NumThreads)
+            KnowNothing[I] = AnalyzeSCC(CG, SCCs[Level[I]]);
+        });
+      for (auto &Worker : Workers)
+        Worker.join();
+    } else
+#endif
+    {
+      (void)NumThreads;
+      for (unsigned I = 0, E = Level.size(); I != E; ++I)
+        KnowNothing[I] = AnalyzeSCC(CG, SCCs[Level[I]]);
+    }
 
-    // Collect the mod/ref properties due to called functions.  We only compute
-    // one mod-ref set.
-    for (unsigned i = 0, e = SCC.size(); i != e && !KnowNothing; ++i) {
-      Function *F = SCC[i]->getFunction();
-      if (!F) {
-        KnowNothing = true;
-        break;
-      }
+    for (unsigned I = 0, E = Level.size(); I != E; ++I) {
+      const std::vector<CallGraphNode *> &SCC = SCCs[Level[I]];
 
-      if (F->isDeclaration()) {
-        // Try to get mod/ref behaviour from function attributes.
-        if (F->doesNotAccessMemory()) {
-          // Can't do better than that!
-        } else if (F->onlyReadsMemory()) {
-          FunctionEffect |= Ref;
-          if (!F->isIntrinsic())
-            // This function might call back into the module and read a global -
-            // consider every global as possibly being read by this function.
-            FR.MayReadAnyGlobal = true;
-        } else {
-          FunctionEffect |= ModRef;
-          // Can't say anything useful unless it's an intrinsic - they don't
-          // read or write global variables of the kind considered here.
-          KnowNothing = !F->isIntrinsic();
-        }
+      // If we can't say anything useful about this SCC, remove all SCC
+      // functions from the FunctionInfo map.
+      if (KnowNothing[I]) {
+        for (auto *Node : SCC)
+          FunctionInfo.erase(Node->getFunction());
         continue;
       }
 
-      for (CallGraphNode::iterator CI = SCC[i]->begin(), E = SCC[i]->end();
-           CI != E && !KnowNothing; ++CI)
-        if (Function *Callee = CI->second->getFunction()) {
-          if (FunctionRecord *CalleeFR = getFunctionInfo(Callee)) {
-            // Propagate function effect up.
-            FunctionEffect |= CalleeFR->FunctionEffect;
-
-            // Incorporate callee's effects on globals into our info.
-            for (const auto &G : CalleeFR->GlobalInfo)
-              FR.GlobalInfo[G.first] |= G.second;
-            FR.MayReadAnyGlobal |= CalleeFR->MayReadAnyGlobal;
-          } else {
-            // Can't say anything about it.  However, if it is inside our SCC,
-            // then nothing needs to be done.
-            CallGraphNode *CalleeNode = CG[Callee];
-            if (std::find(SCC.begin(), SCC.end(), CalleeNode) == SCC.end())
-              KnowNothing = true;
-          }
-        } else {
-          KnowNothing = true;
-        }
+      FunctionRecord &FR = FunctionInfo[SCC[0]->getFunction()];
+      if ((FR.FunctionEffect & Mod) == 0)
+        ++NumReadMemFunctions;
+      if (FR.FunctionEffect == 0)
+        ++NumNoMemFunctions;
+
+      // Finally, now that we know the full effect on this SCC, clone the
+      // information to each function in the SCC.
+      for (unsigned i = 1, e = SCC.size(); i != e; ++i)
+        FunctionInfo[SCC[i]->getFunction()] = FR;
+    }
+  }
+}
+
+/// AnalyzeSCC - Compute the mod/ref info of an SCC whose callees have all been
+/// analyzed, storing it in the record of its first function.  Returns true if
+/// nothing useful can be said about the SCC.  This only reads the records of
+/// other SCCs, so independent SCCs can be analyzed concurrently.
+bool GlobalsModRef::AnalyzeSCC(CallGraph &CG,
+                               const std::vector<CallGraphNode *> &SCC) {
+  if (!SCC[0]->getFunction()) {
+    // Calls externally - can't say anything useful.  Remove any existing
+    // function records (may have been created when scanning globals).
+    return true;
+  }
+
+  FunctionRecord &FR = *getFunctionInfo(SCC[0]->getFunction());
+
+  bool KnowNothing = false;
+  unsigned FunctionEffect = 0;
+
+  // Collect the mod/ref properties due to called functions.  We only compute
+  // one mod-ref set.
+  for (unsigned i = 0, e = SCC.size(); i != e && !KnowNothing; ++i) {
+    Function *F = SCC[i]->getFunction();
+    if (!F) {
+      KnowNothing = true;
+      break;
     }
 
-    // If we can't say anything useful about this SCC, remove all SCC functions
-    // from the FunctionInfo map.
-    if (KnowNothing) {
-      for (auto *Node : SCC)
-        FunctionInfo.erase(Node->getFunction());
+    if (F->isDeclaration()) {
+      // Try to get mod/ref behaviour from function attributes.
+      if (F->doesNotAccessMemory()) {
+        // Can't do better than that!
+      } else if (F->onlyReadsMemory()) {
+        FunctionEffect |= Ref;
+        if (!F->isIntrinsic())
+          // This function might call back into the module and read a global -
+          // consider every global as possibly being read by this function.
+          FR.MayReadAnyGlobal = true;
+      } else {
+        FunctionEffect |= ModRef;
+        // Can't say anything useful unless it's an intrinsic - they don't
+        // read or write global variables of the kind considered here.
+        KnowNothing = !F->isIntrinsic();
+      }
       continue;
     }
 
-    // Scan the function bodies for explicit loads or stores.
-    for (auto *Node : SCC) {
+    for (CallGraphNode::iterator CI = SCC[i]->begin(), E = SCC[i]->end();
+         CI != E && !KnowNothing; ++CI)
+      if (Function *Callee = CI->second->getFunction()) {
+        if (FunctionRecord *CalleeFR = getFunctionInfo(Callee)) {
+          // Propagate function effect up.
+          FunctionEffect |= CalleeFR->FunctionEffect;
+
+          // Incorporate callee's effects on globals into our info.
+          FR.addCalleeInfo(*CalleeFR);
+        } else {
+          // Can't say anything about it.  However, if it is inside our SCC,
+          // then nothing needs to be done.
+          CallGraphNode *CalleeNode = CI->second;
+          if (std::find(SCC.begin(), SCC.end(), CalleeNode) == SCC.end())
+            KnowNothing = true;
+        }
+      } else {
+        KnowNothing = true;
+      }
+  }
+
+  if (KnowNothing)
+    return true;
+
+  // Scan the function bodies for explicit loads or stores.
+  for (auto *Node : SCC) {
+    if (FunctionEffect == ModRef)
+      break; // The mod/ref lattice saturates here.
+    for (Instruction &I : inst_range(Node->getFunction())) {
       if (FunctionEffect == ModRef)
         break; // The mod/ref lattice saturates here.
-      for (Instruction &I : inst_range(Node->getFunction())) {
-        if (FunctionEffect == ModRef)
-          break; // The mod/ref lattice saturates here.
-
-        // We handle calls specially because the graph-relevant aspects are
-        // handled above.
-        if (auto CS = CallSite(&I)) {
-          if (isAllocationFn(&I, TLI) || isFreeCall(&I, TLI)) {
-            // FIXME: It is completely unclear why this is necessary and not
-            // handled by the above graph code.
-            FunctionEffect |= ModRef;
-          } else if (Function *Callee = CS.getCalledFunction()) {
-            // The callgraph doesn't include intrinsic calls.
-            if (Callee->isIntrinsic()) {
-              ModRefBehavior Behaviour =
-                  AliasAnalysis::getModRefBehavior(Callee);
-              FunctionEffect |= (Behaviour & ModRef);
-            }
+
+      // We handle calls specially because the graph-relevant aspects are
+      // handled above.
+      if (auto CS = CallSite(&I)) {
+        if (isAllocationFn(&I, TLI) || isFreeCall(&I, TLI)) {
+          // FIXME: It is completely unclear why this is necessary and not
+          // handled by the above graph code.
+          FunctionEffect |= ModRef;
+        } else if (Function *Callee = CS.getCalledFunction()) {
+          // The callgraph doesn't include intrinsic calls.
+          if (Callee->isIntrinsic()) {
+            ModRefBehavior Behaviour =
+                AliasAnalysis::getModRefBehavior(Callee);
+            FunctionEffect |= (Behaviour & ModRef);
           }
-          continue;
         }
-
-        // All non-call instructions we use the primary predicates for whether
-        // thay read or write memory.
-        if (I.mayReadFromMemory())
-          FunctionEffect |= Ref;
-        if (I.mayWriteToMemory())
-          FunctionEffect |= Mod;
+        continue;
       }
-    }
-
-    if ((FunctionEffect & Mod) == 0)
-      ++NumReadMemFunctions;
-    if (FunctionEffect == 0)
-      ++NumNoMemFunctions;
-    FR.FunctionEffect = FunctionEffect;
 
-    // Finally, now that we know the full effect on this SCC, clone the
-    // information to each function in the SCC.
-    for (unsigned i = 1, e = SCC.size(); i != e; ++i)
-      FunctionInfo[SCC[i]->getFunction()] = FR;
+      // All non-call instructions we use the primary predicates for whether
+      // thay read or write memory.
+      if (I.mayReadFromMemory())
+        FunctionEffect |= Ref;
+      if (I.mayWriteToMemory())
+        FunctionEffect |= Mod;
+    }
   }
+
+  FR.FunctionEffect = FunctionEffect;
+  return false;
 }
 
 /// alias - If one of the pointers is to a global that we are tracking, and the
@@ -582,10 +668,12 @@ GlobalsModRef::getModRefInfo(ImmutableCallSite CS, const MemoryLocation &Loc) {
   if (const GlobalValue *GV =
           dyn_cast<GlobalValue>(GetUnderlyingObject(Loc.Ptr, DL)))
     if (GV->hasLocalLinkage())
-      if (const Function *F = CS.getCalledFunction())
-        if (NonAddressTakenGlobals.count(GV))
-          if (const FunctionRecord *FR = getFunctionInfo(F))
-            Known = FR->getInfoForGlobal(GV);
+      if (const Function *F = CS.getCalledFunction()) {
+        auto I = NonAddressTakenGlobals.find(GV);
+        if (I != NonAddressTakenGlobals.end())
+          if (FunctionRecord *FR = getFunctionInfo(F))
+            Known = FR->getInfoForGlobal(I->second);
+      }
 
   if (Known == NoModRef)
     return NoModRef; // No need to query other mod/ref analyses
@@ -30,6 +30,7 @@
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Operator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -38,6 +39,17 @@ using namespace llvm;
 #define DEBUG_TYPE "inline-cost"
 
 STATISTIC(NumCallsAnalyzed, "Number of call sites analyzed");
+STATISTIC(NumCostCacheHits, "Number of inline costs found in the cache");
+STATISTIC(NumCostCacheMisses, "Number of inline costs missing in the cache");
+
+static cl::opt<bool> DisableInlineCostCache(
+    "disable-inline-cost-cache", cl::init(false), cl::Hidden,
+    cl::desc("Recompute the inline cost of every call site from scratch"));
+
+// Bound the linear scan over the signatures cached for one callee.
+static cl::opt<unsigned> MaxCachedCostsPerCallee(
+    "inline-cost-cache-size", cl::init(16), cl::Hidden,
+    cl::desc("Maximum number of call site signatures cached per callee"));
 
 namespace {
 
@@ -173,6 +185,7 @@ public:
         SROACostSavings(0), SROACostSavingsLost(0) {}
 
   bool analyzeCall(CallSite CS);
+  bool getCallSiteSignature(CallSite CS, SmallVectorImpl<uint64_t> &Signature);
 
   int getThreshold() { return Threshold; }
   int getCost() { return Cost; }
@@ -1042,6 +1055,73 @@ ConstantInt *CallAnalyzer::stripAndComputeInBoundsConstantOffsets(Value *&V) {
   return cast<ConstantInt>(ConstantInt::get(IntPtrTy, Offset));
 }
 
+/// \brief Test whether \p F contains a call to itself.
+static bool isRecursiveFunction(Function &F) {
+  for (User *U : F.users()) {
+    CallSite Site(U);
+    if (!Site)
+      continue;
+    Instruction *I = Site.getInstruction();
+    if (I->getParent()->getParent() == &F)
+      return true;
+  }
+  return false;
+}
+
+/// \brief Test whether the function called at \p CS is noreturn, as far as
+/// the instructions following the call site tell.
+static bool isFollowedByUnreachable(CallSite CS) {
+  Instruction *Instr = CS.getInstruction();
+  if (InvokeInst *II = dyn_cast<InvokeInst>(Instr))
+    return isa<UnreachableInst>(II->getNormalDest()->begin());
+  return isa<UnreachableInst>(++BasicBlock::iterator(Instr));
+}
+
+/// \brief Summarize everything \c analyzeCall reads from the call site.
+///
+/// Two call sites of an unmodified callee which produce the same signature
+/// and are analyzed against the same threshold get the same cost. Returns
+/// false if the call site can't be summarized.
+bool CallAnalyzer::getCallSiteSignature(CallSite CS,
+                                        SmallVectorImpl<uint64_t> &Signature) {
+  Function *Caller = CS.getCaller();
+  Signature.push_back(static_cast<uint32_t>(Threshold));
+  Signature.push_back(uintptr_t(CS.getAttributes().getRawPointer()));
+  Signature.push_back(uintptr_t(F.getAttributes().getRawPointer()));
+  Signature.push_back(
+      uintptr_t(Caller->getAttributes().getFnAttributes().getRawPointer()));
+  bool OnlyOneCallAndLocalLinkage = F.hasLocalLinkage() && F.hasOneUse() &&
+    &F == CS.getCalledFunction();
+  Signature.push_back(OnlyOneCallAndLocalLinkage |
+                      isFollowedByUnreachable(CS) << 1 |
+                      isRecursiveFunction(*Caller) << 2);
+
+  // Record the arguments which are constants, and those which are constant
+  // offsets from some base pointer. Bases are recorded as the index of the
+  // first argument with the same base, which is all the analysis can observe
+  // about them, apart from whether the base is an alloca.
+  SmallVector<Value *, 8> Bases;
+  for (Value *Arg : CS.args()) {
+    Signature.push_back(uintptr_t(dyn_cast<Constant>(Arg)));
+
+    Value *Base = Arg;
+    ConstantInt *Offset = stripAndComputeInBoundsConstantOffsets(Base);
+    if (!Offset) {
+      Bases.push_back(nullptr);
+      Signature.push_back(~0ULL);
+      continue;
+    }
+    if (Offset->getValue().getMinSignedBits() > 64)
+      return false;
+    unsigned BaseIdx =
+        std::find(Bases.begin(), Bases.end(), Base) - Bases.begin();
+    Bases.push_back(Base);
+    Signature.push_back(uint64_t(BaseIdx) << 1 | isa<AllocaInst>(Base));
+    Signature.push_back(Offset->getSExtValue());
+  }
+  return true;
+}
+
 /// \brief Analyze a call site for potential inlining.
 ///
 /// Returns true if inlining this call is viable, and false if it is not
@@ -1118,11 +1198,7 @@ bool CallAnalyzer::analyzeCall(CallSite CS) {
   // invoke is an unreachable instruction, the function is noreturn. As such,
   // there is little point in inlining this unless there is literally zero
   // cost.
-  Instruction *Instr = CS.getInstruction();
-  if (InvokeInst *II = dyn_cast<InvokeInst>(Instr)) {
-    if (isa<UnreachableInst>(II->getNormalDest()->begin()))
-      Threshold = 0;
-  } else if (isa<UnreachableInst>(++BasicBlock::iterator(Instr)))
+  if (isFollowedByUnreachable(CS))
     Threshold = 0;
 
   // If this function uses the coldcc calling convention, prefer not to inline
@@ -1137,18 +1213,8 @@ bool CallAnalyzer::analyzeCall(CallSite CS) {
   if (F.empty())
     return true;
 
-  Function *Caller = CS.getInstruction()->getParent()->getParent();
   // Check if the caller function is recursive itself.
-  for (User *U : Caller->users()) {
-    CallSite Site(U);
-    if (!Site)
-      continue;
-    Instruction *I = Site.getInstruction();
-    if (I->getParent()->getParent() == Caller) {
-      IsCallerRecursive = true;
-      break;
-    }
-  }
+  IsCallerRecursive = isRecursiveFunction(*CS.getCaller());
 
   // Populate our simplified values by mapping from function arguments to call
   // arguments with known important simplifications.
@@ -1327,9 +1393,39 @@ void InlineCostAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
 bool InlineCostAnalysis::runOnSCC(CallGraphSCC &SCC) {
   TTIWP = &getAnalysis<TargetTransformInfoWrapperPass>();
   ACT = &getAnalysis<AssumptionCacheTracker>();
+
+  // The function passes scheduled after the inliner have had a chance to
+  // change the functions of the last SCC, and the functions of this SCC may
+  // be revisited after such a change. Everything else is either finished or
+  // hasn't been looked at yet.
+  for (Function *F : LastSCCFunctions)
+    CostCache.erase(F);
+  LastSCCFunctions.clear();
+  for (CallGraphNode *Node : SCC)
+    if (Function *F = Node->getFunction()) {
+      CostCache.erase(F);
+      LastSCCFunctions.push_back(F);
+    }
   return false;
 }
 
+bool InlineCostAnalysis::doFinalization(CallGraph &CG) {
+  CostCache.clear();
+  LastSCCFunctions.clear();
+  return false;
+}
+
+void InlineCostAnalysis::invalidateCachedCosts(const Function &F) {
+  CostCache.erase(&F);
+}
+
+bool InlineCostAnalysis::getCallSiteSignature(CallSite CS, Function *Callee,
+                                              int Threshold,
+                                              CallSiteSignature &Signature) {
+  CallAnalyzer CA(TTIWP->getTTI(*Callee), ACT, *Callee, Threshold, CS);
+  return CA.getCallSiteSignature(CS, Signature);
+}
+
 InlineCost InlineCostAnalysis::getInlineCost(CallSite CS, int Threshold) {
   return getInlineCost(CS, CS.getCalledFunction(), Threshold);
 }
@@ -1354,6 +1450,35 @@ static bool functionsHaveCompatibleAttributes(Function *Caller,
 
 InlineCost InlineCostAnalysis::getInlineCost(CallSite CS, Function *Callee,
                                              int Threshold) {
+  if (!Callee)
+    return llvm::InlineCost::getNever();
+  TargetTransformInfo &CalleeTTI = TTIWP->getTTI(*Callee);
+  CallSiteSignature Signature;
+  if (DisableInlineCostCache ||
+      !getCallSiteSignature(CS, Callee, Threshold, Signature))
+    return llvm::getInlineCost(CS, Callee, Threshold, CalleeTTI, ACT);
+
+  CachedCosts &Costs = CostCache[Callee];
+  for (const auto &Entry : Costs)
+    if (Entry.first == Signature) {
+      ++NumCostCacheHits;
+      return Entry.second;
+    }
+
+  ++NumCostCacheMisses;
+  InlineCost IC = llvm::getInlineCost(CS, Callee, Threshold, CalleeTTI, ACT);
+  if (Costs.size() < MaxCachedCostsPerCallee)
+    Costs.push_back(std::make_pair(Signature, IC));
+  return IC;
+}
+
+bool InlineCostAnalysis::isInlineViable(Function &F) {
+  return llvm::isInlineViable(F);
+}
+
+InlineCost llvm::getInlineCost(CallSite CS, Function *Callee, int Threshold,
+                               TargetTransformInfo &CalleeTTI,
+                               AssumptionCacheTracker *ACT) {
   // Cannot inline indirect calls.
   if (!Callee)
     return llvm::InlineCost::getNever();
@@ -1369,7 +1494,7 @@ InlineCost InlineCostAnalysis::getInlineCost(CallSite CS, Function *Callee,
   // Never inline functions with conflicting attributes (unless callee has
   // always-inline attribute).
   if (!functionsHaveCompatibleAttributes(CS.getCaller(), Callee,
-                                         TTIWP->getTTI(*Callee)))
+                                         CalleeTTI))
     return llvm::InlineCost::getNever();
 
   // Don't inline this call if the caller has the optnone attribute.
@@ -1386,7 +1511,7 @@ InlineCost InlineCostAnalysis::getInlineCost(CallSite CS, Function *Callee,
   DEBUG(llvm::dbgs() << "      Analyzing call of " << Callee->getName()
         << "...\n");
 
-  CallAnalyzer CA(TTIWP->getTTI(*Callee), ACT, *Callee, Threshold, CS);
+  CallAnalyzer CA(CalleeTTI, ACT, *Callee, Threshold, CS);
   bool ShouldInline = CA.analyzeCall(CS);
 
   DEBUG(CA.dump());
@@ -1400,7 +1525,7 @@ InlineCost InlineCostAnalysis::getInlineCost(CallSite CS, Function *Callee,
   return llvm::InlineCost::get(CA.getCost(), CA.getThreshold());
 }
 
-bool InlineCostAnalysis::isInlineViable(Function &F) {
+bool llvm::isInlineViable(Function &F) {
   bool ReturnsTwice = F.hasFnAttribute(Attribute::ReturnsTwice);
   for (Function::iterator BI = F.begin(), BE = F.end(); BI != BE; ++BI) {
     // Disallow inlining of functions which contain indirect branches or
@@ -28,6 +28,7 @@
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/PatternMatch.h"
 #include "llvm/IR/ValueHandle.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include <map>
@@ -37,6 +38,18 @@ using namespace PatternMatch;
 
 #define DEBUG_TYPE "lazy-value-info"
 
+// The solver gives up on a query, and assumes the values it was asked for are
+// overdefined, after processing this many block values.
+static cl::opt<unsigned> MaxProcessedPerQuery(
+    "lvi-max-processed-per-query", cl::init(500), cl::Hidden,
+    cl::desc("Maximal number of block values computed for a single query"));
+
+// The cache is dropped, and lazily recomputed, once this many block values
+// have been computed since it was last emptied.
+static cl::opt<unsigned> MaxCacheEntries(
+    "lvi-max-cache-entries", cl::init(100000), cl::Hidden,
+    cl::desc("Maximal number of block values kept in the cache"));
+
 char LazyValueInfo::ID = 0;
 INITIALIZE_PASS_BEGIN(LazyValueInfo, "lazy-value-info",
                 "Lazy Value Information Analysis", false, true)
@@ -331,6 +344,10 @@ namespace {
     /// don't spend time removing unused blocks from our caches.
     DenseSet<AssertingVH<BasicBlock> > SeenBlocks;
 
+    /// The number of block values inserted since the cache was last emptied,
+    /// an upper bound of the number of entries of ValueCache.
+    unsigned NumInsertedValues = 0;
+
     /// This stack holds the state of the value solver during a query.
     /// It basically emulates the callstack of the naive
     /// recursive value lookup process.
@@ -357,6 +374,7 @@ namespace {
 
     void insertResult(Value *Val, BasicBlock *BB, const LVILatticeVal &Result) {
       SeenBlocks.insert(BB);
+      ++NumInsertedValues;
       lookup(Val)[BB] = Result;
       if (Result.isOverdefined())
         OverDefinedCache.insert(std::make_pair(BB, Val));
@@ -382,7 +400,17 @@ namespace {
                                             Instruction *BBI);
 
     void solve();
-    
+
+    /// Empty the cache if it went over its budget. Must only be called between
+    /// queries.
+    void enforceCacheBudget() {
+      if (NumInsertedValues <= MaxCacheEntries)
+        return;
+      DEBUG(dbgs() << "LVI: dropping the cache after " << NumInsertedValues
+                   << " insertions\n");
+      clear();
+    }
+
     ValueCacheEntryTy &lookup(Value *V) {
       return ValueCache[LVIValueHandle(V, this)];
     }
@@ -413,6 +441,7 @@ namespace {
     
     /// clear - Empty the cache.
     void clear() {
+      NumInsertedValues = 0;
       SeenBlocks.clear();
       ValueCache.clear();
       OverDefinedCache.clear();
@@ -459,7 +488,32 @@ void LazyValueInfoCache::eraseBlock(BasicBlock *BB) {
 }
 
 void LazyValueInfoCache::solve() {
+  // The items on the stack when the solver is entered are the values the
+  // query asked for, the other ones are intermediate results.
+  size_t NumQueried = BlockValueStack.size();
+  unsigned NumProcessed = 0;
   while (!BlockValueStack.empty()) {
+    if (++NumProcessed > MaxProcessedPerQuery) {
+      DEBUG(dbgs() << "LVI: giving up on a query after " << MaxProcessedPerQuery
+                   << " block values\n");
+      // Drop the intermediate items, and conservatively answer the query.
+      while (BlockValueStack.size() > NumQueried) {
+        BlockValueSet.erase(BlockValueStack.top());
+        BlockValueStack.pop();
+      }
+      while (!BlockValueStack.empty()) {
+        std::pair<BasicBlock *, Value *> &e = BlockValueStack.top();
+        if (!hasBlockValue(e.second, e.first)) {
+          LVILatticeVal Overdefined;
+          Overdefined.markOverdefined();
+          insertResult(e.second, e.first, Overdefined);
+        }
+        BlockValueSet.erase(e);
+        BlockValueStack.pop();
+      }
+      return;
+    }
+
     std::pair<BasicBlock*, Value*> &e = BlockValueStack.top();
     assert(BlockValueSet.count(e) && "Stack value should be in BlockValueSet!");
 
@@ -470,6 +524,7 @@ void LazyValueInfoCache::solve() {
 
       BlockValueStack.pop();
       BlockValueSet.erase(e);
+      NumQueried = std::min(NumQueried, BlockValueStack.size());
     } else {
       // More work needs to be done before revisiting.
       assert(BlockValueStack.top() != e && "Stack should have been pushed!");
@@ -999,6 +1054,7 @@ LVILatticeVal LazyValueInfoCache::getValueInBlock(Value *V, BasicBlock *BB,
         << BB->getName() << "'\n");
   
   assert(BlockValueStack.empty() && BlockValueSet.empty());
+  enforceCacheBudget();
   pushBlockValue(std::make_pair(BB, V));
 
   solve();
@@ -1026,6 +1082,7 @@ getValueOnEdge(Value *V, BasicBlock *FromBB, BasicBlock *ToBB,
   DEBUG(dbgs() << "LVI Getting edge value " << *V << " from '"
         << FromBB->getName() << "' to '" << ToBB->getName() << "'\n");
   
+  enforceCacheBudget();
   LVILatticeVal Result;
   if (!getEdgeValue(V, FromBB, ToBB, Result, CxtI)) {
     solve();
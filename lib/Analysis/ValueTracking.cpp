@@ -2878,12 +2878,11 @@ bool llvm::onlyUsedByLifetimeMarkers(const Value *V) {
 }
 
 static bool isDereferenceableFromAttribute(const Value *BV, APInt Offset,
-                                           Type *Ty, const DataLayout &DL,
+                                           uint64_t Size, const DataLayout &DL,
                                            const Instruction *CtxI,
                                            const DominatorTree *DT,
                                            const TargetLibraryInfo *TLI) {
   assert(Offset.isNonNegative() && "offset can't be negative");
-  assert(Ty->isSized() && "must be sized");
   
   APInt DerefBytes(Offset.getBitWidth(), 0);
   bool CheckForNonNull = false;
@@ -2915,7 +2914,7 @@ static bool isDereferenceableFromAttribute(const Value *BV, APInt Offset,
   }
   
   if (DerefBytes.getBoolValue())
-    if (DerefBytes.uge(Offset + DL.getTypeStoreSize(Ty)))
+    if (DerefBytes.uge(Offset + Size))
       if (!CheckForNonNull || isKnownNonNullAt(BV, CtxI, DT, TLI))
         return true;
 
@@ -2932,7 +2931,8 @@ static bool isDereferenceableFromAttribute(const Value *V, const DataLayout &DL,
     return false;
   
   APInt Offset(DL.getTypeStoreSizeInBits(VTy), 0);
-  return isDereferenceableFromAttribute(V, Offset, Ty, DL, CtxI, DT, TLI);
+  return isDereferenceableFromAttribute(V, Offset, DL.getTypeStoreSize(Ty), DL,
+                                        CtxI, DT, TLI);
 }
 
 /// Return true if Value is always a dereferenceable pointer.
@@ -3033,8 +3033,8 @@ bool llvm::isDereferenceablePointer(const Value *V, const DataLayout &DL,
     const Value *BV = V->stripAndAccumulateInBoundsConstantOffsets(DL, Offset);
     
     if (Offset.isNonNegative())
-      if (isDereferenceableFromAttribute(BV, Offset, Ty, DL,
-                                         CtxI, DT, TLI))
+      if (isDereferenceableFromAttribute(BV, Offset, DL.getTypeStoreSize(Ty),
+                                         DL, CtxI, DT, TLI))
         return true;
   }
 
@@ -3042,6 +3042,44 @@ bool llvm::isDereferenceablePointer(const Value *V, const DataLayout &DL,
   return ::isDereferenceablePointer(V, DL, CtxI, DT, TLI, Visited);
 }
 
+bool llvm::isDereferenceableBytes(const Value *V, uint64_t Size,
+                                  const DataLayout &DL,
+                                  const Instruction *CtxI,
+                                  const DominatorTree *DT,
+                                  const TargetLibraryInfo *TLI) {
+  APInt Offset(DL.getPointerTypeSizeInBits(V->getType()), 0);
+  const Value *BV = V->stripAndAccumulateInBoundsConstantOffsets(DL, Offset);
+  if (Offset.isNegative())
+    return false;
+
+  if (isDereferenceableFromAttribute(BV, Offset, Size, DL, CtxI, DT, TLI))
+    return true;
+
+  // Otherwise the bytes must lie within an object of known size.
+  uint64_t ObjectSize = 0;
+  if (const AllocaInst *AI = dyn_cast<AllocaInst>(BV)) {
+    const ConstantInt *ArraySize = dyn_cast<ConstantInt>(AI->getArraySize());
+    if (!ArraySize || !AI->getAllocatedType()->isSized())
+      return false;
+    ObjectSize = DL.getTypeAllocSize(AI->getAllocatedType()) *
+                 ArraySize->getZExtValue();
+  } else if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(BV)) {
+    Type *Ty = GV->getType()->getElementType();
+    if (GV->hasExternalWeakLinkage() || !Ty->isSized())
+      return false;
+    ObjectSize = DL.getTypeAllocSize(Ty);
+  } else if (const Argument *A = dyn_cast<Argument>(BV)) {
+    if (!A->hasByValAttr())
+      return false;
+    ObjectSize =
+        DL.getTypeAllocSize(A->getType()->getPointerElementType());
+  } else {
+    return false;
+  }
+
+  return (Offset + Size).ule(ObjectSize);
+}
+
 bool llvm::isSafeToSpeculativelyExecute(const Value *V,
                                         const Instruction *CtxI,
                                         const DominatorTree *DT,
@@ -0,0 +1,502 @@
+//===-- MachineOutliner.cpp - Outline repeated instruction sequences ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass replaces repeated sequences of machine instructions with calls to
+// a single outlined copy of the sequence, trading a little speed for code size.
+//
+// Every instruction of the function is mapped to an integer. Instructions the
+// target allows to be outlined map to the same integer when they are
+// identical; everything else, and the end of each block, maps to an integer
+// that occurs only once. A suffix tree over the resulting string exposes every
+// repeated sequence, which is then weighed with the target's size estimates.
+// Sequences are outlined greedily, most profitable first.
+//
+// Outlined sequences are placed in blocks at the end of the function they were
+// taken from, because code generation runs one function at a time and cannot
+// create new functions at this point. A sequence that ends in a return is
+// reached with a branch; any other sequence is reached with a call and is
+// followed by a return in the outlined block.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineFunction.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/Passes.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetInstrInfo.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+#include <algorithm>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "machine-outliner"
+
+static cl::opt<unsigned> MinSequenceLength(
+    "machine-outliner-min-length", cl::Hidden, cl::init(2),
+    cl::desc("Minimum number of instructions in an outlined sequence"));
+
+STATISTIC(NumOutlined, "Number of sequences outlined");
+STATISTIC(NumOccurrencesOutlined, "Number of occurrences replaced by calls");
+STATISTIC(NumBytesSaved, "Estimated number of bytes saved by outlining");
+
+namespace {
+
+const unsigned EmptyIdx = ~0U;
+
+/// A node in a suffix tree. The edge leading into the node is labelled with
+/// the substring [StartIdx, *EndIdx] of the tree's string.
+struct SuffixTreeNode {
+  DenseMap<unsigned, SuffixTreeNode *> Children;
+
+  unsigned StartIdx;
+
+  /// Leaves share a single end index, which is advanced as the tree grows.
+  unsigned *EndIdx;
+
+  /// For leaves, the start of the suffix the leaf represents.
+  unsigned SuffixIdx = EmptyIdx;
+
+  /// The length of the string spelled out from the root to this node.
+  unsigned ConcatLen = 0;
+
+  SuffixTreeNode *Link;
+
+  SuffixTreeNode(unsigned StartIdx, unsigned *EndIdx, SuffixTreeNode *Link)
+      : StartIdx(StartIdx), EndIdx(EndIdx), Link(Link) {}
+
+  bool isRoot() const { return StartIdx == EmptyIdx; }
+  bool isLeaf() const { return SuffixIdx != EmptyIdx; }
+  unsigned size() const { return isRoot() ? 0 : *EndIdx - StartIdx + 1; }
+};
+
+/// A suffix tree built with Ukkonen's algorithm in time linear in the length
+/// of the string. The last character of the string must be unique so that
+/// every suffix ends in a leaf.
+class SuffixTree {
+  ArrayRef<unsigned> Str;
+  SpecificBumpPtrAllocator<SuffixTreeNode> NodeAllocator;
+  BumpPtrAllocator EndIdxAllocator;
+  unsigned LeafEndIdx = EmptyIdx;
+
+  /// The point where the next suffix is inserted: ActiveLen characters down
+  /// the edge of ActiveNode that starts with Str[ActiveIdx].
+  SuffixTreeNode *ActiveNode;
+  unsigned ActiveIdx = EmptyIdx;
+  unsigned ActiveLen = 0;
+
+  SuffixTreeNode *insertLeaf(SuffixTreeNode &Parent, unsigned StartIdx,
+                             unsigned Edge) {
+    SuffixTreeNode *N = new (NodeAllocator.Allocate())
+        SuffixTreeNode(StartIdx, &LeafEndIdx, nullptr);
+    Parent.Children[Edge] = N;
+    return N;
+  }
+
+  SuffixTreeNode *insertInternalNode(SuffixTreeNode *Parent, unsigned StartIdx,
+                                     unsigned EndIdx, unsigned Edge) {
+    unsigned *E = new (EndIdxAllocator) unsigned(EndIdx);
+    SuffixTreeNode *N =
+        new (NodeAllocator.Allocate()) SuffixTreeNode(StartIdx, E, Root);
+    if (Parent)
+      Parent->Children[Edge] = N;
+    return N;
+  }
+
+  /// Add the suffixes of Str[0, EndIdx] that are not in the tree yet, and
+  /// return how many of them are still implicit.
+  unsigned extend(unsigned EndIdx, unsigned SuffixesToAdd) {
+    SuffixTreeNode *NeedsLink = nullptr;
+
+    while (SuffixesToAdd > 0) {
+      if (ActiveLen == 0)
+        ActiveIdx = EndIdx;
+
+      unsigned FirstChar = Str[ActiveIdx];
+      auto It = ActiveNode->Children.find(FirstChar);
+      if (It == ActiveNode->Children.end()) {
+        insertLeaf(*ActiveNode, EndIdx, FirstChar);
+        if (NeedsLink) {
+          NeedsLink->Link = ActiveNode;
+          NeedsLink = nullptr;
+        }
+      } else {
+        SuffixTreeNode *NextNode = It->second;
+        unsigned EdgeLen = NextNode->size();
+
+        // Walk down the edge if the active point lies beyond it.
+        if (ActiveLen >= EdgeLen) {
+          ActiveIdx += EdgeLen;
+          ActiveLen -= EdgeLen;
+          ActiveNode = NextNode;
+          continue;
+        }
+
+        // The suffix is already in the tree implicitly.
+        unsigned LastChar = Str[EndIdx];
+        if (Str[NextNode->StartIdx + ActiveLen] == LastChar) {
+          if (NeedsLink && !ActiveNode->isRoot()) {
+            NeedsLink->Link = ActiveNode;
+            NeedsLink = nullptr;
+          }
+          ++ActiveLen;
+          break;
+        }
+
+        // Split the edge and hang a new leaf off the split point.
+        SuffixTreeNode *SplitNode =
+            insertInternalNode(ActiveNode, NextNode->StartIdx,
+                               NextNode->StartIdx + ActiveLen - 1, FirstChar);
+        insertLeaf(*SplitNode, EndIdx, LastChar);
+        NextNode->StartIdx += ActiveLen;
+        SplitNode->Children[Str[NextNode->StartIdx]] = NextNode;
+
+        if (NeedsLink)
+          NeedsLink->Link = SplitNode;
+        NeedsLink = SplitNode;
+      }
+
+      --SuffixesToAdd;
+      if (ActiveNode->isRoot()) {
+        if (ActiveLen > 0) {
+          --ActiveLen;
+          ActiveIdx = EndIdx - SuffixesToAdd + 1;
+        }
+      } else {
+        ActiveNode = ActiveNode->Link;
+      }
+    }
+
+    return SuffixesToAdd;
+  }
+
+  /// Set the length of the string leading to each node, and the suffix each
+  /// leaf stands for. The tree can be as deep as the string is long, so this
+  /// does not recurse.
+  void setSuffixIndices() {
+    SmallVector<SuffixTreeNode *, 32> Worklist(1, Root);
+    while (!Worklist.empty()) {
+      SuffixTreeNode *N = Worklist.pop_back_val();
+      for (auto &Child : N->Children) {
+        Child.second->ConcatLen = N->ConcatLen + Child.second->size();
+        Worklist.push_back(Child.second);
+      }
+      if (N->Children.empty() && !N->isRoot())
+        N->SuffixIdx = Str.size() - N->ConcatLen;
+    }
+  }
+
+public:
+  SuffixTreeNode *Root = nullptr;
+
+  SuffixTree(ArrayRef<unsigned> Str) : Str(Str) {
+    Root = insertInternalNode(nullptr, EmptyIdx, EmptyIdx, 0);
+    ActiveNode = Root;
+
+    unsigned SuffixesToAdd = 0;
+    for (unsigned EndIdx = 0, E = Str.size(); EndIdx != E; ++EndIdx) {
+      ++SuffixesToAdd;
+      LeafEndIdx = EndIdx;
+      SuffixesToAdd = extend(EndIdx, SuffixesToAdd);
+    }
+
+    setSuffixIndices();
+  }
+};
+
+/// A repeated sequence of instructions and the places it may be taken from.
+struct Candidate {
+  unsigned Length;
+  std::vector<unsigned> Starts;
+  unsigned SequenceSize;
+  bool IsTailCall;
+  int Benefit;
+};
+
+class MachineOutliner : public MachineFunctionPass {
+  const TargetInstrInfo *TII;
+  const TargetRegisterInfo *TRI;
+
+  /// The function as a string of instruction numbers, and the instruction
+  /// each number stands for. Block ends are represented by the block's end
+  /// iterator.
+  std::vector<unsigned> Str;
+  std::vector<MachineBasicBlock::iterator> InstrAt;
+
+  void mapInstructions(MachineFunction &MF);
+  void findCandidates(SuffixTree &ST, std::vector<Candidate> &Candidates);
+  bool buildCandidate(unsigned Length, std::vector<unsigned> &Starts,
+                      Candidate &C);
+  int getBenefit(const Candidate &C, unsigned Occurrences) const;
+  void outline(MachineFunction &MF, const Candidate &C);
+
+public:
+  static char ID;
+
+  MachineOutliner() : MachineFunctionPass(ID) {
+    initializeMachineOutlinerPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+};
+} // end anonymous namespace
+
+char MachineOutliner::ID = 0;
+char &llvm::MachineOutlinerID = MachineOutliner::ID;
+
+INITIALIZE_PASS(MachineOutliner, "machine-outliner",
+                "Machine Function Outliner", false, false)
+
+void MachineOutliner::mapInstructions(MachineFunction &MF) {
+  DenseMap<MachineInstr *, unsigned, MachineInstrExpressionTrait> InstrIDs;
+  unsigned LegalID = 0;
+  // Count down from the top so that the two numbers DenseMap reserves for
+  // its own keys are never used.
+  unsigned IllegalID = EmptyIdx - 2;
+
+  for (MachineBasicBlock &MBB : MF) {
+    for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end(); I != E;
+         ++I) {
+      InstrAt.push_back(I);
+      if (TII->getOutliningType(*I) == TargetInstrInfo::MOT_Illegal) {
+        Str.push_back(IllegalID--);
+        continue;
+      }
+      auto Ins = InstrIDs.insert(std::make_pair(&*I, LegalID));
+      if (Ins.second)
+        ++LegalID;
+      Str.push_back(Ins.first->second);
+    }
+    InstrAt.push_back(MBB.end());
+    Str.push_back(IllegalID--);
+  }
+}
+
+int MachineOutliner::getBenefit(const Candidate &C,
+                                unsigned Occurrences) const {
+  int NotOutlined = Occurrences * C.SequenceSize;
+  int Outlined = Occurrences * TII->getOutliningCallOverhead(C.IsTailCall) +
+                 C.SequenceSize + TII->getOutliningFrameOverhead(C.IsTailCall);
+  return NotOutlined - Outlined;
+}
+
+/// Fill in \p C for the sequence of \p Length instructions starting at each
+/// of \p Starts, keeping only the occurrences that may be outlined. Return
+/// false if the sequence is not worth outlining.
+bool MachineOutliner::buildCandidate(unsigned Length,
+                                     std::vector<unsigned> &Starts,
+                                     Candidate &C) {
+  std::sort(Starts.begin(), Starts.end());
+
+  // Only the last instruction may return.
+  unsigned First = Starts.front();
+  for (unsigned I = First, E = First + Length - 1; I != E; ++I)
+    if (TII->getOutliningType(*InstrAt[I]) ==
+        TargetInstrInfo::MOT_LegalTerminator)
+      return false;
+  C.IsTailCall = TII->getOutliningType(*InstrAt[First + Length - 1]) ==
+                 TargetInstrInfo::MOT_LegalTerminator;
+
+  C.Length = Length;
+  C.Starts.clear();
+  for (unsigned Start : Starts) {
+    // Occurrences of the same sequence may overlap.
+    if (!C.Starts.empty() && Start < C.Starts.back() + Length)
+      continue;
+    MachineBasicBlock::iterator Begin = InstrAt[Start];
+    MachineBasicBlock::iterator End = std::next(InstrAt[Start + Length - 1]);
+    if (!C.IsTailCall &&
+        !TII->isLegalToOutlineWithCall(*Begin->getParent(), Begin, End))
+      continue;
+    C.Starts.push_back(Start);
+  }
+  if (C.Starts.size() < 2)
+    return false;
+
+  C.SequenceSize = 0;
+  for (unsigned I = First, E = First + Length; I != E; ++I)
+    C.SequenceSize += TII->getOutliningInstrSize(*InstrAt[I]);
+  C.Benefit = getBenefit(C, C.Starts.size());
+  return C.Benefit > 0;
+}
+
+void MachineOutliner::findCandidates(SuffixTree &ST,
+                                     std::vector<Candidate> &Candidates) {
+  // Every internal node below the root spells out a sequence that occurs once
+  // for each leaf below it.
+  SmallVector<SuffixTreeNode *, 32> Worklist;
+  Worklist.push_back(ST.Root);
+  while (!Worklist.empty()) {
+    SuffixTreeNode *N = Worklist.pop_back_val();
+    if (N->isLeaf())
+      continue;
+    for (auto &Child : N->Children)
+      Worklist.push_back(Child.second);
+    if (N->isRoot() || N->ConcatLen < MinSequenceLength)
+      continue;
+
+    std::vector<unsigned> Starts;
+    SmallVector<SuffixTreeNode *, 16> Leaves(1, N);
+    while (!Leaves.empty()) {
+      SuffixTreeNode *L = Leaves.pop_back_val();
+      if (L->isLeaf()) {
+        Starts.push_back(L->SuffixIdx);
+        continue;
+      }
+      for (auto &Child : L->Children)
+        Leaves.push_back(Child.second);
+    }
+
+    Candidate C;
+    if (buildCandidate(N->ConcatLen, Starts, C))
+      Candidates.push_back(std::move(C));
+  }
+}
+
+void MachineOutliner::outline(MachineFunction &MF, const Candidate &C) {
+  MachineBasicBlock *Outlined = MF.CreateMachineBasicBlock();
+  MF.push_back(Outlined);
+
+  // A sequence reached with a call needs a label to call.
+  MCSymbol *Sym = nullptr;
+  if (!C.IsTailCall) {
+    Sym = MF.getContext().createTempSymbol();
+    BuildMI(*Outlined, Outlined->end(), DebugLoc(),
+            TII->get(TargetOpcode::EH_LABEL))
+        .addSym(Sym);
+  }
+
+  // Copy the first occurrence. The occurrences may kill different registers,
+  // so drop the kill flags.
+  MachineBasicBlock::iterator Begin = InstrAt[C.Starts.front()];
+  for (unsigned I = 0; I != C.Length; ++I, ++Begin) {
+    MachineInstr *NewMI = MF.CloneMachineInstr(&*Begin);
+    for (MachineOperand &MO : NewMI->operands())
+      if (MO.isReg() && MO.isUse())
+        MO.setIsKill(false);
+    Outlined->insert(Outlined->end(), NewMI);
+  }
+  TII->buildOutlinedFrame(*Outlined, C.IsTailCall);
+
+  // The registers the sequence reads before writing them are live into the
+  // outlined block, and must be live at each call.
+  LivePhysRegs LiveRegs(TRI);
+  SmallVector<unsigned, 8> Defs;
+  for (MachineBasicBlock::reverse_iterator I = Outlined->rbegin(),
+                                           E = Outlined->rend();
+       I != E; ++I) {
+    LiveRegs.stepBackward(*I);
+    for (const MachineOperand &MO : I->operands())
+      if (MO.isReg() && MO.isDef() && MO.getReg())
+        Defs.push_back(MO.getReg());
+  }
+  for (unsigned Reg : LiveRegs)
+    Outlined->addLiveIn(Reg);
+  Outlined->sortUniqueLiveIns();
+  std::sort(Defs.begin(), Defs.end());
+  Defs.erase(std::unique(Defs.begin(), Defs.end()), Defs.end());
+
+  for (unsigned Start : C.Starts) {
+    MachineBasicBlock::iterator Begin = InstrAt[Start];
+    MachineBasicBlock::iterator End = std::next(InstrAt[Start + C.Length - 1]);
+    MachineBasicBlock &MBB = *Begin->getParent();
+
+    MachineInstr *Call =
+        TII->insertOutlinedCall(MBB, Begin, *Outlined, Sym, C.IsTailCall);
+    if (C.IsTailCall) {
+      MBB.addSuccessor(Outlined);
+    } else {
+      for (MachineBasicBlock::livein_iterator LI = Outlined->livein_begin(),
+                                              LE = Outlined->livein_end();
+           LI != LE; ++LI)
+        Call->addOperand(MachineOperand::CreateReg(*LI, /*isDef=*/false,
+                                                   /*isImp=*/true));
+      for (unsigned Reg : Defs)
+        Call->addOperand(MachineOperand::CreateReg(Reg, /*isDef=*/true,
+                                                   /*isImp=*/true));
+    }
+    MBB.erase(Begin, End);
+  }
+
+  DEBUG(dbgs() << "Outlined " << C.Length << " instructions from "
+               << C.Starts.size() << " places into BB#" << Outlined->getNumber()
+               << ", saving about " << C.Benefit << " bytes\n");
+  ++NumOutlined;
+  NumOccurrencesOutlined += C.Starts.size();
+  NumBytesSaved += C.Benefit;
+}
+
+bool MachineOutliner::runOnMachineFunction(MachineFunction &MF) {
+  if (skipOptnoneFunction(*MF.getFunction()) || MF.empty())
+    return false;
+
+  TII = MF.getSubtarget().getInstrInfo();
+  TRI = MF.getSubtarget().getRegisterInfo();
+  if (!TII->isFunctionSafeToOutlineFrom(MF))
+    return false;
+
+  // Outlined blocks are appended to the function, so the last block must not
+  // fall off its end.
+  const MachineBasicBlock &Last = MF.back();
+  if (Last.empty() || !Last.back().isBarrier())
+    return false;
+
+  Str.clear();
+  InstrAt.clear();
+  mapInstructions(MF);
+
+  std::vector<Candidate> Candidates;
+  {
+    SuffixTree ST(Str);
+    findCandidates(ST, Candidates);
+  }
+  if (Candidates.empty())
+    return false;
+
+  std::stable_sort(Candidates.begin(), Candidates.end(),
+                   [](const Candidate &A, const Candidate &B) {
+                     return A.Benefit > B.Benefit;
+                   });
+
+  // Pick candidates greedily, dropping occurrences that overlap instructions
+  // an earlier pick already takes.
+  BitVector Taken(Str.size());
+  std::vector<Candidate> Chosen;
+  for (Candidate &C : Candidates) {
+    auto Overlaps = [&](unsigned Start) {
+      for (unsigned I = Start, E = Start + C.Length; I != E; ++I)
+        if (Taken.test(I))
+          return true;
+      return false;
+    };
+    C.Starts.erase(std::remove_if(C.Starts.begin(), C.Starts.end(), Overlaps),
+                   C.Starts.end());
+    if (C.Starts.size() < 2)
+      continue;
+    C.Benefit = getBenefit(C, C.Starts.size());
+    if (C.Benefit <= 0)
+      continue;
+    for (unsigned Start : C.Starts)
+      Taken.set(Start, Start + C.Length);
+    Chosen.push_back(std::move(C));
+  }
+
+  for (const Candidate &C : Chosen)
+    outline(MF, C);
+  return !Chosen.empty();
+}
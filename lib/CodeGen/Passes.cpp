@@ -77,6 +77,10 @@ static cl::opt<bool> EnableImplicitNullChecks(
     "enable-implicit-null-checks",
     cl::desc("Fold null checks into faulting memory operations"),
     cl::init(false));
+static cl::opt<bool> EnableMachineOutliner(
+    "enable-machine-outliner",
+    cl::desc("Outline repeated instruction sequences to reduce code size"),
+    cl::init(false));
 static cl::opt<bool> PrintLSR("print-lsr-output", cl::Hidden,
     cl::desc("Print LLVM IR produced by the loop-reduce pass"));
 static cl::opt<bool> PrintISelInput("print-isel-input", cl::Hidden,
@@ -578,6 +582,9 @@ void TargetPassConfig::addMachinePasses() {
 
   addPass(&StackMapLivenessID, false);
 
+  if (EnableMachineOutliner)
+    addPass(&MachineOutlinerID);
+
   AddingMachinePasses = false;
 }
 
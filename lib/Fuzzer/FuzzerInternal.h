@@ -105,6 +105,7 @@ class Fuzzer {
   size_t RunOne(const Unit &U);
   void RunOneAndUpdateCorpus(const Unit &U);
   size_t RunOneMaximizeTotalCoverage(const Unit &U);
+  size_t UpdateInlineCounterBitmapAndClearCounters();
   size_t RunOneMaximizeFullCoverageSet(const Unit &U);
   size_t RunOneMaximizeCoveragePairs(const Unit &U);
   void WriteToOutputCorpus(const Unit &U);
@@ -139,11 +140,16 @@ class Fuzzer {
   // For UseCounters
   std::vector<uint8_t> CounterBitmap;
   size_t TotalBits() {  // Slow. Call it only for printing stats.
-    size_t Res = 0;
+    size_t Res = NumInlineCounterBits;
     for (auto x : CounterBitmap) Res += __builtin_popcount(x);
     return Res;
   }
 
+  // For the inline 8-bit counters: the ranges of values seen so far by
+  // each counter, one bit per range.
+  std::vector<uint8_t> InlineCounterBitmap;
+  size_t NumInlineCounterBits = 0;
+
   UserSuppliedFuzzer &USF;
   FuzzingOptions Options;
   system_clock::time_point ProcessStartTime = system_clock::now();
@@ -13,6 +13,29 @@
 #include <sanitizer/coverage_interface.h>
 #include <algorithm>
 
+// The inline 8-bit counters of the modules built with
+// -sanitizer-coverage-inline-8bit-counters. Each module constructor
+// registers its counter array before main() runs, so this has to be
+// statically initialized.
+static const size_t kMaxInlineCounterRegions = 1 << 12;
+static struct {
+  uint8_t *Start, *Stop;
+} InlineCounterRegions[kMaxInlineCounterRegions];
+static size_t NumInlineCounterRegions;
+static size_t NumInlineCounters;
+
+extern "C" {
+__attribute__((visibility("default")))
+void __sanitizer_cov_8bit_counters_init(uint8_t *Start, uint8_t *Stop) {
+  if (Start == Stop) return;
+  assert(NumInlineCounterRegions < kMaxInlineCounterRegions);
+  InlineCounterRegions[NumInlineCounterRegions].Start = Start;
+  InlineCounterRegions[NumInlineCounterRegions].Stop = Stop;
+  NumInlineCounterRegions++;
+  NumInlineCounters += Stop - Start;
+}
+}  // extern "C"
+
 namespace fuzzer {
 
 // Only one Fuzzer per process.
@@ -218,19 +241,60 @@ size_t Fuzzer::RunOneMaximizeFullCoverageSet(const Unit &U) {
   return 0;
 }
 
+// Map a counter value to one bit of its range:
+// 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+.
+static uint8_t CounterToBit(uint8_t Counter) {
+  if (Counter >= 128) return 128;
+  if (Counter >= 32) return 64;
+  if (Counter >= 16) return 32;
+  if (Counter >= 8) return 16;
+  if (Counter >= 4) return 8;
+  if (Counter >= 3) return 4;
+  if (Counter >= 2) return 2;
+  return 1;
+}
+
+// Record the ranges of the inline counters in InlineCounterBitmap and clear
+// the counters. Returns the number of bits set for the first time.
+size_t Fuzzer::UpdateInlineCounterBitmapAndClearCounters() {
+  if (!NumInlineCounters) return 0;
+  InlineCounterBitmap.resize(NumInlineCounters);
+  size_t NumNewBits = 0;
+  uint8_t *Bitmap = InlineCounterBitmap.data();
+  for (size_t R = 0; R < NumInlineCounterRegions; R++) {
+    uint8_t *Start = InlineCounterRegions[R].Start;
+    uint8_t *Stop = InlineCounterRegions[R].Stop;
+    for (uint8_t *P = Start; P < Stop; P++, Bitmap++) {
+      if (!*P) continue;
+      uint8_t Bit = CounterToBit(*P);
+      *P = 0;
+      if (*Bitmap & Bit) continue;
+      *Bitmap |= Bit;
+      NumNewBits++;
+    }
+  }
+  NumInlineCounterBits += NumNewBits;
+  return NumNewBits;
+}
+
 size_t Fuzzer::RunOneMaximizeTotalCoverage(const Unit &U) {
   size_t NumCounters = __sanitizer_get_number_of_counters();
   if (Options.UseCounters) {
     CounterBitmap.resize(NumCounters);
     __sanitizer_update_counter_bitset_and_clear_counters(0);
   }
-  size_t OldCoverage = __sanitizer_get_total_unique_coverage();
+  size_t OldCoverage =
+      __sanitizer_get_total_unique_coverage() + NumInlineCounterBits;
   ExecuteCallback(U);
   size_t NewCoverage = __sanitizer_get_total_unique_coverage();
   size_t NumNewBits = 0;
   if (Options.UseCounters)
     NumNewBits = __sanitizer_update_counter_bitset_and_clear_counters(
         CounterBitmap.data());
+  // The inline counters are the only coverage of the modules built with
+  // them, so their bits count as coverage too.
+  NumNewBits += UpdateInlineCounterBitmapAndClearCounters();
+  NewCoverage += NumInlineCounterBits;
 
   if (!(TotalNumberOfRuns & (TotalNumberOfRuns - 1)) && Options.Verbosity)
     PrintStats("pulse ", NewCoverage);
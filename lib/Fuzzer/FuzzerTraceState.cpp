@@ -13,6 +13,8 @@
 // interesting instructions. Currently supported traces:
 //   * __sanitizer_cov_trace_cmp -- inserted before every ICMP instruction,
 //    receives the type, size and arguments of ICMP.
+//   * __sanitizer_cov_trace_switch -- inserted before every switch
+//    instruction, receives the switch condition and the case values.
 //
 // Every time a traced event is intercepted we analyse the data involved
 // in the event and suggest a mutation for future executions.
@@ -182,6 +184,7 @@ class TraceState {
                         dfsan_label L2);
   void TraceCmpCallback(size_t CmpSize, size_t CmpType, uint64_t Arg1,
                         uint64_t Arg2);
+  void TraceSwitchCallback(uint64_t Val, uint64_t *Cases);
   int TryToAddDesiredData(uint64_t PresentData, uint64_t DesiredData,
                            size_t DataSize);
 
@@ -293,6 +296,18 @@ void TraceState::TraceCmpCallback(size_t CmpSize, size_t CmpType, uint64_t Arg1,
   }
 }
 
+// Cases is {NumCases, ValSizeInBits, Case0, Case1, ...}: try to turn Val
+// into each of the case values.
+void TraceState::TraceSwitchCallback(uint64_t Val, uint64_t *Cases) {
+  if (!RecordingTraces) return;
+  size_t NumCases = Cases[0];
+  size_t ValSize = Cases[1] / 8;
+  if (Options.Verbosity >= 3)
+    Printf("TraceSwitch: %zd %zd\n", Val, NumCases);
+  for (size_t i = 0; i < NumCases; i++)
+    TryToAddDesiredData(Val, Cases[2 + i], ValSize);
+}
+
 static TraceState *TS;
 
 void Fuzzer::StartTraceRecording() {
@@ -362,4 +377,9 @@ void __sanitizer_cov_trace_cmp(uint64_t SizeAndType, uint64_t Arg1,
   TS->TraceCmpCallback(CmpSize, Type, Arg1, Arg2);
 }
 
+void __sanitizer_cov_trace_switch(uint64_t Val, uint64_t *Cases) {
+  if (!TS) return;
+  TS->TraceSwitchCallback(Val, Cases);
+}
+
 }  // extern "C"
@@ -13,8 +13,16 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ProfileData/InstrProf.h"
+#include "InstrProfIndexed.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/ManagedStatic.h"
+#include <algorithm>
 
 using namespace llvm;
 
@@ -61,3 +69,96 @@ static ManagedStatic<InstrProfErrorCategoryType> ErrorCategory;
 const std::error_category &llvm::instrprof_category() {
   return *ErrorCategory;
 }
+
+std::error_code
+InstrProfRecord::mergeValueProfData(const InstrProfRecord &Other) {
+  if (IndirectCallSites.size() != Other.IndirectCallSites.size())
+    return instrprof_error::count_mismatch;
+
+  for (size_t I = 0, E = IndirectCallSites.size(); I < E; ++I) {
+    InstrProfValueSite &Site = IndirectCallSites[I];
+    for (const InstrProfValueData &VD : Other.IndirectCallSites[I]) {
+      auto Found = std::find_if(Site.begin(), Site.end(),
+                                [&](const InstrProfValueData &Existing) {
+                                  return Existing.Value == VD.Value;
+                                });
+      if (Found == Site.end()) {
+        Site.push_back(VD);
+        continue;
+      }
+      if (Found->Count + VD.Count < Found->Count)
+        return instrprof_error::counter_overflow;
+      Found->Count += VD.Count;
+    }
+  }
+  return instrprof_error::success;
+}
+
+std::string llvm::getPGOFuncName(const Function &F) {
+  if (F.hasLocalLinkage())
+    return (F.getParent()->getModuleIdentifier() + ":" + F.getName()).str();
+  return F.getName();
+}
+
+uint64_t llvm::getPGOFuncNameHash(StringRef FuncName) {
+  return IndexedInstrProf::MD5Hash(FuncName);
+}
+
+void llvm::annotateValueSite(Instruction &Inst, InstrProfValueKind ValueKind,
+                             ArrayRef<InstrProfValueData> VDs, uint64_t Sum,
+                             uint32_t MaxNumValues) {
+  if (Sum == 0 || VDs.empty())
+    return;
+
+  SmallVector<InstrProfValueData, 8> Sorted(VDs.begin(), VDs.end());
+  std::stable_sort(Sorted.begin(), Sorted.end(),
+                   [](const InstrProfValueData &L, const InstrProfValueData &R) {
+                     return L.Count > R.Count;
+                   });
+  if (Sorted.size() > MaxNumValues)
+    Sorted.resize(MaxNumValues);
+
+  LLVMContext &Ctx = Inst.getContext();
+  MDBuilder MDB(Ctx);
+  Type *Int32Ty = Type::getInt32Ty(Ctx);
+  Type *Int64Ty = Type::getInt64Ty(Ctx);
+  SmallVector<Metadata *, 8> Vals;
+  Vals.push_back(MDB.createString("VP"));
+  Vals.push_back(MDB.createConstant(ConstantInt::get(Int32Ty, ValueKind)));
+  Vals.push_back(MDB.createConstant(ConstantInt::get(Int64Ty, Sum)));
+  for (const InstrProfValueData &VD : Sorted) {
+    Vals.push_back(MDB.createConstant(ConstantInt::get(Int64Ty, VD.Value)));
+    Vals.push_back(MDB.createConstant(ConstantInt::get(Int64Ty, VD.Count)));
+  }
+  Inst.setMetadata(LLVMContext::MD_prof, MDNode::get(Ctx, Vals));
+}
+
+bool llvm::getValueProfDataFromInst(
+    const Instruction &Inst, InstrProfValueKind ValueKind,
+    SmallVectorImpl<InstrProfValueData> &ValueData, uint64_t &TotalCount) {
+  MDNode *MD = Inst.getMetadata(LLVMContext::MD_prof);
+  if (!MD || MD->getNumOperands() < 5 || MD->getNumOperands() % 2 == 0)
+    return false;
+  MDString *Tag = dyn_cast<MDString>(MD->getOperand(0));
+  if (!Tag || Tag->getString() != "VP")
+    return false;
+
+  ConstantInt *KindInt = mdconst::dyn_extract<ConstantInt>(MD->getOperand(1));
+  if (!KindInt || KindInt->getZExtValue() != ValueKind)
+    return false;
+  ConstantInt *TotalInt = mdconst::dyn_extract<ConstantInt>(MD->getOperand(2));
+  if (!TotalInt)
+    return false;
+  TotalCount = TotalInt->getZExtValue();
+
+  ValueData.clear();
+  for (unsigned I = 3, E = MD->getNumOperands(); I < E; I += 2) {
+    ConstantInt *Value = mdconst::dyn_extract<ConstantInt>(MD->getOperand(I));
+    ConstantInt *Count =
+        mdconst::dyn_extract<ConstantInt>(MD->getOperand(I + 1));
+    if (!Value || !Count)
+      return false;
+    ValueData.push_back({Value->getZExtValue(), Count->getZExtValue()});
+  }
+  return true;
+}
@@ -47,7 +47,8 @@ static inline uint64_t ComputeHash(HashT Type, StringRef K) {
 }
 
 const uint64_t Magic = 0x8169666f72706cff; // "\xfflprofi\x81"
-const uint64_t Version = 2;
+// Version 3 adds the value profile of each function after its counts.
+const uint64_t Version = 3;
 const HashT HashType = HashT::MD5;
 }
 
@@ -136,6 +136,35 @@ std::error_code TextInstrProfReader::readNextRecord(InstrProfRecord &Record) {
     Record.Counts.push_back(Count);
   }
 
+  // Read the value profile, if any: an integer after the counts is the number
+  // of indirect call sites rather than the name of the next function.
+  Record.IndirectCallSites.clear();
+  uint64_t NumSites;
+  if (Line.is_at_end() || Line->getAsInteger(10, NumSites))
+    return success();
+  ++Line;
+  for (uint64_t S = 0; S < NumSites; ++S) {
+    uint64_t NumValues;
+    if (Line.is_at_end())
+      return error(instrprof_error::truncated);
+    if ((Line++)->getAsInteger(10, NumValues))
+      return error(instrprof_error::malformed);
+
+    InstrProfValueSite Site;
+    for (uint64_t V = 0; V < NumValues; ++V) {
+      if (Line.is_at_end())
+        return error(instrprof_error::truncated);
+      // Local function names contain a colon, so split at the last one.
+      std::pair<StringRef, StringRef> NameAndCount = (Line++)->rsplit(':');
+      uint64_t Count;
+      if (NameAndCount.first.empty() ||
+          NameAndCount.second.getAsInteger(10, Count))
+        return error(instrprof_error::malformed);
+      Site.push_back({getPGOFuncNameHash(NameAndCount.first), Count});
+    }
+    Record.IndirectCallSites.push_back(std::move(Site));
+  }
+
   return success();
 }
 
@@ -283,6 +312,8 @@ RawInstrProfReader<IntPtrT>::readNextRecord(InstrProfRecord &Record) {
       Record.Counts.push_back(swap(Count));
   } else
     Record.Counts = RawCounts;
+  // The raw format doesn't carry value profile data.
+  Record.IndirectCallSites.clear();
 
   // Iterate.
   ++Data;
@@ -338,6 +369,32 @@ data_type InstrProfLookupTrait::ReadData(StringRef K, const unsigned char *D,
       CounterBuffer.push_back(endian::readNext<uint64_t, little, unaligned>(D));
 
     DataBuffer.push_back(InstrProfRecord(K, Hash, std::move(CounterBuffer)));
+
+    // Since v3, the value profile follows the counts.
+    if (FormatVersion < 3)
+      continue;
+    I += NumCounts;
+    NumCounts = 0;
+    if (I >= NumEntries)
+      return data_type();
+    uint64_t NumSites = endian::readNext<uint64_t, little, unaligned>(D);
+    ++I;
+    auto &Sites = DataBuffer.back().IndirectCallSites;
+    for (uint64_t S = 0; S < NumSites; ++S) {
+      if (I >= NumEntries)
+        return data_type();
+      uint64_t NumValues = endian::readNext<uint64_t, little, unaligned>(D);
+      ++I;
+      if (I + 2 * NumValues > NumEntries)
+        return data_type();
+      Sites.emplace_back();
+      for (uint64_t V = 0; V < NumValues; ++V) {
+        uint64_t Value = endian::readNext<uint64_t, little, unaligned>(D);
+        uint64_t Count = endian::readNext<uint64_t, little, unaligned>(D);
+        Sites.back().push_back({Value, Count});
+      }
+      I += 2 * NumValues;
+    }
   }
   return DataBuffer;
 }
@@ -390,8 +447,9 @@ std::error_code IndexedInstrProfReader::readHeader() {
   return success();
 }
 
-std::error_code IndexedInstrProfReader::getFunctionCounts(
-    StringRef FuncName, uint64_t FuncHash, std::vector<uint64_t> &Counts) {
+ErrorOr<InstrProfRecord>
+IndexedInstrProfReader::getInstrProfRecord(StringRef FuncName,
+                                           uint64_t FuncHash) {
   auto Iter = Index->find(FuncName);
   if (Iter == Index->end())
     return error(instrprof_error::unknown_function);
@@ -402,15 +460,23 @@ std::error_code IndexedInstrProfReader::getFunctionCounts(
     return error(instrprof_error::malformed);
 
   for (unsigned I = 0, E = Data.size(); I < E; ++I) {
-    // Check for a match and fill the vector if there is one.
-    if (Data[I].Hash == FuncHash) {
-      Counts = Data[I].Counts;
-      return success();
-    }
+    // Check for a match and return the record if there is one.
+    if (Data[I].Hash == FuncHash)
+      return Data[I];
   }
   return error(instrprof_error::hash_mismatch);
 }
 
+std::error_code IndexedInstrProfReader::getFunctionCounts(
+    StringRef FuncName, uint64_t FuncHash, std::vector<uint64_t> &Counts) {
+  ErrorOr<InstrProfRecord> Record = getInstrProfRecord(FuncName, FuncHash);
+  if (std::error_code EC = Record.getError())
+    return EC;
+
+  Counts = Record.get().Counts;
+  return success();
+}
+
 std::error_code
 IndexedInstrProfReader::readNextRecord(InstrProfRecord &Record) {
   // Are we out of records?
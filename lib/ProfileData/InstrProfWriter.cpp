@@ -26,8 +26,8 @@ public:
   typedef StringRef key_type;
   typedef StringRef key_type_ref;
 
-  typedef const InstrProfWriter::CounterData *const data_type;
-  typedef const InstrProfWriter::CounterData *const data_type_ref;
+  typedef const InstrProfWriter::ProfilingData *const data_type;
+  typedef const InstrProfWriter::ProfilingData *const data_type_ref;
 
   typedef uint64_t hash_value_type;
   typedef uint64_t offset_type;
@@ -45,8 +45,12 @@ public:
     LE.write<offset_type>(N);
 
     offset_type M = 0;
-    for (const auto &Counts : *V)
-      M += (2 + Counts.second.size()) * sizeof(uint64_t);
+    for (const auto &ProfileData : *V) {
+      const InstrProfRecord &Record = ProfileData.second;
+      M += (3 + Record.Counts.size()) * sizeof(uint64_t);
+      for (const InstrProfValueSite &Site : Record.IndirectCallSites)
+        M += (1 + 2 * Site.size()) * sizeof(uint64_t);
+    }
     LE.write<offset_type>(M);
 
     return std::make_pair(N, M);
@@ -61,11 +65,22 @@ public:
     using namespace llvm::support;
     endian::Writer<little> LE(Out);
 
-    for (const auto &Counts : *V) {
-      LE.write<uint64_t>(Counts.first);
-      LE.write<uint64_t>(Counts.second.size());
-      for (uint64_t I : Counts.second)
+    for (const auto &ProfileData : *V) {
+      const InstrProfRecord &Record = ProfileData.second;
+      LE.write<uint64_t>(ProfileData.first);
+      LE.write<uint64_t>(Record.Counts.size());
+      for (uint64_t I : Record.Counts)
         LE.write<uint64_t>(I);
+
+      // Since version 3, the value profile follows the counts.
+      LE.write<uint64_t>(Record.IndirectCallSites.size());
+      for (const InstrProfValueSite &Site : Record.IndirectCallSites) {
+        LE.write<uint64_t>(Site.size());
+        for (const InstrProfValueData &VD : Site) {
+          LE.write<uint64_t>(VD.Value);
+          LE.write<uint64_t>(VD.Count);
+        }
+      }
     }
   }
 };
@@ -75,33 +90,43 @@ std::error_code
 InstrProfWriter::addFunctionCounts(StringRef FunctionName,
                                    uint64_t FunctionHash,
                                    ArrayRef<uint64_t> Counters) {
-  auto &CounterData = FunctionData[FunctionName];
+  return addRecord(InstrProfRecord(FunctionName, FunctionHash, Counters));
+}
+
+std::error_code InstrProfWriter::addRecord(const InstrProfRecord &I) {
+  auto &ProfileDataMap = FunctionData[I.Name];
 
-  auto Where = CounterData.find(FunctionHash);
-  if (Where == CounterData.end()) {
+  auto Where = ProfileDataMap.find(I.Hash);
+  if (Where == ProfileDataMap.end()) {
     // We've never seen a function with this name and hash, add it.
-    CounterData[FunctionHash] = Counters;
+    InstrProfRecord &Record = ProfileDataMap[I.Hash];
+    Record = I;
+    // The name is owned by the reader: point it to our own copy instead.
+    Record.Name = FunctionData.find(I.Name)->getKey();
     // We keep track of the max function count as we go for simplicity.
-    if (Counters[0] > MaxFunctionCount)
-      MaxFunctionCount = Counters[0];
+    if (I.Counts[0] > MaxFunctionCount)
+      MaxFunctionCount = I.Counts[0];
     return instrprof_error::success;
   }
 
   // We're updating a function we've seen before.
-  auto &FoundCounters = Where->second;
+  InstrProfRecord &Found = Where->second;
   // If the number of counters doesn't match we either have bad data or a hash
   // collision.
-  if (FoundCounters.size() != Counters.size())
+  if (Found.Counts.size() != I.Counts.size() ||
+      Found.IndirectCallSites.size() != I.IndirectCallSites.size())
     return instrprof_error::count_mismatch;
 
-  for (size_t I = 0, E = Counters.size(); I < E; ++I) {
-    if (FoundCounters[I] + Counters[I] < FoundCounters[I])
+  for (size_t J = 0, E = I.Counts.size(); J < E; ++J) {
+    if (Found.Counts[J] + I.Counts[J] < Found.Counts[J])
       return instrprof_error::counter_overflow;
-    FoundCounters[I] += Counters[I];
+    Found.Counts[J] += I.Counts[J];
   }
+  if (std::error_code EC = Found.mergeValueProfData(I))
+    return EC;
   // We keep track of the max function count as we go for simplicity.
-  if (FoundCounters[0] > MaxFunctionCount)
-    MaxFunctionCount = FoundCounters[0];
+  if (Found.Counts[0] > MaxFunctionCount)
+    MaxFunctionCount = Found.Counts[0];
 
   return instrprof_error::success;
 }
@@ -8,10 +8,10 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements the class that reads LLVM sample profiles. It
-// supports two file formats: text and binary. The textual representation
-// is useful for debugging and testing purposes. The binary representation
-// is more compact, resulting in smaller file sizes. However, they can
-// both be used interchangeably.
+// supports three file formats: text, binary and compact binary. The textual
+// representation is useful for debugging and testing purposes. The binary
+// representations are more compact, resulting in smaller file sizes.
+// However, they can all be used interchangeably.
 //
 // NOTE: If you are making changes to the file format, please remember
 //       to document them in the Clang documentation at
@@ -92,6 +92,62 @@
 //    instruction that calls one of ``foo()``, ``bar()`` and ``baz()``,
 //    with ``baz()`` being the relatively more frequently called target.
 //
+// e. [OPTIONAL] Inlined call sites. A line of the form
+//
+//      offset[.discriminator]: fn:total_samples
+//
+//    means that ``fn`` was inlined at that location in the profiled binary.
+//    It is followed by the samples collected in the inlined copy of ``fn``,
+//    on lines indented deeper than the call site line, which may in turn
+//    contain inlined call sites. Their offsets are relative to the line
+//    where ``fn`` is defined. For example,
+//
+//      main:1000:10
+//      1: 10
+//      2: _Z3fooi:800
+//       1: 600
+//       2: _Z3bari:200
+//        1: 200
+//      3: 190
+//
+//    means that ``foo`` was inlined at line offset 2 of ``main``, and that
+//    ``bar`` was inlined at line offset 2 of that copy of ``foo``.
+//
+// Binary format
+// -------------
+//
+// The binary format stores the same information as the text format:
+//
+//     magic, version
+//     function_name NUL, profile
+//     ...
+//
+// where a profile is
+//
+//     total_samples, head_samples, num_records,
+//       (offset, discriminator, samples, num_calls, (name NUL, samples)*)*
+//     num_inlined_call_sites,
+//       (offset, discriminator, name NUL, profile)*
+//
+// and all the numbers are ULEB128 encoded. Version 100 files have no
+// inlined call sites.
+//
+// Compact binary format
+// ---------------------
+//
+// The compact binary format stores every function name once, in a name
+// table, and refers to them by their index in the table. It also starts
+// with an index of the function profiles, so that a reader only decodes
+// the profiles of the functions it needs:
+//
+//     magic, version
+//     num_names, (name NUL)*
+//     num_functions, (name_index, profile_offset)*
+//     profile*
+//
+// where the profiles have the binary format layout, with name indices in
+// place of the names, and the offsets are relative to the first profile.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ProfileData/SampleProfReader.h"
@@ -108,12 +164,15 @@ using namespace llvm;
 /// \brief Print the samples collected for a function on stream \p OS.
 ///
 /// \param OS Stream to emit the output to.
-void FunctionSamples::print(raw_ostream &OS) {
+///
+/// \param Indent Depth of the inline stack the function is at.
+void FunctionSamples::print(raw_ostream &OS, unsigned Indent) const {
   OS << TotalSamples << ", " << TotalHeadSamples << ", " << BodySamples.size()
      << " sampled lines\n";
   for (const auto &SI : BodySamples) {
     LineLocation Loc = SI.first;
     const SampleRecord &Sample = SI.second;
+    OS.indent(Indent);
     OS << "\tline offset: " << Loc.LineOffset
        << ", discriminator: " << Loc.Discriminator
        << ", number of samples: " << Sample.getSamples();
@@ -124,7 +183,18 @@ void FunctionSamples::print(raw_ostream &OS) {
     }
     OS << "\n";
   }
-  OS << "\n";
+  for (const auto &CI : CallsiteSamples) {
+    LineLocation Loc = CI.first;
+    for (const auto &FI : CI.second) {
+      OS.indent(Indent);
+      OS << "\tline offset: " << Loc.LineOffset
+         << ", discriminator: " << Loc.Discriminator
+         << ", inlined callee: " << FI.first() << ": ";
+      FI.second.print(OS, Indent + 2);
+    }
+  }
+  if (Indent == 0)
+    OS << "\n";
 }
 
 /// \brief Dump the function profile for \p FName.
@@ -157,6 +227,7 @@ std::error_code SampleProfileReaderText::read() {
   // accumulate samples as we parse them.
   Regex HeadRE("^([^0-9].*):([0-9]+):([0-9]+)$");
   Regex LineSampleRE("^([0-9]+)\\.?([0-9]+)?: ([0-9]+)(.*)$");
+  Regex InlineSiteRE("^([0-9]+)\\.?([0-9]+)?: ([^0-9 ][^ ]*):([0-9]+)$");
   Regex CallSampleRE(" +([^0-9 ][^ ]*):([0-9]+)");
   while (!LineIt.is_at_eof()) {
     // Read the header of each function.
@@ -189,9 +260,35 @@ std::error_code SampleProfileReaderText::read() {
     ++LineIt;
 
     // Now read the body. The body of the function ends when we reach
-    // EOF or when we see the start of the next function.
-    while (!LineIt.is_at_eof() && isdigit((*LineIt)[0])) {
-      if (!LineSampleRE.match(*LineIt, &Matches)) {
+    // EOF or when we see the start of the next function. The stack holds
+    // the profiles of the inlined functions the following lines may belong
+    // to, along with the minimum indentation of their lines.
+    SmallVector<std::pair<size_t, FunctionSamples *>, 8> InlineStack;
+    InlineStack.push_back(std::make_pair(0, &FProfile));
+    while (!LineIt.is_at_eof() &&
+           (isdigit((*LineIt)[0]) || (*LineIt)[0] == ' ')) {
+      size_t Depth = LineIt->find_first_not_of(' ');
+      StringRef Line = LineIt->substr(Depth);
+      while (Depth < InlineStack.back().first)
+        InlineStack.pop_back();
+      FunctionSamples &FS = *InlineStack.back().second;
+
+      if (InlineSiteRE.match(Line, &Matches)) {
+        assert(Matches.size() == 5);
+        unsigned LineOffset, NumSamples, Discriminator = 0;
+        Matches[1].getAsInteger(10, LineOffset);
+        if (Matches[2] != "")
+          Matches[2].getAsInteger(10, Discriminator);
+        Matches[4].getAsInteger(10, NumSamples);
+        FunctionSamples &Callee = FS.functionSamplesAt(
+            LineLocation(LineOffset, Discriminator))[Matches[3]];
+        Callee.addTotalSamples(NumSamples);
+        InlineStack.push_back(std::make_pair(Depth + 1, &Callee));
+        ++LineIt;
+        continue;
+      }
+
+      if (!LineSampleRE.match(Line, &Matches)) {
         reportParseError(
             LineIt.line_number(),
             "Expected 'NUM[.NUM]: NUM[ mangled_name:NUM]*', found " + *LineIt);
@@ -217,12 +314,12 @@ std::error_code SampleProfileReaderText::read() {
         StringRef CalledFunction = CallSample[1];
         unsigned CalledFunctionSamples;
         CallSample[2].getAsInteger(10, CalledFunctionSamples);
-        FProfile.addCalledTargetSamples(LineOffset, Discriminator,
-                                        CalledFunction, CalledFunctionSamples);
+        FS.addCalledTargetSamples(LineOffset, Discriminator, CalledFunction,
+                                  CalledFunctionSamples);
         CallsLine = CallSampleRE.sub("", CallsLine);
       }
 
-      FProfile.addBodySamples(LineOffset, Discriminator, NumSamples);
+      FS.addBodySamples(LineOffset, Discriminator, NumSamples);
       ++LineIt;
     }
   }
@@ -264,62 +361,93 @@ ErrorOr<StringRef> SampleProfileReaderBinary::readString() {
   return Str;
 }
 
-std::error_code SampleProfileReaderBinary::read() {
-  while (!at_eof()) {
-    auto FName(readString());
-    if (std::error_code EC = FName.getError())
-      return EC;
+std::error_code
+SampleProfileReaderBinary::readProfile(FunctionSamples &FProfile) {
+  auto Val = readNumber<unsigned>();
+  if (std::error_code EC = Val.getError())
+    return EC;
+  FProfile.addTotalSamples(*Val);
 
-    Profiles[*FName] = FunctionSamples();
-    FunctionSamples &FProfile = Profiles[*FName];
+  Val = readNumber<unsigned>();
+  if (std::error_code EC = Val.getError())
+    return EC;
+  FProfile.addHeadSamples(*Val);
 
-    auto Val = readNumber<unsigned>();
-    if (std::error_code EC = Val.getError())
+  // Read the samples in the body.
+  auto NumRecords = readNumber<unsigned>();
+  if (std::error_code EC = NumRecords.getError())
+    return EC;
+  for (unsigned I = 0; I < *NumRecords; ++I) {
+    auto LineOffset = readNumber<uint64_t>();
+    if (std::error_code EC = LineOffset.getError())
       return EC;
-    FProfile.addTotalSamples(*Val);
 
-    Val = readNumber<unsigned>();
-    if (std::error_code EC = Val.getError())
+    auto Discriminator = readNumber<uint64_t>();
+    if (std::error_code EC = Discriminator.getError())
       return EC;
-    FProfile.addHeadSamples(*Val);
 
-    // Read the samples in the body.
-    auto NumRecords = readNumber<unsigned>();
-    if (std::error_code EC = NumRecords.getError())
+    auto NumSamples = readNumber<uint64_t>();
+    if (std::error_code EC = NumSamples.getError())
       return EC;
-    for (unsigned I = 0; I < *NumRecords; ++I) {
-      auto LineOffset = readNumber<uint64_t>();
-      if (std::error_code EC = LineOffset.getError())
-        return EC;
 
-      auto Discriminator = readNumber<uint64_t>();
-      if (std::error_code EC = Discriminator.getError())
-        return EC;
+    auto NumCalls = readNumber<unsigned>();
+    if (std::error_code EC = NumCalls.getError())
+      return EC;
 
-      auto NumSamples = readNumber<uint64_t>();
-      if (std::error_code EC = NumSamples.getError())
+    for (unsigned J = 0; J < *NumCalls; ++J) {
+      auto CalledFunction(readName());
+      if (std::error_code EC = CalledFunction.getError())
         return EC;
 
-      auto NumCalls = readNumber<unsigned>();
-      if (std::error_code EC = NumCalls.getError())
+      auto CalledFunctionSamples = readNumber<uint64_t>();
+      if (std::error_code EC = CalledFunctionSamples.getError())
         return EC;
 
-      for (unsigned J = 0; J < *NumCalls; ++J) {
-        auto CalledFunction(readString());
-        if (std::error_code EC = CalledFunction.getError())
-          return EC;
+      FProfile.addCalledTargetSamples(*LineOffset, *Discriminator,
+                                      *CalledFunction, *CalledFunctionSamples);
+    }
+
+    FProfile.addBodySamples(*LineOffset, *Discriminator, *NumSamples);
+  }
 
-        auto CalledFunctionSamples = readNumber<uint64_t>();
-        if (std::error_code EC = CalledFunctionSamples.getError())
-          return EC;
+  if (!HasInlineStacks)
+    return sampleprof_error::success;
 
-        FProfile.addCalledTargetSamples(*LineOffset, *Discriminator,
-                                        *CalledFunction,
-                                        *CalledFunctionSamples);
-      }
+  // Read the profiles of the inlined call sites.
+  auto NumCallsites = readNumber<unsigned>();
+  if (std::error_code EC = NumCallsites.getError())
+    return EC;
+  for (unsigned I = 0; I < *NumCallsites; ++I) {
+    auto LineOffset = readNumber<uint64_t>();
+    if (std::error_code EC = LineOffset.getError())
+      return EC;
 
-      FProfile.addBodySamples(*LineOffset, *Discriminator, *NumSamples);
-    }
+    auto Discriminator = readNumber<uint64_t>();
+    if (std::error_code EC = Discriminator.getError())
+      return EC;
+
+    auto CalleeName(readName());
+    if (std::error_code EC = CalleeName.getError())
+      return EC;
+
+    FunctionSamples &CalleeProfile = FProfile.functionSamplesAt(
+        LineLocation(*LineOffset, *Discriminator))[*CalleeName];
+    if (std::error_code EC = readProfile(CalleeProfile))
+      return EC;
+  }
+
+  return sampleprof_error::success;
+}
+
+std::error_code SampleProfileReaderBinary::read() {
+  while (!at_eof()) {
+    auto FName(readString());
+    if (std::error_code EC = FName.getError())
+      return EC;
+
+    Profiles[*FName] = FunctionSamples();
+    if (std::error_code EC = readProfile(Profiles[*FName]))
+      return EC;
   }
 
   return sampleprof_error::success;
@@ -340,8 +468,9 @@ std::error_code SampleProfileReaderBinary::readHeader() {
   auto Version = readNumber<uint64_t>();
   if (std::error_code EC = Version.getError())
     return EC;
-  else if (*Version != SPVersion())
+  else if (*Version != SPVersion() && *Version != 100)
     return sampleprof_error::unsupported_version;
+  HasInlineStacks = *Version != 100;
 
   return sampleprof_error::success;
 }
@@ -353,6 +482,114 @@ bool SampleProfileReaderBinary::hasFormat(const MemoryBuffer &Buffer) {
   return Magic == SPMagic();
 }
 
+std::error_code SampleProfileReaderCompactBinary::readHeader() {
+  Data = reinterpret_cast<const uint8_t *>(Buffer->getBufferStart());
+  End = Data + Buffer->getBufferSize();
+  HasInlineStacks = true;
+
+  // Read and check the magic identifier.
+  auto Magic = readNumber<uint64_t>();
+  if (std::error_code EC = Magic.getError())
+    return EC;
+  else if (*Magic != SPCompactMagic())
+    return sampleprof_error::bad_magic;
+
+  // Read the version number.
+  auto Version = readNumber<uint64_t>();
+  if (std::error_code EC = Version.getError())
+    return EC;
+  else if (*Version != SPCompactVersion())
+    return sampleprof_error::unsupported_version;
+
+  // Read the name table.
+  auto NumNames = readNumber<unsigned>();
+  if (std::error_code EC = NumNames.getError())
+    return EC;
+  NameTable.reserve(*NumNames);
+  for (unsigned I = 0; I < *NumNames; ++I) {
+    auto Name(readString());
+    if (std::error_code EC = Name.getError())
+      return EC;
+    NameTable.push_back(*Name);
+  }
+
+  // Read the function index.
+  auto NumFuncs = readNumber<unsigned>();
+  if (std::error_code EC = NumFuncs.getError())
+    return EC;
+  for (unsigned I = 0; I < *NumFuncs; ++I) {
+    auto FName(readName());
+    if (std::error_code EC = FName.getError())
+      return EC;
+
+    auto Offset = readNumber<uint64_t>();
+    if (std::error_code EC = Offset.getError())
+      return EC;
+    FuncOffsets[*FName] = *Offset;
+  }
+  ProfilesStart = Data;
+
+  return sampleprof_error::success;
+}
+
+ErrorOr<StringRef> SampleProfileReaderCompactBinary::readName() {
+  auto Idx = readNumber<unsigned>();
+  if (std::error_code EC = Idx.getError())
+    return EC;
+  if (*Idx >= NameTable.size()) {
+    std::error_code EC = sampleprof_error::malformed;
+    reportParseError(0, EC.message());
+    return EC;
+  }
+  return NameTable[*Idx];
+}
+
+std::error_code
+SampleProfileReaderCompactBinary::readFunctionProfile(StringRef FName,
+                                                      uint64_t Offset) {
+  if (Offset >= uint64_t(End - ProfilesStart)) {
+    std::error_code EC = sampleprof_error::truncated;
+    reportParseError(0, EC.message());
+    return EC;
+  }
+  Data = ProfilesStart + Offset;
+  Profiles[FName] = FunctionSamples();
+  return readProfile(Profiles[FName]);
+}
+
+std::error_code SampleProfileReaderCompactBinary::read() {
+  if (UseAllFuncs) {
+    for (const auto &I : FuncOffsets)
+      if (std::error_code EC = readFunctionProfile(I.first, I.second))
+        return EC;
+    return sampleprof_error::success;
+  }
+
+  for (StringRef FName : FuncsToUse) {
+    auto I = FuncOffsets.find(FName);
+    if (I == FuncOffsets.end())
+      continue;
+    if (std::error_code EC = readFunctionProfile(I->first, I->second))
+      return EC;
+  }
+  return sampleprof_error::success;
+}
+
+void SampleProfileReaderCompactBinary::collectFuncsToUse(const Module &M) {
+  UseAllFuncs = false;
+  FuncsToUse.clear();
+  for (const auto &F : M)
+    if (!F.isDeclaration())
+      FuncsToUse.push_back(F.getName());
+}
+
+bool SampleProfileReaderCompactBinary::hasFormat(const MemoryBuffer &Buffer) {
+  const uint8_t *Data =
+      reinterpret_cast<const uint8_t *>(Buffer.getBufferStart());
+  uint64_t Magic = decodeULEB128(Data);
+  return Magic == SPCompactMagic();
+}
+
 /// \brief Prepare a memory buffer for the contents of \p Filename.
 ///
 /// \returns an error code indicating the status of the buffer.
@@ -387,7 +624,9 @@ SampleProfileReader::create(StringRef Filename, LLVMContext &C) {
 
   auto Buffer = std::move(BufferOrError.get());
   std::unique_ptr<SampleProfileReader> Reader;
-  if (SampleProfileReaderBinary::hasFormat(*Buffer))
+  if (SampleProfileReaderCompactBinary::hasFormat(*Buffer))
+    Reader.reset(new SampleProfileReaderCompactBinary(std::move(Buffer), C));
+  else if (SampleProfileReaderBinary::hasFormat(*Buffer))
     Reader.reset(new SampleProfileReaderBinary(std::move(Buffer), C));
   else
     Reader.reset(new SampleProfileReaderText(std::move(Buffer), C));
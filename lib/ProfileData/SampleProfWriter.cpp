@@ -8,10 +8,10 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements the class that writes LLVM sample profiles. It
-// supports two file formats: text and binary. The textual representation
-// is useful for debugging and testing purposes. The binary representation
-// is more compact, resulting in smaller file sizes. However, they can
-// both be used interchangeably.
+// supports three file formats: text, binary and compact binary. The textual
+// representation is useful for debugging and testing purposes. The binary
+// representations are more compact, resulting in smaller file sizes.
+// However, they can all be used interchangeably.
 //
 // See lib/ProfileData/SampleProfReader.cpp for documentation on each of the
 // supported formats.
@@ -36,10 +36,16 @@ bool SampleProfileWriterText::write(StringRef FName, const FunctionSamples &S) {
 
   OS << FName << ":" << S.getTotalSamples() << ":" << S.getHeadSamples()
      << "\n";
+  writeBody(S, 0);
+  return true;
+}
 
+void SampleProfileWriterText::writeBody(const FunctionSamples &S,
+                                        unsigned Indent) {
   for (const auto &I : S.getBodySamples()) {
     LineLocation Loc = I.first;
     const SampleRecord &Sample = I.second;
+    OS.indent(Indent);
     if (Loc.Discriminator == 0)
       OS << Loc.LineOffset << ": ";
     else
@@ -52,18 +58,74 @@ bool SampleProfileWriterText::write(StringRef FName, const FunctionSamples &S) {
     OS << "\n";
   }
 
-  return true;
+  for (const auto &I : S.getCallsiteSamples()) {
+    LineLocation Loc = I.first;
+    for (const auto &J : I.second) {
+      OS.indent(Indent);
+      if (Loc.Discriminator == 0)
+        OS << Loc.LineOffset << ": ";
+      else
+        OS << Loc.LineOffset << "." << Loc.Discriminator << ": ";
+      OS << J.first() << ":" << J.second.getTotalSamples() << "\n";
+      writeBody(J.second, Indent + 1);
+    }
+  }
 }
 
 SampleProfileWriterBinary::SampleProfileWriterBinary(StringRef F,
                                                      std::error_code &EC)
+    : SampleProfileWriterBinary(F, EC, SPMagic(), SPVersion()) {}
+
+SampleProfileWriterBinary::SampleProfileWriterBinary(StringRef F,
+                                                     std::error_code &EC,
+                                                     uint64_t Magic,
+                                                     uint64_t Version)
     : SampleProfileWriter(F, EC, sys::fs::F_None) {
   if (EC)
     return;
 
   // Write the file header.
-  encodeULEB128(SPMagic(), OS);
-  encodeULEB128(SPVersion(), OS);
+  encodeULEB128(Magic, OS);
+  encodeULEB128(Version, OS);
+}
+
+void SampleProfileWriterBinary::writeName(raw_ostream &Out, StringRef FName) {
+  Out << FName;
+  encodeULEB128(0, Out);
+}
+
+void SampleProfileWriterBinary::writeProfile(raw_ostream &Out,
+                                             const FunctionSamples &S) {
+  encodeULEB128(S.getTotalSamples(), Out);
+  encodeULEB128(S.getHeadSamples(), Out);
+  encodeULEB128(S.getBodySamples().size(), Out);
+  for (const auto &I : S.getBodySamples()) {
+    LineLocation Loc = I.first;
+    const SampleRecord &Sample = I.second;
+    encodeULEB128(Loc.LineOffset, Out);
+    encodeULEB128(Loc.Discriminator, Out);
+    encodeULEB128(Sample.getSamples(), Out);
+    encodeULEB128(Sample.getCallTargets().size(), Out);
+    for (const auto &J : Sample.getCallTargets()) {
+      writeName(Out, J.first());
+      encodeULEB128(J.second, Out);
+    }
+  }
+
+  // Write the profiles of the inlined call sites.
+  unsigned NumCallsites = 0;
+  for (const auto &I : S.getCallsiteSamples())
+    NumCallsites += I.second.size();
+  encodeULEB128(NumCallsites, Out);
+  for (const auto &I : S.getCallsiteSamples()) {
+    LineLocation Loc = I.first;
+    for (const auto &J : I.second) {
+      encodeULEB128(Loc.LineOffset, Out);
+      encodeULEB128(Loc.Discriminator, Out);
+      writeName(Out, J.first());
+      writeProfile(Out, J.second);
+    }
+  }
 }
 
 /// \brief Write samples to a binary file.
@@ -74,30 +136,53 @@ bool SampleProfileWriterBinary::write(StringRef FName,
   if (S.empty())
     return true;
 
-  OS << FName;
-  encodeULEB128(0, OS);
-  encodeULEB128(S.getTotalSamples(), OS);
-  encodeULEB128(S.getHeadSamples(), OS);
-  encodeULEB128(S.getBodySamples().size(), OS);
-  for (const auto &I : S.getBodySamples()) {
-    LineLocation Loc = I.first;
-    const SampleRecord &Sample = I.second;
-    encodeULEB128(Loc.LineOffset, OS);
-    encodeULEB128(Loc.Discriminator, OS);
-    encodeULEB128(Sample.getSamples(), OS);
-    encodeULEB128(Sample.getCallTargets().size(), OS);
-    for (const auto &J : Sample.getCallTargets()) {
-      std::string Callee = J.first();
-      unsigned CalleeSamples = J.second;
-      OS << Callee;
-      encodeULEB128(0, OS);
-      encodeULEB128(CalleeSamples, OS);
-    }
-  }
+  writeName(OS, FName);
+  writeProfile(OS, S);
+  return true;
+}
 
+unsigned SampleProfileWriterCompactBinary::getNameIndex(StringRef FName) {
+  auto Ins = NameIndex.insert(std::make_pair(FName, NameTable.size()));
+  if (Ins.second)
+    NameTable.push_back(FName);
+  return Ins.first->second;
+}
+
+void SampleProfileWriterCompactBinary::writeName(raw_ostream &Out,
+                                                 StringRef FName) {
+  encodeULEB128(getNameIndex(FName), Out);
+}
+
+/// \brief Encode the samples of \p FName. They are written to the file along
+/// with the index when the writer is destroyed.
+bool SampleProfileWriterCompactBinary::write(StringRef FName,
+                                             const FunctionSamples &S) {
+  if (S.empty())
+    return true;
+
+  FuncOffsets.push_back(std::make_pair(getNameIndex(FName), Profiles.size()));
+  raw_string_ostream ProfilesOS(Profiles);
+  writeProfile(ProfilesOS, S);
+  ProfilesOS.flush();
   return true;
 }
 
+SampleProfileWriterCompactBinary::~SampleProfileWriterCompactBinary() {
+  encodeULEB128(NameTable.size(), OS);
+  for (const auto &Name : NameTable) {
+    OS << Name;
+    encodeULEB128(0, OS);
+  }
+
+  encodeULEB128(FuncOffsets.size(), OS);
+  for (const auto &I : FuncOffsets) {
+    encodeULEB128(I.first, OS);
+    encodeULEB128(I.second, OS);
+  }
+
+  OS << Profiles;
+}
+
 /// \brief Create a sample profile writer based on the specified format.
 ///
 /// \param Filename The file to create.
@@ -114,6 +199,8 @@ SampleProfileWriter::create(StringRef Filename, SampleProfileFormat Format) {
 
   if (Format == SPF_Binary)
     Writer.reset(new SampleProfileWriterBinary(Filename, EC));
+  else if (Format == SPF_Compact_Binary)
+    Writer.reset(new SampleProfileWriterCompactBinary(Filename, EC));
   else if (Format == SPF_Text)
     Writer.reset(new SampleProfileWriterText(Filename, EC));
   else
@@ -6526,6 +6526,162 @@ void X86InstrInfo::genAlternativeCodeSequence(
   return;
 }
 
+bool X86InstrInfo::isFunctionSafeToOutlineFrom(const MachineFunction &MF) const {
+  // Windows unwinding needs every return address to fall inside a function
+  // with unwind info.
+  return !Subtarget.isTargetWin64() && !Subtarget.isOSWindows();
+}
+
+TargetInstrInfo::MachineOutlinerInstrType
+X86InstrInfo::getOutliningType(const MachineInstr &MI) const {
+  if (MI.isDebugValue() || MI.isPosition() || MI.isCFIInstruction() ||
+      MI.isInlineAsm() || MI.isCall())
+    return MOT_Illegal;
+
+  // A plain return may end a sequence that is reached with a branch.
+  if (MI.getOpcode() == X86::RETQ || MI.getOpcode() == X86::RETL)
+    return MOT_LegalTerminator;
+
+  if (MI.isTerminator() || MI.hasUnmodeledSideEffects())
+    return MOT_Illegal;
+
+  // Pseudos that are still around are expanded by the asm printer, and may
+  // depend on where they are.
+  if ((MI.getDesc().TSFlags & X86II::FormMask) == X86II::Pseudo)
+    return MOT_Illegal;
+
+  for (const MachineOperand &MO : MI.operands())
+    if (MO.isMBB() || MO.isFI() || MO.isJTI() || MO.isCFIIndex() ||
+        MO.isRegMask() || MO.isMetadata() || MO.isMCSymbol() ||
+        MO.isTargetIndex())
+      return MOT_Illegal;
+
+  return MOT_Legal;
+}
+
+bool X86InstrInfo::isLegalToOutlineWithCall(
+    const MachineBasicBlock &MBB, MachineBasicBlock::const_iterator Begin,
+    MachineBasicBlock::const_iterator End) const {
+  const MachineFunction &MF = *MBB.getParent();
+
+  // The return address would overwrite the red zone. Functions that adjust
+  // the stack never use it.
+  if (Subtarget.is64Bit() &&
+      !MF.getFunction()->hasFnAttribute(Attribute::NoRedZone) &&
+      !MF.getFrameInfo()->adjustsStack())
+    return false;
+
+  // The unwind info doesn't describe the return address pushed by the call,
+  // so the outlined code couldn't be unwound through.
+  if (MF.getFunction()->needsUnwindTableEntry())
+    return false;
+
+  // The stack pointer is off by the return address in the outlined code.
+  unsigned StackPtr = Subtarget.is64Bit() ? X86::RSP : X86::ESP;
+  for (MachineBasicBlock::const_iterator I = Begin; I != End; ++I)
+    if (I->readsRegister(StackPtr, &getRegisterInfo()) ||
+        I->modifiesRegister(StackPtr, &getRegisterInfo()))
+      return false;
+  return true;
+}
+
+unsigned X86InstrInfo::getOutliningInstrSize(const MachineInstr &MI) const {
+  const MCInstrDesc &Desc = MI.getDesc();
+  uint64_t TSFlags = Desc.TSFlags;
+  unsigned Size = 1;
+
+  switch (TSFlags & X86II::EncodingMask) {
+  case X86II::VEX:
+  case X86II::XOP:
+    Size += 2;
+    break;
+  case X86II::EVEX:
+    Size += 4;
+    break;
+  default:
+    if (TSFlags & X86II::REX_W)
+      ++Size;
+    if ((TSFlags & X86II::OpSizeMask) == X86II::OpSize16)
+      ++Size;
+    if ((TSFlags & X86II::OpPrefixMask) &&
+        (TSFlags & X86II::OpPrefixMask) != X86II::PS)
+      ++Size;
+    switch (TSFlags & X86II::OpMapMask) {
+    case X86II::OB:
+      break;
+    case X86II::TB:
+      ++Size;
+      break;
+    default:
+      Size += 2;
+      break;
+    }
+    break;
+  }
+  if (TSFlags & X86II::LOCK)
+    ++Size;
+  if (TSFlags & X86II::REP)
+    ++Size;
+
+  int MemOp = X86II::getMemoryOperandNo(TSFlags, MI.getOpcode());
+  if (MemOp >= 0) {
+    MemOp += X86II::getOperandBias(Desc);
+    const MachineOperand &Base = MI.getOperand(MemOp + X86::AddrBaseReg);
+    const MachineOperand &Index = MI.getOperand(MemOp + X86::AddrIndexReg);
+    const MachineOperand &Disp = MI.getOperand(MemOp + X86::AddrDisp);
+    unsigned BaseReg = Base.isReg() ? Base.getReg() : 0;
+    // ModRM, and SIB when there is an index or the base is the stack pointer.
+    ++Size;
+    if (Index.getReg() || BaseReg == X86::RSP || BaseReg == X86::ESP ||
+        BaseReg == X86::R12)
+      ++Size;
+    if (!Disp.isImm() || !BaseReg || BaseReg == X86::RIP)
+      Size += 4;
+    else if (Disp.getImm() != 0 || BaseReg == X86::RBP ||
+             BaseReg == X86::EBP || BaseReg == X86::R13)
+      Size += isInt<8>(Disp.getImm()) ? 1 : 4;
+  } else {
+    unsigned Form = TSFlags & X86II::FormMask;
+    if (Form >= X86II::MRMDestReg &&
+        (Form < X86II::RawFrmMemOffs || Form > X86II::RawFrmImm16))
+      ++Size;
+  }
+
+  if (X86II::hasImm(TSFlags))
+    Size += X86II::getSizeOfImm(TSFlags);
+  return Size;
+}
+
+unsigned X86InstrInfo::getOutliningCallOverhead(bool IsTailCall) const {
+  // A call or a jump with a 32-bit displacement.
+  return 5;
+}
+
+unsigned X86InstrInfo::getOutliningFrameOverhead(bool IsTailCall) const {
+  // The return added after a called sequence.
+  return IsTailCall ? 0 : 1;
+}
+
+MachineInstr *X86InstrInfo::insertOutlinedCall(MachineBasicBlock &MBB,
+                                               MachineBasicBlock::iterator It,
+                                               MachineBasicBlock &Outlined,
+                                               MCSymbol *Sym,
+                                               bool IsTailCall) const {
+  DebugLoc DL = It->getDebugLoc();
+  if (IsTailCall)
+    return BuildMI(MBB, It, DL, get(X86::JMP_1)).addMBB(&Outlined);
+  unsigned Opc = Subtarget.is64Bit() ? X86::CALL64pcrel32 : X86::CALLpcrel32;
+  return BuildMI(MBB, It, DL, get(Opc)).addSym(Sym);
+}
+
+void X86InstrInfo::buildOutlinedFrame(MachineBasicBlock &MBB,
+                                      bool IsTailCall) const {
+  if (IsTailCall)
+    return;
+  unsigned Opc = Subtarget.is64Bit() ? X86::RETQ : X86::RETL;
+  BuildMI(MBB, MBB.end(), DebugLoc(), get(Opc));
+}
+
 namespace {
   /// Create Global Base Reg pass. This initializes the PIC
   /// global base register for x86-32.
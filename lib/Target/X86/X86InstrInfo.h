@@ -495,6 +495,32 @@ public:
                                   unsigned &FoldAsLoadDefReg,
                                   MachineInstr *&DefMI) const override;
 
+  bool isFunctionSafeToOutlineFrom(const MachineFunction &MF) const override;
+
+  MachineOutlinerInstrType
+  getOutliningType(const MachineInstr &MI) const override;
+
+  bool
+  isLegalToOutlineWithCall(const MachineBasicBlock &MBB,
+                           MachineBasicBlock::const_iterator Begin,
+                           MachineBasicBlock::const_iterator End) const override;
+
+  /// getOutliningInstrSize - Estimate the encoded size of MI from its
+  /// encoding flags and memory operand, without running the MC encoder.
+  unsigned getOutliningInstrSize(const MachineInstr &MI) const override;
+
+  unsigned getOutliningCallOverhead(bool IsTailCall) const override;
+
+  unsigned getOutliningFrameOverhead(bool IsTailCall) const override;
+
+  MachineInstr *insertOutlinedCall(MachineBasicBlock &MBB,
+                                   MachineBasicBlock::iterator It,
+                                   MachineBasicBlock &Outlined, MCSymbol *Sym,
+                                   bool IsTailCall) const override;
+
+  void buildOutlinedFrame(MachineBasicBlock &MBB,
+                          bool IsTailCall) const override;
+
 private:
   MachineInstr * convertToThreeAddressWithLEA(unsigned MIOpc,
                                               MachineFunction::iterator &MFI,
@@ -84,6 +84,27 @@ unsigned X86TTIImpl::getMaxInterleaveFactor(unsigned VF) {
   return 2;
 }
 
+Optional<unsigned> X86TTIImpl::getCacheSize(TTI::CacheLevel Level) {
+  switch (Level) {
+  case TTI::CacheLevel::L1D:
+    // Atom and Silvermont have a 24KB L1 data cache, the big cores 32KB.
+    if (ST->isAtom() || ST->isSLM())
+      return 24 * 1024;
+    return 32 * 1024;
+  case TTI::CacheLevel::L2D:
+    if (ST->isAtom())
+      return 512 * 1024;
+    if (ST->isSLM())
+      return 1024 * 1024;
+    return 256 * 1024;
+  }
+  llvm_unreachable("Unknown TargetTransformInfo::CacheLevel");
+}
+
+unsigned X86TTIImpl::getCacheLineSize() {
+  return 64;
+}
+
 unsigned X86TTIImpl::getArithmeticInstrCost(
     unsigned Opcode, Type *Ty, TTI::OperandValueKind Op1Info,
     TTI::OperandValueKind Op2Info, TTI::OperandValueProperties Opd1PropInfo,
@@ -875,6 +896,92 @@ unsigned X86TTIImpl::getMaskedMemoryOpCost(unsigned Opcode, Type *SrcTy,
   return Cost+LT.first;
 }
 
+/// \brief Return the cost of a gather or scatter that is expanded into a
+/// sequence of scalar loads or stores.
+unsigned X86TTIImpl::getGSScalarCost(unsigned Opcode, Type *SrcVTy,
+                                     bool VariableMask, unsigned Alignment,
+                                     unsigned AddressSpace) {
+  unsigned VF = SrcVTy->getVectorNumElements();
+
+  unsigned MaskUnpackCost = 0;
+  if (VariableMask) {
+    VectorType *MaskTy =
+        VectorType::get(Type::getInt1Ty(getGlobalContext()), VF);
+    MaskUnpackCost = getScalarizationOverhead(MaskTy, false, true);
+    unsigned ScalarCompareCost = getCmpSelInstrCost(
+        Instruction::ICmp, Type::getInt1Ty(getGlobalContext()), nullptr);
+    unsigned BranchCost = getCFInstrCost(Instruction::Br);
+    MaskUnpackCost += VF * (BranchCost + ScalarCompareCost);
+  }
+
+  // The cost of the scalar loads/stores.
+  unsigned MemoryOpCost = VF * getMemoryOpCost(Opcode, SrcVTy->getScalarType(),
+                                               Alignment, AddressSpace);
+
+  // The cost of extracting the pointers.
+  Type *PtrsTy = VectorType::get(
+      SrcVTy->getScalarType()->getPointerTo(AddressSpace), VF);
+  unsigned AddressUnpackCost = getScalarizationOverhead(PtrsTy, false, true);
+
+  // The cost of inserting the loaded values, or extracting the stored ones.
+  unsigned InsertExtractCost = getScalarizationOverhead(
+      SrcVTy, Opcode == Instruction::Load, Opcode == Instruction::Store);
+
+  return AddressUnpackCost + MemoryOpCost + MaskUnpackCost + InsertExtractCost;
+}
+
+/// \brief Return the cost of a gather or scatter that is lowered to the
+/// AVX-512 instructions.
+unsigned X86TTIImpl::getGSVectorCost(unsigned Opcode, Type *SrcVTy,
+                                     unsigned Alignment,
+                                     unsigned AddressSpace) {
+  unsigned VF = SrcVTy->getVectorNumElements();
+
+  // A gather/scatter of more elements than fit in one register is split,
+  // and so is its vector of pointers.
+  Type *IndexVTy = VectorType::get(
+      IntegerType::get(getGlobalContext(), DL.getPointerSizeInBits()), VF);
+  std::pair<unsigned, MVT> IdxsLT = TLI->getTypeLegalizationCost(DL, IndexVTy);
+  std::pair<unsigned, MVT> SrcLT = TLI->getTypeLegalizationCost(DL, SrcVTy);
+  unsigned SplitFactor = std::max(IdxsLT.first, SrcLT.first);
+  if (SplitFactor > 1 && VF / SplitFactor > 0) {
+    Type *SplitSrcTy =
+        VectorType::get(SrcVTy->getScalarType(), VF / SplitFactor);
+    return SplitFactor *
+           getGSVectorCost(Opcode, SplitSrcTy, Alignment, AddressSpace);
+  }
+
+  // The instructions access the elements one by one; on top of that, there
+  // is a fixed overhead.
+  const unsigned GSOverhead = 2;
+  return GSOverhead + VF * getMemoryOpCost(Opcode, SrcVTy->getScalarType(),
+                                           Alignment, AddressSpace);
+}
+
+unsigned X86TTIImpl::getGatherScatterOpCost(unsigned Opcode, Type *SrcVTy,
+                                            Value *Ptr, bool VariableMask,
+                                            unsigned Alignment) {
+  assert(SrcVTy->isVectorTy() && "Unexpected data type for Gather/Scatter");
+  unsigned VF = SrcVTy->getVectorNumElements();
+  unsigned AddressSpace = 0;
+  if (Ptr)
+    AddressSpace = Ptr->getType()->getScalarType()->getPointerAddressSpace();
+
+  bool Scalarize = false;
+  if ((Opcode == Instruction::Load && !isLegalMaskedGather(SrcVTy)) ||
+      (Opcode == Instruction::Store && !isLegalMaskedScatter(SrcVTy)))
+    Scalarize = true;
+  // A gather/scatter of 2 elements is not profitable.
+  if (VF == 2)
+    Scalarize = true;
+
+  if (Scalarize)
+    return getGSScalarCost(Opcode, SrcVTy, VariableMask, Alignment,
+                           AddressSpace);
+
+  return getGSVectorCost(Opcode, SrcVTy, Alignment, AddressSpace);
+}
+
 unsigned X86TTIImpl::getAddressComputationCost(Type *Ty, bool IsComplex) {
   // Address computations in vectorized code with non-consecutive addresses will
   // likely result in more instructions compared to scalar code where the
@@ -1134,6 +1241,32 @@ bool X86TTIImpl::isLegalMaskedStore(Type *DataType, int Consecutive) {
   return isLegalMaskedLoad(DataType, Consecutive);
 }
 
+bool X86TTIImpl::isLegalMaskedGather(Type *DataTy) {
+  // The Loop Vectorizer asks before the vectorization factor is known, with
+  // the scalar type; CodeGenPrepare asks again with the vector type.
+  if (auto *VecTy = dyn_cast<VectorType>(DataTy)) {
+    unsigned NumElts = VecTy->getNumElements();
+    if (!isPowerOf2_32(NumElts))
+      return false;
+    // Without VLX, the index of a gather of less than 8 elements can't be
+    // widened to a 512-bit vector by the lowering.
+    if (NumElts < 8 && !ST->hasVLX())
+      return false;
+  }
+  Type *ScalarTy = DataTy->getScalarType();
+  unsigned DataWidth = isa<PointerType>(ScalarTy)
+                           ? DL.getPointerSizeInBits()
+                           : ScalarTy->getPrimitiveSizeInBits();
+
+  // AVX-512 allows gather and scatter of 32 and 64 bit elements. The AVX2
+  // gather instructions are not selected for masked gathers.
+  return (DataWidth == 32 || DataWidth == 64) && ST->hasAVX512();
+}
+
+bool X86TTIImpl::isLegalMaskedScatter(Type *DataType) {
+  return isLegalMaskedGather(DataType);
+}
+
 bool X86TTIImpl::hasCompatibleFunctionAttributes(const Function *Caller,
                                                  const Function *Callee) const {
   const TargetMachine &TM = getTLI()->getTargetMachine();
@@ -34,6 +34,10 @@ class X86TTIImpl : public BasicTTIImplBase<X86TTIImpl> {
   const X86TargetLowering *TLI;
 
   unsigned getScalarizationOverhead(Type *Ty, bool Insert, bool Extract);
+  unsigned getGSScalarCost(unsigned Opcode, Type *DataTy, bool VariableMask,
+                           unsigned Alignment, unsigned AddressSpace);
+  unsigned getGSVectorCost(unsigned Opcode, Type *DataTy, unsigned Alignment,
+                           unsigned AddressSpace);
 
   const X86Subtarget *getST() const { return ST; }
   const X86TargetLowering *getTLI() const { return TLI; }
@@ -62,6 +66,8 @@ public:
   unsigned getNumberOfRegisters(bool Vector);
   unsigned getRegisterBitWidth(bool Vector);
   unsigned getMaxInterleaveFactor(unsigned VF);
+  Optional<unsigned> getCacheSize(TTI::CacheLevel Level);
+  unsigned getCacheLineSize();
   unsigned getArithmeticInstrCost(
       unsigned Opcode, Type *Ty,
       TTI::OperandValueKind Opd1Info = TTI::OK_AnyValue,
@@ -77,6 +83,8 @@ public:
                            unsigned AddressSpace);
   unsigned getMaskedMemoryOpCost(unsigned Opcode, Type *Src, unsigned Alignment,
                                  unsigned AddressSpace);
+  unsigned getGatherScatterOpCost(unsigned Opcode, Type *DataTy, Value *Ptr,
+                                  bool VariableMask, unsigned Alignment);
 
   unsigned getAddressComputationCost(Type *PtrTy, bool IsComplex);
 
@@ -92,6 +100,8 @@ public:
                          Type *Ty);
   bool isLegalMaskedLoad(Type *DataType, int Consecutive);
   bool isLegalMaskedStore(Type *DataType, int Consecutive);
+  bool isLegalMaskedGather(Type *DataType);
+  bool isLegalMaskedScatter(Type *DataType);
   bool hasCompatibleFunctionAttributes(const Function *Caller,
                                        const Function *Callee) const;
 
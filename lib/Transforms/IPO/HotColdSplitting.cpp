@@ -0,0 +1,317 @@
+//===- HotColdSplitting.cpp - Outline cold regions of functions -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass moves rarely executed code out of the functions it lives in, so
+// that the hot parts of those functions are packed more densely in the
+// instruction cache.
+//
+// A block is cold if it ends in unreachable or calls a function marked cold.
+// When the function has a profile (an entry count), a block is also cold if
+// BlockFrequencyInfo says it runs less than once per -hotcoldsplit-cold-ratio
+// calls of the function.  Coldness then spreads to blocks that are only
+// entered from cold blocks, and to blocks that only lead to cold blocks.
+// Every cold block that isn't already part of a region seeds a new region made
+// of the cold blocks it dominates.  The region is then
+// trimmed until it is single-entry, and handed to the CodeExtractor if it is
+// large enough.
+//
+// Outlined functions are marked cold, minsize and noinline so that nothing
+// folds them back, and on ELF targets they are placed in a separate section
+// (.text.cold by default).
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/IPO.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ScaledNumber.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "hotcoldsplit"
+
+STATISTIC(NumColdRegionsOutlined, "Number of cold regions outlined");
+STATISTIC(NumColdInstsOutlined, "Number of instructions moved to cold code");
+
+static cl::opt<unsigned> MinColdRegionSize(
+    "hotcoldsplit-threshold", cl::init(4), cl::Hidden,
+    cl::desc("Minimum number of instructions in a cold region for it to be "
+             "outlined (default = 4)"));
+
+static cl::opt<unsigned> ColdFreqRatio(
+    "hotcoldsplit-cold-ratio", cl::init(1000), cl::Hidden,
+    cl::desc("With a profile, a block is cold if it runs less than once per "
+             "this many calls of its function (default = 1000)"));
+
+static cl::opt<std::string> ColdSectionName(
+    "hotcoldsplit-section", cl::init(".text.cold"), cl::Hidden,
+    cl::desc("Section of the outlined cold functions on ELF targets; empty "
+             "to use the default text section"));
+
+namespace {
+class HotColdSplitting : public ModulePass {
+public:
+  static char ID; // Pass identification, replacement for typeid
+  HotColdSplitting() : ModulePass(ID) {
+    initializeHotColdSplittingPass(*PassRegistry::getPassRegistry());
+  }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<BlockFrequencyInfoWrapperPass>();
+  }
+
+  bool runOnModule(Module &M) override;
+
+private:
+  /// Outline the cold regions of \p F. Returns true if anything changed.
+  bool splitFunction(Function &F);
+
+  /// Whether the outlined functions go into ColdSectionName.
+  bool UseColdSection;
+};
+}
+
+char HotColdSplitting::ID = 0;
+INITIALIZE_PASS_BEGIN(HotColdSplitting, "hotcoldsplit",
+                      "Hot Cold Splitting", false, false)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_END(HotColdSplitting, "hotcoldsplit",
+                    "Hot Cold Splitting", false, false)
+
+ModulePass *llvm::createHotColdSplittingPass() {
+  return new HotColdSplitting();
+}
+
+/// Whether the static hints alone say \p BB is rarely executed.
+static bool hasColdHint(const BasicBlock &BB) {
+  if (isa<UnreachableInst>(BB.getTerminator()))
+    return true;
+  for (const Instruction &I : BB) {
+    ImmutableCallSite CS(&I);
+    if (CS && CS.hasFnAttr(Attribute::Cold))
+      return true;
+  }
+  return false;
+}
+
+/// Whether \p BB may be moved into another function. The CodeExtractor
+/// rejects allocas, invokes, landing pads and va_start itself; returns and
+/// resumes have to stay where they are as well.
+static bool mayExtractBlock(const BasicBlock &BB) {
+  const TerminatorInst *TI = BB.getTerminator();
+  if (isa<ReturnInst>(TI) || isa<ResumeInst>(TI) || isa<InvokeInst>(TI) ||
+      BB.isLandingPad())
+    return false;
+  for (const Instruction &I : BB) {
+    if (isa<AllocaInst>(I))
+      return false;
+    if (const CallInst *CI = dyn_cast<CallInst>(&I))
+      if (CI->isMustTailCall())
+        return false;
+  }
+  return true;
+}
+
+/// Collect the region seeded by \p Seed: the cold blocks it dominates that
+/// are reachable from it through cold blocks. Blocks other than the seed that
+/// are entered from outside are dropped until the region is single-entry.
+static SetVector<BasicBlock *>
+getColdRegion(BasicBlock *Seed, const SmallPtrSetImpl<BasicBlock *> &Cold,
+              DominatorTree &DT) {
+  SetVector<BasicBlock *> Region;
+  SmallVector<BasicBlock *, 8> Worklist;
+  Region.insert(Seed);
+  Worklist.push_back(Seed);
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.pop_back_val();
+    for (BasicBlock *Succ : successors(BB))
+      if (Cold.count(Succ) && mayExtractBlock(*Succ) &&
+          DT.dominates(Seed, Succ) && Region.insert(Succ))
+        Worklist.push_back(Succ);
+  }
+
+  bool Changed;
+  do {
+    Changed = false;
+    for (unsigned i = 1; i < Region.size(); ++i) {
+      BasicBlock *BB = Region[i];
+      bool EnteredFromOutside = false;
+      for (BasicBlock *Pred : predecessors(BB))
+        EnteredFromOutside |= !Region.count(Pred);
+      if (EnteredFromOutside) {
+        Region.remove(BB);
+        Changed = true;
+        --i;
+      }
+    }
+  } while (Changed);
+
+  return Region;
+}
+
+/// Whether the CodeExtractor can rewire the exits of \p Region. It redirects
+/// every exit edge to a single block in the caller, so an exit block whose
+/// PHIs have more than one incoming edge from the region can't be handled.
+static bool hasExtractableExits(const SetVector<BasicBlock *> &Region) {
+  for (BasicBlock *BB : Region)
+    for (BasicBlock *Succ : successors(BB)) {
+      if (Region.count(Succ) || !isa<PHINode>(Succ->begin()))
+        continue;
+      unsigned PredsInRegion = 0;
+      for (BasicBlock *Pred : predecessors(Succ))
+        PredsInRegion += Region.count(Pred);
+      if (PredsInRegion > 1)
+        return false;
+    }
+  return true;
+}
+
+bool HotColdSplitting::splitFunction(Function &F) {
+  BlockFrequencyInfo &BFI =
+      getAnalysis<BlockFrequencyInfoWrapperPass>(F).getBFI();
+  bool HasProfile = F.getEntryCount().hasValue();
+  typedef ScaledNumber<uint64_t> Scaled64;
+  Scaled64 EntryFreq(BFI.getBlockFreq(&F.getEntryBlock()).getFrequency(), 0);
+
+  // Classify the blocks once, before the CFG changes. The blocks created by
+  // the extraction are never cold.
+  SmallPtrSet<BasicBlock *, 16> Cold;
+  SmallVector<BasicBlock *, 16> Seeds;
+  for (BasicBlock &BB : F) {
+    if (&BB == &F.getEntryBlock())
+      continue;
+    bool IsCold = hasColdHint(BB);
+    if (!IsCold && HasProfile) {
+      Scaled64 Freq(BFI.getBlockFreq(&BB).getFrequency(), 0);
+      IsCold = Freq * Scaled64(ColdFreqRatio, 0) < EntryFreq;
+    }
+    if (IsCold)
+      Cold.insert(&BB);
+  }
+  if (Cold.empty())
+    return false;
+
+  bool Spread;
+  do {
+    Spread = false;
+    for (BasicBlock &BB : F) {
+      if (&BB == &F.getEntryBlock() || Cold.count(&BB))
+        continue;
+      bool AllPredsCold = pred_begin(&BB) != pred_end(&BB);
+      for (BasicBlock *Pred : predecessors(&BB))
+        AllPredsCold &= Cold.count(Pred) != 0;
+      bool AllSuccsCold = succ_begin(&BB) != succ_end(&BB);
+      for (BasicBlock *Succ : successors(&BB))
+        AllSuccsCold &= Cold.count(Succ) != 0;
+      if (AllPredsCold || AllSuccsCold) {
+        Cold.insert(&BB);
+        Spread = true;
+      }
+    }
+  } while (Spread);
+
+  // Seed in layout order, so that the regions don't depend on the order of
+  // the set.
+  for (BasicBlock &BB : F)
+    if (Cold.count(&BB))
+      Seeds.push_back(&BB);
+
+  bool Changed = false;
+  SmallPtrSet<BasicBlock *, 16> Done;
+  DominatorTree DT(F);
+  for (BasicBlock *Seed : Seeds) {
+    if (Done.count(Seed) || !mayExtractBlock(*Seed) ||
+        !DT.isReachableFromEntry(Seed))
+      continue;
+
+    // Start the region at the outermost cold block dominating the seed, so
+    // that the largest region is taken in one go.
+    DomTreeNode *Node = DT.getNode(Seed);
+    while (Node->getIDom() && Cold.count(Node->getIDom()->getBlock()) &&
+           !Done.count(Node->getIDom()->getBlock()) &&
+           mayExtractBlock(*Node->getIDom()->getBlock()))
+      Node = Node->getIDom();
+    BasicBlock *Head = Node->getBlock();
+
+    SetVector<BasicBlock *> Region = getColdRegion(Head, Cold, DT);
+    Done.insert(Region.begin(), Region.end());
+
+    unsigned Size = 0;
+    for (BasicBlock *BB : Region)
+      Size += BB->size();
+    if (Size < MinColdRegionSize || !hasExtractableExits(Region))
+      continue;
+
+    // Keep the PHIs of the head in this function. The CodeExtractor can split
+    // them off itself, but can't keep the dominator tree up to date if the
+    // head has several successors.
+    SmallVector<BasicBlock *, 8> Blocks(Region.begin(), Region.end());
+    if (isa<PHINode>(Head->begin()))
+      Blocks[0] = SplitBlock(Head, Head->getFirstNonPHI(), &DT);
+
+    CodeExtractor CE(Blocks, &DT);
+    if (!CE.isEligible())
+      continue;
+    Function *Outlined = CE.extractCodeRegion();
+    if (!Outlined)
+      continue;
+
+    DEBUG(dbgs() << "HotColdSplitting: outlined " << Size
+                 << " instructions of " << F.getName() << " into "
+                 << Outlined->getName() << '\n');
+    Outlined->addFnAttr(Attribute::Cold);
+    Outlined->addFnAttr(Attribute::MinSize);
+    Outlined->addFnAttr(Attribute::NoInline);
+    if (UseColdSection && !F.hasSection())
+      Outlined->setSection(ColdSectionName);
+
+    ++NumColdRegionsOutlined;
+    NumColdInstsOutlined += Size;
+    Changed = true;
+
+    // The extraction replaced the region by a call; start from a fresh
+    // dominator tree for the remaining seeds.
+    DT.recalculate(F);
+  }
+  return Changed;
+}
+
+bool HotColdSplitting::runOnModule(Module &M) {
+  UseColdSection = !ColdSectionName.empty() &&
+                   Triple(M.getTargetTriple()).isOSBinFormatELF();
+
+  // Extraction adds functions to the module, so collect the candidates first.
+  SmallVector<Function *, 32> Worklist;
+  for (Function &F : M) {
+    if (F.isDeclaration() || F.hasFnAttribute(Attribute::Cold) ||
+        F.hasFnAttribute(Attribute::OptimizeNone) ||
+        F.hasFnAttribute(Attribute::Naked))
+      continue;
+    Worklist.push_back(&F);
+  }
+
+  bool Changed = false;
+  for (Function *F : Worklist)
+    Changed |= splitFunction(*F);
+  return Changed;
+}
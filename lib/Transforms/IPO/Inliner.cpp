@@ -87,7 +87,7 @@ InlinedArrayAllocasTy;
 
 /// \brief If the inlined function had a higher stack protection level than the
 /// calling function, then bump up the caller's stack protection level.
-static void AdjustCallerSSPLevel(Function *Caller, Function *Callee) {
+void llvm::AdjustCallerSSPLevel(Function *Caller, Function *Callee) {
   // If upgrading the SSP attribute, clear out the old SSP Attributes first.
   // Having multiple SSP attributes doesn't actually hurt, but it adds useless
   // clutter to the IR.
@@ -434,6 +434,7 @@ bool Inliner::runOnSCC(CallGraphSCC &SCC) {
   auto *TLIP = getAnalysisIfAvailable<TargetLibraryInfoWrapperPass>();
   const TargetLibraryInfo *TLI = TLIP ? &TLIP->getTLI() : nullptr;
   AliasAnalysis *AA = &getAnalysis<AliasAnalysis>();
+  auto *ICA = getAnalysisIfAvailable<InlineCostAnalysis>();
 
   SmallPtrSet<Function*, 8> SCCFunctions;
   DEBUG(dbgs() << "Inliner visiting SCC:");
@@ -561,6 +562,10 @@ bool Inliner::runOnSCC(CallGraphSCC &SCC) {
         }
         ++NumInlined;
 
+        // The caller changed, so any cached cost of inlining it is stale.
+        if (ICA)
+          ICA->invalidateCachedCosts(*Caller);
+
         // Report the inline decision.
         emitOptimizationRemark(
             CallerCtx, DEBUG_TYPE, *Caller, DLoc,
@@ -28,10 +28,21 @@
 // -- "FunctionPtr" instances are stored in std::set collection, so every
 //    std::set::insert operation will give you result in log(N) time.
 //
+// To keep the number of full comparisons down, every function is first given
+// a cheap structural hash (see FunctionComparator::functionHash). Functions
+// are only inserted into the tree if some other function shares their hash,
+// and the tree compares hashes before falling back to the full comparison.
+//
 // When a match is found the functions are folded. If both functions are
 // overridable, we move the functionality into a new internal function and
 // leave two overridable thunks to it.
 //
+// With -mergefunc-parametric, internal functions that are only called directly
+// and differ in nothing but a few integer constants or callees are merged as
+// well: a single copy of the body takes the differing values as extra
+// arguments, and the call sites are rewritten to pass them. No thunks are left
+// behind, the original functions are deleted.
+//
 //===----------------------------------------------------------------------===//
 //
 // Future work:
@@ -84,7 +95,10 @@
 #include "llvm/Transforms/IPO.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/CallSite.h"
@@ -93,6 +107,7 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Operator.h"
@@ -102,6 +117,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include <vector>
 using namespace llvm;
 
@@ -111,6 +127,10 @@ STATISTIC(NumFunctionsMerged, "Number of functions merged");
 STATISTIC(NumThunksWritten, "Number of thunks generated");
 STATISTIC(NumAliasesWritten, "Number of aliases generated");
 STATISTIC(NumDoubleWeak, "Number of new functions created");
+STATISTIC(NumHashSingletons, "Number of functions skipped for a unique hash");
+STATISTIC(NumParametricMerged,
+          "Number of functions merged by passing their differences as "
+          "arguments");
 
 static cl::opt<unsigned> NumFunctionsForSanityCheck(
     "mergefunc-sanity",
@@ -119,8 +139,33 @@ static cl::opt<unsigned> NumFunctionsForSanityCheck(
              "'0' disables this check. Works only with '-debug' key."),
     cl::init(0), cl::Hidden);
 
+static cl::opt<bool> EnableParametricMerging(
+    "mergefunc-parametric",
+    cl::desc("Merge internal functions that differ only in a few integer "
+             "constants or callees by passing the differences as arguments"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<unsigned> ParametricMaxParams(
+    "mergefunc-parametric-max-params",
+    cl::desc("The maximum number of arguments added by a parametric merge"),
+    cl::init(3), cl::Hidden);
+
+static cl::opt<unsigned> ParametricMinSize(
+    "mergefunc-parametric-min-size",
+    cl::desc("The minimum number of instructions in a function for it to be "
+             "considered for parametric merging"),
+    cl::init(16), cl::Hidden);
+
 namespace {
 
+/// One operand at which two functions compared in parametric mode differ:
+/// the instruction in each function and the index of the operand.
+struct ParamDiff {
+  const Instruction *InstL;
+  const Instruction *InstR;
+  unsigned OpIdx;
+};
+
 /// FunctionComparator - Compares two functions to determine whether or not
 /// they will generate machine code with the same behaviour. DataLayout is
 /// used if available. The comparator always fails conservatively (erring on the
@@ -128,11 +173,27 @@ namespace {
 class FunctionComparator {
 public:
   FunctionComparator(const Function *F1, const Function *F2)
-      : FnL(F1), FnR(F2) {}
+      : FnL(F1), FnR(F2), Diffs(nullptr) {}
+
+  /// Compare in parametric mode: operands that could be passed in as
+  /// arguments (see canParameterize) are allowed to differ, and every such
+  /// difference is appended to \p D. The result is then only meaningful as
+  /// an equality test, not as an order.
+  FunctionComparator(const Function *F1, const Function *F2,
+                     SmallVectorImpl<ParamDiff> &D)
+      : FnL(F1), FnR(F2), Diffs(&D) {}
 
   /// Test whether the two functions have equivalent behaviour.
   int compare();
 
+  typedef uint64_t FunctionHash;
+
+  /// Hash a function by the things compare() can never consider equal if
+  /// they differ: the number of arguments, varargs, and the opcodes of the
+  /// instructions visited in the same CFG order. Equal functions always have
+  /// equal hashes, so the hash may be compared before compare() is called.
+  static FunctionHash functionHash(Function &F);
+
 private:
   /// Test whether two basic blocks have equivalent behaviour.
   int compare(const BasicBlock *BBL, const BasicBlock *BBR);
@@ -349,9 +410,19 @@ private:
   int cmpStrings(StringRef L, StringRef R) const;
   int cmpAttrs(const AttributeSet L, const AttributeSet R) const;
 
+  /// Whether operand \p OpIdx of \p L and \p R may differ in parametric
+  /// mode. This holds for integer constants of the same type used as
+  /// ordinary data operands, and for the callees of direct calls with the
+  /// same function type.
+  bool canParameterize(const Instruction *L, const Instruction *R,
+                       unsigned OpIdx) const;
+
   // The two functions undergoing comparison.
   const Function *FnL, *FnR;
 
+  // The differences found in parametric mode, or null.
+  SmallVectorImpl<ParamDiff> *Diffs;
+
   /// Assign serial numbers to values from left function, and values from
   /// right function.
   /// Explanation:
@@ -390,10 +461,13 @@ private:
 
 class FunctionNode {
   mutable AssertingVH<Function> F;
+  FunctionComparator::FunctionHash Hash;
 
 public:
-  FunctionNode(Function *F) : F(F) {}
+  FunctionNode(Function *F)
+      : F(F), Hash(FunctionComparator::functionHash(*F)) {}
   Function *getFunc() const { return F; }
+  FunctionComparator::FunctionHash getHash() const { return Hash; }
 
   /// Replace the reference to the function F by the function G, assuming their
   /// implementations are equal.
@@ -405,7 +479,12 @@ public:
   }
 
   void release() { F = 0; }
+
+  /// Functions are ordered by their hash first, so that the expensive
+  /// comparison only runs between functions that may be equal.
   bool operator<(const FunctionNode &RHS) const {
+    if (Hash != RHS.Hash)
+      return Hash < RHS.Hash;
     return (FunctionComparator(F, RHS.getFunc()).compare()) == -1;
   }
 };
@@ -968,6 +1047,10 @@ int FunctionComparator::compare(const BasicBlock *BBL, const BasicBlock *BBR) {
       for (unsigned i = 0, e = InstL->getNumOperands(); i != e; ++i) {
         Value *OpL = InstL->getOperand(i);
         Value *OpR = InstR->getOperand(i);
+        if (Diffs && OpL != OpR && canParameterize(InstL, InstR, i)) {
+          Diffs->push_back({InstL, InstR, i});
+          continue;
+        }
         if (int Res = cmpValues(OpL, OpR))
           return Res;
         if (int Res = cmpNumbers(OpL->getValueID(), OpR->getValueID()))
@@ -988,6 +1071,68 @@ int FunctionComparator::compare(const BasicBlock *BBL, const BasicBlock *BBR) {
   return 0;
 }
 
+bool FunctionComparator::canParameterize(const Instruction *L,
+                                         const Instruction *R,
+                                         unsigned OpIdx) const {
+  const Value *OpL = L->getOperand(OpIdx);
+  const Value *OpR = R->getOperand(OpIdx);
+  if (OpL->getType() != OpR->getType())
+    return false;
+
+  // A call through a parameter instead of one of two callees.
+  if (const CallInst *CI = dyn_cast<CallInst>(L)) {
+    if (OpIdx == CI->getNumArgOperands()) {
+      const Function *CalleeL = dyn_cast<Function>(OpL);
+      const Function *CalleeR = dyn_cast<Function>(OpR);
+      return CalleeL && CalleeR && !CalleeL->isIntrinsic() &&
+             !CalleeR->isIntrinsic() && CalleeL != FnL && CalleeL != FnR &&
+             CalleeR != FnL && CalleeR != FnR;
+    }
+  }
+
+  if (!isa<ConstantInt>(OpL) || !isa<ConstantInt>(OpR))
+    return false;
+
+  // Only the operands that are plain data may become variables. Switch case
+  // values, GEP indices, intrinsic arguments, alloca sizes and the like must
+  // stay constant.
+  if (isa<BinaryOperator>(L) || isa<ICmpInst>(L) || isa<SelectInst>(L) ||
+      isa<ReturnInst>(L))
+    return true;
+  if (isa<StoreInst>(L))
+    return OpIdx == 0;
+  if (const CallInst *CI = dyn_cast<CallInst>(L))
+    return !isa<IntrinsicInst>(CI) && !CI->isInlineAsm();
+  return false;
+}
+
+FunctionComparator::FunctionHash
+FunctionComparator::functionHash(Function &F) {
+  hash_code H = hash_combine(F.isVarArg(), F.arg_size());
+
+  // Walk the blocks in the same order as compare() so that unreachable blocks
+  // are ignored here as well.
+  SmallVector<const BasicBlock *, 8> BBs;
+  SmallSet<const BasicBlock *, 16> VisitedBBs;
+  BBs.push_back(&F.getEntryBlock());
+  VisitedBBs.insert(BBs[0]);
+  while (!BBs.empty()) {
+    const BasicBlock *BB = BBs.pop_back_val();
+    // Mark the start of each block so that the split points count.
+    H = hash_combine(H, BB->size());
+    for (const Instruction &Inst : *BB)
+      H = hash_combine(H, Inst.getOpcode());
+
+    const TerminatorInst *Term = BB->getTerminator();
+    for (unsigned i = 0, e = Term->getNumSuccessors(); i != e; ++i) {
+      if (!VisitedBBs.insert(Term->getSuccessor(i)).second)
+        continue;
+      BBs.push_back(Term->getSuccessor(i));
+    }
+  }
+  return H;
+}
+
 // Test whether the two functions have equivalent behaviour.
 int FunctionComparator::compare() {
 
@@ -1135,6 +1280,30 @@ private:
   /// Replace function F with function G in the function tree.
   void replaceFunctionInTree(FnTreeType::iterator &IterToF, Function *G);
 
+  /// The values passed for each differing operand of a parametric group,
+  /// keyed by the instruction and operand index in the first function of the
+  /// group. Each tuple holds one value per function in the group.
+  typedef MapVector<std::pair<const Instruction *, unsigned>,
+                    SmallVector<Value *, 4>> ParamSlotMap;
+
+  /// Merge the internal functions that only differ in a few operands, see
+  /// -mergefunc-parametric.
+  bool mergeParametric(Module &M);
+
+  /// Try to add \p K, which differs from the first function of \p Group at
+  /// \p Diffs, to the group. Fails if that would need too many arguments.
+  bool addToParametricGroup(SmallVectorImpl<Function *> &Group,
+                            ParamSlotMap &Slots, Function *K,
+                            ArrayRef<ParamDiff> Diffs);
+
+  /// Replace the functions of \p Group by one that takes the values in
+  /// \p Slots as extra arguments, and rewrite all calls. Deletes the group.
+  void mergeWithParams(ArrayRef<Function *> Group, const ParamSlotMap &Slots);
+
+  /// The functions considered for parametric merging. None of them may be
+  /// passed to a merged function, since any of them may be rewritten.
+  SmallPtrSet<const Value *, 16> ParametricCandidates;
+
   /// The set of all distinct functions. Use the insert() and remove() methods
   /// to modify it.
   FnTreeType FnTree;
@@ -1227,11 +1396,31 @@ bool MergeFunctions::doSanityCheck(std::vector<WeakVH> &Worklist) {
 bool MergeFunctions::runOnModule(Module &M) {
   bool Changed = false;
 
-  for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I) {
-    if (!I->isDeclaration() && !I->hasAvailableExternallyLinkage())
-      Deferred.push_back(WeakVH(I));
+  // All functions are hashed first. A function whose hash is unique can't be
+  // equal to any other, so it is never inserted into the tree.
+  std::vector<std::pair<FunctionComparator::FunctionHash, Function *>>
+      HashedFuncs;
+  for (Function &Func : M) {
+    if (!Func.isDeclaration() && !Func.hasAvailableExternallyLinkage())
+      HashedFuncs.push_back({FunctionComparator::functionHash(Func), &Func});
+  }
+
+  std::stable_sort(HashedFuncs.begin(), HashedFuncs.end(), less_first());
+
+  SmallPtrSet<Function *, 32> Colliding;
+  for (auto I = HashedFuncs.begin(), E = HashedFuncs.end(); I != E; ++I) {
+    if ((I != HashedFuncs.begin() && std::prev(I)->first == I->first) ||
+        (std::next(I) != E && std::next(I)->first == I->first))
+      Colliding.insert(I->second);
+    else
+      ++NumHashSingletons;
   }
 
+  // Keep the module order so that the merge order doesn't depend on the hash.
+  for (Function &Func : M)
+    if (Colliding.count(&Func))
+      Deferred.push_back(WeakVH(&Func));
+
   do {
     std::vector<WeakVH> Worklist;
     Deferred.swap(Worklist);
@@ -1271,9 +1460,213 @@ bool MergeFunctions::runOnModule(Module &M) {
 
   FnTree.clear();
 
+  if (EnableParametricMerging)
+    Changed |= mergeParametric(M);
+
+  return Changed;
+}
+
+/// Whether every use of \p F is the callee of a call from another function.
+static bool hasOnlyDirectCalls(Function &F) {
+  for (Use &U : F.uses()) {
+    CallInst *CI = dyn_cast<CallInst>(U.getUser());
+    if (!CI || U.getOperandNo() != CI->getNumArgOperands() ||
+        CI->isMustTailCall() || CI->getParent()->getParent() == &F)
+      return false;
+  }
+  return true;
+}
+
+/// Whether \p F may be replaced by a call to a function with more arguments:
+/// it must be internal, large enough to be worth it, and only called
+/// directly by other functions.
+static bool isParametricCandidate(Function &F) {
+  if (F.isDeclaration() || !F.hasLocalLinkage() || F.isVarArg())
+    return false;
+
+  unsigned Size = 0;
+  for (BasicBlock &BB : F) {
+    Size += BB.size();
+    for (Instruction &I : BB)
+      if (CallInst *CI = dyn_cast<CallInst>(&I))
+        if (CI->isMustTailCall())
+          return false;
+  }
+  if (Size < ParametricMinSize)
+    return false;
+
+  return hasOnlyDirectCalls(F);
+}
+
+bool MergeFunctions::mergeParametric(Module &M) {
+  std::vector<std::pair<FunctionComparator::FunctionHash, Function *>>
+      Candidates;
+  ParametricCandidates.clear();
+  for (Function &F : M)
+    if (isParametricCandidate(F)) {
+      Candidates.push_back({FunctionComparator::functionHash(F), &F});
+      ParametricCandidates.insert(&F);
+    }
+
+  std::stable_sort(Candidates.begin(), Candidates.end(), less_first());
+
+  bool Changed = false;
+  for (auto B = Candidates.begin(), E = Candidates.end(); B != E;) {
+    auto BucketEnd = std::find_if(B, E, [&](const std::pair<
+        FunctionComparator::FunctionHash, Function *> &C) {
+      return C.first != B->first;
+    });
+
+    SmallVector<Function *, 8> Pending;
+    for (auto I = B; I != BucketEnd; ++I)
+      Pending.push_back(I->second);
+    B = BucketEnd;
+
+    // Greedily group every function with the first one still pending.
+    while (Pending.size() > 1) {
+      SmallVector<Function *, 4> Group;
+      SmallVector<Function *, 8> Rest;
+      ParamSlotMap Slots;
+      Group.push_back(Pending[0]);
+      for (unsigned i = 1, e = Pending.size(); i != e; ++i) {
+        Function *K = Pending[i];
+        SmallVector<ParamDiff, 8> Diffs;
+        if (K->getFunctionType() != Group[0]->getFunctionType() ||
+            FunctionComparator(Group[0], K, Diffs).compare() != 0 ||
+            !addToParametricGroup(Group, Slots, K, Diffs))
+          Rest.push_back(K);
+      }
+
+      // Merging an earlier group may have changed how these are used.
+      if (Group.size() > 1 &&
+          std::all_of(Group.begin(), Group.end(),
+                      [](Function *F) { return hasOnlyDirectCalls(*F); })) {
+        mergeWithParams(Group, Slots);
+        Changed = true;
+      }
+      Pending.swap(Rest);
+    }
+  }
   return Changed;
 }
 
+bool MergeFunctions::addToParametricGroup(SmallVectorImpl<Function *> &Group,
+                                          ParamSlotMap &Slots, Function *K,
+                                          ArrayRef<ParamDiff> Diffs) {
+  // Candidates can't be passed to the merged function, since they may be
+  // deleted or have their calls rewritten.
+  auto IsCandidate = [&](Value *V) {
+    return ParametricCandidates.count(V) != 0;
+  };
+
+  ParamSlotMap NewSlots = Slots;
+  unsigned GroupSize = Group.size();
+
+  // K matches the first function everywhere it doesn't differ.
+  for (auto &Slot : NewSlots)
+    Slot.second.push_back(Slot.first.first->getOperand(Slot.first.second));
+
+  for (const ParamDiff &D : Diffs) {
+    Value *ValL = D.InstL->getOperand(D.OpIdx);
+    Value *ValR = D.InstR->getOperand(D.OpIdx);
+    if (IsCandidate(ValL) || IsCandidate(ValR))
+      return false;
+
+    auto Key = std::make_pair(D.InstL, D.OpIdx);
+    auto It = NewSlots.find(Key);
+    if (It != NewSlots.end()) {
+      It->second.back() = ValR;
+      continue;
+    }
+    SmallVector<Value *, 4> Values(GroupSize, ValL);
+    Values.push_back(ValR);
+    NewSlots.insert(std::make_pair(Key, Values));
+  }
+
+  // Slots passing the same values share an argument.
+  SmallVector<SmallVector<Value *, 4>, 4> Params;
+  for (auto &Slot : NewSlots) {
+    if (std::find(Params.begin(), Params.end(), Slot.second) == Params.end())
+      Params.push_back(Slot.second);
+    if (Params.size() > ParametricMaxParams)
+      return false;
+  }
+
+  Group.push_back(K);
+  Slots = std::move(NewSlots);
+  return true;
+}
+
+void MergeFunctions::mergeWithParams(ArrayRef<Function *> Group,
+                                     const ParamSlotMap &Slots) {
+  Function *F = Group[0];
+
+  SmallVector<SmallVector<Value *, 4>, 4> Params;
+  SmallVector<unsigned, 8> SlotParam;
+  for (auto &Slot : Slots) {
+    auto It = std::find(Params.begin(), Params.end(), Slot.second);
+    SlotParam.push_back(It - Params.begin());
+    if (It == Params.end())
+      Params.push_back(Slot.second);
+  }
+
+  FunctionType *FTy = F->getFunctionType();
+  SmallVector<Type *, 8> ArgTys(FTy->param_begin(), FTy->param_end());
+  for (auto &P : Params)
+    ArgTys.push_back(P[0]->getType());
+  FunctionType *NewFTy =
+      FunctionType::get(FTy->getReturnType(), ArgTys, /*isVarArg=*/false);
+
+  Function *H = Function::Create(NewFTy, GlobalValue::InternalLinkage,
+                                 F->getName() + ".merged", F->getParent());
+  ValueToValueMapTy VMap;
+  Function::arg_iterator NewArg = H->arg_begin();
+  for (Argument &Arg : F->args()) {
+    NewArg->setName(Arg.getName());
+    VMap[&Arg] = NewArg++;
+  }
+  SmallVector<ReturnInst *, 4> Returns;
+  CloneFunctionInto(H, F, VMap, /*ModuleLevelChanges=*/false, Returns);
+
+  SmallVector<Argument *, 4> ParamArgs;
+  for (; NewArg != H->arg_end(); ++NewArg)
+    ParamArgs.push_back(NewArg);
+
+  unsigned SlotIdx = 0;
+  for (auto &Slot : Slots) {
+    Instruction *I = cast<Instruction>(VMap[Slot.first.first]);
+    I->setOperand(Slot.first.second, ParamArgs[SlotParam[SlotIdx++]]);
+  }
+
+  // Rewrite the calls of every function in the group to pass its values.
+  for (unsigned G = 0, E = Group.size(); G != E; ++G) {
+    Function *Old = Group[G];
+    while (!Old->use_empty()) {
+      CallInst *CI = cast<CallInst>(Old->user_back());
+      SmallVector<Value *, 8> Args(CI->arg_operands().begin(),
+                                   CI->arg_operands().end());
+      for (auto &P : Params)
+        Args.push_back(P[G]);
+
+      CallInst *NewCI = CallInst::Create(H, Args, "", CI);
+      NewCI->setCallingConv(CI->getCallingConv());
+      NewCI->setAttributes(CI->getAttributes());
+      NewCI->setTailCallKind(CI->getTailCallKind());
+      NewCI->setDebugLoc(CI->getDebugLoc());
+      NewCI->takeName(CI);
+      CI->replaceAllUsesWith(NewCI);
+      CI->eraseFromParent();
+    }
+  }
+
+  for (Function *Old : Group) {
+    DEBUG(dbgs() << "mergeWithParams: " << Old->getName() << " -> "
+                 << H->getName() << '\n');
+    Old->eraseFromParent();
+  }
+  NumParametricMerged += Group.size();
+}
+
 // Replace direct callers of Old with New.
 void MergeFunctions::replaceDirectCallers(Function *Old, Function *New) {
   Constant *BitcastNew = ConstantExpr::getBitCast(New, Old->getType());
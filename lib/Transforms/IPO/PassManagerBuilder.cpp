@@ -25,6 +25,7 @@
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Instrumentation.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Vectorize.h"
 
@@ -89,6 +90,33 @@ static cl::opt<bool> EnableLoopDistribute(
     "enable-loop-distribute", cl::init(false), cl::Hidden,
     cl::desc("Enable the new, experimental LoopDistribution Pass"));
 
+static cl::opt<bool> EnableLoopFusion(
+    "enable-loop-fusion", cl::init(false), cl::Hidden,
+    cl::desc("Enable the new, experimental LoopFusion Pass"));
+
+static cl::opt<bool> EnableLoopTiling(
+    "enable-loop-tiling", cl::init(false), cl::Hidden,
+    cl::desc("Enable the new, experimental LoopTiling Pass"));
+
+static cl::opt<bool> EnableHotColdSplit(
+    "hot-cold-split", cl::init(false), cl::Hidden,
+    cl::desc("Outline the cold regions of functions"));
+
+static cl::opt<bool> EnablePriorityInliner(
+    "enable-priority-inliner", cl::init(false), cl::Hidden,
+    cl::desc("Run the profile-guided priority inliner ahead of the CGSCC "
+             "inliner"));
+
+static cl::opt<std::string> RunPGOInstrGen(
+    "profile-generate", cl::init(""), cl::Hidden,
+    cl::desc("Enable generation phase of PGO instrumentation and specify the "
+             "path of profile data file"));
+
+static cl::opt<std::string> RunPGOInstrUse(
+    "profile-use", cl::init(""), cl::Hidden, cl::value_desc("filename"),
+    cl::desc("Enable use phase of PGO instrumentation and specify the path "
+             "of profile data file"));
+
 PassManagerBuilder::PassManagerBuilder() {
     OptLevel = 2;
     SizeLevel = 0;
@@ -106,6 +134,8 @@ PassManagerBuilder::PassManagerBuilder() {
     VerifyOutput = false;
     MergeFunctions = false;
     PrepareForLTO = false;
+    PGOInstrGen = RunPGOInstrGen;
+    PGOInstrUse = RunPGOInstrUse;
 }
 
 PassManagerBuilder::~PassManagerBuilder() {
@@ -170,6 +200,23 @@ void PassManagerBuilder::populateFunctionPassManager(
   FPM.add(createLowerExpectIntrinsicPass());
 }
 
+void PassManagerBuilder::addPGOInstrPasses(legacy::PassManagerBase &MPM) {
+  // Perform the PGO instrumentation generation pass.
+  if (!PGOInstrGen.empty()) {
+    MPM.add(createPGOInstrumentationGenPass());
+    // Add the profile lowering pass.
+    InstrProfOptions Options;
+    Options.InstrProfileOutput = PGOInstrGen;
+    MPM.add(createInstrProfilingPass(Options));
+  }
+  // Annotate the IR with the counts of a previous instrumented run, and turn
+  // the hot targets of indirect calls into direct calls the inliner can see.
+  if (!PGOInstrUse.empty()) {
+    MPM.add(createPGOInstrumentationUsePass(PGOInstrUse));
+    MPM.add(createPGOIndirectCallPromotionPass());
+  }
+}
+
 void PassManagerBuilder::populateModulePassManager(
     legacy::PassManagerBase &MPM) {
   // If all optimizations are disabled, just run the always-inline pass and,
@@ -203,6 +250,8 @@ void PassManagerBuilder::populateModulePassManager(
   if (!DisableUnitAtATime) {
     addExtensionsToPM(EP_ModuleOptimizerEarly, MPM);
 
+    addPGOInstrPasses(MPM);
+
     MPM.add(createIPSCCPPass());              // IP SCCP
     MPM.add(createGlobalOptimizerPass());     // Optimize out global vars
 
@@ -213,6 +262,11 @@ void PassManagerBuilder::populateModulePassManager(
     MPM.add(createCFGSimplificationPass());   // Clean up after IPCP & DAE
   }
 
+  // Make the global, profile-guided inlining decisions before the CGSCC
+  // inliner makes its local ones.
+  if (EnablePriorityInliner && Inliner)
+    MPM.add(createPriorityInlinerPass());
+
   // Start of CallGraph SCC passes.
   if (!DisableUnitAtATime)
     MPM.add(createPruneEHPass());             // Remove dead EH info
@@ -325,6 +379,15 @@ void PassManagerBuilder::populateModulePassManager(
   // on the rotated form. Disable header duplication at -Oz.
   MPM.add(createLoopRotatePass(SizeLevel == 2 ? 0 : -1));
 
+  // Fuse adjacent loops over the same iteration space, so that the arrays
+  // they share are streamed through the cache once.
+  if (EnableLoopFusion)
+    MPM.add(createLoopFusePass());
+
+  // Block perfect loop nests so that their working set stays in the cache.
+  if (EnableLoopTiling)
+    MPM.add(createLoopTilePass());
+
   // Distribute loops to allow partial vectorization.  I.e. isolate dependences
   // into separate loop that would otherwise inhibit vectorization.
   if (EnableLoopDistribute)
@@ -423,6 +486,11 @@ void PassManagerBuilder::populateModulePassManager(
   if (MergeFunctions)
     MPM.add(createMergeFunctionsPass());
 
+  // Split the cold code out once the inliner and the loop passes are done with
+  // it, so their decisions are made on the whole function.
+  if (EnableHotColdSplit)
+    MPM.add(createHotColdSplittingPass());
+
   addExtensionsToPM(EP_OptimizerLast, MPM);
 }
 
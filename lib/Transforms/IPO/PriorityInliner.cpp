@@ -0,0 +1,444 @@
+//===- PriorityInliner.cpp - Profile-guided global inlining ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a module-level inliner which ranks every call site in
+// the module by its estimated benefit per unit of code growth and inlines them
+// in that order until a whole-module growth budget is exhausted.
+//
+// The benefit of a call site is the call overhead it removes, weighted by how
+// often the call executes.  The execution weight comes from
+// BlockFrequencyInfo, scaled by the caller's entry count when a PGO profile is
+// available.  The size of a call site is the cost computed by the usual inline
+// cost analysis, so argument simplification and dead code in the callee are
+// accounted for.
+//
+// Priorities are recomputed lazily: every function carries a version number
+// which is bumped whenever something is inlined into it, and a queue entry
+// whose caller or callee changed since it was ranked is re-ranked when it
+// reaches the top of the queue.  Ties are broken by the order in which call
+// sites were discovered, so the sequence of decisions (and the report printed
+// with -inline-priority-report) is deterministic.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/IPO.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/InlineCost.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/ScaledNumber.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO/InlinerPass.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <queue>
+using namespace llvm;
+
+#define DEBUG_TYPE "inline-priority"
+
+STATISTIC(NumInlined, "Number of call sites inlined");
+STATISTIC(NumDeleted, "Number of functions deleted because all callers found");
+STATISTIC(NumReranked, "Number of call sites re-ranked after a change");
+STATISTIC(NumOverBudget, "Number of call sites rejected by the growth budget");
+
+static cl::opt<unsigned> GrowthBudget(
+    "inline-priority-budget", cl::init(20), cl::Hidden,
+    cl::desc("Whole-module code growth budget of the priority inliner, as a "
+             "percentage of the initial module size (default = 20)"));
+
+static cl::opt<int> PriorityThreshold(
+    "inline-priority-threshold", cl::init(225), cl::Hidden,
+    cl::desc("Per call site cost threshold of the priority inliner "
+             "(default = 225)"));
+
+static cl::opt<int> HotCallSiteThreshold(
+    "inline-priority-hot-threshold", cl::init(325), cl::Hidden,
+    cl::desc("Per call site cost threshold for hot call sites (default = 325)"));
+
+static cl::opt<int> ColdCallSiteThreshold(
+    "inline-priority-cold-threshold", cl::init(45), cl::Hidden,
+    cl::desc("Per call site cost threshold for call sites that the profile "
+             "says are never executed (default = 45)"));
+
+static cl::opt<unsigned> HotCallSiteRelFreq(
+    "inline-priority-hot-callsite-rel-freq", cl::init(8), cl::Hidden,
+    cl::desc("Minimum block frequency of a call site, relative to the entry "
+             "of its caller, for the call site to be considered hot"));
+
+static cl::opt<bool> PrintReport(
+    "inline-priority-report", cl::init(false), cl::Hidden,
+    cl::desc("Print every decision made by the priority inliner"));
+
+// Threshold to use when optsize is specified.
+const int OptSizeThreshold = 75;
+
+namespace {
+
+typedef ScaledNumber<uint64_t> Scaled64;
+
+/// \brief A call site waiting in the priority queue.
+struct InlineCandidate {
+  WeakVH Call;
+  Scaled64 Priority;
+  /// Discovery order of the call site, used to break ties deterministically.
+  unsigned Order;
+  /// Versions of the caller and callee at the time the call site was ranked.
+  unsigned CallerVersion;
+  unsigned CalleeVersion;
+  /// Cost computed by the inline cost analysis; an estimate of the growth.
+  int Cost;
+  /// Index into the inline history, or -1 for call sites in the input.
+  int InlineHistoryID;
+  bool IsAlways;
+};
+
+struct CandidateCompare {
+  bool operator()(const InlineCandidate &L, const InlineCandidate &R) const {
+    if (L.Priority != R.Priority)
+      return L.Priority < R.Priority;
+    return L.Order > R.Order;
+  }
+};
+
+/// \brief Execution weights of the call sites of one function.
+struct CallSiteWeights {
+  unsigned Version;
+  /// Relative frequency of the call site block; the entry block is 1.0.
+  DenseMap<const Instruction *, Scaled64> RelFreq;
+  /// Entry count of the function, or 1 when there is no profile.
+  Scaled64 EntryCount;
+  bool HasProfile;
+};
+
+class PriorityInliner : public ModulePass {
+  CallGraph *CG;
+  AssumptionCacheTracker *ACT;
+  TargetTransformInfoWrapperPass *TTIWP;
+
+  DenseMap<const Function *, unsigned> Versions;
+  DenseMap<const Function *, CallSiteWeights> Weights;
+  std::priority_queue<InlineCandidate, std::vector<InlineCandidate>,
+                      CandidateCompare> Queue;
+  SmallVector<std::pair<Function *, int>, 8> InlineHistory;
+  unsigned NextOrder;
+
+  const CallSiteWeights &getWeights(Function &F);
+  int getThreshold(CallSite CS, Scaled64 RelFreq, bool HasProfile) const;
+  void enqueue(CallSite CS, unsigned Order, int InlineHistoryID);
+  bool inlineHistoryIncludes(Function *F, int InlineHistoryID) const;
+  void report(CallSite CS, const Twine &Msg) const;
+  void report(Function *Caller, Function *Callee, const Twine &Msg) const;
+
+public:
+  static char ID; // Pass identification, replacement for typeid
+  PriorityInliner() : ModulePass(ID), CG(nullptr), ACT(nullptr),
+                      TTIWP(nullptr), NextOrder(0) {
+    initializePriorityInlinerPass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnModule(Module &M) override;
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+};
+
+} // end anonymous namespace
+
+char PriorityInliner::ID = 0;
+INITIALIZE_PASS_BEGIN(PriorityInliner, "inline-priority",
+                      "Profile-guided priority inliner", false, false)
+INITIALIZE_PASS_DEPENDENCY(AssumptionCacheTracker)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(CallGraphWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(TargetTransformInfoWrapperPass)
+INITIALIZE_PASS_END(PriorityInliner, "inline-priority",
+                    "Profile-guided priority inliner", false, false)
+
+ModulePass *llvm::createPriorityInlinerPass() { return new PriorityInliner(); }
+
+void PriorityInliner::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<AssumptionCacheTracker>();
+  AU.addRequired<BlockFrequencyInfoWrapperPass>();
+  AU.addRequired<CallGraphWrapperPass>();
+  AU.addRequired<TargetTransformInfoWrapperPass>();
+}
+
+static uint64_t getFunctionSize(const Function &F) {
+  uint64_t Size = 0;
+  for (const BasicBlock &BB : F)
+    Size += BB.size();
+  return Size;
+}
+
+/// Return the execution weights of the call sites in \p F, recomputing the
+/// block frequencies if anything has been inlined into \p F since they were
+/// last computed.
+const CallSiteWeights &PriorityInliner::getWeights(Function &F) {
+  unsigned Version = Versions[&F];
+  auto I = Weights.find(&F);
+  if (I != Weights.end() && I->second.Version == Version)
+    return I->second;
+
+  CallSiteWeights &W = Weights[&F];
+  W.Version = Version;
+  W.RelFreq.clear();
+  Optional<uint64_t> EntryCount = F.getEntryCount();
+  W.HasProfile = EntryCount.hasValue();
+  W.EntryCount = Scaled64::get(W.HasProfile ? *EntryCount : 1);
+
+  BlockFrequencyInfo &BFI =
+      getAnalysis<BlockFrequencyInfoWrapperPass>(F).getBFI();
+  uint64_t EntryFreq = BFI.getEntryFreq();
+  for (BasicBlock &BB : F) {
+    Scaled64 RelFreq =
+        Scaled64::get(BFI.getBlockFreq(&BB).getFrequency()) /
+        Scaled64::get(EntryFreq);
+    for (Instruction &I : BB)
+      if (CallSite(&I))
+        W.RelFreq[&I] = RelFreq;
+  }
+  return W;
+}
+
+/// Compute the cost threshold for a single call site.  The threshold only
+/// filters out call sites which are too expensive to ever be worthwhile; the
+/// ranking and the growth budget decide what actually gets inlined.
+int PriorityInliner::getThreshold(CallSite CS, Scaled64 RelFreq,
+                                  bool HasProfile) const {
+  Function *Caller = CS.getCaller();
+  int Threshold = PriorityThreshold;
+  if (Caller->hasFnAttribute(Attribute::OptimizeForSize) &&
+      OptSizeThreshold < Threshold)
+    Threshold = OptSizeThreshold;
+
+  // A call site that the profile says never runs only gets inlined if that
+  // doesn't make the caller bigger.
+  if (HasProfile && RelFreq.isZero())
+    return std::min(Threshold, int(ColdCallSiteThreshold));
+
+  if (RelFreq >= Scaled64::get(HotCallSiteRelFreq) &&
+      !Caller->hasFnAttribute(Attribute::MinSize))
+    Threshold = std::max(Threshold, int(HotCallSiteThreshold));
+  return Threshold;
+}
+
+void PriorityInliner::report(CallSite CS, const Twine &Msg) const {
+  report(CS.getCaller(), CS.getCalledFunction(), Msg);
+}
+
+void PriorityInliner::report(Function *Caller, Function *Callee,
+                             const Twine &Msg) const {
+  if (PrintReport)
+    errs() << "inline-priority: " << Caller->getName() << " -> "
+           << Callee->getName() << ": " << Msg << "\n";
+  DEBUG(dbgs() << "    " << Caller->getName() << " -> " << Callee->getName()
+               << ": " << Msg << "\n");
+}
+
+/// Rank the call site \p CS and push it onto the queue, unless the inline cost
+/// analysis says it must never be inlined.
+void PriorityInliner::enqueue(CallSite CS, unsigned Order,
+                              int InlineHistoryID) {
+  Function *Caller = CS.getCaller();
+  Function *Callee = CS.getCalledFunction();
+  const CallSiteWeights &W = getWeights(*Caller);
+  Scaled64 RelFreq = W.RelFreq.lookup(CS.getInstruction());
+
+  InlineCost IC = getInlineCost(CS, Callee,
+                                getThreshold(CS, RelFreq, W.HasProfile),
+                                TTIWP->getTTI(*Callee), ACT);
+  if (IC.isNever()) {
+    report(CS, "never inlined (cost=never)");
+    return;
+  }
+  if (!IC) {
+    report(CS, "too costly (cost=" + Twine(IC.getCost()) + ", threshold=" +
+                   Twine(IC.getCostDelta() + IC.getCost()) + ")");
+    return;
+  }
+
+  InlineCandidate C;
+  C.Call = CS.getInstruction();
+  C.Order = Order;
+  C.CallerVersion = Versions[Caller];
+  C.CalleeVersion = Versions[Callee];
+  C.InlineHistoryID = InlineHistoryID;
+  C.IsAlways = IC.isAlways();
+  if (C.IsAlways) {
+    C.Cost = 0;
+    C.Priority = Scaled64::getLargest();
+  } else {
+    // The benefit is the call overhead which goes away, weighted by how often
+    // the call executes; the size is what the cost analysis expects the
+    // callee to add to the caller after simplification.
+    C.Cost = IC.getCost();
+    int Benefit = InlineConstants::CallPenalty +
+                  InlineConstants::InstrCost * (CS.arg_size() + 1);
+    int Size = std::max(C.Cost, InlineConstants::InstrCost);
+    C.Priority = RelFreq * W.EntryCount * Scaled64::get(Benefit) /
+                 Scaled64::get(Size);
+  }
+  Queue.push(C);
+}
+
+/// Return true if the specified inline history ID indicates an inline history
+/// that includes the specified function.
+bool PriorityInliner::inlineHistoryIncludes(Function *F,
+                                            int InlineHistoryID) const {
+  while (InlineHistoryID != -1) {
+    assert(unsigned(InlineHistoryID) < InlineHistory.size() &&
+           "Invalid inline history ID");
+    if (InlineHistory[InlineHistoryID].first == F)
+      return true;
+    InlineHistoryID = InlineHistory[InlineHistoryID].second;
+  }
+  return false;
+}
+
+static bool isInlineCandidate(CallSite CS) {
+  if (!CS || isa<IntrinsicInst>(CS.getInstruction()))
+    return false;
+  Function *Callee = CS.getCalledFunction();
+  return Callee && !Callee->isDeclaration();
+}
+
+bool PriorityInliner::runOnModule(Module &M) {
+  CG = &getAnalysis<CallGraphWrapperPass>().getCallGraph();
+  ACT = &getAnalysis<AssumptionCacheTracker>();
+  TTIWP = &getAnalysis<TargetTransformInfoWrapperPass>();
+
+  // Size the budget from the module as it is before any inlining.
+  uint64_t ModuleSize = 0;
+  for (Function &F : M)
+    ModuleSize += getFunctionSize(F);
+  int64_t Budget = ModuleSize * GrowthBudget / 100;
+  int64_t Growth = 0;
+
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    for (BasicBlock &BB : F)
+      for (Instruction &I : BB) {
+        CallSite CS(&I);
+        if (isInlineCandidate(CS))
+          enqueue(CS, NextOrder++, -1);
+      }
+  }
+
+  DEBUG(dbgs() << "Priority inliner: " << Queue.size()
+               << " candidates, module size " << ModuleSize << ", budget "
+               << Budget << "\n");
+
+  InlineFunctionInfo IFI(CG, nullptr, ACT);
+  bool Changed = false;
+  while (!Queue.empty()) {
+    InlineCandidate C = Queue.top();
+    Queue.pop();
+
+    // The call site may have been deleted along with a dead function.
+    if (!C.Call)
+      continue;
+    CallSite CS(C.Call);
+    Function *Caller = CS.getCaller();
+    Function *Callee = CS.getCalledFunction();
+
+    // Re-rank the call site if either side changed since it was ranked.
+    if (C.CallerVersion != Versions[Caller] ||
+        C.CalleeVersion != Versions[Callee]) {
+      ++NumReranked;
+      enqueue(CS, C.Order, C.InlineHistoryID);
+      continue;
+    }
+
+    if (C.InlineHistoryID != -1 &&
+        inlineHistoryIncludes(Callee, C.InlineHistoryID)) {
+      report(CS, "recursive through inlined call sites");
+      continue;
+    }
+
+    int64_t SiteGrowth = std::max(C.Cost, 0) / InlineConstants::InstrCost;
+    if (!C.IsAlways && Growth + SiteGrowth > Budget) {
+      ++NumOverBudget;
+      report(CS, "over budget (priority=" + C.Priority.toString() +
+                     ", growth=" + Twine(SiteGrowth) + ", used=" +
+                     Twine(Growth) + ", budget=" + Twine(Budget) + ")");
+      continue;
+    }
+
+    LLVMContext &Ctx = Caller->getContext();
+    DebugLoc DLoc = CS.getInstruction()->getDebugLoc();
+    std::string Priority =
+        C.IsAlways ? std::string("always") : C.Priority.toString();
+    if (!InlineFunction(CS, IFI)) {
+      report(CS, "not inlinable (priority=" + Priority + ")");
+      emitOptimizationRemarkMissed(Ctx, DEBUG_TYPE, *Caller, DLoc,
+                                   Twine(Callee->getName() +
+                                         " will not be inlined into " +
+                                         Caller->getName()));
+      continue;
+    }
+    AdjustCallerSSPLevel(Caller, Callee);
+    // The call site is gone once inlined, so name its ends directly.
+    report(Caller, Callee, "inlined (priority=" + Priority + ", cost=" +
+                               Twine(C.Cost) + ")");
+    emitOptimizationRemark(Ctx, DEBUG_TYPE, *Caller, DLoc,
+                           Twine(Callee->getName() + " inlined into " +
+                                 Caller->getName()));
+    ++NumInlined;
+    ++Versions[Caller];
+    Growth += SiteGrowth;
+    Changed = true;
+
+    // Queue up the call sites which came along with the callee body.
+    if (!IFI.InlinedCalls.empty()) {
+      int NewHistoryID = InlineHistory.size();
+      InlineHistory.push_back(std::make_pair(Callee, C.InlineHistoryID));
+      for (Value *Ptr : IFI.InlinedCalls) {
+        CallSite NewCS(Ptr);
+        if (isInlineCandidate(NewCS))
+          enqueue(NewCS, NextOrder++, NewHistoryID);
+      }
+    }
+
+    // If we inlined the last call to a local function, delete its body now
+    // and hand its size back to the budget.
+    if (Callee->use_empty() && Callee->hasLocalLinkage() &&
+        (*CG)[Callee]->getNumReferences() == 0) {
+      DEBUG(dbgs() << "    -> Deleting dead function: " << Callee->getName()
+                   << "\n");
+      Growth -= getFunctionSize(*Callee);
+      Versions.erase(Callee);
+      Weights.erase(Callee);
+      CallGraphNode *CalleeNode = (*CG)[Callee];
+      CalleeNode->removeAllCalledFunctions();
+      delete CG->removeFunctionFromModule(CalleeNode);
+      ++NumDeleted;
+    }
+  }
+
+  if (PrintReport)
+    errs() << "inline-priority: growth " << Growth << " of budget " << Budget
+           << " instructions\n";
+
+  Versions.clear();
+  Weights.clear();
+  InlineHistory.clear();
+  NextOrder = 0;
+  return Changed;
+}
@@ -57,6 +57,9 @@
 #include "llvm/IR/ValueHandle.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Utils/Local.h"
@@ -74,6 +77,80 @@ STATISTIC(NumSunkInst , "Number of instructions sunk");
 STATISTIC(NumExpand,    "Number of expansions");
 STATISTIC(NumFactor   , "Number of factorizations");
 STATISTIC(NumReassoc  , "Number of reassociations");
+STATISTIC(NumIterationLimit, "Number of functions that hit the iteration limit");
+
+static cl::opt<unsigned> MaxIterations(
+    "instcombine-max-iterations", cl::Hidden, cl::init(1000),
+    cl::desc("Maximum number of times the worklist is seeded with the whole "
+             "function. With 1, only the users of changed instructions are "
+             "revisited."));
+
+static cl::opt<bool> EnableVisitStats(
+    "instcombine-visit-stats", cl::Hidden, cl::init(false),
+    cl::desc("Count and time the visits of each opcode, and print them at "
+             "exit"));
+
+// CreateInfoOutputFile - Return a file stream to print our output on.
+namespace llvm { extern raw_ostream *CreateInfoOutputFile(); }
+
+namespace {
+/// \brief The number of visits, the number of visits that changed something,
+/// and the time spent in the visitor, for each opcode.
+class VisitStatsInfo {
+  struct OpcodeStats {
+    unsigned Visits;
+    unsigned Hits;
+    TimeRecord Time;
+
+    OpcodeStats() : Visits(0), Hits(0) {}
+  };
+  OpcodeStats Opcodes[Instruction::OtherOpsEnd];
+
+public:
+  void addVisit(unsigned Opcode, bool Hit, const TimeRecord &Time) {
+    OpcodeStats &Stats = Opcodes[Opcode];
+    ++Stats.Visits;
+    if (Hit)
+      ++Stats.Hits;
+    Stats.Time += Time;
+  }
+
+  void print(raw_ostream &OS) const;
+
+  ~VisitStatsInfo() {
+    std::unique_ptr<raw_ostream> OutStream(CreateInfoOutputFile());
+    print(*OutStream);
+  }
+};
+}
+
+void VisitStatsInfo::print(raw_ostream &OS) const {
+  // Most expensive visitors first.
+  SmallVector<unsigned, 64> Order;
+  for (unsigned Opcode = 0; Opcode != Instruction::OtherOpsEnd; ++Opcode)
+    if (Opcodes[Opcode].Visits)
+      Order.push_back(Opcode);
+  if (Order.empty())
+    return;
+  std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+    return Opcodes[B].Time.getProcessTime() < Opcodes[A].Time.getProcessTime();
+  });
+
+  OS << "===" << std::string(73, '-') << "===\n"
+     << "                    Instruction combining visitor statistics\n"
+     << "===" << std::string(73, '-') << "===\n\n"
+     << "    Visits      Hits  Time (s)  Opcode\n";
+  for (unsigned Opcode : Order) {
+    const OpcodeStats &Stats = Opcodes[Opcode];
+    OS << format("%10u %9u %9.4f", Stats.Visits, Stats.Hits,
+                 Stats.Time.getProcessTime())
+       << "  " << Instruction::getOpcodeName(Opcode) << '\n';
+  }
+  OS << '\n';
+  OS.flush();
+}
+
+static ManagedStatic<VisitStatsInfo> VisitStats;
 
 Value *InstCombiner::EmitGEPOffset(User *GEP) {
   return llvm::EmitGEPOffset(Builder, DL, GEP);
@@ -1370,11 +1447,15 @@ Instruction *InstCombiner::visitGetElementPtrInst(GetElementPtrInst &GEP) {
       }
 
     Type *IndexTy = (*I)->getType();
-    if (IndexTy != IntPtrTy) {
+    Type *NewIndexTy = IntPtrTy;
+    // A scalar base may be indexed by a vector; keep the index a vector.
+    if (IndexTy->isVectorTy() && !IntPtrTy->isVectorTy())
+      NewIndexTy = VectorType::get(IntPtrTy, IndexTy->getVectorNumElements());
+    if (IndexTy != NewIndexTy) {
       // If we are using a wider index than needed for this platform, shrink
       // it to what we need.  If narrower, sign-extend it to what we need.
       // This explicit cast can make subsequent optimizations more obvious.
-      *I = Builder->CreateIntCast(*I, IntPtrTy, true);
+      *I = Builder->CreateIntCast(*I, NewIndexTy, true);
       MadeChange = true;
     }
   }
@@ -2774,7 +2855,19 @@ bool InstCombiner::run() {
     DEBUG(raw_string_ostream SS(OrigI); I->print(SS); OrigI = SS.str(););
     DEBUG(dbgs() << "IC: Visiting: " << OrigI << '\n');
 
-    if (Instruction *Result = visit(*I)) {
+    Instruction *Result;
+    if (EnableVisitStats) {
+      unsigned Opcode = I->getOpcode();
+      TimeRecord Time;
+      Time -= TimeRecord::getCurrentTime(true);
+      Result = visit(*I);
+      Time += TimeRecord::getCurrentTime(false);
+      VisitStats->addVisit(Opcode, Result != nullptr, Time);
+    } else {
+      Result = visit(*I);
+    }
+
+    if (Result) {
       ++NumCombined;
       // Should we replace the old instruction with a new one?
       if (Result != I) {
@@ -3009,9 +3102,16 @@ combineInstructionsOverFunction(Function &F, InstCombineWorklist &Worklist,
   bool DbgDeclaresChanged = LowerDbgDeclare(F);
 
   // Iterate while there is work to do.
-  int Iteration = 0;
+  unsigned Iteration = 0;
+  bool MadeIRChange = false;
   for (;;) {
     ++Iteration;
+    if (Iteration > MaxIterations) {
+      DEBUG(dbgs() << "\n\nINSTCOMBINE ITERATION LIMIT REACHED on "
+                   << F.getName() << "\n");
+      ++NumIterationLimit;
+      break;
+    }
     DEBUG(dbgs() << "\n\nINSTCOMBINE ITERATION #" << Iteration << " on "
                  << F.getName() << "\n");
 
@@ -3026,9 +3126,10 @@ combineInstructionsOverFunction(Function &F, InstCombineWorklist &Worklist,
 
     if (!Changed)
       break;
+    MadeIRChange = true;
   }
 
-  return DbgDeclaresChanged || Iteration > 1;
+  return DbgDeclaresChanged || MadeIRChange;
 }
 
 PreservedAnalyses InstCombinePass::run(Function &F,
@@ -18,6 +18,7 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
@@ -27,6 +28,7 @@
 #include "llvm/Analysis/MemoryBuiltins.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/DataLayout.h"
@@ -203,6 +205,24 @@ static cl::opt<bool> ClOptGlobals("asan-opt-globals",
 static cl::opt<bool> ClOptStack(
     "asan-opt-stack", cl::desc("Don't instrument scalar stack variables"),
     cl::Hidden, cl::init(false));
+static cl::opt<bool> ClOptDominating(
+    "asan-opt-dominating",
+    cl::desc("Don't instrument accesses covered by a dominating check"),
+    cl::Hidden, cl::init(true));
+static cl::opt<bool> ClOptMergeAdjacent(
+    "asan-opt-merge-adjacent",
+    cl::desc("Merge the checks of adjacent accesses into a single wider check"),
+    cl::Hidden, cl::init(false));
+static cl::opt<unsigned> ClOptDominatingMaxBlocks(
+    "asan-opt-dominating-max-blocks",
+    cl::desc("Maximal number of blocks to scan for calls between a check and "
+             "the access it covers"),
+    cl::Hidden, cl::init(32));
+static cl::opt<unsigned> ClOptDominatingMaxChecks(
+    "asan-opt-dominating-max-checks",
+    cl::desc("Maximal number of dominating checks of a base pointer that an "
+             "access is compared with"),
+    cl::Hidden, cl::init(16));
 
 static cl::opt<bool> ClCheckLifetime(
     "asan-check-lifetime",
@@ -237,6 +257,10 @@ STATISTIC(NumOptimizedAccessesToGlobalVar,
           "Number of optimized accesses to global vars");
 STATISTIC(NumOptimizedAccessesToStackVar,
           "Number of optimized accesses to stack vars");
+STATISTIC(NumOptimizedAccessesByDominatingCheck,
+          "Number of accesses covered by a dominating check");
+STATISTIC(NumMergedAccesses,
+          "Number of accesses merged into the check of an adjacent access");
 
 namespace {
 /// Frontend-provided metadata for source location.
@@ -423,9 +447,17 @@ struct AddressSanitizer : public FunctionPass {
   void instrumentMop(ObjectSizeOffsetVisitor &ObjSizeVis, Instruction *I,
                      bool UseCalls, const DataLayout &DL);
   void instrumentPointerComparisonOrSubtraction(Instruction *I);
+  // An access whose check was merged into a wider one: its offset in bytes
+  // from the start of the wider check, and its size in bits.
+  struct WidenedMember {
+    Instruction *I;
+    uint64_t Offset;
+    uint32_t TypeSize;
+  };
   void instrumentAddress(Instruction *OrigIns, Instruction *InsertBefore,
                          Value *Addr, uint32_t TypeSize, bool IsWrite,
-                         Value *SizeArgument, bool UseCalls, uint32_t Exp);
+                         Value *SizeArgument, bool UseCalls, uint32_t Exp,
+                         ArrayRef<WidenedMember> Members = None);
   void instrumentUnusualSizeOrAlignment(Instruction *I, Value *Addr,
                                         uint32_t TypeSize, bool IsWrite,
                                         Value *SizeArgument, bool UseCalls,
@@ -451,6 +483,11 @@ struct AddressSanitizer : public FunctionPass {
   bool GlobalIsLinkerInitialized(GlobalVariable *G);
   bool isSafeAccess(ObjectSizeOffsetVisitor &ObjSizeVis, Value *Addr,
                     uint64_t TypeSize) const;
+  bool isCheckedWithOneShadowLoad(uint64_t TypeSize, unsigned Alignment) const;
+  bool noCallsBetween(BasicBlock *From, BasicBlock *To,
+                      const DenseMap<BasicBlock *, unsigned> &NumCalls) const;
+  void removeRedundantChecks(Function &F,
+                             SmallVectorImpl<Instruction *> &ToInstrument);
 
   LLVMContext *C;
   Triple TargetTriple;
@@ -473,6 +510,9 @@ struct AddressSanitizer : public FunctionPass {
   InlineAsm *EmptyAsm;
   GlobalsMetadata GlobalsMD;
   DenseMap<AllocaInst *, bool> ProcessedAllocas;
+  // Accesses whose check was widened to cover adjacent accesses, mapped to the
+  // accesses the check covers, themselves included.
+  DenseMap<Instruction *, SmallVector<WidenedMember, 4>> WidenedChecks;
 
   friend struct FunctionStackPoisoner;
 };
@@ -907,6 +947,14 @@ void AddressSanitizer::instrumentMop(ObjectSizeOffsetVisitor &ObjSizeVis,
   uint64_t TypeSize = 0;
   Value *Addr = isInterestingMemoryAccess(I, &IsWrite, &TypeSize, &Alignment);
   assert(Addr);
+  ArrayRef<WidenedMember> Members;
+  auto Widened = WidenedChecks.find(I);
+  if (Widened != WidenedChecks.end()) {
+    Members = Widened->second;
+    TypeSize = 0;
+    for (const WidenedMember &M : Members)
+      TypeSize += M.TypeSize;
+  }
 
   // Optimization experiments.
   // The experiments can be used to evaluate potential optimizations that remove
@@ -946,18 +994,26 @@ void AddressSanitizer::instrumentMop(ObjectSizeOffsetVisitor &ObjSizeVis,
   else
     NumInstrumentedReads++;
 
-  unsigned Granularity = 1 << Mapping.Scale;
-  // Instrument a 1-, 2-, 4-, 8-, or 16- byte access with one check
-  // if the data is properly aligned.
-  if ((TypeSize == 8 || TypeSize == 16 || TypeSize == 32 || TypeSize == 64 ||
-       TypeSize == 128) &&
-      (Alignment >= Granularity || Alignment == 0 || Alignment >= TypeSize / 8))
+  if (isCheckedWithOneShadowLoad(TypeSize, Alignment))
     return instrumentAddress(I, I, Addr, TypeSize, IsWrite, nullptr, UseCalls,
-                             Exp);
+                             Exp, Members);
   instrumentUnusualSizeOrAlignment(I, Addr, TypeSize, IsWrite, nullptr,
                                    UseCalls, Exp);
 }
 
+// Instrument a 1-, 2-, 4-, 8-, or 16- byte access with one check
+// if the data is properly aligned. Such a check covers all the bytes of the
+// access, while the check of an unusual access only looks at its first and
+// last bytes.
+bool AddressSanitizer::isCheckedWithOneShadowLoad(uint64_t TypeSize,
+                                                  unsigned Alignment) const {
+  unsigned Granularity = 1 << Mapping.Scale;
+  return (TypeSize == 8 || TypeSize == 16 || TypeSize == 32 ||
+          TypeSize == 64 || TypeSize == 128) &&
+         (Alignment >= Granularity || Alignment == 0 ||
+          Alignment >= TypeSize / 8);
+}
+
 Instruction *AddressSanitizer::generateCrashCode(Instruction *InsertBefore,
                                                  Value *Addr, bool IsWrite,
                                                  size_t AccessSizeIndex,
@@ -1011,18 +1067,32 @@ void AddressSanitizer::instrumentAddress(Instruction *OrigIns,
                                          Instruction *InsertBefore, Value *Addr,
                                          uint32_t TypeSize, bool IsWrite,
                                          Value *SizeArgument, bool UseCalls,
-                                         uint32_t Exp) {
+                                         uint32_t Exp,
+                                         ArrayRef<WidenedMember> Members) {
   IRBuilder<> IRB(InsertBefore);
   Value *AddrLong = IRB.CreatePointerCast(Addr, IntptrTy);
   size_t AccessSizeIndex = TypeSizeToSizeIndex(TypeSize);
 
   if (UseCalls) {
-    if (Exp == 0)
-      IRB.CreateCall(AsanMemoryAccessCallback[IsWrite][0][AccessSizeIndex],
-                     AddrLong);
-    else
-      IRB.CreateCall(AsanMemoryAccessCallback[IsWrite][1][AccessSizeIndex],
-                     {AddrLong, ConstantInt::get(IRB.getInt32Ty(), Exp)});
+    // The callbacks report the access they check, so a widened check is
+    // split back into the checks of its members.
+    SmallVector<WidenedMember, 4> Checks(Members.begin(), Members.end());
+    if (Checks.empty())
+      Checks.push_back({OrigIns, 0, TypeSize});
+    for (const WidenedMember &M : Checks) {
+      IRB.SetCurrentDebugLocation(M.I->getDebugLoc());
+      Value *CheckAddr = AddrLong;
+      if (M.Offset)
+        CheckAddr =
+            IRB.CreateAdd(AddrLong, ConstantInt::get(IntptrTy, M.Offset));
+      size_t CheckSizeIndex = TypeSizeToSizeIndex(M.TypeSize);
+      if (Exp == 0)
+        IRB.CreateCall(AsanMemoryAccessCallback[IsWrite][0][CheckSizeIndex],
+                       CheckAddr);
+      else
+        IRB.CreateCall(AsanMemoryAccessCallback[IsWrite][1][CheckSizeIndex],
+                       {CheckAddr, ConstantInt::get(IRB.getInt32Ty(), Exp)});
+    }
     return;
   }
 
@@ -1056,6 +1126,17 @@ void AddressSanitizer::instrumentAddress(Instruction *OrigIns,
     CrashTerm = SplitBlockAndInsertIfThen(Cmp, InsertBefore, true);
   }
 
+  // When a widened check fails, check its members in order, so that the first
+  // bad one is reported with its own location and size.
+  for (const WidenedMember &M : Members) {
+    Value *MemberAddr = AddrLong;
+    if (M.Offset)
+      MemberAddr = BinaryOperator::CreateAdd(
+          AddrLong, ConstantInt::get(IntptrTy, M.Offset), "", CrashTerm);
+    instrumentAddress(M.I, CrashTerm, MemberAddr, M.TypeSize, IsWrite, nullptr,
+                      false, Exp);
+  }
+
   Instruction *Crash = generateCrashCode(CrashTerm, AddrLong, IsWrite,
                                          AccessSizeIndex, SizeArgument, Exp);
   Crash->setDebugLoc(OrigIns->getDebugLoc());
@@ -1479,6 +1560,204 @@ bool AddressSanitizer::maybeInsertAsanInitAtFunctionEntry(Function &F) {
   return false;
 }
 
+// Return true if no path from the end of From to the beginning of To, which
+// From dominates, goes through a call.
+bool AddressSanitizer::noCallsBetween(
+    BasicBlock *From, BasicBlock *To,
+    const DenseMap<BasicBlock *, unsigned> &NumCalls) const {
+  SmallPtrSet<BasicBlock *, 16> Visited;
+  SmallVector<BasicBlock *, 16> Worklist(pred_begin(To), pred_end(To));
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.pop_back_val();
+    if (BB == From || !Visited.insert(BB).second)
+      continue;
+    if (NumCalls.lookup(BB) != 0 || Visited.size() > ClOptDominatingMaxBlocks)
+      return false;
+    Worklist.append(pred_begin(BB), pred_end(BB));
+  }
+  return true;
+}
+
+// Drop the checks of the accesses whose bytes are already checked when they
+// execute, and optionally merge the checks of adjacent accesses of a block.
+// Only the accesses at a constant offset from some base pointer are
+// considered. Any call may change the shadow (free, poisoning of a stack
+// variable, ...), so a check only covers the accesses that it reaches without
+// going through a call.
+void AddressSanitizer::removeRedundantChecks(
+    Function &F, SmallVectorImpl<Instruction *> &ToInstrument) {
+  struct Access {
+    Instruction *I;
+    Value *Base;
+    int64_t Offset;
+    uint64_t Size;  // In bytes.
+    unsigned Alignment;
+    bool IsWrite;
+    // The number of calls before I in its block.
+    unsigned Segment;
+    bool Removed;
+  };
+
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  SmallPtrSet<Instruction *, 16> Interesting(ToInstrument.begin(),
+                                             ToInstrument.end());
+  DenseMap<BasicBlock *, unsigned> NumCalls;
+  SmallVector<Access, 16> Accesses;
+  for (auto &BB : F) {
+    unsigned N = 0;
+    for (auto &Inst : BB) {
+      if (isa<DbgInfoIntrinsic>(Inst))
+        continue;
+      if (CallSite(&Inst)) {
+        ++N;
+        continue;
+      }
+      if (!Interesting.count(&Inst))
+        continue;
+      bool IsWrite;
+      uint64_t TypeSize;
+      unsigned Alignment;
+      Value *Addr =
+          isInterestingMemoryAccess(&Inst, &IsWrite, &TypeSize, &Alignment);
+      if (!Addr || TypeSize % 8 != 0)
+        continue;
+      int64_t Offset;
+      Value *Base = GetPointerBaseWithConstantOffset(Addr, Offset, DL);
+      Accesses.push_back(
+          {&Inst, Base, Offset, TypeSize / 8, Alignment, IsWrite, N, false});
+    }
+    NumCalls[&BB] = N;
+  }
+
+  // Merge the accesses that follow each other in memory and in the same
+  // call-free part of a block. The check of the first access is widened when
+  // the whole run can still be checked with a single shadow load. Only
+  // accesses that can be checked on their own with one shadow load are
+  // merged, so that a failed check can still report the bad access.
+  auto IsMergeable = [](const Access &A) {
+    return isPowerOf2_64(A.Size) && A.Size <= 16;
+  };
+  if (ClOptMergeAdjacent) {
+    for (unsigned i = 0, e = Accesses.size(); i != e; ++i) {
+      Access &Leader = Accesses[i];
+      if (Leader.Removed || Leader.Alignment == 0 || !IsMergeable(Leader))
+        continue;
+      SmallVector<unsigned, 4> Run;
+      uint64_t RunSize = Leader.Size;
+      uint64_t BestSize = 0;
+      unsigned BestLength = 0;
+      for (unsigned j = i + 1; j != e && RunSize < 16; ++j) {
+        Access &A = Accesses[j];
+        if (A.I->getParent() != Leader.I->getParent() ||
+            A.Segment != Leader.Segment)
+          break;
+        if (A.Removed || A.Base != Leader.Base || A.IsWrite != Leader.IsWrite ||
+            A.Offset != Leader.Offset + int64_t(RunSize) || !IsMergeable(A))
+          continue;
+        Run.push_back(j);
+        RunSize += A.Size;
+        if (isCheckedWithOneShadowLoad(RunSize * 8, Leader.Alignment)) {
+          BestSize = RunSize;
+          BestLength = Run.size();
+        }
+      }
+      if (!BestLength)
+        continue;
+      auto &Members = WidenedChecks[Leader.I];
+      Members.push_back({Leader.I, 0, uint32_t(Leader.Size * 8)});
+      for (unsigned j = 0; j != BestLength; ++j) {
+        Access &A = Accesses[Run[j]];
+        A.Removed = true;
+        Members.push_back(
+            {A.I, uint64_t(A.Offset - Leader.Offset), uint32_t(A.Size * 8)});
+        NumMergedAccesses++;
+      }
+      Leader.Size = BestSize;
+    }
+  }
+
+  if (ClOptDominating) {
+    // The accesses of each block are next to each other, in program order.
+    DenseMap<BasicBlock *, std::pair<unsigned, unsigned>> AccessesOfBlock;
+    for (unsigned i = 0, e = Accesses.size(); i != e; ++i) {
+      auto &Range = AccessesOfBlock.insert(std::make_pair(
+          Accesses[i].I->getParent(), std::make_pair(i, i))).first->second;
+      Range.second = i + 1;
+    }
+
+    auto Covers = [&](const Access &Cover, const Access &A) {
+      if (Cover.Offset > A.Offset ||
+          Cover.Offset + Cover.Size < A.Offset + A.Size)
+        return false;
+      BasicBlock *CoverBB = Cover.I->getParent();
+      BasicBlock *BB = A.I->getParent();
+      if (CoverBB == BB)
+        return Cover.Segment == A.Segment;
+      return Cover.Segment == NumCalls[CoverBB] && A.Segment == 0 &&
+             noCallsBetween(CoverBB, BB, NumCalls);
+    };
+
+    // Walk the dominator tree, keeping the checks of the blocks dominating the
+    // current one (and of the accesses before the current one in its block) by
+    // base pointer, so that each access is only compared with the checks that
+    // execute before it.
+    DenseMap<Value *, SmallVector<unsigned, 8>> LiveChecks;
+    SmallVector<Value *, 16> LiveBases;
+    struct Frame {
+      DomTreeNode *Node;
+      DomTreeNode::iterator NextChild;
+      unsigned NumLive;
+    };
+    SmallVector<Frame, 16> Stack;
+    auto Enter = [&](DomTreeNode *Node) {
+      Stack.push_back({Node, Node->begin(), unsigned(LiveBases.size())});
+      auto Range = AccessesOfBlock.lookup(Node->getBlock());
+      for (unsigned i = Range.first; i != Range.second; ++i) {
+        Access &A = Accesses[i];
+        if (A.Removed)
+          continue;
+        auto &Live = LiveChecks[A.Base];
+        if (std::any_of(Live.rbegin(), Live.rend(), [&](unsigned j) {
+              return Covers(Accesses[j], A);
+            })) {
+          A.Removed = true;
+          NumOptimizedAccessesByDominatingCheck++;
+          continue;
+        }
+        if (Live.size() < ClOptDominatingMaxChecks &&
+            isCheckedWithOneShadowLoad(A.Size * 8, A.Alignment)) {
+          Live.push_back(i);
+          LiveBases.push_back(A.Base);
+        }
+      }
+    };
+
+    Enter(DT->getRootNode());
+    while (!Stack.empty()) {
+      Frame &Top = Stack.back();
+      if (Top.NextChild != Top.Node->end()) {
+        Enter(*Top.NextChild++);
+        continue;
+      }
+      while (LiveBases.size() > Top.NumLive)
+        LiveChecks[LiveBases.pop_back_val()].pop_back();
+      Stack.pop_back();
+    }
+  }
+
+  SmallPtrSet<Instruction *, 16> RemovedChecks;
+  for (auto &A : Accesses)
+    if (A.Removed)
+      RemovedChecks.insert(A.I);
+  if (RemovedChecks.empty())
+    return;
+  ToInstrument.erase(std::remove_if(ToInstrument.begin(), ToInstrument.end(),
+                                    [&](Instruction *I) {
+                                      return RemovedChecks.count(I);
+                                    }),
+                     ToInstrument.end());
+}
+
 bool AddressSanitizer::runOnFunction(Function &F) {
   if (&F == AsanCtorFunction) return false;
   if (F.getLinkage() == GlobalValue::AvailableExternallyLinkage) return false;
@@ -1541,6 +1820,10 @@ bool AddressSanitizer::runOnFunction(Function &F) {
     }
   }
 
+  WidenedChecks.clear();
+  if (ClOpt)
+    removeRedundantChecks(F, ToInstrument);
+
   bool UseCalls =
       CompileKernel ||
       (ClInstrumentationWithCallsThreshold >= 0 &&
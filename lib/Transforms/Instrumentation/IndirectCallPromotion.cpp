@@ -0,0 +1,301 @@
+//===-- IndirectCallPromotion.cpp - Promote indirect calls to direct calls ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the transformation that promotes indirect calls to
+// conditional direct calls when the indirect-call value profile metadata is
+// available.
+//
+// A hot target Foo of the indirect call
+//
+//   %r = call i32 %fptr(i32 %x)
+//
+// is turned into
+//
+//   %cmp = icmp eq i32 (i32)* %fptr, @Foo
+//   br i1 %cmp, label %if.true.direct_targ, label %if.false.orig_indirect
+// if.true.direct_targ:
+//   %r1 = call i32 @Foo(i32 %x)
+//   br label %if.end.icp
+// if.false.orig_indirect:
+//   %r2 = call i32 %fptr(i32 %x)
+//   br label %if.end.icp
+// if.end.icp:
+//   %r = phi i32 [ %r1, %if.true.direct_targ ], [ %r2, %if.false.orig_indirect ]
+//
+// after which the direct call can be inlined. Only call instructions are
+// promoted: invokes are left alone.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Instrumentation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <limits>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "icall-promotion"
+
+STATISTIC(NumOfPGOICallPromotion, "Number of indirect call promotions.");
+STATISTIC(NumOfPGOICallsites, "Number of indirect call candidate sites.");
+
+// Command line option to disable indirect-call promotion with the default as
+// false. This is for debug purpose.
+static cl::opt<bool> DisableICP("disable-icp", cl::init(false), cl::Hidden,
+                                cl::desc("Disable indirect call promotion"));
+
+// The minimum call count for the direct-call target to be considered as the
+// promoted target.
+static cl::opt<unsigned>
+    ICPCountThreshold("icp-count-threshold", cl::Hidden, cl::ZeroOrMore,
+                      cl::init(1000),
+                      cl::desc("The minimum count to the direct call target "
+                               "for the promotion"));
+
+// The percent threshold for the direct-call target (this call site vs the
+// remaining call count) for it to be considered as the promoted target.
+static cl::opt<unsigned>
+    ICPPercentThreshold("icp-percent-threshold", cl::init(30), cl::Hidden,
+                        cl::ZeroOrMore,
+                        cl::desc("The percentage threshold for the promotion"));
+
+// Set the maximum number of targets to promote for a single indirect-call
+// callsite.
+static cl::opt<unsigned>
+    MaxNumPromotions("icp-max-prom", cl::init(2), cl::Hidden, cl::ZeroOrMore,
+                     cl::desc("Max number of promotions for a single indirect "
+                              "call callsite"));
+
+namespace {
+
+class PGOIndirectCallPromotion : public ModulePass {
+public:
+  static char ID;
+
+  PGOIndirectCallPromotion() : ModulePass(ID) {
+    initializePGOIndirectCallPromotionPass(*PassRegistry::getPassRegistry());
+  }
+
+  const char *getPassName() const override {
+    return "PGOIndirectCallPromotion";
+  }
+
+private:
+  /// The functions of the module, by the hash of their profile name.
+  DenseMap<uint64_t, Function *> Symtab;
+
+  bool runOnModule(Module &M) override;
+  bool processFunction(Function &F);
+  unsigned tryToPromote(CallInst *CI, ArrayRef<InstrProfValueData> Targets,
+                        uint64_t &TotalCount);
+};
+
+} // end anonymous namespace
+
+char PGOIndirectCallPromotion::ID = 0;
+INITIALIZE_PASS(PGOIndirectCallPromotion, "pgo-icall-prom",
+                "Use PGO instrumentation profile to promote indirect calls to "
+                "direct calls.",
+                false, false)
+
+ModulePass *llvm::createPGOIndirectCallPromotionPass() {
+  return new PGOIndirectCallPromotion();
+}
+
+/// Return true if the call CI can call Target directly, casting pointer
+/// arguments and the returned pointer as needed.  Only pointers in the same
+/// address space are cast.
+static bool isLegalToPromote(CallInst *CI, Function *Target) {
+  FunctionType *CallTy = CI->getFunctionType();
+  FunctionType *TargetTy = Target->getFunctionType();
+  if (CallTy == TargetTy)
+    return true;
+
+  auto AreCompatible = [](Type *A, Type *B) {
+    return A == B ||
+           (A->isPointerTy() && B->isPointerTy() &&
+            A->getPointerAddressSpace() == B->getPointerAddressSpace());
+  };
+  if (!AreCompatible(CallTy->getReturnType(), TargetTy->getReturnType()))
+    return false;
+  if (TargetTy->isVarArg() != CallTy->isVarArg() ||
+      TargetTy->getNumParams() != CallTy->getNumParams())
+    return false;
+  for (unsigned I = 0, E = TargetTy->getNumParams(); I != E; ++I)
+    if (!AreCompatible(CallTy->getParamType(I), TargetTy->getParamType(I)))
+      return false;
+  return true;
+}
+
+/// Return branch weights for Count and TotalCount - Count, scaled to fit in
+/// 32 bits.
+static MDNode *createBranchWeights(LLVMContext &Ctx, uint64_t Count,
+                                   uint64_t TotalCount) {
+  uint64_t Scale = TotalCount / std::numeric_limits<uint32_t>::max() + 1;
+  return MDBuilder(Ctx).createBranchWeights(
+      static_cast<uint32_t>(Count / Scale),
+      static_cast<uint32_t>((TotalCount - Count) / Scale));
+}
+
+/// Guard a direct call to Target by a comparison of the callee of CI with it.
+/// CI ends up in the else block, where it can be promoted again.
+static void promoteIndirectCall(CallInst *CI, Function *Target, uint64_t Count,
+                                uint64_t TotalCount) {
+  Value *Callee = CI->getCalledValue();
+  Constant *CastedTarget = ConstantExpr::getBitCast(Target, Callee->getType());
+  ICmpInst *Cond = new ICmpInst(CI, ICmpInst::ICMP_EQ, Callee, CastedTarget);
+
+  TerminatorInst *ThenTerm, *ElseTerm;
+  SplitBlockAndInsertIfThenElse(
+      Cond, CI, &ThenTerm, &ElseTerm,
+      createBranchWeights(CI->getContext(), Count, TotalCount));
+  BasicBlock *DirectBB = ThenTerm->getParent();
+  BasicBlock *IndirectBB = ElseTerm->getParent();
+  BasicBlock *MergeBB = CI->getParent();
+  DirectBB->setName("if.true.direct_targ");
+  IndirectBB->setName("if.false.orig_indirect");
+  MergeBB->setName("if.end.icp");
+
+  FunctionType *TargetTy = Target->getFunctionType();
+  SmallVector<Value *, 8> Args;
+  for (unsigned I = 0, E = CI->getNumArgOperands(); I != E; ++I) {
+    Value *Arg = CI->getArgOperand(I);
+    if (I < TargetTy->getNumParams() &&
+        Arg->getType() != TargetTy->getParamType(I))
+      Arg = new BitCastInst(Arg, TargetTy->getParamType(I), "", ThenTerm);
+    Args.push_back(Arg);
+  }
+  // The attributes of cast arguments and of a cast return value describe the
+  // indirect callee's types, so only keep them where the types agree.
+  LLVMContext &Ctx = CI->getContext();
+  AttributeSet Attrs = CI->getAttributes();
+  for (unsigned I = 0, E = TargetTy->getNumParams(); I != E; ++I)
+    if (Args[I]->getType() != CI->getArgOperand(I)->getType())
+      Attrs =
+          Attrs.removeAttributes(Ctx, I + 1, Attrs.getParamAttributes(I + 1));
+  if (TargetTy->getReturnType() != CI->getType())
+    Attrs = Attrs.removeAttributes(Ctx, AttributeSet::ReturnIndex,
+                                   Attrs.getRetAttributes());
+
+  CallInst *DirectCall = CallInst::Create(Target, Args, "", ThenTerm);
+  DirectCall->setCallingConv(CI->getCallingConv());
+  DirectCall->setAttributes(Attrs);
+  DirectCall->setTailCallKind(CI->getTailCallKind());
+  DirectCall->setDebugLoc(CI->getDebugLoc());
+  Value *DirectResult = DirectCall;
+  if (DirectCall->getType() != CI->getType() && !CI->getType()->isVoidTy())
+    DirectResult = new BitCastInst(DirectCall, CI->getType(), "", ThenTerm);
+
+  CI->moveBefore(ElseTerm);
+  if (CI->getType()->isVoidTy() || CI->use_empty())
+    return;
+
+  PHINode *PHI = PHINode::Create(CI->getType(), 2, "", &MergeBB->front());
+  CI->replaceAllUsesWith(PHI);
+  PHI->takeName(CI);
+  PHI->addIncoming(DirectResult, DirectBB);
+  PHI->addIncoming(CI, IndirectBB);
+}
+
+unsigned
+PGOIndirectCallPromotion::tryToPromote(CallInst *CI,
+                                       ArrayRef<InstrProfValueData> Targets,
+                                       uint64_t &TotalCount) {
+  unsigned NumPromoted = 0;
+  for (const InstrProfValueData &VD : Targets) {
+    // The targets are sorted by decreasing count, so the following ones are
+    // not hot enough either.
+    if (NumPromoted == MaxNumPromotions || VD.Count < ICPCountThreshold ||
+        VD.Count * 100 < ICPPercentThreshold * TotalCount)
+      break;
+
+    Function *Target = Symtab.lookup(VD.Value);
+    if (!Target) {
+      DEBUG(dbgs() << " Not promote: Cannot find the target\n");
+      break;
+    }
+    if (!isLegalToPromote(CI, Target)) {
+      DEBUG(dbgs() << " Not promote: Incompatible signature of "
+                   << Target->getName() << "\n");
+      break;
+    }
+
+    DEBUG(dbgs() << " Promote the icall to " << Target->getName()
+                 << " with count " << VD.Count << " out of " << TotalCount
+                 << "\n");
+    promoteIndirectCall(CI, Target, VD.Count, TotalCount);
+    TotalCount -= VD.Count;
+    ++NumPromoted;
+    ++NumOfPGOICallPromotion;
+  }
+  return NumPromoted;
+}
+
+bool PGOIndirectCallPromotion::processFunction(Function &F) {
+  SmallVector<CallInst *, 8> Candidates;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+    if (auto *CI = dyn_cast<CallInst>(&*I))
+      // A musttail call must stay right before its return, which a guarded
+      // direct call would break.
+      if (!CI->getCalledFunction() && !CI->isInlineAsm() &&
+          !CI->isMustTailCall() && CI->getMetadata(LLVMContext::MD_prof))
+        Candidates.push_back(CI);
+
+  bool Changed = false;
+  for (CallInst *CI : Candidates) {
+    SmallVector<InstrProfValueData, 4> Targets;
+    uint64_t TotalCount;
+    if (!getValueProfDataFromInst(*CI, IPVK_IndirectCallTarget, Targets,
+                                  TotalCount))
+      continue;
+    ++NumOfPGOICallsites;
+    DEBUG(dbgs() << "\nWork on callsite " << *CI << "\n");
+
+    unsigned NumPromoted = tryToPromote(CI, Targets, TotalCount);
+    if (NumPromoted == 0)
+      continue;
+    Changed = true;
+
+    // Keep the targets that were not promoted for later passes.
+    CI->setMetadata(LLVMContext::MD_prof, nullptr);
+    annotateValueSite(*CI, IPVK_IndirectCallTarget,
+                      makeArrayRef(Targets).slice(NumPromoted), TotalCount,
+                      Targets.size() - NumPromoted);
+  }
+  return Changed;
+}
+
+bool PGOIndirectCallPromotion::runOnModule(Module &M) {
+  if (DisableICP)
+    return false;
+
+  Symtab.clear();
+  for (Function &F : M)
+    Symtab[getPGOFuncNameHash(getPGOFuncName(F))] = &F;
+
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    Changed |= processFunction(F);
+  }
+  return Changed;
+}
@@ -11,20 +11,54 @@
 // profiling. It also builds the data structures and initialization code needed
 // for updating execution counts and emitting the profile at runtime.
 //
+// The instrprof_value_profile intrinsics are lowered to calls to the runtime,
+// which records the values seen at each site along with the function's
+// profile data.
+//
+// With counter promotion enabled, the counter updates inside a loop are
+// accumulated in a register and added to the counter in memory once at each
+// loop exit. Counts accumulated in a loop that is left by unwinding through a
+// call, or by a call that never returns, are lost.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/Instrumentation.h"
 
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
 
 using namespace llvm;
 
 #define DEBUG_TYPE "instrprof"
 
+STATISTIC(NumPromotedUpdates, "Number of counter updates promoted out of loops");
+STATISTIC(NumFlushedUpdates, "Number of counter updates added at loop exits");
+
+static cl::opt<bool> DoCounterPromotion(
+    "do-counter-promotion", cl::ZeroOrMore, cl::init(false),
+    cl::desc("Keep counter updates in registers inside loops"));
+
+static cl::opt<bool> AtomicCounterUpdateAll(
+    "instrprof-atomic-counter-update-all", cl::ZeroOrMore, cl::init(false),
+    cl::desc("Make all profile counter updates atomic"));
+
+static cl::opt<unsigned> MaxNumOfPromotionsPerLoop(
+    "max-counter-promotions-per-loop", cl::Hidden, cl::init(20),
+    cl::desc("Max number of counters promoted in a single loop"));
+
+static cl::opt<unsigned> MaxNumOfPromotionExits(
+    "max-counter-promotion-exits", cl::Hidden, cl::init(8),
+    cl::desc("Max number of exits of a loop whose counters are promoted"));
+
 namespace {
 
 class InstrProfiling : public ModulePass {
@@ -50,8 +84,19 @@ private:
   InstrProfOptions Options;
   Module *M;
   DenseMap<GlobalVariable *, GlobalVariable *> RegionCounters;
+  DenseMap<GlobalVariable *, GlobalVariable *> ProfileDataVars;
   std::vector<Value *> UsedVars;
 
+  /// The counter updates of the current function that may be promoted out of
+  /// loops. Entries of updates that have been promoted are null.
+  std::vector<Instruction *> PromotionCandidates;
+
+  bool isAtomic() const { return Options.Atomic || AtomicCounterUpdateAll; }
+
+  bool isCounterPromotionEnabled() const {
+    return Options.DoCounterPromotion || DoCounterPromotion;
+  }
+
   bool isMachO() const {
     return Triple(M->getTargetTriple()).isOSBinFormatMachO();
   }
@@ -79,6 +124,22 @@ private:
   /// Replace instrprof_increment with an increment of the appropriate value.
   void lowerIncrement(InstrProfIncrementInst *Inc);
 
+  /// Replace instrprof_value_profile with a call to the runtime.
+  void lowerValueProfileInst(InstrProfValueProfileInst *Ind);
+
+  /// Add Step to the counter at Addr, and return the instruction that writes
+  /// the counter.
+  Instruction *emitCounterUpdate(IRBuilder<> &Builder, Value *Addr,
+                                 Value *Step);
+
+  /// Keep the counter updates in the loops of F in registers, and write them
+  /// back at the loop exits.
+  void promoteCounterUpdates(Function &F);
+
+  /// Promote the counter updates of a single loop, whose inner loops have
+  /// already been processed.
+  void promoteCounterUpdates(Loop *L);
+
   /// Set up the section and uses for coverage data and its references.
   void lowerCoverageData(GlobalVariable *CoverageData);
 
@@ -118,15 +179,28 @@ bool InstrProfiling::runOnModule(Module &M) {
 
   this->M = &M;
   RegionCounters.clear();
+  ProfileDataVars.clear();
   UsedVars.clear();
 
-  for (Function &F : M)
+  for (Function &F : M) {
+    PromotionCandidates.clear();
     for (BasicBlock &BB : F)
       for (auto I = BB.begin(), E = BB.end(); I != E;)
         if (auto *Inc = dyn_cast<InstrProfIncrementInst>(I++)) {
           lowerIncrement(Inc);
           MadeChange = true;
         }
+    if (isCounterPromotionEnabled() && !PromotionCandidates.empty())
+      promoteCounterUpdates(F);
+    // The value profiling sites refer to the data variable created while
+    // lowering the increments.
+    for (BasicBlock &BB : F)
+      for (auto I = BB.begin(), E = BB.end(); I != E;)
+        if (auto *Ind = dyn_cast<InstrProfValueProfileInst>(I++)) {
+          lowerValueProfileInst(Ind);
+          MadeChange = true;
+        }
+  }
   if (GlobalVariable *Coverage = M.getNamedGlobal("__llvm_coverage_mapping")) {
     lowerCoverageData(Coverage);
     MadeChange = true;
@@ -147,12 +221,161 @@ void InstrProfiling::lowerIncrement(InstrProfIncrementInst *Inc) {
   IRBuilder<> Builder(Inc->getParent(), *Inc);
   uint64_t Index = Inc->getIndex()->getZExtValue();
   Value *Addr = Builder.CreateConstInBoundsGEP2_64(Counters, 0, Index);
-  Value *Count = Builder.CreateLoad(Addr, "pgocount");
-  Count = Builder.CreateAdd(Count, Builder.getInt64(1));
-  Inc->replaceAllUsesWith(Builder.CreateStore(Count, Addr));
+  PromotionCandidates.push_back(
+      emitCounterUpdate(Builder, Addr, Builder.getInt64(1)));
   Inc->eraseFromParent();
 }
 
+static Constant *getOrInsertValueProfilingCall(Module &M) {
+  LLVMContext &Ctx = M.getContext();
+  Type *ParamTypes[] = {Type::getInt64Ty(Ctx), Type::getInt8PtrTy(Ctx),
+                        Type::getInt32Ty(Ctx)};
+  auto *ValueProfilingCallTy =
+      FunctionType::get(Type::getVoidTy(Ctx), ParamTypes, false);
+  return M.getOrInsertFunction("__llvm_profile_instrument_target",
+                               ValueProfilingCallTy);
+}
+
+void InstrProfiling::lowerValueProfileInst(InstrProfValueProfileInst *Ind) {
+  auto It = ProfileDataVars.find(Ind->getName());
+  // Without counters there is no profile data to record the values in.
+  if (It == ProfileDataVars.end()) {
+    Ind->eraseFromParent();
+    return;
+  }
+
+  IRBuilder<> Builder(Ind->getParent(), *Ind);
+  Value *Args[] = {Ind->getTargetValue(),
+                   Builder.CreateBitCast(It->second, Builder.getInt8PtrTy()),
+                   Builder.getInt32(Ind->getIndex()->getZExtValue())};
+  Builder.CreateCall(getOrInsertValueProfilingCall(*M), Args);
+  Ind->eraseFromParent();
+}
+
+Instruction *InstrProfiling::emitCounterUpdate(IRBuilder<> &Builder,
+                                               Value *Addr, Value *Step) {
+  if (isAtomic())
+    return Builder.CreateAtomicRMW(AtomicRMWInst::Add, Addr, Step, Monotonic);
+  Value *Count = Builder.CreateLoad(Addr, "pgocount");
+  Count = Builder.CreateAdd(Count, Step);
+  return Builder.CreateStore(Count, Addr);
+}
+
+/// Get the counter address written by a counter update.
+static Value *getUpdateAddr(Instruction *Update) {
+  if (auto *RMW = dyn_cast<AtomicRMWInst>(Update))
+    return RMW->getPointerOperand();
+  return cast<StoreInst>(Update)->getPointerOperand();
+}
+
+/// Get the amount a counter update adds to the counter.
+static Value *getUpdateStep(Instruction *Update) {
+  if (auto *RMW = dyn_cast<AtomicRMWInst>(Update))
+    return RMW->getValOperand();
+  auto *Add = cast<BinaryOperator>(cast<StoreInst>(Update)->getValueOperand());
+  return Add->getOperand(1);
+}
+
+/// Erase a counter update together with the load and add feeding it.
+static void eraseUpdate(Instruction *Update) {
+  if (auto *Store = dyn_cast<StoreInst>(Update)) {
+    auto *Add = cast<Instruction>(Store->getValueOperand());
+    auto *Load = cast<Instruction>(Add->getOperand(0));
+    Store->eraseFromParent();
+    Add->eraseFromParent();
+    Load->eraseFromParent();
+    return;
+  }
+  Update->eraseFromParent();
+}
+
+static void appendLoopsInPostorder(Loop *L, SmallVectorImpl<Loop *> &Loops) {
+  for (Loop *SubLoop : *L)
+    appendLoopsInPostorder(SubLoop, Loops);
+  Loops.push_back(L);
+}
+
+void InstrProfiling::promoteCounterUpdates(Function &F) {
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+
+  // Visit inner loops first, so that the updates they flush at their exits
+  // can in turn be promoted out of the enclosing loops.
+  SmallVector<Loop *, 8> Loops;
+  for (Loop *L : LI)
+    appendLoopsInPostorder(L, Loops);
+  for (Loop *L : Loops)
+    promoteCounterUpdates(L);
+}
+
+void InstrProfiling::promoteCounterUpdates(Loop *L) {
+  BasicBlock *Preheader = L->getLoopPreheader();
+  if (!Preheader || !L->hasDedicatedExits())
+    return;
+
+  SmallVector<BasicBlock *, 8> ExitBlocks;
+  L->getUniqueExitBlocks(ExitBlocks);
+  if (ExitBlocks.empty() || ExitBlocks.size() > MaxNumOfPromotionExits)
+    return;
+  for (BasicBlock *Exit : ExitBlocks)
+    if (Exit->isLandingPad())
+      return;
+
+  // Group the updates in the loop by the counter they write. Counter addresses
+  // are uniqued constant expressions.
+  MapVector<Value *, SmallVector<unsigned, 4>> UpdatesByCounter;
+  for (unsigned I = 0, E = PromotionCandidates.size(); I != E; ++I)
+    if (Instruction *Update = PromotionCandidates[I])
+      if (L->contains(Update->getParent()))
+        UpdatesByCounter[getUpdateAddr(Update)].push_back(I);
+
+  Type *Int64Ty = Type::getInt64Ty(M->getContext());
+  unsigned NumPromoted = 0;
+  for (auto &Counter : UpdatesByCounter) {
+    if (NumPromoted == MaxNumOfPromotionsPerLoop)
+      break;
+
+    // Each block may define the accumulated count only once.
+    SmallPtrSet<BasicBlock *, 8> Blocks;
+    bool HasDuplicate = false;
+    for (unsigned I : Counter.second)
+      if (!Blocks.insert(PromotionCandidates[I]->getParent()).second)
+        HasDuplicate = true;
+    if (HasDuplicate)
+      continue;
+
+    // Replace every update in the loop by an addition to the count
+    // accumulated since the loop was entered.
+    SSAUpdater SSA;
+    SSA.Initialize(Int64Ty, "pgocount.promoted");
+    SSA.AddAvailableValue(Preheader, ConstantInt::get(Int64Ty, 0));
+    SmallVector<Instruction *, 4> Deltas;
+    for (unsigned I : Counter.second) {
+      Instruction *Update = PromotionCandidates[I];
+      Instruction *Delta =
+          BinaryOperator::CreateAdd(UndefValue::get(Int64Ty),
+                                    getUpdateStep(Update), "pgocount.delta",
+                                    Update);
+      SSA.AddAvailableValue(Delta->getParent(), Delta);
+      Deltas.push_back(Delta);
+      eraseUpdate(Update);
+      PromotionCandidates[I] = nullptr;
+      ++NumPromotedUpdates;
+    }
+    for (Instruction *Delta : Deltas)
+      Delta->setOperand(0, SSA.GetValueInMiddleOfBlock(Delta->getParent()));
+
+    // Write the accumulated count back at each exit.
+    for (BasicBlock *Exit : ExitBlocks) {
+      IRBuilder<> Builder(Exit, Exit->getFirstInsertionPt());
+      PromotionCandidates.push_back(emitCounterUpdate(
+          Builder, Counter.first, SSA.GetValueInMiddleOfBlock(Exit)));
+      ++NumFlushedUpdates;
+    }
+    ++NumPromoted;
+  }
+}
+
 void InstrProfiling::lowerCoverageData(GlobalVariable *CoverageData) {
   CoverageData->setSection(getCoverageSection());
   CoverageData->setAlignment(8);
@@ -241,6 +464,7 @@ InstrProfiling::getOrCreateRegionCounters(InstrProfIncrementInst *Inc) {
   Data->setSection(getDataSection());
   Data->setAlignment(8);
   Data->setComdat(Fn->getComdat());
+  ProfileDataVars[Name] = Data;
 
   // Mark the data variable as used so that it isn't stripped out.
   UsedVars.push_back(Data);
@@ -0,0 +1,669 @@
+//===-- PGOInstrumentation.cpp - MST-based PGO Instrumentation ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements IR level profile guided optimization: the
+// instrumentation pass and the profile use pass, which don't depend on the
+// front end.
+//
+// Both passes build the same graph from the CFG of each function: the CFG
+// edges, plus a fake node that is the source of an edge to the entry block and
+// the target of an edge from every block without successors. A maximum
+// spanning tree of this graph is computed with the estimated edge frequencies
+// as weights. Only the edges that are not in the tree are instrumented: the
+// counts of the tree edges follow from flow conservation, and keeping the hot
+// edges in the tree keeps the counters off the hot paths.
+//
+// The instrumentation pass inserts an llvm.instrprof.increment call on each
+// instrumented edge, splitting critical edges when needed. The calls are then
+// lowered by the InstrProfiling pass, and the counts are written in the usual
+// InstrProf format.
+//
+// The profile use pass reads the counts of the instrumented edges from an
+// indexed profile, propagates them to all the edges and blocks, and attaches
+// them to the function as its entry count and to the branches as
+// branch_weights metadata.
+//
+// The targets of indirect calls are profiled as well: the instrumentation
+// pass inserts an llvm.instrprof.value.profile call before each of them, and
+// the profile use pass attaches the most frequent targets to the calls as
+// value profile metadata, for indirect call promotion to use.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Instrumentation.h"
+#include "MaximumSpanningTree.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <limits>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "pgo-instrumentation"
+
+STATISTIC(NumOfPGOInstrument, "Number of edges instrumented.");
+STATISTIC(NumOfPGOEdge, "Number of edges.");
+STATISTIC(NumOfPGOSplit, "Number of critical edge splits.");
+STATISTIC(NumOfPGOFunc, "Number of functions having valid profile counts.");
+STATISTIC(NumOfPGOMismatch, "Number of functions having mismatch profile.");
+STATISTIC(NumOfPGOMissing, "Number of functions without profile.");
+STATISTIC(NumOfPGOICall, "Number of indirect call value instrumentations.");
+
+// Command line option to specify the file to read profile from. This is
+// mainly used for testing.
+static cl::opt<std::string>
+    PGOTestProfileFile("pgo-test-profile-file", cl::init(""), cl::Hidden,
+                       cl::value_desc("filename"),
+                       cl::desc("Specify the path of profile data file. This is"
+                                "mainly for test purpose."));
+
+// Command line option to disable value profiling. The default is true:
+// i.e. value profiling is disabled by default until it is ready to be turned
+// on; pass -disable-vp=false to enable it.
+static cl::opt<bool> DisableValueProfiling("disable-vp", cl::init(true),
+                                           cl::Hidden,
+                                           cl::desc("Disable Value Profiling"));
+
+// Command line option to set the maximum number of targets attached to an
+// indirect call by the profile use pass.
+static cl::opt<unsigned> MaxNumAnnotations(
+    "icp-max-annotations", cl::init(3), cl::Hidden, cl::ZeroOrMore,
+    cl::desc("Max number of annotations for a single indirect call callsite"));
+
+namespace {
+
+/// An edge of the instrumentation graph. A null SrcBB is the fake node feeding
+/// the entry block; a null DestBB is the fake node the exits lead to.
+struct PGOEdge {
+  const BasicBlock *SrcBB;
+  const BasicBlock *DestBB;
+  unsigned SuccNum;
+  double Weight;
+  bool InMST;
+  bool CountValid;
+  uint64_t Count;
+
+  PGOEdge(const BasicBlock *Src, const BasicBlock *Dest, unsigned SuccNum,
+          double Weight)
+      : SrcBB(Src), DestBB(Dest), SuccNum(SuccNum), Weight(Weight),
+        InMST(false), CountValid(false), Count(0) {}
+
+  /// Return true if the edge is not in the spanning tree and has a counter.
+  bool isInstrumented() const { return !InMST; }
+};
+
+/// The instrumentation graph of a function and its spanning tree. The
+/// instrumentation and the profile use passes build it the same way, so that
+/// they agree on which edges have counters and in which order.
+class FuncPGOInstrumentation {
+public:
+  Function &F;
+  std::vector<PGOEdge> Edges;
+  std::string FuncName;
+  uint64_t FunctionHash;
+  /// False if an edge that must be instrumented cannot be: the function is
+  /// then neither instrumented nor annotated.
+  bool IsInstrumentable;
+
+  FuncPGOInstrumentation(Function &F, BranchProbabilityInfo *BPI,
+                         BlockFrequencyInfo *BFI);
+
+  unsigned getNumCounters() const {
+    unsigned NumCounters = 0;
+    for (const PGOEdge &E : Edges)
+      if (E.isInstrumented())
+        ++NumCounters;
+    return NumCounters;
+  }
+
+private:
+  void computeSpanningTree();
+  void computeHash();
+};
+
+} // end anonymous namespace
+
+/// Return true if a counter can be placed on the edge, possibly by splitting
+/// it.
+static bool canInstrumentEdge(const PGOEdge &E) {
+  if (!E.SrcBB || !E.DestBB)
+    return true;
+  const TerminatorInst *TI = E.SrcBB->getTerminator();
+  if (TI->getNumSuccessors() <= 1 || E.DestBB->getSinglePredecessor())
+    return true;
+  return !isa<IndirectBrInst>(TI) && !E.DestBB->isLandingPad();
+}
+
+FuncPGOInstrumentation::FuncPGOInstrumentation(Function &F,
+                                               BranchProbabilityInfo *BPI,
+                                               BlockFrequencyInfo *BFI)
+    : F(F), FuncName(getPGOFuncName(F)), FunctionHash(0),
+      IsInstrumentable(true) {
+  // Edges that cannot carry a counter get an infinite weight so that they
+  // end up in the spanning tree whenever possible.
+  const double Unsplittable = std::numeric_limits<double>::infinity();
+
+  const BasicBlock *Entry = &F.getEntryBlock();
+  Edges.emplace_back(nullptr, Entry, ~0U,
+                     static_cast<double>(BFI->getEntryFreq()));
+  for (const BasicBlock &BB : F) {
+    double Freq = static_cast<double>(BFI->getBlockFreq(&BB).getFrequency());
+    const TerminatorInst *TI = BB.getTerminator();
+    unsigned NumSuccs = TI->getNumSuccessors();
+    if (NumSuccs == 0) {
+      Edges.emplace_back(&BB, nullptr, ~0U, Freq);
+      continue;
+    }
+    for (unsigned I = 0; I != NumSuccs; ++I) {
+      const BasicBlock *Succ = TI->getSuccessor(I);
+      double Weight =
+          (BFI->getBlockFreq(&BB) * BPI->getEdgeProbability(&BB, I))
+              .getFrequency();
+      Edges.emplace_back(&BB, Succ, I, Weight);
+      if (!canInstrumentEdge(Edges.back()))
+        Edges.back().Weight = Unsplittable;
+    }
+  }
+  NumOfPGOEdge += Edges.size();
+
+  computeSpanningTree();
+  computeHash();
+
+  for (const PGOEdge &E : Edges)
+    if (E.isInstrumented() && !canInstrumentEdge(E))
+      IsInstrumentable = false;
+
+  DEBUG(dbgs() << "PGO: " << FuncName << ": " << Edges.size() << " edges, "
+               << getNumCounters() << " counters, hash " << FunctionHash
+               << '\n');
+}
+
+void FuncPGOInstrumentation::computeSpanningTree() {
+  typedef MaximumSpanningTree<BasicBlock> MSTType;
+  MSTType::EdgeWeights EdgeWeights;
+  for (const PGOEdge &E : Edges)
+    EdgeWeights.push_back(
+        std::make_pair(std::make_pair(E.SrcBB, E.DestBB), E.Weight));
+  MSTType MST(EdgeWeights);
+
+  // The tree only names the ends of its edges. Parallel edges are
+  // interchangeable, so mark the first one that is not in the tree yet.
+  for (const MSTType::Edge &TreeEdge : MST) {
+    for (PGOEdge &E : Edges) {
+      if (!E.InMST && E.SrcBB == TreeEdge.first &&
+          E.DestBB == TreeEdge.second) {
+        E.InMST = true;
+        break;
+      }
+    }
+  }
+}
+
+void FuncPGOInstrumentation::computeHash() {
+  // Hash the shape of the CFG, so that a profile collected on a different
+  // version of the function is detected.
+  DenseMap<const BasicBlock *, uint32_t> BlockNumbers;
+  uint32_t NumBlocks = 0;
+  for (const BasicBlock &BB : F)
+    BlockNumbers[&BB] = NumBlocks++;
+
+  MD5 Hash;
+  for (const PGOEdge &E : Edges) {
+    uint32_t Ends[] = {E.SrcBB ? BlockNumbers[E.SrcBB] + 1 : 0,
+                       E.DestBB ? BlockNumbers[E.DestBB] + 1 : 0};
+    Hash.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(Ends),
+                                  sizeof(Ends)));
+  }
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  uint64_t Low = 0;
+  for (unsigned I = 0; I != 4; ++I)
+    Low |= uint64_t(Result[I]) << (8 * I);
+
+  FunctionHash = uint64_t(getNumCounters()) << 48 |
+                 uint64_t(Edges.size()) << 32 | Low;
+}
+
+/// Create the variable holding the profile name of F, like the front end
+/// does for its own instrumentation.
+static GlobalVariable *createPGOFuncNameVar(Function &F, StringRef FuncName) {
+  // Usually, we want to match the function's linkage, but
+  // available_externally and extern_weak both have the wrong semantics.
+  GlobalValue::LinkageTypes Linkage = F.getLinkage();
+  if (Linkage == GlobalValue::ExternalWeakLinkage)
+    Linkage = GlobalValue::LinkOnceAnyLinkage;
+  else if (Linkage == GlobalValue::AvailableExternallyLinkage)
+    Linkage = GlobalValue::LinkOnceODRLinkage;
+  else if (Linkage == GlobalValue::InternalLinkage ||
+           Linkage == GlobalValue::ExternalLinkage)
+    Linkage = GlobalValue::PrivateLinkage;
+
+  Constant *Value =
+      ConstantDataArray::getString(F.getContext(), FuncName, false);
+  auto *FuncNameVar =
+      new GlobalVariable(*F.getParent(), Value->getType(), true, Linkage,
+                         Value, "__llvm_profile_name_" + FuncName);
+
+  // Hide the symbol so that we correctly get a copy for each executable.
+  if (!GlobalValue::isLocalLinkage(FuncNameVar->getLinkage()))
+    FuncNameVar->setVisibility(GlobalValue::HiddenVisibility);
+  return FuncNameVar;
+}
+
+/// Return the block in which to count the executions of edge E, splitting
+/// the edge if it is critical.
+static BasicBlock *getInstrumentationBlock(Function &F, const PGOEdge &E) {
+  BasicBlock *Src = const_cast<BasicBlock *>(E.SrcBB);
+  BasicBlock *Dest = const_cast<BasicBlock *>(E.DestBB);
+  if (!Src)
+    return &F.getEntryBlock();
+  if (!Dest)
+    return Src;
+  TerminatorInst *TI = Src->getTerminator();
+  if (TI->getNumSuccessors() <= 1)
+    return Src;
+  if (Dest->getSinglePredecessor())
+    return Dest;
+
+  ++NumOfPGOSplit;
+  return SplitCriticalEdge(TI, E.SuccNum);
+}
+
+/// Return the indirect calls of F, in the order in which their value
+/// profiling sites are numbered.
+static std::vector<Instruction *> findIndirectCallSites(Function &F) {
+  std::vector<Instruction *> Sites;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
+    CallSite CS(&*I);
+    if (!CS || CS.getCalledFunction() || CS.isInlineAsm())
+      continue;
+    Sites.push_back(&*I);
+  }
+  return Sites;
+}
+
+static void instrumentOneFunc(Function &F, Module *M,
+                              BranchProbabilityInfo *BPI,
+                              BlockFrequencyInfo *BFI) {
+  FuncPGOInstrumentation FuncInfo(F, BPI, BFI);
+  if (!FuncInfo.IsInstrumentable)
+    return;
+
+  std::vector<Instruction *> IndirectCallSites = findIndirectCallSites(F);
+  unsigned NumCounters = FuncInfo.getNumCounters();
+  GlobalVariable *FuncNameVar = createPGOFuncNameVar(F, FuncInfo.FuncName);
+  Type *I8PtrTy = Type::getInt8PtrTy(M->getContext());
+
+  // Find all the insertion blocks before splitting any edge: splitting keeps
+  // the successor numbers of the other edges valid.
+  SmallVector<BasicBlock *, 16> InstrBBs;
+  for (const PGOEdge &E : FuncInfo.Edges)
+    if (E.isInstrumented())
+      InstrBBs.push_back(getInstrumentationBlock(F, E));
+
+  unsigned I = 0;
+  for (const PGOEdge &E : FuncInfo.Edges) {
+    if (!E.isInstrumented())
+      continue;
+    BasicBlock *InstrBB = InstrBBs[I];
+    assert(InstrBB && "Cannot get the instrumentation block");
+
+    // Count exits right before leaving the block, and everything else as
+    // soon as the block is entered.
+    IRBuilder<> Builder(InstrBB, E.DestBB ? InstrBB->getFirstInsertionPt()
+                                          : InstrBB->getTerminator());
+    Builder.CreateCall(
+        Intrinsic::getDeclaration(M, Intrinsic::instrprof_increment),
+        {ConstantExpr::getBitCast(FuncNameVar, I8PtrTy),
+         Builder.getInt64(FuncInfo.FunctionHash),
+         Builder.getInt32(NumCounters), Builder.getInt32(I++)});
+    ++NumOfPGOInstrument;
+  }
+
+  if (DisableValueProfiling)
+    return;
+
+  unsigned SiteIndex = 0;
+  for (Instruction *Call : IndirectCallSites) {
+    CallSite CS(Call);
+    IRBuilder<> Builder(Call);
+    Builder.CreateCall(
+        Intrinsic::getDeclaration(M, Intrinsic::instrprof_value_profile),
+        {ConstantExpr::getBitCast(FuncNameVar, I8PtrTy),
+         Builder.getInt64(FuncInfo.FunctionHash),
+         Builder.CreatePtrToInt(CS.getCalledValue(), Builder.getInt64Ty()),
+         Builder.getInt32(IPVK_IndirectCallTarget),
+         Builder.getInt32(SiteIndex++)});
+    ++NumOfPGOICall;
+  }
+}
+
+namespace {
+
+class PGOInstrumentationGen : public ModulePass {
+public:
+  static char ID;
+
+  PGOInstrumentationGen() : ModulePass(ID) {
+    initializePGOInstrumentationGenPass(*PassRegistry::getPassRegistry());
+  }
+
+  const char *getPassName() const override {
+    return "PGOInstrumentationGenPass";
+  }
+
+private:
+  bool runOnModule(Module &M) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<BlockFrequencyInfoWrapperPass>();
+    AU.addRequired<BranchProbabilityInfoWrapperPass>();
+  }
+};
+
+class PGOInstrumentationUse : public ModulePass {
+public:
+  static char ID;
+
+  // Provide the profile filename as the parameter.
+  PGOInstrumentationUse(std::string Filename = "")
+      : ModulePass(ID), ProfileFileName(Filename) {
+    if (!PGOTestProfileFile.empty())
+      ProfileFileName = PGOTestProfileFile;
+    initializePGOInstrumentationUsePass(*PassRegistry::getPassRegistry());
+  }
+
+  const char *getPassName() const override {
+    return "PGOInstrumentationUsePass";
+  }
+
+private:
+  std::string ProfileFileName;
+  std::unique_ptr<IndexedInstrProfReader> PGOReader;
+
+  bool runOnModule(Module &M) override;
+  bool annotateOneFunc(Function &F, BranchProbabilityInfo *BPI,
+                       BlockFrequencyInfo *BFI);
+  void annotateIndirectCallSites(Function &F, const InstrProfRecord &Record);
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<BlockFrequencyInfoWrapperPass>();
+    AU.addRequired<BranchProbabilityInfoWrapperPass>();
+  }
+};
+
+} // end anonymous namespace
+
+char PGOInstrumentationGen::ID = 0;
+INITIALIZE_PASS_BEGIN(PGOInstrumentationGen, "pgo-instr-gen",
+                      "PGO instrumentation.", false, false)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(BranchProbabilityInfoWrapperPass)
+INITIALIZE_PASS_END(PGOInstrumentationGen, "pgo-instr-gen",
+                    "PGO instrumentation.", false, false)
+
+ModulePass *llvm::createPGOInstrumentationGenPass() {
+  return new PGOInstrumentationGen();
+}
+
+char PGOInstrumentationUse::ID = 0;
+INITIALIZE_PASS_BEGIN(PGOInstrumentationUse, "pgo-instr-use",
+                      "Read PGO instrumentation profile.", false, false)
+INITIALIZE_PASS_DEPENDENCY(BlockFrequencyInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(BranchProbabilityInfoWrapperPass)
+INITIALIZE_PASS_END(PGOInstrumentationUse, "pgo-instr-use",
+                    "Read PGO instrumentation profile.", false, false)
+
+ModulePass *llvm::createPGOInstrumentationUsePass(StringRef Filename) {
+  return new PGOInstrumentationUse(Filename.str());
+}
+
+bool PGOInstrumentationGen::runOnModule(Module &M) {
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    BranchProbabilityInfo *BPI =
+        &getAnalysis<BranchProbabilityInfoWrapperPass>(F).getBPI();
+    BlockFrequencyInfo *BFI =
+        &getAnalysis<BlockFrequencyInfoWrapperPass>(F).getBFI();
+    instrumentOneFunc(F, &M, BPI, BFI);
+    Changed = true;
+  }
+  return Changed;
+}
+
+/// Sum the counts of Edges into Sum. Return false if one is unknown, in which
+/// case UnknownEdge is set to the last unknown edge and NumUnknown to their
+/// number.
+static bool sumEdgeCounts(ArrayRef<PGOEdge *> Edges, uint64_t &Sum,
+                          PGOEdge *&UnknownEdge, unsigned &NumUnknown) {
+  Sum = 0;
+  NumUnknown = 0;
+  for (PGOEdge *E : Edges) {
+    if (E->CountValid) {
+      Sum += E->Count;
+      continue;
+    }
+    UnknownEdge = E;
+    ++NumUnknown;
+  }
+  return NumUnknown == 0;
+}
+
+/// Propagate the counts of the instrumented edges to the other edges, using
+/// that the count of every node is both the sum of the counts of its incoming
+/// edges and the sum of the counts of its outgoing edges. Return false if
+/// some edge count could not be computed.
+static bool populateCounters(FuncPGOInstrumentation &FuncInfo) {
+  struct NodeInfo {
+    SmallVector<PGOEdge *, 4> InEdges, OutEdges;
+    bool CountValid;
+    uint64_t Count;
+    NodeInfo() : CountValid(false), Count(0) {}
+  };
+  // The fake node is keyed by null.
+  DenseMap<const BasicBlock *, NodeInfo> Nodes;
+  for (PGOEdge &E : FuncInfo.Edges) {
+    Nodes[E.SrcBB].OutEdges.push_back(&E);
+    Nodes[E.DestBB].InEdges.push_back(&E);
+  }
+
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (auto &Entry : Nodes) {
+      NodeInfo &Node = Entry.second;
+      uint64_t Sum;
+      PGOEdge *Unknown = nullptr;
+      unsigned NumUnknown;
+
+      if (!Node.CountValid) {
+        if (sumEdgeCounts(Node.OutEdges, Sum, Unknown, NumUnknown) ||
+            sumEdgeCounts(Node.InEdges, Sum, Unknown, NumUnknown)) {
+          Node.Count = Sum;
+          Node.CountValid = true;
+          Changed = true;
+        }
+        continue;
+      }
+
+      for (ArrayRef<PGOEdge *> Edges : {makeArrayRef(Node.OutEdges),
+                                        makeArrayRef(Node.InEdges)}) {
+        if (sumEdgeCounts(Edges, Sum, Unknown, NumUnknown) || NumUnknown != 1)
+          continue;
+        // Inconsistent profiles can make the difference negative.
+        Unknown->Count = Node.Count > Sum ? Node.Count - Sum : 0;
+        Unknown->CountValid = true;
+        Changed = true;
+      }
+    }
+  }
+
+  for (const PGOEdge &E : FuncInfo.Edges)
+    if (!E.CountValid)
+      return false;
+  return true;
+}
+
+/// Attach the edge counts to the terminators of F as branch weights.
+static void setBranchWeights(FuncPGOInstrumentation &FuncInfo) {
+  DenseMap<const BasicBlock *, SmallVector<uint64_t, 4>> SuccCounts;
+  for (const PGOEdge &E : FuncInfo.Edges) {
+    if (!E.SrcBB || !E.DestBB)
+      continue;
+    SmallVector<uint64_t, 4> &Counts = SuccCounts[E.SrcBB];
+    if (Counts.size() <= E.SuccNum)
+      Counts.resize(E.SuccNum + 1);
+    Counts[E.SuccNum] = E.Count;
+  }
+
+  MDBuilder MDB(FuncInfo.F.getContext());
+  for (BasicBlock &BB : FuncInfo.F) {
+    TerminatorInst *TI = BB.getTerminator();
+    if (TI->getNumSuccessors() < 2 ||
+        !(isa<BranchInst>(TI) || isa<SwitchInst>(TI) ||
+          isa<IndirectBrInst>(TI)))
+      continue;
+
+    const SmallVector<uint64_t, 4> &Counts = SuccCounts[&BB];
+    uint64_t MaxCount = 0;
+    for (uint64_t Count : Counts)
+      MaxCount = std::max(MaxCount, Count);
+    if (MaxCount == 0)
+      continue;
+
+    // Branch weights are 32 bits wide: scale the counts down if needed.
+    uint64_t Scale = MaxCount / std::numeric_limits<uint32_t>::max() + 1;
+    SmallVector<uint32_t, 4> Weights;
+    for (uint64_t Count : Counts)
+      Weights.push_back(static_cast<uint32_t>(Count / Scale));
+    TI->setMetadata(LLVMContext::MD_prof, MDB.createBranchWeights(Weights));
+  }
+}
+
+bool PGOInstrumentationUse::annotateOneFunc(Function &F,
+                                            BranchProbabilityInfo *BPI,
+                                            BlockFrequencyInfo *BFI) {
+  FuncPGOInstrumentation FuncInfo(F, BPI, BFI);
+  if (!FuncInfo.IsInstrumentable)
+    return false;
+
+  ErrorOr<InstrProfRecord> Record =
+      PGOReader->getInstrProfRecord(FuncInfo.FuncName, FuncInfo.FunctionHash);
+  if (std::error_code EC = Record.getError()) {
+    if (EC == instrprof_error::unknown_function) {
+      ++NumOfPGOMissing;
+      return false;
+    }
+    ++NumOfPGOMismatch;
+    std::string Msg = EC.message() + " for function " + FuncInfo.FuncName;
+    F.getContext().diagnose(DiagnosticInfoPGOProfile(
+        ProfileFileName.data(), Msg, DS_Warning));
+    return false;
+  }
+
+  const std::vector<uint64_t> &Counts = Record.get().Counts;
+  if (Counts.size() != FuncInfo.getNumCounters()) {
+    ++NumOfPGOMismatch;
+    std::string Msg = "inconsistent number of counters for function " +
+                      FuncInfo.FuncName;
+    F.getContext().diagnose(DiagnosticInfoPGOProfile(
+        ProfileFileName.data(), Msg, DS_Warning));
+    return false;
+  }
+
+  unsigned I = 0;
+  for (PGOEdge &E : FuncInfo.Edges) {
+    if (!E.isInstrumented())
+      continue;
+    E.Count = Counts[I++];
+    E.CountValid = true;
+  }
+  if (!populateCounters(FuncInfo))
+    return false;
+
+  ++NumOfPGOFunc;
+  F.setEntryCount(FuncInfo.Edges.front().Count);
+  setBranchWeights(FuncInfo);
+  annotateIndirectCallSites(F, Record.get());
+  return true;
+}
+
+void PGOInstrumentationUse::annotateIndirectCallSites(
+    Function &F, const InstrProfRecord &Record) {
+  // Profiles collected without value profiling have no sites at all.
+  if (DisableValueProfiling || Record.IndirectCallSites.empty())
+    return;
+
+  std::vector<Instruction *> Sites = findIndirectCallSites(F);
+  if (Sites.size() != Record.IndirectCallSites.size()) {
+    std::string Msg = "inconsistent number of indirect call sites for "
+                      "function " + getPGOFuncName(F);
+    F.getContext().diagnose(DiagnosticInfoPGOProfile(
+        ProfileFileName.data(), Msg, DS_Warning));
+    return;
+  }
+
+  for (size_t I = 0, E = Sites.size(); I < E; ++I) {
+    const InstrProfValueSite &Site = Record.IndirectCallSites[I];
+    uint64_t Sum = 0;
+    for (const InstrProfValueData &VD : Site)
+      Sum += VD.Count;
+    annotateValueSite(*Sites[I], IPVK_IndirectCallTarget, Site, Sum,
+                      MaxNumAnnotations);
+  }
+}
+
+bool PGOInstrumentationUse::runOnModule(Module &M) {
+  DEBUG(dbgs() << "Read in profile counters: ");
+  auto &Ctx = M.getContext();
+  // Read the counter array from file.
+  auto ReaderOrErr = IndexedInstrProfReader::create(ProfileFileName);
+  if (std::error_code EC = ReaderOrErr.getError()) {
+    Ctx.diagnose(
+        DiagnosticInfoPGOProfile(ProfileFileName.data(), EC.message()));
+    return false;
+  }
+
+  PGOReader = std::move(ReaderOrErr.get());
+  if (!PGOReader) {
+    Ctx.diagnose(DiagnosticInfoPGOProfile(ProfileFileName.data(),
+                                          "Cannot get PGOReader"));
+    return false;
+  }
+
+  bool Changed = false;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    BranchProbabilityInfo *BPI =
+        &getAnalysis<BranchProbabilityInfoWrapperPass>(F).getBPI();
+    BlockFrequencyInfo *BFI =
+        &getAnalysis<BlockFrequencyInfoWrapperPass>(F).getBFI();
+    Changed |= annotateOneFunc(F, BPI, BFI);
+  }
+  return Changed;
+}
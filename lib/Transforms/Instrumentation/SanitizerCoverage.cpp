@@ -26,11 +26,19 @@
 // it only tells if a given function (block) was ever executed. No counters.
 // But for many use cases this is what we need and the added slowdown small.
 //
+// With inline 8-bit counters, the guards and the callbacks are replaced by
+// a single increment of the block's counter:
+// Counters[Idx]++;
+// The counters of the module live in one array, placed in a dedicated
+// section and handed to __sanitizer_cov_8bit_counters_init by the module
+// constructor, so that a fuzzer can read them directly.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/Instrumentation.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DebugInfo.h"
@@ -59,6 +67,10 @@ static const char *const kSanCovIndirCallName = "__sanitizer_cov_indir_call16";
 static const char *const kSanCovTraceEnter = "__sanitizer_cov_trace_func_enter";
 static const char *const kSanCovTraceBB = "__sanitizer_cov_trace_basic_block";
 static const char *const kSanCovTraceCmp = "__sanitizer_cov_trace_cmp";
+static const char *const kSanCovTraceSwitch = "__sanitizer_cov_trace_switch";
+static const char *const kSanCov8bitCountersInitName =
+    "__sanitizer_cov_8bit_counters_init";
+static const char *const kSanCovCountersSectionName = "__sancov_cntrs";
 static const char *const kSanCovModuleCtorName = "sancov.module_ctor";
 static const uint64_t    kSanCtorAndDtorPriority = 2;
 
@@ -96,6 +108,15 @@ static cl::opt<bool> ClUse8bitCounters("sanitizer-coverage-8bit-counters",
                                        cl::desc("Experimental 8-bit counters"),
                                        cl::Hidden, cl::init(false));
 
+// 8-bit counters incremented inline, in place of the guards and of the
+// __sanitizer_cov callbacks. They have the same inaccuracies as the
+// experimental 8-bit counters above, but no call on the fast path.
+static cl::opt<bool> ClInline8bitCounters(
+    "sanitizer-coverage-inline-8bit-counters",
+    cl::desc("Increment 8-bit counters inline instead of calling "
+             "__sanitizer_cov"),
+    cl::Hidden, cl::init(false));
+
 namespace {
 
 SanitizerCoverageOptions getOptions(int LegacyCoverageLevel) {
@@ -129,6 +150,13 @@ SanitizerCoverageOptions OverrideFromCL(SanitizerCoverageOptions Options) {
   Options.TraceBB |= ClExperimentalTracing;
   Options.TraceCmp |= ClExperimentalCMPTracing;
   Options.Use8bitCounters |= ClUse8bitCounters;
+  Options.Inline8bitCounters |= ClInline8bitCounters;
+  // The inline counters replace the guards, which the basic block tracing
+  // and the experimental 8-bit counters are indexed by.
+  if (Options.Inline8bitCounters) {
+    Options.TraceBB = false;
+    Options.Use8bitCounters = false;
+  }
   return Options;
 }
 
@@ -148,9 +176,13 @@ class SanitizerCoverageModule : public ModulePass {
   void InjectCoverageForIndirectCalls(Function &F,
                                       ArrayRef<Instruction *> IndirCalls);
   void InjectTraceForCmp(Function &F, ArrayRef<Instruction *> CmpTraceTargets);
+  void InjectTraceForSwitch(Function &F,
+                            ArrayRef<Instruction *> SwitchTraceTargets);
   bool InjectCoverage(Function &F, ArrayRef<BasicBlock *> AllBlocks);
   void SetNoSanitizeMetadata(Instruction *I);
   void InjectCoverageAtBlock(Function &F, BasicBlock &BB, bool UseCalls);
+  void InjectInlineCounterAtBlock(IRBuilder<> &IRB);
+  void CreateInlineCounters(Module &M);
   unsigned NumberOfInstrumentedBlocks() {
     return SanCovFunction->getNumUses() + SanCovWithCheckFunction->getNumUses();
   }
@@ -159,6 +191,7 @@ class SanitizerCoverageModule : public ModulePass {
   Function *SanCovIndirCallFunction;
   Function *SanCovTraceEnter, *SanCovTraceBB;
   Function *SanCovTraceCmpFunction;
+  Function *SanCovTraceSwitchFunction;
   InlineAsm *EmptyAsm;
   Type *IntptrTy, *Int64Ty;
   LLVMContext *C;
@@ -166,6 +199,8 @@ class SanitizerCoverageModule : public ModulePass {
 
   GlobalVariable *GuardArray;
   GlobalVariable *EightBitCounterArray;
+  GlobalVariable *InlineCounterArray;
+  unsigned NumInlineCounters;
 
   SanitizerCoverageOptions Options;
 };
@@ -183,6 +218,7 @@ bool SanitizerCoverageModule::runOnModule(Module &M) {
   Type *Int8PtrTy = PointerType::getUnqual(IRB.getInt8Ty());
   Type *Int32PtrTy = PointerType::getUnqual(IRB.getInt32Ty());
   Int64Ty = IRB.getInt64Ty();
+  Type *Int64PtrTy = PointerType::getUnqual(Int64Ty);
 
   SanCovFunction = checkSanitizerInterfaceFunction(
       M.getOrInsertFunction(kSanCovName, VoidTy, Int32PtrTy, nullptr));
@@ -194,6 +230,9 @@ bool SanitizerCoverageModule::runOnModule(Module &M) {
   SanCovTraceCmpFunction =
       checkSanitizerInterfaceFunction(M.getOrInsertFunction(
           kSanCovTraceCmp, VoidTy, Int64Ty, Int64Ty, Int64Ty, nullptr));
+  SanCovTraceSwitchFunction =
+      checkSanitizerInterfaceFunction(M.getOrInsertFunction(
+          kSanCovTraceSwitch, VoidTy, Int64Ty, Int64PtrTy, nullptr));
 
   // We insert an empty inline asm after cov callbacks to avoid callback merge.
   EmptyAsm = InlineAsm::get(FunctionType::get(IRB.getVoidTy(), false),
@@ -220,6 +259,18 @@ bool SanitizerCoverageModule::runOnModule(Module &M) {
         new GlobalVariable(M, Int8Ty, false, GlobalVariable::ExternalLinkage,
                            nullptr, "__sancov_gen_cov_tmp");
 
+  if (Options.Inline8bitCounters) {
+    NumInlineCounters = 0;
+    InlineCounterArray = new GlobalVariable(
+        M, ArrayType::get(Int8Ty, 0), false, GlobalVariable::ExternalLinkage,
+        nullptr, "__sancov_gen_cov_tmp");
+    for (auto &F : M)
+      runOnFunction(F);
+    CreateInlineCounters(M);
+    GuardArray->eraseFromParent();
+    return true;
+  }
+
   for (auto &F : M)
     runOnFunction(F);
 
@@ -285,6 +336,7 @@ bool SanitizerCoverageModule::runOnFunction(Function &F) {
   SmallVector<Instruction*, 8> IndirCalls;
   SmallVector<BasicBlock*, 16> AllBlocks;
   SmallVector<Instruction*, 8> CmpTraceTargets;
+  SmallVector<Instruction*, 8> SwitchTraceTargets;
   for (auto &BB : F) {
     AllBlocks.push_back(&BB);
     for (auto &Inst : BB) {
@@ -295,11 +347,14 @@ bool SanitizerCoverageModule::runOnFunction(Function &F) {
       }
       if (Options.TraceCmp && isa<ICmpInst>(&Inst))
         CmpTraceTargets.push_back(&Inst);
+      if (Options.TraceCmp && isa<SwitchInst>(&Inst))
+        SwitchTraceTargets.push_back(&Inst);
     }
   }
   InjectCoverage(F, AllBlocks);
   InjectCoverageForIndirectCalls(F, IndirCalls);
   InjectTraceForCmp(F, CmpTraceTargets);
+  InjectTraceForSwitch(F, SwitchTraceTargets);
   return true;
 }
 
@@ -356,6 +411,8 @@ void SanitizerCoverageModule::InjectTraceForCmp(
       Value *A0 = ICMP->getOperand(0);
       Value *A1 = ICMP->getOperand(1);
       if (!A0->getType()->isIntegerTy()) continue;
+      // Comparisons of two constants give the fuzzer nothing to work with.
+      if (isa<Constant>(A0) && isa<Constant>(A1)) continue;
       uint64_t TypeSize = DL->getTypeStoreSizeInBits(A0->getType());
       // __sanitizer_cov_trace_cmp((type_size << 32) | predicate, A0, A1);
       IRB.CreateCall(
@@ -367,6 +424,36 @@ void SanitizerCoverageModule::InjectTraceForCmp(
   }
 }
 
+// On every switch we call __sanitizer_cov_trace_switch with the switch
+// condition and an array of constants
+// {NumCases, ValueSizeInBits, Case0Value, Case1Value, ...},
+// so that the fuzzer can try the case values.
+void SanitizerCoverageModule::InjectTraceForSwitch(
+    Function &F, ArrayRef<Instruction *> SwitchTraceTargets) {
+  for (auto I : SwitchTraceTargets) {
+    SwitchInst *SI = cast<SwitchInst>(I);
+    Value *Cond = SI->getCondition();
+    if (isa<Constant>(Cond)) continue;
+    uint64_t TypeSize = DL->getTypeStoreSizeInBits(Cond->getType());
+    if (TypeSize > 64) continue;
+    SmallVector<Constant *, 16> Initializers;
+    Initializers.push_back(ConstantInt::get(Int64Ty, SI->getNumCases()));
+    Initializers.push_back(ConstantInt::get(Int64Ty, TypeSize));
+    for (auto Case : SI->cases())
+      Initializers.push_back(
+          ConstantExpr::getIntegerCast(Case.getCaseValue(), Int64Ty, true));
+    ArrayType *ArrayOfInt64Ty = ArrayType::get(Int64Ty, Initializers.size());
+    GlobalVariable *Cases = new GlobalVariable(
+        *F.getParent(), ArrayOfInt64Ty, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(ArrayOfInt64Ty, Initializers),
+        "__sancov_gen_switch_cases");
+    IRBuilder<> IRB(SI);
+    IRB.CreateCall(SanCovTraceSwitchFunction,
+                   {IRB.CreateIntCast(Cond, Int64Ty, true),
+                    IRB.CreatePointerCast(Cases, Int64Ty->getPointerTo())});
+  }
+}
+
 void SanitizerCoverageModule::SetNoSanitizeMetadata(Instruction *I) {
   I->setMetadata(
       I->getParent()->getParent()->getParent()->getMDKindID("nosanitize"),
@@ -403,6 +490,10 @@ void SanitizerCoverageModule::InjectCoverageAtBlock(Function &F, BasicBlock &BB,
 
   IRBuilder<> IRB(IP);
   IRB.SetCurrentDebugLocation(EntryLoc);
+  if (Options.Inline8bitCounters) {
+    InjectInlineCounterAtBlock(IRB);
+    return;
+  }
   SmallVector<Value *, 1> Indices;
   Value *GuardP = IRB.CreateAdd(
       IRB.CreatePointerCast(GuardArray, IntptrTy),
@@ -447,6 +538,51 @@ void SanitizerCoverageModule::InjectCoverageAtBlock(Function &F, BasicBlock &BB,
   }
 }
 
+// Counters[NumInlineCounters++]++, on the dummy array that
+// CreateInlineCounters replaces with the real one.
+void SanitizerCoverageModule::InjectInlineCounterAtBlock(IRBuilder<> &IRB) {
+  Value *P =
+      IRB.CreateConstInBoundsGEP2_64(InlineCounterArray, 0, NumInlineCounters++);
+  LoadInst *LI = IRB.CreateLoad(P);
+  Value *Inc = IRB.CreateAdd(LI, ConstantInt::get(IRB.getInt8Ty(), 1));
+  StoreInst *SI = IRB.CreateStore(Inc, P);
+  SetNoSanitizeMetadata(LI);
+  SetNoSanitizeMetadata(SI);
+}
+
+// Create the array of inline counters of the module, in the counters
+// section, and register it with the run-time from the module constructor.
+void SanitizerCoverageModule::CreateInlineCounters(Module &M) {
+  IRBuilder<> IRB(*C);
+  Type *Int8Ty = IRB.getInt8Ty();
+  Type *Int8PtrTy = IRB.getInt8PtrTy();
+  Type *Int8ArrayNTy = ArrayType::get(Int8Ty, NumInlineCounters);
+  GlobalVariable *RealInlineCounterArray = new GlobalVariable(
+      M, Int8ArrayNTy, false, GlobalValue::PrivateLinkage,
+      Constant::getNullValue(Int8ArrayNTy), "__sancov_gen_cov_counters");
+  Triple TargetTriple(M.getTargetTriple());
+  RealInlineCounterArray->setSection(
+      TargetTriple.isOSBinFormatMachO()
+          ? std::string("__DATA,") + kSanCovCountersSectionName
+          : std::string(kSanCovCountersSectionName));
+  InlineCounterArray->replaceAllUsesWith(ConstantExpr::getBitCast(
+      RealInlineCounterArray, InlineCounterArray->getType()));
+  InlineCounterArray->eraseFromParent();
+
+  Constant *Zero = ConstantInt::get(IntptrTy, 0);
+  Constant *Start = ConstantExpr::getInBoundsGetElementPtr(
+      Int8ArrayNTy, RealInlineCounterArray, ArrayRef<Constant *>{Zero, Zero});
+  Constant *End = ConstantExpr::getInBoundsGetElementPtr(
+      Int8ArrayNTy, RealInlineCounterArray,
+      ArrayRef<Constant *>{Zero,
+                           ConstantInt::get(IntptrTy, NumInlineCounters)});
+  Function *CtorFunc;
+  std::tie(CtorFunc, std::ignore) = createSanitizerCtorAndInitFunctions(
+      M, kSanCovModuleCtorName, kSanCov8bitCountersInitName,
+      {Int8PtrTy, Int8PtrTy}, {Start, End});
+  appendToGlobalCtors(M, CtorFunc, kSanCtorAndDtorPriority);
+}
+
 char SanitizerCoverageModule::ID = 0;
 INITIALIZE_PASS(SanitizerCoverageModule, "sancov",
     "SanitizerCoverage: TODO."
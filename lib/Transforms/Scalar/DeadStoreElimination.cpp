@@ -7,8 +7,11 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file implements a trivial dead store elimination that only considers
-// basic-block local redundant stores.
+// This file implements a trivial dead store elimination that mostly considers
+// basic-block local redundant stores.  Partially overwritten memsets and
+// memcpys are shortened, and constant stores into an earlier wider constant
+// store are merged into it.  Optionally, stores that are completely
+// overwritten along all paths leaving their block are removed as well.
 //
 // FIXME: This should eventually be extended to be a post-dominator tree
 // traversal.  Doing so would be pretty trivial.
@@ -25,6 +28,7 @@
 #include "llvm/Analysis/MemoryDependenceAnalysis.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Dominators.h"
@@ -33,6 +37,7 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/Local.h"
@@ -42,6 +47,28 @@ using namespace llvm;
 
 STATISTIC(NumFastStores, "Number of stores deleted");
 STATISTIC(NumFastOther , "Number of other instrs removed");
+STATISTIC(NumModifiedStores, "Number of stores shortened or merged");
+STATISTIC(NumCrossBlockStores, "Number of stores deleted across blocks");
+
+static cl::opt<bool>
+EnablePartialOverwriteTracking("enable-dse-partial-overwrite-tracking",
+  cl::init(true), cl::Hidden,
+  cl::desc("Shorten memsets and memcpys whose beginning is overwritten"));
+
+static cl::opt<bool>
+EnablePartialStoreMerging("enable-dse-partial-store-merging",
+  cl::init(true), cl::Hidden,
+  cl::desc("Merge constant stores into earlier wider constant stores"));
+
+static cl::opt<bool>
+EnableGlobalDSE("enable-dse-global", cl::init(false), cl::Hidden,
+  cl::desc("Remove stores that are overwritten along all paths leaving "
+           "their block"));
+
+static cl::opt<unsigned>
+GlobalDSEMaxBlocks("dse-global-max-blocks", cl::init(32), cl::Hidden,
+  cl::desc("Maximum number of blocks visited to prove a store dead across "
+           "blocks"));
 
 namespace {
   struct DSE : public FunctionPass {
@@ -71,6 +98,11 @@ namespace {
         if (DT->isReachableFromEntry(I))
           Changed |= runOnBasicBlock(*I);
 
+      if (EnableGlobalDSE)
+        for (Function::iterator I = F.begin(), E = F.end(); I != E; ++I)
+          if (DT->isReachableFromEntry(I))
+            Changed |= handleSuccessorKills(*I);
+
       AA = nullptr; MD = nullptr; DT = nullptr;
       return Changed;
     }
@@ -78,6 +110,8 @@ namespace {
     bool runOnBasicBlock(BasicBlock &BB);
     bool HandleFree(CallInst *F);
     bool handleEndBlock(BasicBlock &BB);
+    bool handleSuccessorKills(BasicBlock &BB);
+    bool isKilledAlongAllPaths(Instruction *SI, const MemoryLocation &Loc);
     void RemoveAccessedObjects(const MemoryLocation &LoadedLoc,
                                SmallSetVector<Value *, 16> &DeadStackObjects,
                                const DataLayout &DL);
@@ -324,15 +358,20 @@ namespace {
   enum OverwriteResult
   {
     OverwriteComplete,
+    OverwriteBegin,
     OverwriteEnd,
+    OverwriteInside,
     OverwriteUnknown
   };
 }
 
 /// isOverwrite - Return 'OverwriteComplete' if a store to the 'Later' location
 /// completely overwrites a store to the 'Earlier' location.
-/// 'OverwriteEnd' if the end of the 'Earlier' location is completely
-/// overwritten by 'Later', or 'OverwriteUnknown' if nothing can be determined
+/// 'OverwriteBegin' or 'OverwriteEnd' if the beginning or the end of the
+/// 'Earlier' location is completely overwritten by 'Later', 'OverwriteInside'
+/// if 'Later' lies strictly within 'Earlier', or 'OverwriteUnknown' if nothing
+/// can be determined.  Unless 'OverwriteUnknown' is returned, 'EarlierOff' and
+/// 'LaterOff' are set to the offsets of both locations from a common base.
 static OverwriteResult isOverwrite(const MemoryLocation &Later,
                                    const MemoryLocation &Earlier,
                                    const DataLayout &DL,
@@ -423,6 +462,26 @@ static OverwriteResult isOverwrite(const MemoryLocation &Later,
       int64_t(LaterOff + Later.Size) >= int64_t(EarlierOff + Earlier.Size))
     return OverwriteEnd;
 
+  // The mirrored case is when the later store overwrites the beginning of the
+  // earlier store
+  //
+  //             |--earlier--|
+  //      |--   later   --|
+  //
+  // In this case we may want to advance the start of earlier instead.
+  if (LaterOff <= EarlierOff &&
+      int64_t(LaterOff + Later.Size) > EarlierOff)
+    return OverwriteBegin;
+
+  // Finally the later store may lie within the earlier one, touching neither
+  // of its ends
+  //
+  //      |-----  earlier  ------|
+  //          |--  later  --|
+  if (LaterOff > EarlierOff &&
+      int64_t(LaterOff + Later.Size) < int64_t(EarlierOff + Earlier.Size))
+    return OverwriteInside;
+
   // Otherwise, they don't completely overlap.
   return OverwriteUnknown;
 }
@@ -469,6 +528,77 @@ static bool isPossibleSelfRead(Instruction *Inst,
   return true;
 }
 
+/// shortenBegin - The first 'Bytes' bytes written by the memset or memcpy
+/// 'DepWrite' are overwritten later on.  Advance its destination (and source)
+/// past them if that keeps the intrinsic aligned.  Return true on success.
+static bool shortenBegin(Instruction *DepWrite, uint64_t Bytes) {
+  MemIntrinsic *DepIntrinsic = cast<MemIntrinsic>(DepWrite);
+  ConstantInt *DepWriteLength = dyn_cast<ConstantInt>(DepIntrinsic->getLength());
+  if (!DepWriteLength || Bytes >= DepWriteLength->getZExtValue())
+    return false;
+
+  // As for the end, don't break up writes that are likely to be vectorized.
+  unsigned DepWriteAlign = DepIntrinsic->getAlignment();
+  if (DepWriteAlign > 1 ? Bytes % DepWriteAlign != 0
+                        : !llvm::isPowerOf2_64(Bytes))
+    return false;
+
+  Value *Offset = ConstantInt::get(DepWriteLength->getType(), Bytes);
+  Type *Int8Ty = Type::getInt8Ty(DepWrite->getContext());
+  DepIntrinsic->setDest(GetElementPtrInst::CreateInBounds(
+      Int8Ty, DepIntrinsic->getRawDest(), Offset, "", DepWrite));
+  if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(DepWrite))
+    MTI->setSource(GetElementPtrInst::CreateInBounds(
+        Int8Ty, MTI->getRawSource(), Offset, "", DepWrite));
+  DepIntrinsic->setLength(ConstantInt::get(
+      DepWriteLength->getType(), DepWriteLength->getZExtValue() - Bytes));
+  return true;
+}
+
+/// mergeStores - 'Later' stores a constant into bytes that the earlier store
+/// 'Earlier' of a wider constant also writes to, with nothing accessing them
+/// in between.  Fold the later constant into the earlier one, so that 'Later'
+/// becomes dead.  Return true on success.
+static bool mergeStores(Instruction *Later, Instruction *Earlier,
+                        int64_t LaterOff, int64_t EarlierOff,
+                        const DataLayout &DL) {
+  StoreInst *LaterSI = dyn_cast<StoreInst>(Later);
+  StoreInst *EarlierSI = dyn_cast<StoreInst>(Earlier);
+  if (!LaterSI || !EarlierSI || !LaterSI->isSimple() || !EarlierSI->isSimple())
+    return false;
+
+  ConstantInt *LaterValue = dyn_cast<ConstantInt>(LaterSI->getValueOperand());
+  ConstantInt *EarlierValue =
+      dyn_cast<ConstantInt>(EarlierSI->getValueOperand());
+  if (!LaterValue || !EarlierValue)
+    return false;
+
+  // Both values must fill the bytes they are stored to exactly.
+  Type *LaterTy = LaterValue->getType(), *EarlierTy = EarlierValue->getType();
+  unsigned LaterBits = DL.getTypeSizeInBits(LaterTy);
+  unsigned EarlierBits = DL.getTypeSizeInBits(EarlierTy);
+  if (LaterBits != DL.getTypeStoreSizeInBits(LaterTy) ||
+      EarlierBits != DL.getTypeStoreSizeInBits(EarlierTy))
+    return false;
+
+  if (LaterOff < EarlierOff ||
+      uint64_t(LaterOff - EarlierOff) * 8 + LaterBits > EarlierBits)
+    return false;
+
+  unsigned Shift = (LaterOff - EarlierOff) * 8;
+  if (DL.isBigEndian())
+    Shift = EarlierBits - LaterBits - Shift;
+  APInt Mask = APInt::getBitsSet(EarlierBits, Shift, Shift + LaterBits);
+  APInt Merged = (EarlierValue->getValue() & ~Mask) |
+                 (LaterValue->getValue().zext(EarlierBits) << Shift);
+
+  DEBUG(dbgs() << "DSE: Merge Stores:\n  EARLIER: " << *Earlier
+               << "\n  LATER: " << *Later << "\n  MERGED VALUE: " << Merged
+               << '\n');
+  EarlierSI->setOperand(0, ConstantInt::get(EarlierTy, Merged));
+  return true;
+}
+
 
 //===----------------------------------------------------------------------===//
 // DSE Pass
@@ -531,6 +661,9 @@ bool DSE::runOnBasicBlock(BasicBlock &BB) {
     if (!Loc.Ptr)
       continue;
 
+    // Only the write 'Inst' directly depends on may absorb it: anything found
+    // after looking past may-aliased stores could be overwritten by those.
+    bool IsDirectDep = true;
     while (InstDep.isDef() || InstDep.isClobber()) {
       // Get the memory clobbered by the instruction we depend on.  MemDep will
       // skip any instructions that 'Loc' clearly doesn't interact with.  If we
@@ -593,10 +726,36 @@ bool DSE::runOnBasicBlock(BasicBlock &BB) {
                                                     InstWriteOffset -
                                                     DepWriteOffset);
             DepIntrinsic->setLength(TrimmedLength);
+            ++NumModifiedStores;
+            MadeChange = true;
+          }
+        } else if (OR == OverwriteBegin && EnablePartialOverwriteTracking &&
+                   isShortenable(DepWrite)) {
+          uint64_t Bytes = InstWriteOffset + Loc.Size - DepWriteOffset;
+          if (shortenBegin(DepWrite, Bytes)) {
+            DEBUG(dbgs() << "DSE: Remove Dead Store:\n  OW BEGIN: "
+                  << *DepWrite << "\n  KILLER (offset "
+                  << InstWriteOffset << ", "
+                  << Loc.Size << ")"
+                  << *Inst << '\n');
+            ++NumModifiedStores;
             MadeChange = true;
           }
         }
+
+        if (OR != OverwriteComplete && OR != OverwriteUnknown &&
+            EnablePartialStoreMerging && IsDirectDep &&
+            mergeStores(Inst, DepWrite, InstWriteOffset, DepWriteOffset, DL)) {
+          // 'Inst' is dead now.  The next instruction is after it, so BBI
+          // stays valid.
+          DeleteDeadInstruction(Inst, *MD, TLI);
+          ++NumModifiedStores;
+          ++NumFastStores;
+          MadeChange = true;
+          break;
+        }
       }
+      IsDirectDep = false;
 
       // If this is a may-aliased store that is clobbering the store value, we
       // can keep searching past it for another must-aliased pointer that stores
@@ -842,6 +1001,136 @@ bool DSE::handleEndBlock(BasicBlock &BB) {
   return MadeChange;
 }
 
+namespace {
+  enum KillResult { NotKilled, Killed, MayBeRead };
+}
+
+/// classifyAccess - Tell whether 'I' completely overwrites 'Loc' without
+/// reading it first, may observe its contents, or neither.  'IsStackObject'
+/// says that 'Loc' is in a local alloca, which can't be read by the callers
+/// once the function returns or unwinds.
+static KillResult classifyAccess(Instruction *I, const MemoryLocation &Loc,
+                                 bool IsStackObject, AliasAnalysis &AA,
+                                 const DataLayout &DL,
+                                 const TargetLibraryInfo *TLI) {
+  bool MayRead = AA.getModRefInfo(I, Loc) & AliasAnalysis::Ref;
+  if (!MayRead && hasMemoryWrite(I, TLI)) {
+    MemoryLocation WriteLoc = getLocForWrite(I, AA);
+    int64_t InstWriteOffset, DepWriteOffset;
+    if (WriteLoc.Ptr &&
+        isOverwrite(WriteLoc, Loc, DL, TLI, DepWriteOffset, InstWriteOffset) ==
+            OverwriteComplete)
+      return Killed;
+  }
+
+  if (MayRead || (I->mayThrow() && !IsStackObject))
+    return MayBeRead;
+  return NotKilled;
+}
+
+/// isKilledAlongAllPaths - Return true if the location 'Loc' written by 'SI'
+/// is completely overwritten along every path leaving it before anything may
+/// read it.  The walk gives up on cycles and on blocks dominating the block of
+/// 'SI': the pointers compared there may hold different values than at 'SI'.
+bool DSE::isKilledAlongAllPaths(Instruction *SI, const MemoryLocation &Loc) {
+  BasicBlock *StoreBB = SI->getParent();
+  const DataLayout &DL = StoreBB->getModule()->getDataLayout();
+  bool IsStackObject = isa<AllocaInst>(GetUnderlyingObject(Loc.Ptr, DL));
+
+  // Scan the rest of the block of the store first.
+  for (BasicBlock::iterator I = std::next(BasicBlock::iterator(SI)),
+       E = StoreBB->end(); I != E; ++I) {
+    KillResult R = classifyAccess(I, Loc, IsStackObject, *AA, DL, TLI);
+    if (R == Killed)
+      return true;
+    if (R == MayBeRead)
+      return false;
+  }
+
+  // Then walk the successors depth first.  A block maps to true once all the
+  // paths through it are known to kill the location.
+  DenseMap<BasicBlock *, bool> Visited;
+  SmallVector<std::pair<BasicBlock *, succ_iterator>, 8> Stack;
+  Stack.push_back(std::make_pair(StoreBB, succ_begin(StoreBB)));
+  while (!Stack.empty()) {
+    BasicBlock *BB = Stack.back().first;
+    succ_iterator &SuccI = Stack.back().second;
+    if (SuccI == succ_end(BB)) {
+      Visited[BB] = true;
+      Stack.pop_back();
+      continue;
+    }
+    BasicBlock *Succ = *SuccI++;
+
+    auto It = Visited.find(Succ);
+    if (It != Visited.end()) {
+      if (!It->second)
+        return false;
+      continue;
+    }
+    if (Visited.size() >= GlobalDSEMaxBlocks || DT->dominates(Succ, StoreBB))
+      return false;
+    Visited[Succ] = false;
+
+    KillResult R = NotKilled;
+    for (BasicBlock::iterator I = Succ->begin(), E = Succ->end();
+         I != E && R == NotKilled; ++I)
+      R = classifyAccess(I, Loc, IsStackObject, *AA, DL, TLI);
+    if (R == MayBeRead)
+      return false;
+
+    TerminatorInst *TI = Succ->getTerminator();
+    if (R == Killed || isa<UnreachableInst>(TI)) {
+      Visited[Succ] = true;
+      continue;
+    }
+    // Callers may read the location once the function returns.
+    if (TI->getNumSuccessors() == 0) {
+      if (!IsStackObject || !isa<ReturnInst>(TI))
+        return false;
+      Visited[Succ] = true;
+      continue;
+    }
+    Stack.push_back(std::make_pair(Succ, succ_begin(Succ)));
+  }
+  return true;
+}
+
+/// handleSuccessorKills - Remove stores of the block that are overwritten along
+/// all the paths leaving it, as in:
+///   store i32 0, i32* %P
+///   br i1 %c, label %A, label %B
+/// A:
+///   store i32 1, i32* %P
+///   ...
+/// B:
+///   store i32 2, i32* %P
+bool DSE::handleSuccessorKills(BasicBlock &BB) {
+  if (BB.getTerminator()->getNumSuccessors() == 0)
+    return false;
+
+  SmallVector<Instruction *, 8> Stores;
+  for (BasicBlock::iterator I = BB.begin(), E = BB.end(); I != E; ++I)
+    if ((isa<StoreInst>(I) || isa<MemIntrinsic>(I)) && isRemovable(I))
+      Stores.push_back(I);
+
+  bool MadeChange = false;
+  for (Instruction *SI : Stores) {
+    MemoryLocation Loc = getLocForWrite(SI, *AA);
+    if (!Loc.Ptr || Loc.Size == MemoryLocation::UnknownSize ||
+        !isKilledAlongAllPaths(SI, Loc))
+      continue;
+
+    DEBUG(dbgs() << "DSE: Dead Store Killed In Successors:\n  DEAD: " << *SI
+                 << '\n');
+    DeleteDeadInstruction(SI, *MD, TLI);
+    ++NumCrossBlockStores;
+    ++NumFastStores;
+    MadeChange = true;
+  }
+  return MadeChange;
+}
+
 /// RemoveAccessedObjects - Check to see if the specified location may alias any
 /// of the stack objects in the DeadStackObjects set.  If so, they become live
 /// because the location is being loaded.
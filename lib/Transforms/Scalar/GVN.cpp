@@ -26,10 +26,13 @@
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
 #include "llvm/Analysis/CFG.h"
 #include "llvm/Analysis/ConstantFolding.h"
 #include "llvm/Analysis/InstructionSimplify.h"
 #include "llvm/Analysis/Loads.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/MemoryBuiltins.h"
 #include "llvm/Analysis/MemoryDependenceAnalysis.h"
 #include "llvm/Analysis/PHITransAddr.h"
@@ -63,11 +66,18 @@ STATISTIC(NumGVNBlocks, "Number of blocks merged");
 STATISTIC(NumGVNSimpl,  "Number of instructions simplified");
 STATISTIC(NumGVNEqProp, "Number of equalities propagated");
 STATISTIC(NumPRELoad,   "Number of loads PRE'd");
+STATISTIC(NumPREMultiPred, "Number of PRE'd values inserted in several preds");
 
 static cl::opt<bool> EnablePRE("enable-pre",
                                cl::init(true), cl::Hidden);
 static cl::opt<bool> EnableLoadPRE("enable-load-pre", cl::init(true));
 
+// Maximum number of predecessors a partially redundant value is inserted in.
+static cl::opt<unsigned> MaxPREInsertions(
+    "gvn-max-pre-insertions", cl::Hidden, cl::init(4),
+    cl::desc("Max number of predecessors to insert a partially redundant "
+             "value in (default = 4)"));
+
 // Maximum allowed recursion depth.
 static cl::opt<uint32_t>
 MaxRecurseDepth("max-recurse-depth", cl::Hidden, cl::init(1000), cl::ZeroOrMore,
@@ -596,6 +606,12 @@ namespace {
     AssumptionCache *AC;
     SetVector<BasicBlock *> DeadBlocks;
 
+    /// Block frequencies used to decide whether PRE into several
+    /// predecessors is profitable.  They are only computed once such a
+    /// candidate is found, and dropped whenever the CFG changes.
+    std::unique_ptr<BranchProbabilityInfo> BPI;
+    std::unique_ptr<BlockFrequencyInfo> BFI;
+
     ValueTable VN;
 
     /// A mapping from value numbers to lists of Value*'s that
@@ -714,6 +730,13 @@ namespace {
     bool performScalarPRE(Instruction *I);
     bool performScalarPREInsertion(Instruction *Instr, BasicBlock *Pred,
                                    unsigned int ValNo);
+    BlockFrequency getEdgeFreq(const BasicBlock *Pred,
+                               const BasicBlock *Succ) const;
+    void forgetBlockFrequencies() {
+      BFI.reset();
+      BPI.reset();
+    }
+    bool isPREProfitable(BasicBlock *BB, ArrayRef<BasicBlock *> InsertPreds);
     Value *findLeader(const BasicBlock *BB, uint32_t num);
     void cleanupGlobalSets();
     void verifyRemoved(const Instruction *I) const;
@@ -1572,12 +1595,20 @@ bool GVN::PerformLoadPRE(LoadInst *LI, AvailValInBlkVect &ValuesPerBlock,
   assert(NumUnavailablePreds != 0 &&
          "Fully available value should already be eliminated!");
 
-  // If this load is unavailable in multiple predecessors, reject it.
+  // If this load is unavailable in multiple predecessors, only insert a
+  // reload in each of them when they are estimated to be colder than the
+  // predecessors that already have the value.
   // FIXME: If we could restructure the CFG, we could make a common pred with
   // all the preds that don't have an available LI and insert a new load into
   // that one block.
-  if (NumUnavailablePreds != 1)
+  if (NumUnavailablePreds != 1) {
+    SmallVector<BasicBlock *, 4> InsertPreds(CriticalEdgePred.begin(),
+                                             CriticalEdgePred.end());
+    for (const auto &PredLoad : PredLoads)
+      InsertPreds.push_back(PredLoad.first);
+    if (!isPREProfitable(LoadBB, InsertPreds))
       return false;
+  }
 
   // Split critical edges, and update the unavailable predecessors accordingly.
   for (BasicBlock *OrigPred : CriticalEdgePred) {
@@ -2327,7 +2358,10 @@ bool GVN::runOnFunction(Function& F) {
 
     bool removedBlock = MergeBlockIntoPredecessor(
         BB, DT, /* LoopInfo */ nullptr, VN.getAliasAnalysis(), MD);
-    if (removedBlock) ++NumGVNBlocks;
+    if (removedBlock) {
+      ++NumGVNBlocks;
+      forgetBlockFrequencies();
+    }
 
     Changed |= removedBlock;
   }
@@ -2360,6 +2394,7 @@ bool GVN::runOnFunction(Function& F) {
   // Do not cleanup DeadBlocks in cleanupGlobalSets() as it's called for each
   // iteration. 
   DeadBlocks.clear();
+  forgetBlockFrequencies();
 
   return Changed;
 }
@@ -2409,6 +2444,53 @@ bool GVN::processBlock(BasicBlock *BB) {
   return ChangedFunction;
 }
 
+/// Return the estimated execution count of the edge from \p Pred to \p Succ.
+BlockFrequency GVN::getEdgeFreq(const BasicBlock *Pred,
+                                const BasicBlock *Succ) const {
+  return BFI->getBlockFreq(Pred) * BPI->getEdgeProbability(Pred, Succ);
+}
+
+/// Decide whether a value that is partially redundant in \p BB may be
+/// inserted on the edges coming from \p InsertPreds.  Inserting it in a
+/// single predecessor only moves the computation and is always allowed.
+/// Inserting it in several predecessors grows the code, so it is only done
+/// when the estimated block frequencies say that those edges are together
+/// colder than the edges that already provide the value.  This is a
+/// heuristic: the estimate may not match the actual run-time behavior.
+bool GVN::isPREProfitable(BasicBlock *BB, ArrayRef<BasicBlock *> InsertPreds) {
+  if (InsertPreds.size() == 1)
+    return true;
+  Function &F = *BB->getParent();
+  if (InsertPreds.size() > MaxPREInsertions ||
+      F.hasFnAttribute(Attribute::OptimizeForSize))
+    return false;
+
+  if (!BFI) {
+    LoopInfo LI(*DT);
+    BPI.reset(new BranchProbabilityInfo(F, LI));
+    BFI.reset(new BlockFrequencyInfo(F, *BPI, LI));
+  }
+
+  SmallPtrSet<const BasicBlock *, 4> Insert(InsertPreds.begin(),
+                                            InsertPreds.end());
+  SmallPtrSet<const BasicBlock *, 8> Visited;
+  BlockFrequency InsertFreq, AvailFreq;
+  for (const BasicBlock *Pred : predecessors(BB)) {
+    if (!Visited.insert(Pred).second)
+      continue;
+    if (Insert.count(Pred))
+      InsertFreq += getEdgeFreq(Pred, BB);
+    else
+      AvailFreq += getEdgeFreq(Pred, BB);
+  }
+
+  DEBUG(dbgs() << "GVN PRE into " << InsertPreds.size() << " preds of "
+               << BB->getName() << ": insertion freq "
+               << InsertFreq.getFrequency() << ", available freq "
+               << AvailFreq.getFrequency() << '\n');
+  return InsertFreq < AvailFreq;
+}
+
 // Instantiate an expression in a predecessor that lacked it.
 bool GVN::performScalarPREInsertion(Instruction *Instr, BasicBlock *Pred,
                                     unsigned int ValNo) {
@@ -2469,15 +2551,14 @@ bool GVN::performScalarPRE(Instruction *CurInst) {
 
   uint32_t ValNo = VN.lookup(CurInst);
 
-  // Look for the predecessors for PRE opportunities.  We're
-  // only trying to solve the basic diamond case, where
-  // a value is computed in the successor and one predecessor,
-  // but not the other.  We also explicitly disallow cases
-  // where the successor is its own predecessor, because they're
-  // more complicated to get right.
+  // Look for the predecessors for PRE opportunities.  A value that is
+  // computed in the successor and some of its predecessors is made available
+  // in the others by inserting a copy there.  We explicitly disallow cases
+  // where the successor is its own predecessor, because they're more
+  // complicated to get right.
   unsigned NumWith = 0;
   unsigned NumWithout = 0;
-  BasicBlock *PREPred = nullptr;
+  SmallVector<BasicBlock *, 4> PREPreds;
   BasicBlock *CurrentBlock = CurInst->getParent();
   predMap.clear();
 
@@ -2488,66 +2569,85 @@ bool GVN::performScalarPRE(Instruction *CurInst) {
     // own predecessor, or in blocks with predecessors
     // that are not reachable.
     if (P == CurrentBlock) {
-      NumWithout = 2;
-      break;
+      return false;
     } else if (!DT->isReachableFromEntry(P)) {
-      NumWithout = 2;
-      break;
+      return false;
     }
 
     Value *predV = findLeader(P, ValNo);
     if (!predV) {
+      // A predecessor reaching us along several edges lacks the value on all
+      // of them.
+      if (std::find(PREPreds.begin(), PREPreds.end(), P) != PREPreds.end())
+        return false;
       predMap.push_back(std::make_pair(static_cast<Value *>(nullptr), P));
-      PREPred = P;
+      PREPreds.push_back(P);
       ++NumWithout;
     } else if (predV == CurInst) {
       /* CurInst dominates this predecessor. */
-      NumWithout = 2;
-      break;
+      return false;
     } else {
       predMap.push_back(std::make_pair(predV, P));
       ++NumWith;
     }
   }
 
-  // Don't do PRE when it might increase code size, i.e. when
-  // we would need to insert instructions in more than one pred.
-  if (NumWithout > 1 || NumWith == 0)
+  // Don't do PRE when it is likely to increase the number of evaluations,
+  // i.e. when the value has to be inserted in predecessors that are estimated
+  // to be hotter than the ones that already compute it.
+  if (NumWith == 0 || (NumWithout != 0 &&
+                       !isPREProfitable(CurrentBlock, PREPreds)))
     return false;
 
-  // We may have a case where all predecessors have the instruction,
-  // and we just need to insert a phi node. Otherwise, perform
-  // insertion.
-  Instruction *PREInstr = nullptr;
-
-  if (NumWithout != 0) {
+  for (BasicBlock *PREPred : PREPreds) {
     // Don't do PRE across indirect branch.
     if (isa<IndirectBrInst>(PREPred->getTerminator()))
       return false;
+  }
 
-    // We can't do PRE safely on a critical edge, so instead we schedule
-    // the edge to be split and perform the PRE the next time we iterate
-    // on the function.
+  // We can't do PRE safely on a critical edge, so instead we schedule
+  // the edge to be split and perform the PRE the next time we iterate
+  // on the function.
+  bool HasCriticalEdge = false;
+  for (BasicBlock *PREPred : PREPreds) {
     unsigned SuccNum = GetSuccessorNumber(PREPred, CurrentBlock);
     if (isCriticalEdge(PREPred->getTerminator(), SuccNum)) {
       toSplit.push_back(std::make_pair(PREPred->getTerminator(), SuccNum));
-      return false;
+      HasCriticalEdge = true;
     }
-    // We need to insert somewhere, so let's give it a shot
-    PREInstr = CurInst->clone();
-    if (!performScalarPREInsertion(PREInstr, PREPred, ValNo)) {
-      // If we failed insertion, make sure we remove the instruction.
-      DEBUG(verifyRemoved(PREInstr));
-      delete PREInstr;
-      return false;
+  }
+  if (HasCriticalEdge)
+    return false;
+
+  // We need to insert somewhere, so let's give it a shot
+  SmallDenseMap<BasicBlock *, Instruction *, 4> PREInstrs;
+  for (BasicBlock *PREPred : PREPreds) {
+    Instruction *PREInstr = CurInst->clone();
+    if (performScalarPREInsertion(PREInstr, PREPred, ValNo)) {
+      PREInstrs[PREPred] = PREInstr;
+      continue;
+    }
+
+    // If we failed insertion, make sure we remove the instruction and the
+    // copies already inserted in the other predecessors.
+    DEBUG(verifyRemoved(PREInstr));
+    delete PREInstr;
+    for (auto &Inserted : PREInstrs) {
+      VN.erase(Inserted.second);
+      removeFromLeaderTable(ValNo, Inserted.second, Inserted.first);
+      DEBUG(verifyRemoved(Inserted.second));
+      Inserted.second->eraseFromParent();
     }
+    return false;
   }
 
-  // Either we should have filled in the PRE instruction, or we should
+  // Either we should have filled in the PRE instructions, or we should
   // not have needed insertions.
-  assert (PREInstr != nullptr || NumWithout == 0);
+  assert(PREInstrs.size() == NumWithout);
 
   ++NumGVNPRE;
+  if (NumWithout > 1)
+    ++NumPREMultiPred;
 
   // Create a PHI to make the value available in this block.
   PHINode *Phi =
@@ -2557,7 +2657,7 @@ bool GVN::performScalarPRE(Instruction *CurInst) {
     if (Value *V = predMap[i].first)
       Phi->addIncoming(V, predMap[i].second);
     else
-      Phi->addIncoming(PREInstr, PREPred);
+      Phi->addIncoming(PREInstrs[predMap[i].second], predMap[i].second);
   }
 
   VN.add(Phi, ValNo);
@@ -2611,6 +2711,8 @@ bool GVN::performPRE(Function &F) {
 BasicBlock *GVN::splitCriticalEdges(BasicBlock *Pred, BasicBlock *Succ) {
   BasicBlock *BB = SplitCriticalEdge(
       Pred, Succ, CriticalEdgeSplittingOptions(getAliasAnalysis(), DT));
+  if (BB)
+    forgetBlockFrequencies();
   if (MD)
     MD->invalidateCachedPredecessors();
   return BB;
@@ -2626,6 +2728,7 @@ bool GVN::splitCriticalEdges() {
     SplitCriticalEdge(Edge.first, Edge.second,
                       CriticalEdgeSplittingOptions(getAliasAnalysis(), DT));
   } while (!toSplit.empty());
+  forgetBlockFrequencies();
   if (MD) MD->invalidateCachedPredecessors();
   return true;
 }
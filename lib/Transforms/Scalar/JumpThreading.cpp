@@ -18,13 +18,17 @@
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
 #include "llvm/Analysis/CFG.h"
 #include "llvm/Analysis/ConstantFolding.h"
 #include "llvm/Analysis/InstructionSimplify.h"
 #include "llvm/Analysis/LazyValueInfo.h"
 #include "llvm/Analysis/Loads.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Metadata.h"
@@ -43,12 +47,19 @@ using namespace llvm;
 STATISTIC(NumThreads, "Number of jumps threaded");
 STATISTIC(NumFolds,   "Number of terminators folded");
 STATISTIC(NumDupes,   "Number of branch blocks duplicated to eliminate phi");
+STATISTIC(NumColdEdges, "Number of cold edges not threaded");
 
 static cl::opt<unsigned>
 BBDuplicateThreshold("jump-threading-threshold",
           cl::desc("Max block size to duplicate for jump threading"),
           cl::init(6), cl::Hidden);
 
+static cl::opt<unsigned> ColdEdgePercent(
+    "jump-threading-cold-edge-percent",
+    cl::desc("With profile data, don't duplicate blocks for the edges whose "
+             "frequency is below this percentage of the function entry's"),
+    cl::init(1), cl::Hidden);
+
 namespace {
   // These are at global scope so static functions can use them too.
   typedef SmallVectorImpl<std::pair<Constant*, BasicBlock*> > PredValueInfo;
@@ -89,6 +100,21 @@ namespace {
 
     unsigned BBDupThreshold;
 
+    // Block frequencies of the function, when it has profile data. They are
+    // computed on demand at most once per pass over the function, unless a
+    // query involves a block that is not in FreqBlocks, i.e. one created
+    // since they were computed. Blocks must be removed from FreqBlocks before
+    // they are deleted, so that a new block at the same address isn't taken
+    // for them.
+    bool HasProfileData;
+    std::unique_ptr<BranchProbabilityInfo> BPI;
+    std::unique_ptr<BlockFrequencyInfo> BFI;
+#ifdef NDEBUG
+    SmallPtrSet<BasicBlock*, 32> FreqBlocks;
+#else
+    SmallSet<AssertingVH<BasicBlock>, 32> FreqBlocks;
+#endif
+
     // RAII helper for updating the recursion stack.
     struct RecursionSetRemover {
       DenseSet<std::pair<Value*, BasicBlock*> > &TheSet;
@@ -118,6 +144,8 @@ namespace {
     }
 
     void FindLoopHeaders(Function &F);
+    bool isColdEdge(const SmallVectorImpl<BasicBlock *> &PredBBs,
+                    BasicBlock *BB);
     bool ProcessBlock(BasicBlock *BB);
     bool ThreadEdge(BasicBlock *BB, const SmallVectorImpl<BasicBlock*> &PredBBs,
                     BasicBlock *SuccBB);
@@ -151,6 +179,16 @@ INITIALIZE_PASS_END(JumpThreading, "jump-threading",
 // Public interface to the Jump Threading pass
 FunctionPass *llvm::createJumpThreadingPass(int Threshold) { return new JumpThreading(Threshold); }
 
+/// Return true if F has an entry count or branch weights.
+static bool hasProfileData(const Function &F) {
+  if (F.getEntryCount())
+    return true;
+  for (const BasicBlock &BB : F)
+    if (BB.getTerminator()->getMetadata(LLVMContext::MD_prof))
+      return true;
+  return false;
+}
+
 /// runOnFunction - Top level algorithm.
 ///
 bool JumpThreading::runOnFunction(Function &F) {
@@ -160,6 +198,7 @@ bool JumpThreading::runOnFunction(Function &F) {
   DEBUG(dbgs() << "Jump threading on function '" << F.getName() << "'\n");
   TLI = &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
   LVI = &getAnalysis<LazyValueInfo>();
+  HasProfileData = hasProfileData(F);
 
   // Remove unreachable blocks from function as they may result in infinite
   // loop. We do threading if we found something profitable. Jump threading a
@@ -175,6 +214,7 @@ bool JumpThreading::runOnFunction(Function &F) {
   bool Changed, EverChanged = false;
   do {
     Changed = false;
+    BFI.reset();
     for (Function::iterator I = F.begin(), E = F.end(); I != E;) {
       BasicBlock *BB = I;
       // Thread all of the branches we can over this block.
@@ -191,6 +231,7 @@ bool JumpThreading::runOnFunction(Function &F) {
               << "' with terminator: " << *BB->getTerminator() << '\n');
         LoopHeaders.erase(BB);
         LVI->eraseBlock(BB);
+        FreqBlocks.erase(BB);
         DeleteDeadBlock(BB);
         Changed = true;
         continue;
@@ -209,6 +250,7 @@ bool JumpThreading::runOnFunction(Function &F) {
         // block, we have to make sure it isn't in the LoopHeaders set.  We
         // reinsert afterward if needed.
         bool ErasedFromLoopHeaders = LoopHeaders.erase(BB);
+        bool ErasedFromFreqBlocks = FreqBlocks.erase(BB);
         BasicBlock *Succ = BI->getSuccessor(0);
 
         // FIXME: It is always conservatively correct to drop the info
@@ -221,6 +263,8 @@ bool JumpThreading::runOnFunction(Function &F) {
           // If we deleted BB and BB was the header of a loop, then the
           // successor is now the header of the loop.
           BB = Succ;
+        } else if (ErasedFromFreqBlocks) {
+          FreqBlocks.insert(BB);
         }
 
         if (ErasedFromLoopHeaders)
@@ -231,9 +275,52 @@ bool JumpThreading::runOnFunction(Function &F) {
   } while (Changed);
 
   LoopHeaders.clear();
+  FreqBlocks.clear();
+  BFI.reset();
+  BPI.reset();
   return EverChanged;
 }
 
+/// isColdEdge - Return true if the profile says that the edges from PredBBs to
+/// BB are too rarely taken to pay for duplicating BB. Without profile data, no
+/// edge is cold.
+bool JumpThreading::isColdEdge(const SmallVectorImpl<BasicBlock *> &PredBBs,
+                               BasicBlock *BB) {
+  if (!HasProfileData)
+    return false;
+
+  bool Stale = !BFI || !FreqBlocks.count(BB);
+  for (BasicBlock *PredBB : PredBBs)
+    Stale |= !FreqBlocks.count(PredBB);
+  if (Stale) {
+    Function &F = *BB->getParent();
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    BPI.reset(new BranchProbabilityInfo(F, LI));
+    BFI.reset(new BlockFrequencyInfo(F, *BPI, LI));
+    FreqBlocks.clear();
+    for (BasicBlock &FB : F)
+      FreqBlocks.insert(&FB);
+  }
+
+  BlockFrequency EdgeFreq;
+  for (BasicBlock *PredBB : PredBBs)
+    EdgeFreq += BFI->getBlockFreq(PredBB) *
+                BPI->getEdgeProbability(PredBB, BB);
+  // The frequencies are small integers when the profile is flat, so compare
+  // them without rounding.
+  uint64_t EntryFreq = BFI->getEntryFreq();
+  if ((APInt(128, EdgeFreq.getFrequency()) * APInt(128, 100))
+          .uge(APInt(128, EntryFreq) * APInt(128, ColdEdgePercent)))
+    return false;
+
+  DEBUG(dbgs() << "  Not duplicating BB '" << BB->getName()
+               << "' for a cold edge, frequency " << EdgeFreq.getFrequency()
+               << " for an entry frequency of " << EntryFreq << "\n");
+  ++NumColdEdges;
+  return true;
+}
+
 /// getJumpThreadDuplicationCost - Return the cost of duplicating this block to
 /// thread across it. Stop scanning the block when passing the threshold.
 static unsigned getJumpThreadDuplicationCost(const BasicBlock *BB,
@@ -676,6 +763,7 @@ bool JumpThreading::ProcessBlock(BasicBlock *BB) {
         LoopHeaders.insert(BB);
 
       LVI->eraseBlock(SinglePred);
+      FreqBlocks.erase(SinglePred);
       MergeBasicBlockIntoOnlyPred(BB);
 
       return true;
@@ -1387,6 +1475,9 @@ bool JumpThreading::ThreadEdge(BasicBlock *BB,
     return false;
   }
 
+  if (isColdEdge(PredBBs, BB))
+    return false;
+
   // And finally, do it!  Start by factoring the predecessors is needed.
   BasicBlock *PredBB;
   if (PredBBs.size() == 1)
@@ -1530,6 +1621,9 @@ bool JumpThreading::DuplicateCondBranchOnPHIIntoPred(BasicBlock *BB,
     return false;
   }
 
+  if (isColdEdge(PredBBs, BB))
+    return false;
+
   // And finally, do it!  Start by factoring the predecessors is needed.
   BasicBlock *PredBB;
   if (PredBBs.size() == 1)
@@ -0,0 +1,416 @@
+//===- LoopFuse.cpp - Loop Fusion Pass ------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the Loop Fusion Pass, the inverse of Loop Distribution.
+// Adjacent loops that run the same number of iterations are merged into a
+// single loop, so that data streamed through the cache by the first loop is
+// reused by the second while it is still there.
+//
+// Two sibling innermost loops are candidates when the exit block of the first
+// is the preheader of the second and does nothing but branch to it, which
+// makes the loops control-flow equivalent: one runs exactly when the other
+// does. Their trip counts must be the same SCEV expression.
+//
+// Fusion moves each iteration of the second loop's memory accesses ahead of
+// later iterations of the first loop's accesses. DependenceAnalysis is asked
+// first whether two accesses may depend at all; when they may, their
+// addresses are compared as functions of the shared induction variable, and
+// fusion only proceeds if no access of the second loop reaches memory that a
+// later iteration of the first loop accesses.
+//
+// A simple register pressure model rejects fusions whose combined loop would
+// keep more values live than the target has registers.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#define LFUSE_NAME "loop-fuse"
+#define DEBUG_TYPE LFUSE_NAME
+
+using namespace llvm;
+
+static cl::opt<unsigned> MaxLiveValues(
+    "loop-fuse-max-live-values", cl::Hidden, cl::init(0),
+    cl::desc("Maximum number of values a fused loop may keep live; zero means "
+             "the number of scalar registers of the target"));
+
+STATISTIC(NumLoopsFused, "Number of loops fused");
+STATISTIC(NumReusedAccesses,
+          "Number of memory accesses to data the other fused loop accesses in "
+          "the same iteration");
+
+namespace {
+/// \brief The loop fusion pass.
+class LoopFuse : public FunctionPass {
+public:
+  LoopFuse() : FunctionPass(ID) {
+    initializeLoopFusePass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnFunction(Function &F) override {
+    if (skipOptnoneFunction(F))
+      return false;
+
+    LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+    SE = &getAnalysis<ScalarEvolution>();
+    DA = &getAnalysis<DependenceAnalysis>();
+    TTI = &getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+    DL = &F.getParent()->getDataLayout();
+
+    bool Changed = fuseSiblings(std::vector<Loop *>(LI->begin(), LI->end()));
+    if (Changed)
+      DT->recalculate(F);
+    return Changed;
+  }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addPreserved<LoopInfoWrapperPass>();
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addPreserved<DominatorTreeWrapperPass>();
+    AU.addRequired<ScalarEvolution>();
+    AU.addRequired<DependenceAnalysis>();
+    AU.addRequired<TargetTransformInfoWrapperPass>();
+  }
+
+  static char ID;
+
+private:
+  LoopInfo *LI;
+  DominatorTree *DT;
+  ScalarEvolution *SE;
+  DependenceAnalysis *DA;
+  const TargetTransformInfo *TTI;
+  const DataLayout *DL;
+
+  /// \brief Fuse what can be fused among \p Loops, which share a parent, and
+  /// then among the children of each of them.
+  bool fuseSiblings(std::vector<Loop *> Loops);
+
+  /// \brief Return true if \p L has the shape fusion expects, and collect its
+  /// memory accesses into \p Accesses.
+  bool isCandidate(Loop *L, SmallVectorImpl<Instruction *> &Accesses);
+
+  /// \brief Return true if \p Second directly follows \p First and runs the
+  /// same number of iterations.
+  bool areAdjacentAndEquivalent(Loop *First, Loop *Second);
+
+  /// \brief Return true if fusing keeps the order of every pair of dependent
+  /// accesses \p A, from the first loop, and \p B, from the second. Count
+  /// the pairs that access the same data in the same iteration in
+  /// \p NumReused.
+  bool isSafeToReorder(Instruction *A, Instruction *B, Loop *First,
+                       Loop *Second, unsigned &NumReused);
+
+  /// \brief Return true if the fused loop would keep few enough values live.
+  bool isProfitable(Loop *First, Loop *Second);
+
+  /// \brief Merge \p Second into \p First.
+  void fuse(Loop *First, Loop *Second);
+};
+} // end anonymous namespace
+
+static Value *getPointerOperand(Instruction *I) {
+  if (auto *LI = dyn_cast<LoadInst>(I))
+    return LI->getPointerOperand();
+  return cast<StoreInst>(I)->getPointerOperand();
+}
+
+static Type *getAccessType(Instruction *I) {
+  if (auto *SI = dyn_cast<StoreInst>(I))
+    return SI->getValueOperand()->getType();
+  return I->getType();
+}
+
+/// \brief Rewrite the affine recurrence \p S of \p From into the same
+/// recurrence of \p To. Return null if \p S is not of that form.
+static const SCEVAddRecExpr *rewriteForLoop(const SCEV *S, Loop *From, Loop *To,
+                                            ScalarEvolution &SE) {
+  auto *AR = dyn_cast<SCEVAddRecExpr>(S);
+  if (!AR || AR->getLoop() != From || !AR->isAffine())
+    return nullptr;
+  const SCEV *Start = AR->getStart();
+  const SCEV *Step = AR->getStepRecurrence(SE);
+  if (!SE.isLoopInvariant(Start, To) || !SE.isLoopInvariant(Step, To))
+    return nullptr;
+  if (From == To)
+    return AR;
+  return dyn_cast<SCEVAddRecExpr>(
+      SE.getAddRecExpr(Start, Step, To, SCEV::FlagAnyWrap));
+}
+
+bool LoopFuse::isCandidate(Loop *L, SmallVectorImpl<Instruction *> &Accesses) {
+  if (!L->empty() || !L->getLoopPreheader() || !L->hasDedicatedExits())
+    return false;
+
+  // The latch must be the only way out, so that each iteration runs the
+  // whole body.
+  BasicBlock *Latch = L->getLoopLatch();
+  if (!Latch || L->getExitingBlock() != Latch || !L->getExitBlock())
+    return false;
+  auto *BI = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!BI || !BI->isConditional())
+    return false;
+
+  if (isa<SCEVCouldNotCompute>(SE->getBackedgeTakenCount(L)))
+    return false;
+
+  for (BasicBlock *BB : L->getBlocks())
+    for (Instruction &I : *BB) {
+      if (auto *Ld = dyn_cast<LoadInst>(&I)) {
+        if (!Ld->isSimple())
+          return false;
+        Accesses.push_back(Ld);
+        continue;
+      }
+      if (auto *St = dyn_cast<StoreInst>(&I)) {
+        if (!St->isSimple())
+          return false;
+        Accesses.push_back(St);
+        continue;
+      }
+      if (I.mayReadOrWriteMemory() || I.mayHaveSideEffects())
+        return false;
+    }
+  return true;
+}
+
+bool LoopFuse::areAdjacentAndEquivalent(Loop *First, Loop *Second) {
+  // The second loop must be entered right after the first one exits, only
+  // from there, and with nothing computed in between.
+  BasicBlock *Between = First->getExitBlock();
+  if (Between != Second->getLoopPreheader() ||
+      Between->getSinglePredecessor() != First->getLoopLatch() ||
+      &Between->front() != Between->getTerminator())
+    return false;
+
+  // The second loop would see the current iteration's values of the first
+  // loop instead of the final ones.
+  for (BasicBlock *BB : First->getBlocks())
+    for (Instruction &I : *BB)
+      for (User *U : I.users())
+        if (!First->contains(cast<Instruction>(U)))
+          return false;
+
+  const SCEV *FirstCount = SE->getBackedgeTakenCount(First);
+  const SCEV *SecondCount = SE->getBackedgeTakenCount(Second);
+  if (FirstCount != SecondCount) {
+    DEBUG(dbgs() << "LFuse: Trip counts differ: " << *FirstCount << " vs "
+                 << *SecondCount << "\n");
+    return false;
+  }
+  return true;
+}
+
+bool LoopFuse::isSafeToReorder(Instruction *A, Instruction *B, Loop *First,
+                               Loop *Second, unsigned &NumReused) {
+  if (!DA->depends(A, B, true))
+    return true;
+
+  // After fusion, iteration i of the first loop is followed by iteration i of
+  // the second. Express both addresses in the fused loop's iteration.
+  const SCEVAddRecExpr *PA =
+      rewriteForLoop(SE->getSCEV(getPointerOperand(A)), First, First, *SE);
+  const SCEVAddRecExpr *PB =
+      rewriteForLoop(SE->getSCEV(getPointerOperand(B)), Second, First, *SE);
+  if (!PA || !PB)
+    return false;
+
+  const SCEV *Step = PA->getStepRecurrence(*SE);
+  auto *C = dyn_cast<SCEVConstant>(Step);
+  if (!C || Step != PB->getStepRecurrence(*SE) || C->getValue()->isZero())
+    return false;
+  auto *Dist =
+      dyn_cast<SCEVConstant>(SE->getMinusSCEV(PA->getStart(), PB->getStart()));
+  if (!Dist)
+    return false;
+
+  // A in iteration i and B in iteration j touch the same bytes only when
+  // j - i is about Dist / Step. B must never reach memory that A touches in
+  // a later iteration, i.e. j < i must be impossible.
+  int64_t Stride = C->getValue()->getSExtValue();
+  int64_t Distance = Dist->getValue()->getSExtValue();
+  uint64_t SizeA = DL->getTypeStoreSize(getAccessType(A));
+  uint64_t SizeB = DL->getTypeStoreSize(getAccessType(B));
+  bool Safe = Stride > 0 ? Distance >= 0 && SizeB <= uint64_t(Stride)
+                         : Distance <= 0 && SizeA <= uint64_t(-Stride);
+  if (Safe && Distance == 0)
+    ++NumReused;
+  return Safe;
+}
+
+bool LoopFuse::isProfitable(Loop *First, Loop *Second) {
+  // Count the values carried around the backedge and the loop-invariant
+  // values the bodies use. Both stay live throughout the fused loop.
+  unsigned Live = 0;
+  SmallPtrSet<Value *, 16> Invariants;
+  for (Loop *L : {First, Second}) {
+    for (Instruction &I : *L->getHeader()) {
+      if (!isa<PHINode>(I))
+        break;
+      ++Live;
+    }
+    for (BasicBlock *BB : L->getBlocks())
+      for (Instruction &I : *BB)
+        for (Value *Op : I.operands())
+          if (isa<Argument>(Op) ||
+              (isa<Instruction>(Op) && !L->contains(cast<Instruction>(Op))))
+            Invariants.insert(Op);
+  }
+  Live += Invariants.size();
+
+  unsigned Limit = MaxLiveValues ? MaxLiveValues
+                                 : TTI->getNumberOfRegisters(false);
+  DEBUG(dbgs() << "LFuse: Fused loop keeps " << Live << " values live, limit "
+               << Limit << "\n");
+  return Live <= Limit;
+}
+
+void LoopFuse::fuse(Loop *First, Loop *Second) {
+  BasicBlock *Preheader = First->getLoopPreheader();
+  BasicBlock *Header = First->getHeader();
+  BasicBlock *Latch = First->getLoopLatch();
+  BasicBlock *Between = Second->getLoopPreheader();
+  BasicBlock *SecondHeader = Second->getHeader();
+  BasicBlock *SecondLatch = Second->getLoopLatch();
+
+  SE->forgetLoop(First);
+  SE->forgetLoop(Second);
+
+  // The first loop's latch now continues into the second loop's body, and
+  // the second loop's latch decides whether to iterate again.
+  auto *BI = cast<BranchInst>(Latch->getTerminator());
+  Value *Cond = BI->getCondition();
+  BranchInst::Create(SecondHeader, BI);
+  BI->eraseFromParent();
+  RecursivelyDeleteTriviallyDeadInstructions(Cond);
+  SecondLatch->getTerminator()->replaceUsesOfWith(SecondHeader, Header);
+
+  for (Instruction &I : *Header) {
+    auto *PN = dyn_cast<PHINode>(&I);
+    if (!PN)
+      break;
+    PN->setIncomingBlock(PN->getBasicBlockIndex(Latch), SecondLatch);
+  }
+
+  // The second loop's recurrences are now carried by the fused header. Their
+  // start values are available before the first loop, since nothing between
+  // the loops computes anything.
+  Instruction *InsertPt = Header->getFirstNonPHI();
+  while (auto *PN = dyn_cast<PHINode>(&SecondHeader->front())) {
+    PN->setIncomingBlock(PN->getBasicBlockIndex(Between), Preheader);
+    PN->moveBefore(InsertPt);
+  }
+
+  LI->removeBlock(Between);
+  DeleteDeadBlock(Between);
+
+  for (BasicBlock *BB : Second->getBlocks()) {
+    First->addBlockEntry(BB);
+    if (LI->getLoopFor(BB) == Second)
+      LI->changeLoopFor(BB, First);
+  }
+  if (Loop *Parent = Second->getParentLoop())
+    Parent->removeChildLoop(std::find(Parent->begin(), Parent->end(), Second));
+  else
+    LI->removeLoop(std::find(LI->begin(), LI->end(), Second));
+  delete Second;
+
+  ++NumLoopsFused;
+}
+
+bool LoopFuse::fuseSiblings(std::vector<Loop *> Loops) {
+  bool Changed = false;
+
+  bool FusedAny;
+  do {
+    FusedAny = false;
+    for (Loop *First : Loops) {
+      SmallVector<Instruction *, 16> FirstAccesses;
+      if (!isCandidate(First, FirstAccesses))
+        continue;
+
+      for (Loop *Second : Loops) {
+        if (Second == First)
+          continue;
+        SmallVector<Instruction *, 16> SecondAccesses;
+        if (!isCandidate(Second, SecondAccesses) ||
+            !areAdjacentAndEquivalent(First, Second))
+          continue;
+
+        DEBUG(dbgs() << "LFuse: Trying to fuse " << *First << " with "
+                     << *Second);
+
+        bool Safe = true;
+        unsigned NumReused = 0;
+        for (Instruction *A : FirstAccesses) {
+          for (Instruction *B : SecondAccesses) {
+            if (isa<LoadInst>(A) && isa<LoadInst>(B))
+              continue;
+            if (!isSafeToReorder(A, B, First, Second, NumReused)) {
+              DEBUG(dbgs() << "LFuse: Fusion would reorder " << *A << " and "
+                           << *B << "\n");
+              Safe = false;
+              break;
+            }
+          }
+          if (!Safe)
+            break;
+        }
+        if (!Safe || !isProfitable(First, Second))
+          continue;
+
+        fuse(First, Second);
+        NumReusedAccesses += NumReused;
+        Loops.erase(std::find(Loops.begin(), Loops.end(), Second));
+        FusedAny = Changed = true;
+        break;
+      }
+      if (FusedAny)
+        break;
+    }
+  } while (FusedAny);
+
+  for (Loop *L : Loops)
+    Changed |= fuseSiblings(std::vector<Loop *>(L->begin(), L->end()));
+  return Changed;
+}
+
+char LoopFuse::ID;
+static const char lfuse_name[] = "Loop Fusion";
+
+INITIALIZE_PASS_BEGIN(LoopFuse, LFUSE_NAME, lfuse_name, false, false)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolution)
+INITIALIZE_PASS_DEPENDENCY(DependenceAnalysis)
+INITIALIZE_PASS_DEPENDENCY(TargetTransformInfoWrapperPass)
+INITIALIZE_PASS_END(LoopFuse, LFUSE_NAME, lfuse_name, false, false)
+
+namespace llvm {
+FunctionPass *createLoopFusePass() { return new LoopFuse(); }
+}
@@ -0,0 +1,441 @@
+//===- LoopTile.cpp - Loop Tiling Pass ------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the Loop Tiling Pass. It blocks the two innermost
+// loops of a perfect loop nest for cache locality:
+//
+//   for (i = Si; i < Ei; ++i)           for (ii = Si; ii < Ei; ii += T)
+//     for (j = Sj; j < Ej; ++j)    =>     for (jj = Sj; jj < Ej; jj += T)
+//       body(i, j);                         for (i = ii; i < min(ii + T, Ei); ++i)
+//                                             for (j = jj; j < min(jj + T, Ej); ++j)
+//                                               body(i, j);
+//
+// The original loops become the loops within a tile and keep their bodies;
+// two new loops walk over the tiles. Running the i loop of one tile before
+// moving on to the next jj tile reorders iterations, which is legal when the
+// nest is fully permutable: DependenceAnalysis must show that no dependence
+// runs backwards in either loop.
+//
+// The tile size is chosen so that one tile of every array the nest accesses
+// fits in the L1 data cache reported by TargetTransformInfo.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/DependenceAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Transforms/Scalar.h"
+#include <cmath>
+
+#define LTILE_NAME "loop-tile"
+#define DEBUG_TYPE LTILE_NAME
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+    TileSize("loop-tile-size", cl::Hidden, cl::init(0),
+             cl::desc("Use this tile size instead of one derived from the "
+                      "target's cache size"));
+
+/// The tile size to use when the target does not report its cache size.
+static const unsigned DefaultTileSize = 32;
+
+STATISTIC(NumLoopNestsTiled, "Number of loop nests tiled");
+
+namespace {
+/// \brief The induction variable of a loop that may be tiled: it counts up by
+/// one from Start, and the loop exits once it reaches Bound.
+struct TileableIV {
+  PHINode *IV;
+  Value *Start;
+  Value *Bound;
+  /// The exit test, which compares the incremented IV against Bound.
+  ICmpInst *Cmp;
+};
+
+/// \brief The loop tiling pass.
+class LoopTile : public FunctionPass {
+public:
+  LoopTile() : FunctionPass(ID) {
+    initializeLoopTilePass(*PassRegistry::getPassRegistry());
+  }
+
+  bool runOnFunction(Function &F) override {
+    if (skipOptnoneFunction(F))
+      return false;
+
+    LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+    SE = &getAnalysis<ScalarEvolution>();
+    DA = &getAnalysis<DependenceAnalysis>();
+    TTI = &getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+    DL = &F.getParent()->getDataLayout();
+
+    // Collect the outer loops of innermost loop pairs first, since tiling
+    // adds loops.
+    SmallVector<Loop *, 8> Worklist;
+    SmallVector<Loop *, 8> Stack(LI->begin(), LI->end());
+    while (!Stack.empty()) {
+      Loop *L = Stack.pop_back_val();
+      if (L->getSubLoops().size() == 1 && L->getSubLoops()[0]->empty())
+        Worklist.push_back(L);
+      Stack.append(L->begin(), L->end());
+    }
+
+    bool Changed = false;
+    for (Loop *L : Worklist)
+      Changed |= processNest(L);
+    if (Changed)
+      DT->recalculate(F);
+    return Changed;
+  }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addPreserved<LoopInfoWrapperPass>();
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addPreserved<DominatorTreeWrapperPass>();
+    AU.addRequired<ScalarEvolution>();
+    AU.addRequired<DependenceAnalysis>();
+    AU.addRequired<TargetTransformInfoWrapperPass>();
+  }
+
+  static char ID;
+
+private:
+  LoopInfo *LI;
+  DominatorTree *DT;
+  ScalarEvolution *SE;
+  DependenceAnalysis *DA;
+  const TargetTransformInfo *TTI;
+  const DataLayout *DL;
+
+  /// \brief Tile \p Outer and its only, innermost, subloop.
+  bool processNest(Loop *Outer);
+
+  /// \brief Return true if \p L counts up by one between bounds that are
+  /// invariant in \p Nest, and describe its induction variable in \p Info.
+  bool analyzeIV(Loop *L, Loop *Nest, TileableIV &Info);
+
+  /// \brief Return true if \p Outer does nothing outside its subloop but
+  /// control its induction variable, and nothing outside uses its values.
+  bool isPerfectNest(Loop *Outer);
+
+  /// \brief Return true if no dependence between \p Accesses runs backwards
+  /// in either loop of the nest.
+  bool isFullyPermutable(ArrayRef<Instruction *> Accesses);
+
+  /// \brief Pick a tile size that fits one tile of each array in \p Accesses
+  /// into the L1 data cache.
+  unsigned getTileSize(ArrayRef<Instruction *> Accesses);
+
+  /// \brief Wrap the nest in two loops over tiles of size \p Size.
+  void tile(Loop *Outer, TileableIV &OuterIV, TileableIV &InnerIV,
+            unsigned Size);
+};
+} // end anonymous namespace
+
+static Value *getPointerOperand(Instruction *I) {
+  if (auto *LI = dyn_cast<LoadInst>(I))
+    return LI->getPointerOperand();
+  return cast<StoreInst>(I)->getPointerOperand();
+}
+
+bool LoopTile::analyzeIV(Loop *L, Loop *Nest, TileableIV &Info) {
+  BasicBlock *Preheader = L->getLoopPreheader();
+  BasicBlock *Latch = L->getLoopLatch();
+  if (!Preheader || !Latch || L->getExitingBlock() != Latch ||
+      !L->getExitBlock())
+    return false;
+
+  // The IV must be the only value carried around the backedge.
+  BasicBlock *Header = L->getHeader();
+  Info.IV = dyn_cast<PHINode>(&Header->front());
+  if (!Info.IV || isa<PHINode>(Info.IV->getNextNode()) ||
+      !Info.IV->getType()->isIntegerTy())
+    return false;
+  Info.Start = Info.IV->getIncomingValueForBlock(Preheader);
+
+  auto *BI = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!BI || !BI->isConditional())
+    return false;
+  Info.Cmp = dyn_cast<ICmpInst>(BI->getCondition());
+  if (!Info.Cmp || !Info.Cmp->isEquality() || !Info.Cmp->hasOneUse())
+    return false;
+
+  Value *Next = Info.IV->getIncomingValueForBlock(Latch);
+  if (Info.Cmp->getOperand(0) != Next)
+    return false;
+  Info.Bound = Info.Cmp->getOperand(1);
+  auto *Inc = dyn_cast<BinaryOperator>(Next);
+  if (!Inc || Inc->getOpcode() != Instruction::Add ||
+      Inc->getOperand(0) != Info.IV)
+    return false;
+  auto *Step = dyn_cast<ConstantInt>(Inc->getOperand(1));
+  if (!Step || !Step->isOne())
+    return false;
+
+  if (!Nest->isLoopInvariant(Info.Start) || !Nest->isLoopInvariant(Info.Bound))
+    return false;
+
+  // The IV must stay below the bound in signed terms, so that the bound of
+  // each tile is the smaller of its end and the loop's bound.
+  const SCEV *Start = SE->getSCEV(Info.Start);
+  const SCEV *Bound = SE->getSCEV(Info.Bound);
+  return SE->isKnownPredicate(ICmpInst::ICMP_SLT, Start, Bound) ||
+         SE->isLoopEntryGuardedByCond(L, ICmpInst::ICMP_SLT, Start, Bound);
+}
+
+bool LoopTile::isPerfectNest(Loop *Outer) {
+  Loop *Inner = Outer->getSubLoops()[0];
+  for (BasicBlock *BB : Outer->getBlocks()) {
+    bool InInner = Inner->contains(BB);
+    for (Instruction &I : *BB) {
+      if (!InInner && (I.mayReadOrWriteMemory() || I.mayHaveSideEffects()))
+        return false;
+      // The last iteration of the nest is also the last one after tiling,
+      // but the outer loop sees its inner loop end once per tile.
+      for (User *U : I.users()) {
+        auto *UI = cast<Instruction>(U);
+        if (!Outer->contains(UI) || (InInner && !Inner->contains(UI)))
+          return false;
+      }
+    }
+  }
+  return !isa<PHINode>(Outer->getExitBlock()->front());
+}
+
+bool LoopTile::isFullyPermutable(ArrayRef<Instruction *> Accesses) {
+  for (unsigned I = 0, E = Accesses.size(); I != E; ++I) {
+    for (unsigned J = I; J != E; ++J) {
+      Instruction *Src = Accesses[I];
+      Instruction *Dst = Accesses[J];
+      if (isa<LoadInst>(Src) && isa<LoadInst>(Dst))
+        continue;
+      auto D = DA->depends(Src, Dst, true);
+      if (!D)
+        continue;
+      if (D->isConfused() || D->getLevels() == 0)
+        return false;
+
+      // The dependence may be reported from either end. It is preserved by
+      // any loop order if it never points backwards in any loop, seen from
+      // one end or the other.
+      bool Forward = true, Backward = true;
+      for (unsigned Level = 1; Level <= D->getLevels(); ++Level) {
+        unsigned Dir = D->getDirection(Level);
+        Forward &= !(Dir & Dependence::DVEntry::GT);
+        Backward &= !(Dir & Dependence::DVEntry::LT);
+      }
+      if (!Forward && !Backward) {
+        DEBUG(dbgs() << "LTile: Dependence between " << *Src << " and "
+                     << *Dst << " prevents tiling\n");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+unsigned LoopTile::getTileSize(ArrayRef<Instruction *> Accesses) {
+  if (TileSize)
+    return TileSize;
+
+  Optional<unsigned> CacheSize =
+      TTI->getCacheSize(TargetTransformInfo::CacheLevel::L1D);
+  if (!CacheSize)
+    return DefaultTileSize;
+
+  SmallPtrSet<Value *, 8> Objects;
+  uint64_t EltSize = 1;
+  for (Instruction *I : Accesses) {
+    Value *Ptr = getPointerOperand(I);
+    Objects.insert(GetUnderlyingObject(Ptr, *DL));
+    EltSize = std::max(EltSize, DL->getTypeStoreSize(
+                                    Ptr->getType()->getPointerElementType()));
+  }
+
+  // A tile of T x T iterations touches up to T x T elements of each array.
+  uint64_t TileElts = *CacheSize / (std::max<size_t>(Objects.size(), 1) *
+                                    EltSize);
+  unsigned Size = std::sqrt(double(TileElts));
+
+  // Keep whole cache lines in each row of a tile.
+  unsigned LineElts = std::max<uint64_t>(TTI->getCacheLineSize() / EltSize, 1);
+  Size = std::max(Size / LineElts * LineElts, LineElts);
+  return Size;
+}
+
+void LoopTile::tile(Loop *Outer, TileableIV &OuterIV, TileableIV &InnerIV,
+                    unsigned Size) {
+  Loop *Inner = Outer->getSubLoops()[0];
+  BasicBlock *Preheader = Outer->getLoopPreheader();
+  BasicBlock *Header = Outer->getHeader();
+  BasicBlock *Latch = Outer->getLoopLatch();
+  BasicBlock *Exit = Outer->getExitBlock();
+  BasicBlock *InnerPreheader = Inner->getLoopPreheader();
+  Function *F = Header->getParent();
+  LLVMContext &Ctx = F->getContext();
+
+  SE->forgetLoop(Outer);
+
+  // for (ii = Si; ...) { for (jj = Sj; ...) { ... } }
+  BasicBlock *TileIHeader =
+      BasicBlock::Create(Ctx, "tile.i.header", F, Header);
+  BasicBlock *TileJHeader =
+      BasicBlock::Create(Ctx, "tile.j.header", F, Header);
+  BasicBlock *TileJLatch =
+      BasicBlock::Create(Ctx, "tile.j.latch", F, Exit);
+  BasicBlock *TileILatch =
+      BasicBlock::Create(Ctx, "tile.i.latch", F, Exit);
+
+  Type *ITy = OuterIV.IV->getType();
+  Type *JTy = InnerIV.IV->getType();
+
+  IRBuilder<> B(TileIHeader);
+  PHINode *II = B.CreatePHI(ITy, 2, "ii");
+  B.CreateBr(TileJHeader);
+
+  B.SetInsertPoint(TileJHeader);
+  PHINode *JJ = B.CreatePHI(JTy, 2, "jj");
+  // Each tile ends Size iterations in or at the loop's bound, whichever comes
+  // first. IV < Bound, so Bound - IV is exact when read as unsigned, and IV +
+  // Size is only used when it stays below Bound and thus cannot wrap.
+  Value *IEnd = B.CreateAdd(II, ConstantInt::get(ITy, Size), "ii.end");
+  Value *ILeft = B.CreateSub(OuterIV.Bound, II, "ii.left");
+  IEnd = B.CreateSelect(B.CreateICmpUGT(ILeft, ConstantInt::get(ITy, Size)),
+                        IEnd, OuterIV.Bound, "i.end");
+  Value *JEnd = B.CreateAdd(JJ, ConstantInt::get(JTy, Size), "jj.end");
+  Value *JLeft = B.CreateSub(InnerIV.Bound, JJ, "jj.left");
+  JEnd = B.CreateSelect(B.CreateICmpUGT(JLeft, ConstantInt::get(JTy, Size)),
+                        JEnd, InnerIV.Bound, "j.end");
+  B.CreateBr(Header);
+
+  // The next tile starts where the current one ends; the last tile ends at
+  // the bound.
+  B.SetInsertPoint(TileJLatch);
+  B.CreateCondBr(B.CreateICmpNE(JEnd, InnerIV.Bound), TileJHeader,
+                 TileILatch);
+
+  B.SetInsertPoint(TileILatch);
+  B.CreateCondBr(B.CreateICmpNE(IEnd, OuterIV.Bound), TileIHeader, Exit);
+
+  II->addIncoming(OuterIV.Start, Preheader);
+  II->addIncoming(IEnd, TileILatch);
+  JJ->addIncoming(InnerIV.Start, TileIHeader);
+  JJ->addIncoming(JEnd, TileJLatch);
+
+  // The original loops now run within the current tile.
+  Preheader->getTerminator()->replaceUsesOfWith(Header, TileIHeader);
+  Latch->getTerminator()->replaceUsesOfWith(Exit, TileJLatch);
+  OuterIV.IV->setIncomingBlock(OuterIV.IV->getBasicBlockIndex(Preheader),
+                               TileJHeader);
+  OuterIV.IV->setIncomingValue(OuterIV.IV->getBasicBlockIndex(TileJHeader),
+                               II);
+  InnerIV.IV->setIncomingValue(
+      InnerIV.IV->getBasicBlockIndex(InnerPreheader), JJ);
+  OuterIV.Cmp->setOperand(1, IEnd);
+  InnerIV.Cmp->setOperand(1, JEnd);
+
+  // Nest the new loops around the original ones.
+  Loop *TileI = new Loop();
+  Loop *TileJ = new Loop();
+  if (Loop *Parent = Outer->getParentLoop())
+    Parent->replaceChildLoopWith(Outer, TileI);
+  else
+    LI->changeTopLevelLoop(Outer, TileI);
+  TileI->addChildLoop(TileJ);
+  TileJ->addChildLoop(Outer);
+
+  TileI->addBasicBlockToLoop(TileIHeader, *LI);
+  TileJ->addBasicBlockToLoop(TileJHeader, *LI);
+  for (BasicBlock *BB : Outer->getBlocks()) {
+    TileJ->addBlockEntry(BB);
+    TileI->addBlockEntry(BB);
+  }
+  TileJ->addBasicBlockToLoop(TileJLatch, *LI);
+  TileI->addBasicBlockToLoop(TileILatch, *LI);
+
+  ++NumLoopNestsTiled;
+}
+
+bool LoopTile::processNest(Loop *Outer) {
+  Loop *Inner = Outer->getSubLoops()[0];
+  DEBUG(dbgs() << "LTile: Checking nest " << *Outer);
+
+  TileableIV OuterIV, InnerIV;
+  if (!analyzeIV(Outer, Outer, OuterIV) || !analyzeIV(Inner, Outer, InnerIV)) {
+    DEBUG(dbgs() << "LTile: Unsupported induction variables\n");
+    return false;
+  }
+  if (!isPerfectNest(Outer)) {
+    DEBUG(dbgs() << "LTile: Not a perfect nest\n");
+    return false;
+  }
+
+  SmallVector<Instruction *, 16> Accesses;
+  for (BasicBlock *BB : Inner->getBlocks())
+    for (Instruction &I : *BB) {
+      if (auto *Ld = dyn_cast<LoadInst>(&I)) {
+        if (!Ld->isSimple())
+          return false;
+        Accesses.push_back(Ld);
+      } else if (auto *St = dyn_cast<StoreInst>(&I)) {
+        if (!St->isSimple())
+          return false;
+        Accesses.push_back(St);
+      } else if (I.mayReadOrWriteMemory() || I.mayHaveSideEffects()) {
+        return false;
+      }
+    }
+  if (Accesses.empty() || !isFullyPermutable(Accesses))
+    return false;
+
+  unsigned Size = getTileSize(Accesses);
+
+  // Loops that fit in a single tile gain nothing.
+  auto *OuterTC = dyn_cast<SCEVConstant>(SE->getBackedgeTakenCount(Outer));
+  auto *InnerTC = dyn_cast<SCEVConstant>(SE->getBackedgeTakenCount(Inner));
+  if (OuterTC && InnerTC &&
+      OuterTC->getValue()->getValue().ult(Size) &&
+      InnerTC->getValue()->getValue().ult(Size))
+    return false;
+
+  DEBUG(dbgs() << "LTile: Tiling with tile size " << Size << "\n");
+  tile(Outer, OuterIV, InnerIV, Size);
+  return true;
+}
+
+char LoopTile::ID;
+static const char ltile_name[] = "Loop Tiling";
+
+INITIALIZE_PASS_BEGIN(LoopTile, LTILE_NAME, ltile_name, false, false)
+INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(ScalarEvolution)
+INITIALIZE_PASS_DEPENDENCY(DependenceAnalysis)
+INITIALIZE_PASS_DEPENDENCY(TargetTransformInfoWrapperPass)
+INITIALIZE_PASS_END(LoopTile, LTILE_NAME, ltile_name, false, false)
+
+namespace llvm {
+FunctionPass *createLoopTilePass() { return new LoopTile(); }
+}
@@ -31,6 +31,8 @@
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
 #include "llvm/Analysis/CodeMetrics.h"
 #include "llvm/Analysis/InstructionSimplify.h"
 #include "llvm/Analysis/LoopInfo.h"
@@ -63,6 +65,8 @@ STATISTIC(NumSelects , "Number of selects unswitched");
 STATISTIC(NumTrivial , "Number of unswitches that are trivial");
 STATISTIC(NumSimplify, "Number of simplifications of unswitched code");
 STATISTIC(TotalInsts,  "Total number of instructions analyzed");
+STATISTIC(NumColdLoops, "Number of cold loops not unswitched");
+STATISTIC(NumOverBudget, "Number of unswitches over the function budget");
 
 // The specific value of 100 here was chosen based only on intuition and a
 // few specific examples.
@@ -70,6 +74,21 @@ static cl::opt<unsigned>
 Threshold("loop-unswitch-threshold", cl::desc("Max loop size to unswitch"),
           cl::init(100), cl::Hidden);
 
+// The per-loop threshold above does not stop the loops of a function, nor the
+// copies of a loop, from each getting unswitched up to it.
+static cl::opt<unsigned>
+FunctionGrowthBudget("loop-unswitch-function-budget",
+                     cl::desc("Max number of instructions added to a function "
+                              "by non-trivial unswitching"),
+                     cl::init(1000), cl::Hidden);
+
+static cl::opt<unsigned>
+ColdLoopPercent("loop-unswitch-cold-loop-percent",
+                cl::desc("With profile data, don't clone the loops whose "
+                         "header frequency is below this percentage of the "
+                         "function entry's"),
+                cl::init(1), cl::Hidden);
+
 namespace {
 
   class LUAnalysisCache {
@@ -136,6 +155,11 @@ namespace {
     // threshold.
     bool CostAllowsUnswitching();
 
+    // Returns the estimated size of the current loop.
+    unsigned getLoopSize() const {
+      return CurrentLoopProperties->SizeEstimation;
+    }
+
     // Clone all loop-unswitch related loop properties.
     // Redistribute unswitching quotas.
     // Note, that new loop data is stored inside the VMap.
@@ -169,15 +193,29 @@ namespace {
     // NewBlocks contained cloned copy of basic blocks from LoopBlocks.
     std::vector<BasicBlock*> NewBlocks;
 
+    // The number of instructions that non-trivial unswitching added to the
+    // current function so far.
+    unsigned FunctionGrowth;
+
+    // Block frequencies of the current function when it has profile data.
+    // They are computed on demand and dropped whenever unswitching changes the
+    // CFG.
+    bool HasProfileData;
+    std::unique_ptr<BranchProbabilityInfo> BPI;
+    std::unique_ptr<BlockFrequencyInfo> BFI;
+
   public:
     static char ID; // Pass ID, replacement for typeid
     explicit LoopUnswitch(bool Os = false) :
       LoopPass(ID), OptimizeForSize(Os), redoLoop(false),
       currentLoop(nullptr), DT(nullptr), loopHeader(nullptr),
-      loopPreheader(nullptr) {
+      loopPreheader(nullptr), FunctionGrowth(0),
+      HasProfileData(false) {
         initializeLoopUnswitchPass(*PassRegistry::getPassRegistry());
       }
 
+    bool doInitialization(Loop *L, LPPassManager &LPM) override;
+    bool doFinalization() override;
     bool runOnLoop(Loop *L, LPPassManager &LPM) override;
     bool processCurrentLoop();
 
@@ -203,6 +241,14 @@ namespace {
       BranchesInfo.forgetLoop(currentLoop);
     }
 
+    void computeBlockFrequencies();
+    void forgetBlockFrequencies() {
+      BFI.reset();
+      BPI.reset();
+    }
+    bool isColdLoop(Loop *L);
+    Constant *findHottestUnswitchedCase(SwitchInst *SI);
+
     void initLoopData() {
       loopHeader = currentLoop->getHeader();
       loopPreheader = currentLoop->getLoopPreheader();
@@ -403,6 +449,30 @@ static Value *FindLIVLoopCondition(Value *Cond, Loop *L, bool &Changed) {
   return nullptr;
 }
 
+/// Return true if F has an entry count or branch weights.
+static bool hasProfileData(const Function &F) {
+  if (F.getEntryCount())
+    return true;
+  for (const BasicBlock &BB : F)
+    if (BB.getTerminator()->getMetadata(LLVMContext::MD_prof))
+      return true;
+  return false;
+}
+
+/// The loop pass manager initializes its passes with each loop of a function
+/// before running them on any of them, so start the per-function state here.
+bool LoopUnswitch::doInitialization(Loop *L, LPPassManager &LPM) {
+  FunctionGrowth = 0;
+  HasProfileData = hasProfileData(*L->getHeader()->getParent());
+  forgetBlockFrequencies();
+  return false;
+}
+
+bool LoopUnswitch::doFinalization() {
+  forgetBlockFrequencies();
+  return false;
+}
+
 bool LoopUnswitch::runOnLoop(Loop *L, LPPassManager &LPM_Ref) {
   if (skipOptnoneFunction(L))
     return false;
@@ -431,6 +501,59 @@ bool LoopUnswitch::runOnLoop(Loop *L, LPPassManager &LPM_Ref) {
   return Changed;
 }
 
+void LoopUnswitch::computeBlockFrequencies() {
+  if (BFI)
+    return;
+  Function &F = *loopHeader->getParent();
+  BPI.reset(new BranchProbabilityInfo(F, *LI));
+  BFI.reset(new BlockFrequencyInfo(F, *BPI, *LI));
+}
+
+/// isColdLoop - Return true if the profile says that L runs too rarely to pay
+/// for cloning it. Without profile data, no loop is cold.
+bool LoopUnswitch::isColdLoop(Loop *L) {
+  if (!HasProfileData)
+    return false;
+  computeBlockFrequencies();
+  // Blocks that the frequencies don't know about have a frequency of zero.
+  // Another loop pass created the header since they were computed.
+  if (!BFI->getBlockFreq(L->getHeader()).getFrequency()) {
+    forgetBlockFrequencies();
+    computeBlockFrequencies();
+  }
+  // The frequencies are small integers when the profile is flat, so compare
+  // them without rounding.
+  uint64_t HeaderFreq = BFI->getBlockFreq(L->getHeader()).getFrequency();
+  uint64_t EntryFreq = BFI->getEntryFreq();
+  return (APInt(128, HeaderFreq) * APInt(128, 100))
+      .ult(APInt(128, EntryFreq) * APInt(128, ColdLoopPercent));
+}
+
+/// findHottestUnswitchedCase - Return the value of the case of SI, not yet
+/// unswitched, that leads to its most frequent successor, or to its first
+/// successor without profile data.
+Constant *LoopUnswitch::findHottestUnswitchedCase(SwitchInst *SI) {
+  Constant *Hottest = nullptr;
+  BranchProbability HottestProb = BranchProbability::getZero();
+  if (HasProfileData)
+    computeBlockFrequencies();
+  for (SwitchInst::CaseIt i = SI->case_begin(), e = SI->case_end(); i != e;
+       ++i) {
+    Constant *Candidate = i.getCaseValue();
+    if (BranchesInfo.isUnswitched(SI, Candidate))
+      continue;
+    if (!HasProfileData)
+      return Candidate;
+    BranchProbability Prob =
+        BPI->getEdgeProbability(SI->getParent(), i.getCaseSuccessor());
+    if (!Hottest || HottestProb < Prob) {
+      Hottest = Candidate;
+      HottestProb = Prob;
+    }
+  }
+  return Hottest;
+}
+
 /// processCurrentLoop - Do actual work and unswitch loop if possible
 /// and profitable.
 bool LoopUnswitch::processCurrentLoop() {
@@ -486,21 +609,12 @@ bool LoopUnswitch::processCurrentLoop() {
       unsigned NumCases = SI->getNumCases();
       if (LoopCond && NumCases) {
         // Find a value to unswitch on:
-        // FIXME: this should chose the most expensive case!
         // FIXME: scan for a case with a non-critical edge?
-        Constant *UnswitchVal = nullptr;
-
         // Do not process same value again and again.
         // At this point we have some cases already unswitched and
-        // some not yet unswitched. Let's find the first not yet unswitched one.
-        for (SwitchInst::CaseIt i = SI->case_begin(), e = SI->case_end();
-             i != e; ++i) {
-          Constant *UnswitchValCandidate = i.getCaseValue();
-          if (!BranchesInfo.isUnswitched(SI, UnswitchValCandidate)) {
-            UnswitchVal = UnswitchValCandidate;
-            break;
-          }
-        }
+        // some not yet unswitched. Let's find the hottest not yet unswitched
+        // one.
+        Constant *UnswitchVal = findHottestUnswitchedCase(SI);
 
         if (!UnswitchVal)
           continue;
@@ -692,6 +806,23 @@ bool LoopUnswitch::UnswitchIfProfitable(Value *LoopCond, Constant *Val,
   if (OptimizeForSize || F->hasFnAttribute(Attribute::OptimizeForSize))
     return false;
 
+  unsigned LoopSize = BranchesInfo.getLoopSize();
+  if (FunctionGrowth + LoopSize > FunctionGrowthBudget) {
+    DEBUG(dbgs() << "NOT unswitching loop %"
+                 << currentLoop->getHeader()->getName()
+                 << ", function growth budget exhausted.\n");
+    ++NumOverBudget;
+    return false;
+  }
+
+  if (isColdLoop(currentLoop)) {
+    DEBUG(dbgs() << "NOT unswitching cold loop %"
+                 << currentLoop->getHeader()->getName() << "\n");
+    ++NumColdLoops;
+    return false;
+  }
+
+  FunctionGrowth += LoopSize;
   UnswitchNontrivialCondition(LoopCond, Val, currentLoop, TI);
   return true;
 }
@@ -822,6 +953,7 @@ void LoopUnswitch::UnswitchTrivialCondition(Loop *L, Value *Cond, Constant *Val,
 
   // We need to reprocess this loop, it could be unswitched again.
   redoLoop = true;
+  forgetBlockFrequencies();
 
   // Now that we know that the loop is never entered when this condition is a
   // particular value, rewrite the loop with this info.  We know that this will
@@ -976,6 +1108,7 @@ void LoopUnswitch::UnswitchNontrivialCondition(Value *LIC, Constant *Val,
 
   LoopProcessWorklist.push_back(NewLoop);
   redoLoop = true;
+  forgetBlockFrequencies();
 
   // Keep a WeakVH holding onto LIC.  If the first call to RewriteLoopBody
   // deletes the instruction (for example by simplifying a PHI that feeds into
@@ -21,10 +21,12 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/PointerIntPair.h"
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/InlineCost.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constants.h"
@@ -32,11 +34,14 @@
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/Local.h"
 #include <algorithm>
 using namespace llvm;
@@ -49,6 +54,26 @@ STATISTIC(NumDeadBlocks , "Number of basic blocks unreachable");
 STATISTIC(IPNumInstRemoved, "Number of instructions removed by IPSCCP");
 STATISTIC(IPNumArgsElimed ,"Number of arguments constant propagated by IPSCCP");
 STATISTIC(IPNumGlobalConst, "Number of globals found to be constant by IPSCCP");
+STATISTIC(IPNumSpecialized, "Number of functions specialized by IPSCCP");
+
+static cl::opt<bool> SpecializeFunctions(
+    "ipsccp-specialize-functions", cl::init(false), cl::Hidden,
+    cl::desc("Clone internal functions for the call sites passing them "
+             "constant arguments"));
+
+// The minimal bonus, in the units of the inline cost, of a specialization.
+static cl::opt<unsigned> SpecializationThreshold(
+    "ipsccp-specialization-threshold", cl::init(100), cl::Hidden,
+    cl::desc("Minimal estimated simplification of a specialized function"));
+
+static cl::opt<unsigned> SpecializationMaxSize(
+    "ipsccp-specialization-max-size", cl::init(500), cl::Hidden,
+    cl::desc("Maximal number of instructions of a specialized function"));
+
+static cl::opt<unsigned> SpecializationBudget(
+    "ipsccp-specialization-budget", cl::init(1000), cl::Hidden,
+    cl::desc("Maximal number of instructions added to the module by function "
+             "specialization"));
 
 namespace {
 /// LatticeVal class - This class represents the different lattice values that
@@ -1690,7 +1715,235 @@ static bool AddressIsTaken(const GlobalValue *GV) {
   return false;
 }
 
+/// Return the constant I folds to when the values of Known are substituted to
+/// its operands, or null.
+static Constant *foldWithKnownOperands(Instruction *I,
+                                       const DenseMap<Value *, Constant *> &Known,
+                                       const DataLayout &DL) {
+  if (!isa<BinaryOperator>(I) && !isa<CastInst>(I) && !isa<CmpInst>(I) &&
+      !isa<SelectInst>(I))
+    return nullptr;
+
+  SmallVector<Constant *, 4> Ops;
+  for (Value *Op : I->operands()) {
+    Constant *C = dyn_cast<Constant>(Op);
+    if (!C)
+      C = Known.lookup(Op);
+    if (!C)
+      return nullptr;
+    Ops.push_back(C);
+  }
+  if (CmpInst *Cmp = dyn_cast<CmpInst>(I))
+    return ConstantFoldCompareInstOperands(Cmp->getPredicate(), Ops[0], Ops[1],
+                                           DL);
+  return ConstantFoldInstOperands(I->getOpcode(), I->getType(), Ops, DL);
+}
+
+/// Estimate, in the units of the inline cost, how much simpler F gets when its
+/// arguments are replaced by the constants of Args (null for the arguments
+/// left alone). Like the inliner, count the instructions folded away, the
+/// blocks that become dead and the indirect calls turned into direct ones.
+static int getSpecializationBonus(Function &F, ArrayRef<Constant *> Args,
+                                  const DataLayout &DL) {
+  DenseMap<Value *, Constant *> Known;
+  SmallPtrSet<Instruction *, 8> Visited;
+  SmallVector<Instruction *, 16> Worklist;
+  auto AddUsers = [&](Value *V) {
+    for (User *U : V->users())
+      if (Instruction *I = dyn_cast<Instruction>(U))
+        Worklist.push_back(I);
+  };
+
+  unsigned ArgNo = 0;
+  for (Argument &A : F.args())
+    if (Constant *C = Args[ArgNo++]) {
+      Known[&A] = C;
+      AddUsers(&A);
+    }
+
+  int Bonus = 0;
+  while (!Worklist.empty()) {
+    Instruction *I = Worklist.pop_back_val();
+    if (Known.count(I))
+      continue;
+
+    if (CallSite CS = CallSite(I)) {
+      Constant *Callee = Known.lookup(CS.getCalledValue());
+      if (Callee && isa<Function>(Callee->stripPointerCasts()) &&
+          Visited.insert(I).second)
+        Bonus += InlineConstants::IndirectCallThreshold;
+      continue;
+    }
+
+    if (isa<BranchInst>(I) || isa<SwitchInst>(I)) {
+      ConstantInt *Cond = dyn_cast_or_null<ConstantInt>(Known.lookup(
+          isa<BranchInst>(I) ? cast<BranchInst>(I)->getCondition()
+                             : cast<SwitchInst>(I)->getCondition()));
+      if (!Cond || !Visited.insert(I).second)
+        continue;
+      BasicBlock *Taken;
+      if (BranchInst *BI = dyn_cast<BranchInst>(I))
+        Taken = BI->getSuccessor(Cond->isZero() ? 1 : 0);
+      else
+        Taken = cast<SwitchInst>(I)->findCaseValue(Cond).getCaseSuccessor();
+      // The successors only reached from here become dead.
+      TerminatorInst *TI = cast<TerminatorInst>(I);
+      for (unsigned i = 0, e = TI->getNumSuccessors(); i != e; ++i) {
+        BasicBlock *Succ = TI->getSuccessor(i);
+        if (Succ != Taken && Succ->getSinglePredecessor())
+          Bonus += InlineConstants::InstrCost * Succ->size();
+      }
+      Bonus += InlineConstants::InstrCost;
+      continue;
+    }
+
+    if (Constant *C = foldWithKnownOperands(I, Known, DL)) {
+      Known[I] = C;
+      Bonus += InlineConstants::InstrCost;
+      AddUsers(I);
+    }
+  }
+  return Bonus;
+}
+
+/// Return the constant passed as argument ArgNo of CS when it is worth
+/// specializing for it, or null.
+static Constant *getSpecializationArgument(CallSite CS, unsigned ArgNo) {
+  Constant *C = dyn_cast<Constant>(CS.getArgument(ArgNo));
+  if (C && (isa<ConstantInt>(C) || isa<ConstantFP>(C) ||
+            isa<ConstantPointerNull>(C) ||
+            isa<Function>(C->stripPointerCasts())))
+    return C;
+  return nullptr;
+}
+
+namespace {
+/// The call sites of an internal function passing it the same constants.
+struct SpecializationCandidate {
+  Function *F;
+  SmallVector<Constant *, 4> Args;
+  SmallVector<CallSite, 4> CallSites;
+  int Bonus;
+};
+} // end anonymous namespace
+
+/// Clone the internal functions for the sets of call sites passing them the
+/// same constant arguments, when the clone would get simpler enough. The
+/// arguments of the clones are replaced by the constants, which IPSCCP then
+/// propagates. The call sites all passing the same constants are left to
+/// IPSCCP itself.
+static bool specializeFunctions(Module &M) {
+  const DataLayout &DL = M.getDataLayout();
+  DenseMap<Function *, unsigned> FunctionSize;
+  for (Function &F : M) {
+    unsigned Size = 0;
+    for (BasicBlock &BB : F)
+      Size += BB.size();
+    FunctionSize[&F] = Size;
+  }
+
+  std::vector<SpecializationCandidate> Candidates;
+  for (Function &F : M) {
+    if (F.isDeclaration() || !F.hasLocalLinkage() || F.arg_empty() ||
+        F.hasFnAttribute(Attribute::OptimizeNone) ||
+        FunctionSize[&F] > SpecializationMaxSize || AddressIsTaken(&F))
+      continue;
+    bool CanClone = true;
+    for (BasicBlock &BB : F) {
+      CanClone &= !BB.hasAddressTaken();
+      for (Instruction &I : BB)
+        if (CallInst *CI = dyn_cast<CallInst>(&I))
+          CanClone &= !CI->cannotDuplicate();
+    }
+    if (!CanClone)
+      continue;
+
+    std::vector<SpecializationCandidate> Groups;
+    unsigned NumCallSites = 0;
+    for (User *U : F.users()) {
+      CallSite CS(U);
+      if (!CS || CS.getCalledValue() != &F)
+        continue;
+      ++NumCallSites;
+      // Leave the recursive calls to the original function.
+      if (CS.getCaller() == &F)
+        continue;
+
+      SmallVector<Constant *, 4> Args;
+      bool HasConstant = false;
+      for (unsigned i = 0, e = F.arg_size(); i != e; ++i) {
+        Args.push_back(getSpecializationArgument(CS, i));
+        HasConstant |= Args.back() != nullptr;
+      }
+      if (!HasConstant)
+        continue;
+
+      auto Group = std::find_if(Groups.begin(), Groups.end(),
+                                [&](const SpecializationCandidate &G) {
+                                  return G.Args == Args;
+                                });
+      if (Group == Groups.end()) {
+        Groups.push_back({&F, Args, {}, 0});
+        Group = std::prev(Groups.end());
+      }
+      Group->CallSites.push_back(CS);
+    }
+
+    for (SpecializationCandidate &G : Groups) {
+      if (G.CallSites.size() == NumCallSites)
+        continue;
+      G.Bonus = getSpecializationBonus(F, G.Args, DL);
+      DEBUG(dbgs() << "IPSCCP: specialization bonus of " << F.getName()
+                   << " for " << G.CallSites.size()
+                   << " call sites: " << G.Bonus << "\n");
+      if (G.Bonus >= int(SpecializationThreshold))
+        Candidates.push_back(G);
+    }
+  }
+
+  // Specialize the most profitable candidates first, until the budget is
+  // spent.
+  std::stable_sort(Candidates.begin(), Candidates.end(),
+                   [](const SpecializationCandidate &L,
+                      const SpecializationCandidate &R) {
+                     return L.Bonus > R.Bonus;
+                   });
+  unsigned Budget = SpecializationBudget;
+  SmallSetVector<Function *, 8> Specialized;
+  for (SpecializationCandidate &C : Candidates) {
+    Function *F = C.F;
+    if (FunctionSize[F] > Budget)
+      continue;
+    Budget -= FunctionSize[F];
+
+    ValueToValueMapTy VMap;
+    Function *Clone = CloneFunction(F, VMap, /*ModuleLevelChanges=*/false);
+    Clone->setName(F->getName() + ".specialized");
+    M.getFunctionList().push_back(Clone);
+    unsigned ArgNo = 0;
+    for (Argument &A : Clone->args())
+      if (Constant *Arg = C.Args[ArgNo++])
+        A.replaceAllUsesWith(Arg);
+    for (CallSite CS : C.CallSites)
+      CS.setCalledFunction(Clone);
+
+    DEBUG(dbgs() << "IPSCCP: specialized " << F->getName() << " as "
+                 << Clone->getName() << "\n");
+    Specialized.insert(F);
+    ++IPNumSpecialized;
+  }
+
+  // The functions whose call sites were all redirected to clones are dead.
+  for (Function *F : Specialized)
+    if (F->use_empty())
+      F->eraseFromParent();
+
+  return !Specialized.empty();
+}
+
 bool IPSCCP::runOnModule(Module &M) {
+  bool Specialized = SpecializeFunctions && specializeFunctions(M);
+
   const DataLayout &DL = M.getDataLayout();
   const TargetLibraryInfo *TLI =
       &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
@@ -1941,5 +2194,5 @@ bool IPSCCP::runOnModule(Module &M) {
     ++IPNumGlobalConst;
   }
 
-  return MadeChanges;
+  return MadeChanges || Specialized;
 }
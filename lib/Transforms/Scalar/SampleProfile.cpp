@@ -12,6 +12,12 @@
 // http://perf.wiki.kernel.org/) and generates IR metadata to reflect the
 // profile information in the given profile.
 //
+// Before annotating a function, the pass inlines the hot call sites that
+// were inlined in the profiled binary, as recorded by the inline stacks of
+// the profile. This replays the inlining decisions made when the profile
+// was collected, so that the samples of the inlined callees can be
+// attributed to their inlined copies rather than being lost.
+//
 // This pass generates branch weight annotations on the IR:
 //
 // - prof: Represents branch weights. This annotation is added to branches
@@ -26,7 +32,9 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/AssumptionCache.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/PostDominators.h"
 #include "llvm/IR/Constants.h"
@@ -45,6 +53,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include <cctype>
 
 using namespace llvm;
@@ -52,6 +61,8 @@ using namespace sampleprof;
 
 #define DEBUG_TYPE "sample-profile"
 
+STATISTIC(NumInlined, "Number of call sites inlined to replay the profile");
+
 // Command line option to specify the file to read samples from. This is
 // mainly used for debugging.
 static cl::opt<std::string> SampleProfileFile(
@@ -61,6 +72,15 @@ static cl::opt<unsigned> SampleProfileMaxPropagateIterations(
     "sample-profile-max-propagate-iterations", cl::init(100),
     cl::desc("Maximum number of iterations to go through when propagating "
              "sample block/edge weights through the CFG."));
+static cl::opt<unsigned> SampleProfileInlineHotThreshold(
+    "sample-profile-inline-hot-threshold", cl::init(1),
+    cl::desc("Minimum percentage of the samples of a function that a call "
+             "site inlined in the profiled binary must have to be inlined "
+             "before annotating the function."));
+static cl::opt<unsigned> SampleProfileMaxInlineDepth(
+    "sample-profile-max-inline-depth", cl::init(16),
+    cl::desc("Maximum depth of the inline stacks of the profile that are "
+             "replayed before annotating a function."));
 
 namespace {
 typedef DenseMap<BasicBlock *, unsigned> BlockWeightMap;
@@ -74,13 +94,13 @@ typedef DenseMap<BasicBlock *, SmallVector<BasicBlock *, 8>> BlockEdgeMap;
 /// This pass reads profile data from the file specified by
 /// -sample-profile-file and annotates every affected function with the
 /// profile information found in that file.
-class SampleProfileLoader : public FunctionPass {
+class SampleProfileLoader : public ModulePass {
 public:
   // Class identification, replacement for typeinfo
   static char ID;
 
   SampleProfileLoader(StringRef Name = SampleProfileFile)
-      : FunctionPass(ID), DT(nullptr), PDT(nullptr), LI(nullptr), Ctx(nullptr),
+      : ModulePass(ID), DT(nullptr), PDT(nullptr), LI(nullptr), Ctx(nullptr),
         Reader(), Samples(nullptr), Filename(Name), ProfileIsValid(false) {
     initializeSampleProfileLoaderPass(*PassRegistry::getPassRegistry());
   }
@@ -91,18 +111,21 @@ public:
 
   const char *getPassName() const override { return "Sample profile pass"; }
 
-  bool runOnFunction(Function &F) override;
+  bool runOnModule(Module &M) override;
 
   void getAnalysisUsage(AnalysisUsage &AU) const override {
-    AU.setPreservesCFG();
-    AU.addRequired<LoopInfoWrapperPass>();
-    AU.addRequired<DominatorTreeWrapperPass>();
-    AU.addRequired<PostDominatorTree>();
+    AU.addRequired<AssumptionCacheTracker>();
   }
 
 protected:
+  bool runOnFunction(Function &F);
   unsigned getFunctionLoc(Function &F);
   bool emitAnnotations(Function &F);
+  int getLineOffset(const DILocation *DIL) const;
+  const FunctionSamples *findFunctionSamples(const Instruction &I) const;
+  const FunctionSamples *findCalleeFunctionSamples(const CallInst &I) const;
+  bool inlineHotFunctions(Function &F);
+  void computeDominanceAndLoopInfo(Function &F);
   unsigned getInstWeight(Instruction &I);
   unsigned getBlockWeight(BasicBlock *BB);
   void printEdgeWeight(raw_ostream &OS, Edge E);
@@ -149,9 +172,11 @@ protected:
   EquivalenceClassMap EquivalenceClass;
 
   /// \brief Dominance, post-dominance and loop information.
-  DominatorTree *DT;
-  PostDominatorTree *PDT;
-  LoopInfo *LI;
+  ///
+  /// They are computed after the hot call sites are inlined.
+  std::unique_ptr<DominatorTree> DT;
+  std::unique_ptr<DominatorTreeBase<BasicBlock>> PDT;
+  std::unique_ptr<LoopInfo> LI;
 
   /// \brief Predecessors for each basic block in the CFG.
   BlockEdgeMap Predecessors;
@@ -204,30 +229,191 @@ void SampleProfileLoader::printBlockWeight(raw_ostream &OS, BasicBlock *BB) {
   OS << "weight[" << BB->getName() << "]: " << BlockWeights[BB] << "\n";
 }
 
+/// \brief Return the line offset of \p DIL from the start of the function
+/// it is in, or -1 if it precedes it.
+///
+/// For a location inlined from another function, the offset is relative to
+/// the start of the inlined function.
+int SampleProfileLoader::getLineOffset(const DILocation *DIL) const {
+  unsigned FunctionLineno = HeaderLineno;
+  if (DIL->getInlinedAt()) {
+    const DISubprogram *SP = DIL->getScope()->getSubprogram();
+    FunctionLineno = SP ? SP->getLine() : 0;
+  }
+  if (DIL->getLine() < FunctionLineno)
+    return -1;
+  return DIL->getLine() - FunctionLineno;
+}
+
+/// \brief Get the profile of the (possibly inlined) function \p Inst is in.
+///
+/// The inline stack of \p Inst is given by the inlinedAt chain of its debug
+/// location. Every inlined frame is looked up in the callsite samples of the
+/// frame it was inlined into, starting from the samples of the function
+/// being annotated.
+///
+/// \returns nullptr if some frame of the inline stack was not inlined in the
+/// profiled binary.
+const FunctionSamples *
+SampleProfileLoader::findFunctionSamples(const Instruction &Inst) const {
+  const DILocation *DIL = Inst.getDebugLoc();
+  if (!DIL)
+    return Samples;
+
+  // Collect the call sites of the inline stack, innermost first.
+  SmallVector<std::pair<LineLocation, StringRef>, 8> InlineStack;
+  for (; const DILocation *CallSite = DIL->getInlinedAt(); DIL = CallSite) {
+    const DISubprogram *Callee = DIL->getScope()->getSubprogram();
+    if (!Callee)
+      return nullptr;
+    StringRef CalleeName = Callee->getLinkageName();
+    if (CalleeName.empty())
+      CalleeName = Callee->getName();
+    int LOffset = getLineOffset(CallSite);
+    if (LOffset < 0)
+      return nullptr;
+    InlineStack.push_back(std::make_pair(
+        LineLocation(LOffset, CallSite->getDiscriminator()), CalleeName));
+  }
+
+  const FunctionSamples *FS = Samples;
+  for (auto I = InlineStack.rbegin(), E = InlineStack.rend(); FS && I != E;
+       ++I)
+    FS = FS->findFunctionSamplesAt(I->first, I->second);
+  return FS;
+}
+
+/// \brief Get the profile of the callee of \p Inst, if the callee was
+/// inlined at this call site in the profiled binary.
+const FunctionSamples *
+SampleProfileLoader::findCalleeFunctionSamples(const CallInst &Inst) const {
+  const Function *Callee = Inst.getCalledFunction();
+  const DILocation *DIL = Inst.getDebugLoc();
+  if (!Callee || !DIL)
+    return nullptr;
+
+  const FunctionSamples *FS = findFunctionSamples(Inst);
+  if (!FS)
+    return nullptr;
+  int LOffset = getLineOffset(DIL);
+  if (LOffset < 0)
+    return nullptr;
+  return FS->findFunctionSamplesAt(
+      LineLocation(LOffset, DIL->getDiscriminator()), Callee->getName());
+}
+
+/// \brief Return true if \p CI was inlined along with the body of one of its
+/// callers, i.e. its debug location has an inline stack of its own, and its
+/// callee is not on that inline stack already.
+static bool isInlinedFromProfile(const CallInst &CI) {
+  const Function *Callee = CI.getCalledFunction();
+  const DILocation *DIL = CI.getDebugLoc();
+  if (!Callee || !DIL || !DIL->getInlinedAt())
+    return false;
+
+  for (; DIL; DIL = DIL->getInlinedAt()) {
+    const DISubprogram *SP = DIL->getScope()->getSubprogram();
+    if (!SP)
+      return false;
+    if (SP->getLinkageName() == Callee->getName() ||
+        SP->getName() == Callee->getName())
+      return false;
+  }
+  return true;
+}
+
+/// \brief Inline the hot call sites of \p F that were inlined in the
+/// profiled binary.
+///
+/// A call site is hot if its inlined profile has at least
+/// -sample-profile-inline-hot-threshold percent of the samples of \p F.
+/// The call sites of the inlined callees are in turn considered, following
+/// the inline stacks of the profile, until no hot call site is left or
+/// -sample-profile-max-inline-depth is reached.
+///
+/// \returns true if any call site was inlined.
+bool SampleProfileLoader::inlineHotFunctions(Function &F) {
+  bool Changed = false;
+  uint64_t HotThreshold =
+      uint64_t(Samples->getTotalSamples()) * SampleProfileInlineHotThreshold;
+  for (unsigned Depth = 0; Depth < SampleProfileMaxInlineDepth; ++Depth) {
+    SmallVector<CallInst *, 8> HotCalls;
+    for (auto &BB : F)
+      for (auto &I : BB) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (!CI || CI->getCalledFunction() == &F)
+          continue;
+        // Calls inlined by an earlier round without an inline stack of their
+        // own (e.g. from a callee without debug info) carry the location of
+        // the call they replaced and would match its profile again. Calls
+        // back into their own inline stack would be inlined forever.
+        if (Depth > 0 && !isInlinedFromProfile(*CI))
+          continue;
+        const FunctionSamples *FS = findCalleeFunctionSamples(*CI);
+        if (FS && uint64_t(FS->getTotalSamples()) * 100 >= HotThreshold &&
+            FS->getTotalSamples() > 0)
+          HotCalls.push_back(CI);
+      }
+
+    bool LocalChanged = false;
+    for (CallInst *CI : HotCalls) {
+      Function *Callee = CI->getCalledFunction();
+      if (Callee->isDeclaration())
+        continue;
+      DEBUG(dbgs() << "Inlining hot call site " << *CI << "\n");
+      InlineFunctionInfo IFI(nullptr, nullptr,
+                             &getAnalysis<AssumptionCacheTracker>());
+      if (InlineFunction(CI, IFI)) {
+        LocalChanged = true;
+        ++NumInlined;
+      }
+    }
+    if (!LocalChanged)
+      break;
+    Changed = true;
+  }
+  return Changed;
+}
+
+/// \brief Compute the dominator, post-dominator and loop information of
+/// \p F.
+void SampleProfileLoader::computeDominanceAndLoopInfo(Function &F) {
+  DT.reset(new DominatorTree(F));
+  PDT.reset(new DominatorTreeBase<BasicBlock>(true));
+  PDT->recalculate(F);
+  LI.reset(new LoopInfo(*DT));
+}
+
 /// \brief Get the weight for an instruction.
 ///
 /// The "weight" of an instruction \p Inst is the number of samples
 /// collected on that instruction at runtime. To retrieve it, we
-/// need to compute the line number of \p Inst relative to the start of its
-/// function. We use HeaderLineno to compute the offset. We then
-/// look up the samples collected for \p Inst using BodySamples.
+/// need to compute the line number of \p Inst relative to the start of the
+/// function it comes from, which may be a function inlined in the one being
+/// annotated. We then look up the samples collected for \p Inst in the
+/// profile of that function.
 ///
 /// \param Inst Instruction to query.
 ///
 /// \returns The profiled weight of I.
 unsigned SampleProfileLoader::getInstWeight(Instruction &Inst) {
-  DebugLoc DLoc = Inst.getDebugLoc();
-  if (!DLoc)
+  const DILocation *DIL = Inst.getDebugLoc();
+  if (!DIL)
     return 0;
 
-  unsigned Lineno = DLoc.getLine();
-  if (Lineno < HeaderLineno)
+  const FunctionSamples *FS = findFunctionSamples(Inst);
+  if (!FS)
     return 0;
 
-  const DILocation *DIL = DLoc;
-  int LOffset = Lineno - HeaderLineno;
+  int LOffset = getLineOffset(DIL);
+  if (LOffset < 0)
+    return 0;
+
+  unsigned Lineno = DIL->getLine();
   unsigned Discriminator = DIL->getDiscriminator();
-  unsigned Weight = Samples->samplesAt(LOffset, Discriminator);
+  auto Rec = FS->getBodySamples().find(LineLocation(LOffset, Discriminator));
+  unsigned Weight =
+      Rec == FS->getBodySamples().end() ? 0 : Rec->second.getSamples();
   DEBUG(dbgs() << "    " << Lineno << "." << Discriminator << ":" << Inst
                << " (line offset: " << LOffset << "." << Discriminator
                << " - weight: " << Weight << ")\n");
@@ -364,7 +550,7 @@ void SampleProfileLoader::findEquivalenceClasses(Function &F) {
     // class by making BB2's equivalence class be BB1.
     DominatedBBs.clear();
     DT->getDescendants(BB1, DominatedBBs);
-    findEquivalencesFor(BB1, DominatedBBs, PDT->DT);
+    findEquivalencesFor(BB1, DominatedBBs, PDT.get());
 
     // Repeat the same logic for all the blocks post-dominated by BB1.
     // We are looking for every basic block BB2 such that:
@@ -376,7 +562,7 @@ void SampleProfileLoader::findEquivalenceClasses(Function &F) {
     // If all those conditions hold, BB2's equivalence class is BB1.
     DominatedBBs.clear();
     PDT->getDescendants(BB1, DominatedBBs);
-    findEquivalencesFor(BB1, DominatedBBs, DT);
+    findEquivalencesFor(BB1, DominatedBBs, DT.get());
 
     DEBUG(printBlockEquivalence(dbgs(), BB1));
   }
@@ -718,10 +904,23 @@ bool SampleProfileLoader::emitAnnotations(Function &F) {
   DEBUG(dbgs() << "Line number for the first instruction in " << F.getName()
                << ": " << HeaderLineno << "\n");
 
+  Changed |= inlineHotFunctions(F);
+
+  // Inlining changed the CFG: compute the analyses on the final one.
+  computeDominanceAndLoopInfo(F);
+  BlockWeights.clear();
+  EdgeWeights.clear();
+  VisitedBlocks.clear();
+  VisitedEdges.clear();
+  EquivalenceClass.clear();
+  Predecessors.clear();
+  Successors.clear();
+
   // Compute basic block weights.
-  Changed |= computeBlockWeights(F);
+  bool HasWeights = computeBlockWeights(F);
+  Changed |= HasWeights;
 
-  if (Changed) {
+  if (HasWeights) {
     // Find equivalence classes.
     findEquivalenceClasses(F);
 
@@ -735,9 +934,7 @@ bool SampleProfileLoader::emitAnnotations(Function &F) {
 char SampleProfileLoader::ID = 0;
 INITIALIZE_PASS_BEGIN(SampleProfileLoader, "sample-profile",
                       "Sample Profile loader", false, false)
-INITIALIZE_PASS_DEPENDENCY(DominatorTreeWrapperPass)
-INITIALIZE_PASS_DEPENDENCY(PostDominatorTree)
-INITIALIZE_PASS_DEPENDENCY(LoopInfoWrapperPass)
+INITIALIZE_PASS_DEPENDENCY(AssumptionCacheTracker)
 INITIALIZE_PASS_DEPENDENCY(AddDiscriminators)
 INITIALIZE_PASS_END(SampleProfileLoader, "sample-profile",
                     "Sample Profile loader", false, false)
@@ -750,25 +947,31 @@ bool SampleProfileLoader::doInitialization(Module &M) {
     return false;
   }
   Reader = std::move(ReaderOrErr.get());
+  Reader->collectFuncsToUse(M);
   ProfileIsValid = (Reader->read() == sampleprof_error::success);
   return true;
 }
 
-FunctionPass *llvm::createSampleProfileLoaderPass() {
+ModulePass *llvm::createSampleProfileLoaderPass() {
   return new SampleProfileLoader(SampleProfileFile);
 }
 
-FunctionPass *llvm::createSampleProfileLoaderPass(StringRef Name) {
+ModulePass *llvm::createSampleProfileLoaderPass(StringRef Name) {
   return new SampleProfileLoader(Name);
 }
 
-bool SampleProfileLoader::runOnFunction(Function &F) {
+bool SampleProfileLoader::runOnModule(Module &M) {
   if (!ProfileIsValid)
     return false;
 
-  DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
-  PDT = &getAnalysis<PostDominatorTree>();
-  LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  bool Changed = false;
+  for (auto &F : M)
+    if (!F.isDeclaration())
+      Changed |= runOnFunction(F);
+  return Changed;
+}
+
+bool SampleProfileLoader::runOnFunction(Function &F) {
   Ctx = &F.getParent()->getContext();
   Samples = Reader->getSamplesFor(F);
   if (!Samples->empty())
@@ -110,6 +110,9 @@ using namespace llvm::PatternMatch;
 
 STATISTIC(LoopsVectorized, "Number of loops vectorized");
 STATISTIC(LoopsAnalyzed, "Number of loops analyzed for vectorization");
+STATISTIC(OuterLoopsVectorized, "Number of outer loops vectorized");
+STATISTIC(EarlyExitLoopsVectorized,
+          "Number of loops with an early exit vectorized");
 
 static cl::opt<bool>
 EnableIfConversion("enable-if-conversion", cl::init(true), cl::Hidden,
@@ -209,6 +212,21 @@ static cl::opt<bool> EnableCondStoresVectorization(
     "enable-cond-stores-vec", cl::init(false), cl::Hidden,
     cl::desc("Enable if predication of stores during vectorization."));
 
+static cl::opt<bool> EnableOuterLoopVectorization(
+    "enable-outer-loop-vectorization", cl::init(false), cl::Hidden,
+    cl::desc("Enable vectorization of loops that contain a single inner loop "
+             "with a trip count that is invariant in the outer loop"));
+
+static cl::opt<bool> EnableEarlyExitVectorization(
+    "enable-early-exit-vectorization", cl::init(false), cl::Hidden,
+    cl::desc("Enable vectorization of loops with a data-dependent early exit "
+             "whose loads are known to be dereferenceable"));
+
+static cl::opt<unsigned> InnerLoopTripCountEstimate(
+    "vectorizer-inner-trip-count-estimate", cl::init(8), cl::Hidden,
+    cl::desc("The trip count assumed for inner loops with an unknown trip "
+             "count when costing outer-loop vectorization"));
+
 static cl::opt<unsigned> MaxNestedScalarReductionIC(
     "max-nested-scalar-reduction-interleave", cl::init(2), cl::Hidden,
     cl::desc("The maximum interleave count to use when interleaving a scalar "
@@ -268,7 +286,8 @@ public:
       : OrigLoop(OrigLoop), SE(SE), LI(LI), DT(DT), TLI(TLI), TTI(TTI),
         VF(VecWidth), UF(UnrollFactor), Builder(SE->getContext()),
         Induction(nullptr), OldInduction(nullptr), WidenMap(UnrollFactor),
-        Legal(nullptr), AddedSafetyChecks(false) {}
+        Legal(nullptr), AddedSafetyChecks(false), LoopEarlyExitBlock(nullptr),
+        EarlyExitLane(nullptr) {}
 
   // Perform the actual loop widening (vectorization).
   void vectorize(LoopVectorizationLegality *L) {
@@ -319,10 +338,14 @@ protected:
   /// See PR14725.
   void fixLCSSAPHIs();
 
+  /// Leave the vector loop for LoopEarlyExitBlock as soon as any lane takes
+  /// the early exit of the original loop, and compute the first such lane.
+  void fixEarlyExit();
+
   /// A helper function that computes the predicate of the block BB, assuming
   /// that the header block of the loop is set to True. It returns the *entry*
   /// mask for the block BB.
-  VectorParts createBlockInMask(BasicBlock *BB);
+  virtual VectorParts createBlockInMask(BasicBlock *BB);
   /// A helper function that computes the predicate of the edge between SRC
   /// and DST.
   VectorParts createEdgeMask(BasicBlock *Src, BasicBlock *Dst);
@@ -333,8 +356,8 @@ protected:
   /// Vectorize a single PHINode in a block. This method handles the induction
   /// variable canonicalization. It supports both VF = 1 for unrolled loops and
   /// arbitrary length vectors.
-  void widenPHIInstruction(Instruction *PN, VectorParts &Entry,
-                           unsigned UF, unsigned VF, PhiVector *PV);
+  virtual void widenPHIInstruction(Instruction *PN, VectorParts &Entry,
+                                   unsigned UF, unsigned VF, PhiVector *PV);
 
   /// Insert the new loop to the loop hierarchy and pass manager
   /// and update the analysis passes.
@@ -349,6 +372,9 @@ protected:
 
   /// Vectorize Load and Store instructions,
   virtual void vectorizeMemoryInstruction(Instruction *Instr);
+  /// Vectorize a non-consecutive Load/Store instruction into a masked
+  /// gather/scatter.
+  void vectorizeGatherScatter(Instruction *Instr, unsigned Alignment);
 
   /// Create a broadcast instruction. This method generates a broadcast
   /// instruction (shuffle) for loop invariant values and for the induction
@@ -472,6 +498,13 @@ protected:
 
   // Record whether runtime check is added.
   bool AddedSafetyChecks;
+
+  /// The block the vector loop leaves from when a lane takes the early exit
+  /// of the original loop, or null if the loop has no early exit.
+  BasicBlock *LoopEarlyExitBlock;
+  /// Placeholder for the first exiting lane, defined in LoopEarlyExitBlock
+  /// once the exit condition has been widened.
+  PHINode *EarlyExitLane;
 };
 
 class InnerLoopUnroller : public InnerLoopVectorizer {
@@ -490,6 +523,34 @@ private:
   Value *reverseVector(Value *Vec) override;
 };
 
+/// OuterLoopVectorizer vectorizes a loop that contains a single inner loop.
+/// The lanes of a vector hold consecutive iterations of the outer loop, and
+/// the inner loop is kept as a loop inside the vector loop. Because its trip
+/// count is invariant in the outer loop, all lanes leave the inner loop in
+/// the same iteration and its control flow stays scalar.
+class OuterLoopVectorizer : public InnerLoopVectorizer {
+public:
+  OuterLoopVectorizer(Loop *OrigLoop, ScalarEvolution *SE, LoopInfo *LI,
+                      DominatorTree *DT, const TargetLibraryInfo *TLI,
+                      const TargetTransformInfo *TTI, unsigned VecWidth)
+      : InnerLoopVectorizer(OrigLoop, SE, LI, DT, TLI, TTI, VecWidth, 1),
+        InnerVectorBody(nullptr), InnerVectorExit(nullptr) {}
+
+private:
+  void vectorizeLoop() override;
+  VectorParts createBlockInMask(BasicBlock *BB) override;
+  void widenPHIInstruction(Instruction *PN, VectorParts &Entry, unsigned UF,
+                           unsigned VF, PhiVector *PV) override;
+
+  /// Emit the vector form of the inner loop \p Inner at the current insertion
+  /// point, splitting the vector loop body around it.
+  void vectorizeInnerLoop(Loop *Inner, PhiVector *PV);
+
+  /// The vectorized inner loop and the block that follows it.
+  BasicBlock *InnerVectorBody;
+  BasicBlock *InnerVectorExit;
+};
+
 /// \brief Look for a meaningful debug location on the instruction or it's
 /// operands.
 static Instruction *getDebugLocFromInstOrOperands(Instruction *I) {
@@ -798,8 +859,9 @@ public:
                             Function *F, const TargetTransformInfo *TTI,
                             LoopAccessAnalysis *LAA)
       : NumPredStores(0), TheLoop(L), SE(SE), TLI(TLI), TheFunction(F),
-        TTI(TTI), DT(DT), LAA(LAA), LAI(nullptr), InterleaveInfo(SE, L, DT),
-        Induction(nullptr), WidestIndTy(nullptr), HasFunNoNaNAttr(false) {}
+        TTI(TTI), DT(DT), AA(AA), LAA(LAA), LAI(nullptr),
+        InterleaveInfo(SE, L, DT), Induction(nullptr), WidestIndTy(nullptr),
+        EarlyExitingBlock(nullptr), HasFunNoNaNAttr(false) {}
 
   /// This enum represents the kinds of inductions that we support.
   enum InductionKind {
@@ -888,9 +950,23 @@ public:
   /// loop, only that it is legal to do so.
   bool canVectorize();
 
+  /// Returns true if it is legal to vectorize this loop across the
+  /// iterations of its single inner loop, which is kept as a scalar loop
+  /// inside the vector loop. Memory dependences are not analyzed by
+  /// LoopAccessAnalysis here, so no runtime checks are ever needed.
+  bool canVectorizeOuterLoop();
+
   /// Returns the Induction variable.
   PHINode *getInduction() { return Induction; }
 
+  /// Returns the block, other than the latch, from which the loop may exit,
+  /// or null if the latch is the only exiting block.
+  BasicBlock *getEarlyExitingBlock() { return EarlyExitingBlock; }
+
+  /// Returns the backedge-taken count the vector loop is built from. For a
+  /// loop with an early exit, this is the count of the latch exit alone.
+  const SCEV *getBackedgeTakenCount();
+
   /// Returns the reduction variables found in the loop.
   ReductionList *getReductionVars() { return &Reductions; }
 
@@ -923,9 +999,10 @@ public:
   /// Returns true if this instruction will remain scalar after vectorization.
   bool isUniformAfterVectorization(Instruction* I) { return Uniforms.count(I); }
 
-  /// Returns the information that we collected about runtime memory check.
+  /// Returns the information that we collected about runtime memory check,
+  /// or null for an outer loop.
   const RuntimePointerChecking *getRuntimePointerChecking() const {
-    return LAI->getRuntimePointerChecking();
+    return LAI ? LAI->getRuntimePointerChecking() : nullptr;
   }
 
   const LoopAccessInfo *getLAI() const {
@@ -942,7 +1019,9 @@ public:
     return InterleaveInfo.getInterleaveGroup(Instr);
   }
 
-  unsigned getMaxSafeDepDistBytes() { return LAI->getMaxSafeDepDistBytes(); }
+  unsigned getMaxSafeDepDistBytes() {
+    return LAI ? LAI->getMaxSafeDepDistBytes() : -1U;
+  }
 
   bool hasStride(Value *V) { return StrideSet.count(V); }
   bool mustCheckStrides() { return !StrideSet.empty(); }
@@ -961,6 +1040,16 @@ public:
   bool isLegalMaskedLoad(Type *DataType, Value *Ptr) {
     return TTI->isLegalMaskedLoad(DataType, isConsecutivePtr(Ptr));
   }
+  /// Returns true if the target machine supports masked scatter operation
+  /// for the given \p DataType.
+  bool isLegalMaskedScatter(Type *DataType) {
+    return TTI->isLegalMaskedScatter(DataType);
+  }
+  /// Returns true if the target machine supports masked gather operation
+  /// for the given \p DataType.
+  bool isLegalMaskedGather(Type *DataType) {
+    return TTI->isLegalMaskedGather(DataType);
+  }
   /// Returns true if vector representation of the instruction \p I
   /// requires mask.
   bool isMaskRequired(const Instruction* I) {
@@ -987,6 +1076,32 @@ private:
   /// Returns true if the loop is vectorizable
   bool canVectorizeMemory();
 
+  /// Checks that vectorizing an outer loop does not reorder dependent memory
+  /// accesses of different outer iterations. Every store must write a
+  /// distinct address per outer iteration that does not change in the inner
+  /// loop, and may only alias the accesses to the very same address.
+  bool canVectorizeOuterLoopMemory();
+
+  /// Checks the shape of a loop with two exiting blocks: the latch, and one
+  /// block that dominates it and leaves the loop on a data-dependent
+  /// condition. Sets EarlyExitingBlock if the loop qualifies.
+  bool canVectorizeEarlyExit();
+
+  /// Checks that a loop with an early exit may be executed past the
+  /// iteration that leaves it: it must not write memory, every other
+  /// instruction must be safe to speculate, and all of its loads must be
+  /// dereferenceable up to the latch exit.
+  bool canVectorizeEarlyExitMemory();
+
+  /// Returns true if the pointer \p Ptr can be dereferenced in each of the
+  /// \p TripCount iterations of TheLoop.
+  bool isDereferenceableInLoop(Value *Ptr, uint64_t TripCount);
+
+  /// Returns true if V has the same value in all the lanes when the outer
+  /// loop TheLoop is vectorized, i.e. it does not depend on TheLoop's
+  /// iteration. Unlike loop invariance, V may still vary in the inner loop.
+  bool isOuterLoopUniform(Value *V);
+
   /// Return true if we can vectorize this loop using the IF-conversion
   /// transformation.
   bool canVectorizeWithIfConvert();
@@ -1031,6 +1146,8 @@ private:
   const TargetTransformInfo *TTI;
   /// Dominator Tree.
   DominatorTree *DT;
+  /// Alias Analysis.
+  AliasAnalysis *AA;
   // LoopAccess analysis.
   LoopAccessAnalysis *LAA;
   // And the loop-accesses info corresponding to this loop.  This pointer is
@@ -1054,6 +1171,10 @@ private:
   InductionList Inductions;
   /// Holds the widest induction type encountered.
   Type *WidestIndTy;
+  /// The exiting block other than the latch, if any. The vector loop tests
+  /// the exit condition of all of its lanes and hands the iteration that
+  /// exits over to the scalar loop.
+  BasicBlock *EarlyExitingBlock;
 
   /// Allowed outside users. This holds the reduction
   /// vars which can be accessed from outside the loop.
@@ -1136,13 +1257,14 @@ public:
   /// \return  information about the register usage of the loop.
   RegisterUsage calculateRegisterUsage();
 
-private:
   /// Returns the expected execution cost. The unit of the cost does
   /// not matter because we use the 'cost' units to compare different
   /// vector widths. The cost that is returned is *not* normalized by
-  /// the factor width.
+  /// the factor width. The blocks of an inner loop are weighted by its
+  /// (estimated) trip count.
   unsigned expectedCost(unsigned VF);
 
+private:
   /// Returns the execution time cost of an instruction for a given vector
   /// width. Vector width of one means scalar.
   unsigned getInstructionCost(Instruction *I, unsigned VF);
@@ -1415,6 +1537,14 @@ static void emitMissedWarning(Function *F, Loop *L,
   }
 }
 
+/// \brief Returns the trip count to assume for \p L, an inner loop of a loop
+/// considered for outer-loop vectorization.
+static unsigned getInnerLoopTripCountEstimate(ScalarEvolution *SE, Loop *L) {
+  if (unsigned TC = SE->getSmallConstantTripCount(L))
+    return TC;
+  return InnerLoopTripCountEstimate;
+}
+
 static void addInnerLoop(Loop &L, SmallVectorImpl<Loop *> &V) {
   if (L.empty())
     return V.push_back(&L);
@@ -1488,8 +1618,17 @@ struct LoopVectorize : public FunctionPass {
 
     // Now walk the identified inner loops.
     bool Changed = false;
-    while (!Worklist.empty())
-      Changed |= processLoop(Worklist.pop_back_val());
+    while (!Worklist.empty()) {
+      Loop *L = Worklist.pop_back_val();
+      // Vectorizing the parent of a short inner loop may fill the vector
+      // lanes better than vectorizing the inner loop itself.
+      if (EnableOuterLoopVectorization && L->getParentLoop() &&
+          processOuterLoop(L->getParentLoop())) {
+        Changed = true;
+        continue;
+      }
+      Changed |= processLoop(L);
+    }
 
     // Process each loop nest in the function.
     return Changed;
@@ -1699,6 +1838,118 @@ struct LoopVectorize : public FunctionPass {
     return true;
   }
 
+  /// Try to vectorize \p L, a loop with a single inner loop, across the
+  /// iterations of \p L. Returns true if the loop nest was vectorized.
+  bool processOuterLoop(Loop *L) {
+    if (L->getSubLoops().size() != 1)
+      return false;
+    Loop *Inner = L->getSubLoops().front();
+
+    DEBUG(dbgs() << "\nLV: Checking an outer loop in \""
+                 << L->getHeader()->getParent()->getName() << "\" from "
+                 << getDebugLocString(L) << "\n");
+
+    LoopVectorizeHints Hints(L, DisableUnrolling);
+    Function *F = L->getHeader()->getParent();
+    bool Forced = Hints.getForce() == LoopVectorizeHints::FK_Enabled;
+    if (Hints.getForce() == LoopVectorizeHints::FK_Disabled ||
+        (!AlwaysVectorize && !Forced) || Hints.getWidth() == 1)
+      return false;
+
+    // Do not vectorize loops with a tiny trip count.
+    const unsigned TC = SE->getSmallConstantTripCount(L);
+    if (TC > 0u && TC < TinyTripCountVectorThreshold && !Forced)
+      return false;
+
+    if (F->hasFnAttribute(Attribute::NoImplicitFloat))
+      return false;
+
+    LoopVectorizationLegality LVL(L, SE, DT, TLI, AA, F, TTI, LAA);
+    if (!LVL.canVectorizeOuterLoop()) {
+      DEBUG(dbgs() << "LV: Not vectorizing outer loop: Cannot prove "
+                      "legality.\n");
+      return false;
+    }
+
+    bool OptForSize = !Forced && F->hasFnAttribute(Attribute::OptimizeForSize);
+    LoopVectorizationCostModel CM(L, SE, LI, &LVL, *TTI, TLI, AC, F, &Hints);
+    const LoopVectorizationCostModel::VectorizationFactor VF =
+        CM.selectVectorizationFactor(OptForSize);
+    if (VF.Width == 1) {
+      DEBUG(dbgs() << "LV: Outer loop vectorization is not beneficial.\n");
+      return false;
+    }
+
+    // Unless the user picked the width, compare with the cost of vectorizing
+    // the inner loop instead, which will be tried next.
+    if (!Hints.getWidth() &&
+        !isOuterLoopVectorizationBeneficial(L, Inner, CM, VF, OptForSize))
+      return false;
+
+    DEBUG(dbgs() << "LV: Vectorizing outer loop (" << VF.Width << ").\n");
+    OuterLoopVectorizer OLV(L, SE, LI, DT, TLI, TTI, VF.Width);
+    OLV.vectorize(&LVL);
+    ++LoopsVectorized;
+    ++OuterLoopsVectorized;
+
+    // No runtime checks are needed, so the scalar loop only handles the
+    // remainder.
+    AddRuntimeUnrollDisableMetaData(L);
+
+    emitOptimizationRemark(F->getContext(), DEBUG_TYPE, *F, L->getStartLoc(),
+                           Twine("vectorized outer loop (vectorization "
+                                 "width: ") + Twine(VF.Width) + ")");
+
+    // Mark the loop as already vectorized to avoid vectorizing again.
+    Hints.setAlreadyVectorized();
+
+    DEBUG(verifyFunction(*L->getHeader()->getParent()));
+    return true;
+  }
+
+  /// Returns true if vectorizing \p L with \p VF is cheaper than vectorizing
+  /// its inner loop \p Inner. The cost of \p L weighs the inner loop by its
+  /// trip count; when the inner loop is vectorized instead, only its vector
+  /// iterations get cheaper, while its remainder and the rest of \p L stay
+  /// scalar.
+  bool isOuterLoopVectorizationBeneficial(
+      Loop *L, Loop *Inner, LoopVectorizationCostModel &CM,
+      const LoopVectorizationCostModel::VectorizationFactor &VF,
+      bool OptForSize) {
+    Function *F = L->getHeader()->getParent();
+    unsigned InnerTC = getInnerLoopTripCountEstimate(SE, Inner);
+    unsigned ScalarCost = CM.expectedCost(1);
+    unsigned InnerPathCost = ScalarCost;
+
+    LoopVectorizeHints InnerHints(Inner, DisableUnrolling);
+    bool InnerForced =
+        InnerHints.getForce() == LoopVectorizeHints::FK_Enabled;
+    unsigned InnerConstTC = SE->getSmallConstantTripCount(Inner);
+    bool InnerTooShort = InnerConstTC > 0u &&
+                         InnerConstTC < TinyTripCountVectorThreshold &&
+                         !InnerForced;
+    LoopVectorizationLegality InnerLVL(Inner, SE, DT, TLI, AA, F, TTI, LAA);
+    if (InnerHints.getForce() != LoopVectorizeHints::FK_Disabled &&
+        !InnerTooShort && InnerLVL.canVectorize()) {
+      LoopVectorizationCostModel InnerCM(Inner, SE, LI, &InnerLVL, *TTI, TLI,
+                                         AC, F, &InnerHints);
+      unsigned InnerVF = InnerCM.selectVectorizationFactor(OptForSize).Width;
+      if (InnerVF > 1) {
+        unsigned InnerScalarCost = InnerCM.expectedCost(1);
+        unsigned InnerVectorCost = InnerCM.expectedCost(InnerVF);
+        unsigned InnerCost = (InnerTC / InnerVF) * InnerVectorCost +
+                             (InnerTC % InnerVF) * InnerScalarCost;
+        if (InnerTC * InnerScalarCost <= ScalarCost)
+          InnerPathCost = ScalarCost - InnerTC * InnerScalarCost + InnerCost;
+      }
+    }
+
+    DEBUG(dbgs() << "LV: Outer loop cost for VF " << VF.Width << ": "
+                 << VF.Cost << ", with the inner loop vectorized: "
+                 << InnerPathCost * VF.Width << ".\n");
+    return VF.Cost < InnerPathCost * VF.Width;
+  }
+
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.addRequired<AssumptionCacheTracker>();
     AU.addRequiredID(LoopSimplifyID);
@@ -1812,10 +2063,9 @@ int LoopVectorizationLegality::isConsecutivePtr(Value *Ptr) {
   unsigned InductionOperand = getGEPInductionOperand(Gep);
 
   // Check that all of the gep indices are uniform except for our induction
-  // operand.
+  // operand. In an outer loop, an index may still vary in the inner loop.
   for (unsigned i = 0; i != NumOperands; ++i)
-    if (i != InductionOperand &&
-        !SE->isLoopInvariant(SE->getSCEV(Gep->getOperand(i)), TheLoop))
+    if (i != InductionOperand && !isOuterLoopUniform(Gep->getOperand(i)))
       return 0;
 
   // We can emit wide load/stores only if the last non-zero index is the
@@ -1841,6 +2091,16 @@ int LoopVectorizationLegality::isConsecutivePtr(Value *Ptr) {
               ? C->getOperand()
               : Last;
   }
+  // When vectorizing an outer loop, an index that also moves in the inner
+  // loop is consecutive across the lanes if its value on entry to the inner
+  // loop is, as long as the inner step does not depend on the outer loop.
+  while (const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(Last)) {
+    if (AR->getLoop() == TheLoop || !TheLoop->contains(AR->getLoop()) ||
+        !SE->isLoopInvariant(AR->getStepRecurrence(*SE), TheLoop))
+      break;
+    Last = AR->getStart();
+  }
+
   if (const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(Last)) {
     const SCEV *Step = AR->getStepRecurrence(*SE);
 
@@ -1856,6 +2116,10 @@ int LoopVectorizationLegality::isConsecutivePtr(Value *Ptr) {
 }
 
 bool LoopVectorizationLegality::isUniform(Value *V) {
+  // Outer loops and loops with an early exit are analyzed without
+  // LoopAccessInfo.
+  if (!LAI)
+    return isOuterLoopUniform(V);
   return LAI->isUniform(V);
 }
 
@@ -2165,14 +2429,39 @@ void InnerLoopVectorizer::vectorizeMemoryInstruction(Instruction *Instr) {
   if (ScalarAllocatedSize != VectorElementSize)
     return scalarizeInstruction(Instr);
 
-  // If the pointer is loop invariant or if it is non-consecutive,
-  // scalarize the load.
+  // If the pointer is loop invariant, scalarize the load. If it is
+  // non-consecutive, use a gather/scatter when the target supports it and
+  // scalarize the access otherwise.
   int ConsecutiveStride = Legal->isConsecutivePtr(Ptr);
   bool Reverse = ConsecutiveStride < 0;
   bool UniformLoad = LI && Legal->isUniform(Ptr);
-  if (!ConsecutiveStride || UniformLoad)
+  bool CreateGatherScatter =
+      !ConsecutiveStride && ((LI && Legal->isLegalMaskedGather(ScalarDataTy)) ||
+                             (SI && Legal->isLegalMaskedScatter(ScalarDataTy)));
+  // A load in an inner loop whose address is the same for all the lanes of
+  // the vectorized outer loop is issued once and broadcast.
+  if (UniformLoad && this->LI->getLoopFor(LI->getParent()) != OrigLoop) {
+    setDebugLocFromInst(Builder, LI);
+    VectorParts &Entry = WidenMap.get(Instr);
+    VectorParts &PtrParts = getVectorValue(Ptr);
+    for (unsigned Part = 0; Part < UF; ++Part) {
+      Value *ScalarPtr = PtrParts[Part];
+      if (ScalarPtr->getType()->isVectorTy())
+        ScalarPtr = Builder.CreateExtractElement(ScalarPtr,
+                                                 Builder.getInt32(0));
+      LoadInst *NewLI = Builder.CreateAlignedLoad(ScalarPtr, Alignment);
+      propagateMetadata(NewLI, LI);
+      Entry[Part] = Builder.CreateVectorSplat(VF, NewLI, "broadcast");
+    }
+    return;
+  }
+
+  if ((!ConsecutiveStride && !CreateGatherScatter) || UniformLoad)
     return scalarizeInstruction(Instr);
 
+  if (CreateGatherScatter)
+    return vectorizeGatherScatter(Instr, Alignment);
+
   Constant *Zero = Builder.getInt32(0);
   VectorParts &Entry = WidenMap.get(Instr);
 
@@ -2191,8 +2480,8 @@ void InnerLoopVectorizer::vectorizeMemoryInstruction(Instruction *Instr) {
     Ptr = Builder.Insert(Gep2);
   } else if (Gep) {
     setDebugLocFromInst(Builder, Gep);
-    assert(SE->isLoopInvariant(SE->getSCEV(Gep->getPointerOperand()),
-                               OrigLoop) && "Base ptr must be invariant");
+    assert(Legal->isUniform(Gep->getPointerOperand()) &&
+           "Base ptr must be invariant");
 
     // The last index does not have to be the induction. It can be
     // consecutive and be a function of the index. For example A[I+1];
@@ -2208,8 +2497,7 @@ void InnerLoopVectorizer::vectorizeMemoryInstruction(Instruction *Instr) {
       // Update last index or loop invariant instruction anchored in loop.
       if (i == InductionOperand ||
           (GepOperandInst && OrigLoop->contains(GepOperandInst))) {
-        assert((i == InductionOperand ||
-               SE->isLoopInvariant(SE->getSCEV(GepOperandInst), OrigLoop)) &&
+        assert((i == InductionOperand || Legal->isUniform(GepOperandInst)) &&
                "Must be last index or loop invariant");
 
         VectorParts &GEPParts = getVectorValue(GepOperand);
@@ -2298,6 +2586,71 @@ void InnerLoopVectorizer::vectorizeMemoryInstruction(Instruction *Instr) {
   }
 }
 
+void InnerLoopVectorizer::vectorizeGatherScatter(Instruction *Instr,
+                                                 unsigned Alignment) {
+  LoadInst *LI = dyn_cast<LoadInst>(Instr);
+  StoreInst *SI = dyn_cast<StoreInst>(Instr);
+  Value *Ptr = LI ? LI->getPointerOperand() : SI->getPointerOperand();
+
+  // Compute a vector of pointers per unroll part. A GEP is rebuilt with its
+  // loop varying operands widened, so that the address arithmetic itself is
+  // vectorized instead of being extracted lane by lane.
+  VectorParts VectorGep;
+  GetElementPtrInst *Gep = dyn_cast<GetElementPtrInst>(Ptr);
+  if (Gep) {
+    setDebugLocFromInst(Builder, Gep);
+    for (unsigned Part = 0; Part < UF; ++Part) {
+      Value *Base = Gep->getPointerOperand();
+      if (!OrigLoop->isLoopInvariant(Base))
+        Base = getVectorValue(Base)[Part];
+      SmallVector<Value *, 4> Indices;
+      for (auto I = Gep->idx_begin(), E = Gep->idx_end(); I != E; ++I) {
+        Value *Idx = *I;
+        if (OrigLoop->isLoopInvariant(Idx))
+          Indices.push_back(Idx);
+        else
+          Indices.push_back(getVectorValue(Idx)[Part]);
+      }
+      Value *NewGep =
+          Gep->isInBounds()
+              ? Builder.CreateInBoundsGEP(Gep->getSourceElementType(), Base,
+                                          Indices, "VectorGep")
+              : Builder.CreateGEP(Gep->getSourceElementType(), Base, Indices,
+                                  "VectorGep");
+      if (!NewGep->getType()->isVectorTy())
+        NewGep = Builder.CreateVectorSplat(VF, NewGep);
+      VectorGep.push_back(NewGep);
+    }
+  } else {
+    setDebugLocFromInst(Builder, Ptr);
+    VectorGep = getVectorValue(Ptr);
+  }
+
+  VectorParts Mask = createBlockInMask(Instr->getParent());
+  if (SI) {
+    setDebugLocFromInst(Builder, SI);
+    VectorParts StoredVal = getVectorValue(SI->getValueOperand());
+    for (unsigned Part = 0; Part < UF; ++Part) {
+      Value *PartMask = Legal->isMaskRequired(SI) ? Mask[Part] : nullptr;
+      Instruction *NewSI = Builder.CreateMaskedScatter(
+          StoredVal[Part], VectorGep[Part], Alignment, PartMask);
+      propagateMetadata(NewSI, SI);
+    }
+    return;
+  }
+
+  setDebugLocFromInst(Builder, LI);
+  VectorParts &Entry = WidenMap.get(Instr);
+  for (unsigned Part = 0; Part < UF; ++Part) {
+    Value *PartMask = Legal->isMaskRequired(LI) ? Mask[Part] : nullptr;
+    Instruction *NewLI =
+        Builder.CreateMaskedGather(VectorGep[Part], Alignment, PartMask,
+                                   nullptr, "wide.masked.gather");
+    propagateMetadata(NewLI, LI);
+    Entry[Part] = NewLI;
+  }
+}
+
 void InnerLoopVectorizer::scalarizeInstruction(Instruction *Instr, bool IfPredicateStore) {
   assert(!Instr->getType()->isAggregateType() && "Can't handle vectors");
   // Holds vector parameters or scalars, in case of uniform vals.
@@ -2455,6 +2808,21 @@ InnerLoopVectorizer::addStrideCheck(Instruction *Loc) {
   return std::make_pair(FirstInst, TheCheck);
 }
 
+/// \brief Add the value that the induction \p II has in the iteration
+/// \p ExitIdx, at which the scalar loop resumes after an early exit from
+/// \p EarlyExitBB, to the resume value phi \p ResumeVal.
+static void
+addEarlyExitResumeValue(const LoopVectorizationLegality::InductionInfo &II,
+                        PHINode *ResumeVal, BasicBlock *EarlyExitBB,
+                        Value *ExitIdx, Value *StartIdx) {
+  IRBuilder<> B(EarlyExitBB->getTerminator());
+  Type *CountTy = II.IK == LoopVectorizationLegality::IK_PtrInduction
+                      ? II.StepValue->getType()
+                      : II.StartValue->getType();
+  Value *Count = B.CreateSExtOrTrunc(B.CreateSub(ExitIdx, StartIdx), CountTy);
+  ResumeVal->addIncoming(II.transform(B, Count), EarlyExitBB);
+}
+
 void InnerLoopVectorizer::createEmptyLoop() {
   /*
    In this function we generate a new loop. The new loop will contain
@@ -2491,6 +2859,16 @@ void InnerLoopVectorizer::createEmptyLoop() {
   BasicBlock *OldBasicBlock = OrigLoop->getHeader();
   BasicBlock *VectorPH = OrigLoop->getLoopPreheader();
   BasicBlock *ExitBlock = OrigLoop->getExitBlock();
+  BasicBlock *EarlyExiting = Legal->getEarlyExitingBlock();
+  // With an early exit, the vector loop rejoins the scalar code at the exit
+  // of the latch. The scalar loop takes the early exit itself.
+  if (EarlyExiting) {
+    BranchInst *LatchBr =
+        cast<BranchInst>(OrigLoop->getLoopLatch()->getTerminator());
+    ExitBlock = OrigLoop->contains(LatchBr->getSuccessor(0))
+                    ? LatchBr->getSuccessor(1)
+                    : LatchBr->getSuccessor(0);
+  }
   assert(VectorPH && "Invalid loop structure");
   assert(ExitBlock && "Must have an exit block");
 
@@ -2502,7 +2880,7 @@ void InnerLoopVectorizer::createEmptyLoop() {
   Type *IdxTy = Legal->getWidestInductionType();
 
   // Find the loop boundaries.
-  const SCEV *ExitCount = SE->getBackedgeTakenCount(OrigLoop);
+  const SCEV *ExitCount = Legal->getBackedgeTakenCount();
   assert(ExitCount != SE->getCouldNotCompute() && "Invalid loop count");
 
   // The exit count might have the type of i64 while the phi is i32. This can
@@ -2587,6 +2965,25 @@ void InnerLoopVectorizer::createEmptyLoop() {
   // Generate the induction variable.
   setDebugLocFromInst(Builder, getDebugLocFromInstOrOperands(OldInduction));
   Induction = Builder.CreatePHI(IdxTy, 2, "index");
+
+  // The vector loop branches to this block when any lane of an iteration
+  // takes the early exit. The scalar loop resumes at the iteration of the
+  // first such lane, which vectorizeLoop fills in once the exit condition has
+  // been widened.
+  BasicBlock *EarlyExitBB = nullptr;
+  Value *ExitIdx = nullptr;
+  if (EarlyExiting) {
+    EarlyExitBB = BasicBlock::Create(OldBasicBlock->getContext(),
+                                     "vector.early.exit",
+                                     OldBasicBlock->getParent(), MiddleBlock);
+    if (ParentLoop)
+      ParentLoop->addBasicBlockToLoop(EarlyExitBB, *LI);
+    IRBuilder<> EarlyExitBuilder(EarlyExitBB);
+    EarlyExitLane = EarlyExitBuilder.CreatePHI(IdxTy, 1, "early.exit.lane");
+    ExitIdx = EarlyExitBuilder.CreateAdd(Induction, EarlyExitLane,
+                                         "early.exit.idx");
+    EarlyExitBuilder.CreateBr(MiddleBlock);
+  }
   // The loop step is equal to the vectorization factor (num of SIMD elements)
   // times the unroll factor (num of SIMD instructions).
   Constant *Step = ConstantInt::get(IdxTy, VF * UF);
@@ -2671,9 +3068,11 @@ void InnerLoopVectorizer::createEmptyLoop() {
   // Generate the code that checks in runtime if arrays overlap. We put the
   // checks into a separate block to make the more common case of few elements
   // faster.
-  Instruction *MemRuntimeCheck;
-  std::tie(FirstCheckInst, MemRuntimeCheck) =
-      Legal->getLAI()->addRuntimeCheck(VectorPH->getTerminator());
+  // Outer loops are vectorized without runtime checks.
+  Instruction *MemRuntimeCheck = nullptr;
+  if (const LoopAccessInfo *LAI = Legal->getLAI())
+    std::tie(FirstCheckInst, MemRuntimeCheck) =
+        LAI->addRuntimeCheck(VectorPH->getTerminator());
   if (MemRuntimeCheck) {
     AddedSafetyChecks = true;
     // Create a new block containing the memory check.
@@ -2752,6 +3151,13 @@ void InnerLoopVectorizer::createEmptyLoop() {
         for (unsigned I = 1, E = LoopBypassBlocks.size(); I != E; ++I)
           TruncResumeVal->addIncoming(II.StartValue, LoopBypassBlocks[I]);
         TruncResumeVal->addIncoming(EndValue, VecBody);
+        if (EarlyExitBB) {
+          IRBuilder<> EarlyExitBuilder(EarlyExitBB->getTerminator());
+          TruncResumeVal->addIncoming(
+              EarlyExitBuilder.CreateTrunc(ExitIdx, OrigPhi->getType()),
+              EarlyExitBB);
+          ResumeVal->addIncoming(ExitIdx, EarlyExitBB);
+        }
 
         BCTruncResumeVal->addIncoming(II.StartValue, LoopBypassBlocks[0]);
 
@@ -2769,6 +3175,8 @@ void InnerLoopVectorizer::createEmptyLoop() {
                                                    "cast.crd");
       EndValue = II.transform(BypassBuilder, CRD);
       EndValue->setName("ind.end");
+      if (EarlyExitBB)
+        addEarlyExitResumeValue(II, ResumeVal, EarlyExitBB, ExitIdx, StartIdx);
       break;
     }
     case LoopVectorizationLegality::IK_PtrInduction: {
@@ -2777,6 +3185,8 @@ void InnerLoopVectorizer::createEmptyLoop() {
                                                    "cast.crd");
       EndValue = II.transform(BypassBuilder, CRD);
       EndValue->setName("ptr.ind.end");
+      if (EarlyExitBB)
+        addEarlyExitResumeValue(II, ResumeVal, EarlyExitBB, ExitIdx, StartIdx);
       break;
     }
     }// end of case
@@ -2816,6 +3226,8 @@ void InnerLoopVectorizer::createEmptyLoop() {
     for (unsigned I = 1, E = LoopBypassBlocks.size(); I != E; ++I)
       ResumeIndex->addIncoming(StartIdx, LoopBypassBlocks[I]);
     ResumeIndex->addIncoming(IdxEndRoundDown, VecBody);
+    if (EarlyExitBB)
+      ResumeIndex->addIncoming(ExitIdx, EarlyExitBB);
   }
 
   // Make sure that we found the index where scalar loop needs to continue.
@@ -2824,7 +3236,8 @@ void InnerLoopVectorizer::createEmptyLoop() {
 
   // Add a check in the middle block to see if we have completed
   // all of the iterations in the first vector loop.
-  // If (N - N%VF) == N, then we *don't* need to run the remainder.
+  // If (N - N%VF) == N, then we *don't* need to run the remainder. After an
+  // early exit the resume index is below N, and the scalar loop runs.
   Value *CmpN = CmpInst::Create(Instruction::ICmp, CmpInst::ICMP_EQ, IdxEnd,
                                 ResumeIndex, "cmp.n",
                                 MiddleBlock->getTerminator());
@@ -2852,6 +3265,7 @@ void InnerLoopVectorizer::createEmptyLoop() {
   LoopExitBlock = ExitBlock;
   LoopVectorBody.push_back(VecBody);
   LoopScalarBody = OldBasicBlock;
+  LoopEarlyExitBlock = EarlyExitBB;
 
   LoopVectorizeHints Hints(Lp, true);
   Hints.setAlreadyVectorized();
@@ -3051,6 +3465,9 @@ void InnerLoopVectorizer::vectorizeLoop() {
        be = DFS.endRPO(); bb != be; ++bb)
     vectorizeBlockInLoop(*bb, &RdxPHIsToFix);
 
+  if (LoopEarlyExitBlock)
+    fixEarlyExit();
+
   // At this point every instruction in the original loop is widened to
   // a vector form. We are almost done. Now, we need to fix the PHI nodes
   // that we vectorized. The PHI nodes are currently empty because we did
@@ -3261,12 +3678,56 @@ void InnerLoopVectorizer::fixLCSSAPHIs() {
        LEE = LoopExitBlock->end(); LEI != LEE; ++LEI) {
     PHINode *LCSSAPhi = dyn_cast<PHINode>(LEI);
     if (!LCSSAPhi) break;
-    if (LCSSAPhi->getNumIncomingValues() == 1)
+    // Values leaving a loop with an early exit through the latch are loop
+    // invariant, see LoopVectorizationLegality::canVectorizeEarlyExit.
+    if (LoopEarlyExitBlock)
+      LCSSAPhi->addIncoming(
+          LCSSAPhi->getIncomingValueForBlock(OrigLoop->getLoopLatch()),
+          LoopMiddleBlock);
+    else if (LCSSAPhi->getNumIncomingValues() == 1)
       LCSSAPhi->addIncoming(UndefValue::get(LCSSAPhi->getType()),
                             LoopMiddleBlock);
   }
 }
 
+void InnerLoopVectorizer::fixEarlyExit() {
+  BranchInst *Br =
+      cast<BranchInst>(Legal->getEarlyExitingBlock()->getTerminator());
+  BasicBlock *VecLatch = LoopVectorBody.back();
+
+  // Find the lanes that leave the loop. The early exit is tested at the end
+  // of the vector body, so every lane has executed the iteration.
+  Builder.SetInsertPoint(VecLatch->getTerminator());
+  Value *Exits = getVectorValue(Br->getCondition())[0];
+  if (OrigLoop->contains(Br->getSuccessor(0)))
+    Exits = Builder.CreateNot(Exits);
+  Value *Bits = Builder.CreateBitCast(Exits, Builder.getIntNTy(VF),
+                                      "early.exit.bits");
+  Value *AnyExit = Builder.CreateICmpNE(
+      Bits, ConstantInt::get(Bits->getType(), 0), "early.exit.any");
+
+  BasicBlock *Continue =
+      VecLatch->splitBasicBlock(VecLatch->getTerminator(),
+                                "vector.body.continue");
+  LI->getLoopFor(VecLatch)->addBasicBlockToLoop(Continue, *LI);
+  ReplaceInstWithInst(VecLatch->getTerminator(),
+                      BranchInst::Create(LoopEarlyExitBlock, Continue,
+                                         AnyExit));
+  LoopVectorBody.push_back(Continue);
+
+  // The scalar loop resumes at the first lane that exits.
+  Builder.SetInsertPoint(LoopEarlyExitBlock->getFirstInsertionPt());
+  Module *M = LoopEarlyExitBlock->getModule();
+  Function *Cttz =
+      Intrinsic::getDeclaration(M, Intrinsic::cttz, Bits->getType());
+  Value *Lane = Builder.CreateCall(Cttz, {Bits, Builder.getTrue()});
+  Lane = Builder.CreateZExtOrTrunc(Lane, EarlyExitLane->getType());
+  Lane->takeName(EarlyExitLane);
+  EarlyExitLane->replaceAllUsesWith(Lane);
+  EarlyExitLane->eraseFromParent();
+  EarlyExitLane = nullptr;
+}
+
 InnerLoopVectorizer::VectorParts
 InnerLoopVectorizer::createEdgeMask(BasicBlock *Src, BasicBlock *Dst) {
   assert(std::find(pred_begin(Dst), pred_end(Dst), Src) != pred_end(Dst) &&
@@ -3708,10 +4169,16 @@ void InnerLoopVectorizer::updateAnalysis() {
       DT->addNewBlock(LoopVectorBody[0], LoopVectorPreHeader);
     else if (isPredicatedBlock(i)) {
       DT->addNewBlock(LoopVectorBody[i], LoopVectorBody[i-1]);
+    } else if (BasicBlock *Pred = LoopVectorBody[i]->getSinglePredecessor()) {
+      // The block after a vectorized inner loop is only entered from it.
+      DT->addNewBlock(LoopVectorBody[i], Pred);
     } else {
       DT->addNewBlock(LoopVectorBody[i], LoopVectorBody[i-2]);
     }
   }
+  if (LoopEarlyExitBlock)
+    DT->addNewBlock(LoopEarlyExitBlock,
+                    LoopEarlyExitBlock->getSinglePredecessor());
 
   DT->addNewBlock(LoopMiddleBlock, LoopBypassBlocks[1]);
   DT->addNewBlock(LoopScalarPreHeader, LoopBypassBlocks[0]);
@@ -3820,8 +4287,11 @@ bool LoopVectorizationLegality::canVectorize() {
     return false;
   }
 
-  // We must have a single exiting block.
-  if (!TheLoop->getExitingBlock()) {
+  // We must have a single exiting block, or a single early exit in addition
+  // to the latch.
+  EarlyExitingBlock = nullptr;
+  if (!TheLoop->getExitingBlock() &&
+      (!EnableEarlyExitVectorization || !canVectorizeEarlyExit())) {
     emitAnalysis(
         VectorizationReport() <<
         "loop control flow is not understood by vectorizer");
@@ -3831,7 +4301,8 @@ bool LoopVectorizationLegality::canVectorize() {
   // We only handle bottom-tested loops, i.e. loop in which the condition is
   // checked at the end of each iteration. With that we can assume that all
   // instructions in the loop are executed the same number of times.
-  if (TheLoop->getExitingBlock() != TheLoop->getLoopLatch()) {
+  if (!EarlyExitingBlock &&
+      TheLoop->getExitingBlock() != TheLoop->getLoopLatch()) {
     emitAnalysis(
         VectorizationReport() <<
         "loop control flow is not understood by vectorizer");
@@ -3850,7 +4321,7 @@ bool LoopVectorizationLegality::canVectorize() {
   }
 
   // ScalarEvolution needs to be able to find the exit count.
-  const SCEV *ExitCount = SE->getBackedgeTakenCount(TheLoop);
+  const SCEV *ExitCount = getBackedgeTakenCount();
   if (ExitCount == SE->getCouldNotCompute()) {
     emitAnalysis(VectorizationReport() <<
                  "could not determine number of loop iterations");
@@ -3864,6 +4335,34 @@ bool LoopVectorizationLegality::canVectorize() {
     return false;
   }
 
+  if (EarlyExitingBlock) {
+    // The vector loop leaves as soon as any lane exits, so a reduction would
+    // have to be computed from a partial vector.
+    if (!Reductions.empty()) {
+      emitAnalysis(VectorizationReport() <<
+                   "reductions in a loop with an early exit are not "
+                   "supported by vectorizer");
+      return false;
+    }
+
+    // The strides would be versioned by LoopAccessAnalysis, which we don't
+    // use for these loops.
+    Strides.clear();
+    StrideSet.clear();
+
+    // Lanes past the exit are executed speculatively.
+    if (!canVectorizeEarlyExitMemory()) {
+      DEBUG(dbgs() << "LV: Can't speculate the loop past its early exit\n");
+      return false;
+    }
+
+    collectLoopUniforms();
+
+    DEBUG(dbgs() << "LV: We can vectorize this loop with an early exit in "
+                 << EarlyExitingBlock->getName() << "!\n");
+    return true;
+  }
+
   // Go over each instruction and look at memory deps.
   if (!canVectorizeMemory()) {
     DEBUG(dbgs() << "LV: Can't vectorize due to memory conflicts\n");
@@ -3889,6 +4388,311 @@ bool LoopVectorizationLegality::canVectorize() {
   return true;
 }
 
+const SCEV *LoopVectorizationLegality::getBackedgeTakenCount() {
+  if (EarlyExitingBlock)
+    return SE->getExitCount(TheLoop, TheLoop->getLoopLatch());
+  return SE->getBackedgeTakenCount(TheLoop);
+}
+
+bool LoopVectorizationLegality::canVectorizeEarlyExit() {
+  SmallVector<BasicBlock *, 4> ExitingBlocks;
+  TheLoop->getExitingBlocks(ExitingBlocks);
+  BasicBlock *Latch = TheLoop->getLoopLatch();
+  if (ExitingBlocks.size() != 2 || !Latch)
+    return false;
+
+  if (ExitingBlocks[0] != Latch && ExitingBlocks[1] != Latch)
+    return false;
+  BasicBlock *Early =
+      ExitingBlocks[0] == Latch ? ExitingBlocks[1] : ExitingBlocks[0];
+
+  // The early exit must be checked in every iteration that reaches the latch,
+  // on a condition that we can widen.
+  BranchInst *Br = dyn_cast<BranchInst>(Early->getTerminator());
+  if (!Br || !Br->isConditional() || !DT->dominates(Early, Latch))
+    return false;
+
+  // The vector loop runs for the trip count of the latch exit, which must be
+  // a constant: we can't tell whether a symbolic bound was meant to be
+  // reached or was guarded by the early exit.
+  if (!isa<SCEVConstant>(SE->getExitCount(TheLoop, Latch)))
+    return false;
+
+  // The values the loop leaves with through the latch must not depend on the
+  // iteration, as the vector loop only computes them in the scalar loop.
+  BranchInst *LatchBr = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!LatchBr || !LatchBr->isConditional())
+    return false;
+  BasicBlock *LatchExit = TheLoop->contains(LatchBr->getSuccessor(0))
+                              ? LatchBr->getSuccessor(1)
+                              : LatchBr->getSuccessor(0);
+  for (BasicBlock::iterator I = LatchExit->begin(); isa<PHINode>(I); ++I) {
+    Value *V = cast<PHINode>(I)->getIncomingValueForBlock(Latch);
+    if (!TheLoop->isLoopInvariant(V))
+      return false;
+  }
+
+  DEBUG(dbgs() << "LV: Found an early exit in " << Early->getName() << '\n');
+  EarlyExitingBlock = Early;
+  return true;
+}
+
+bool LoopVectorizationLegality::isDereferenceableInLoop(Value *Ptr,
+                                                        uint64_t TripCount) {
+  const DataLayout &DL = TheLoop->getHeader()->getModule()->getDataLayout();
+  Instruction *CtxI = TheLoop->getLoopPreheader()->getTerminator();
+  if (TheLoop->isLoopInvariant(Ptr))
+    return isDereferenceablePointer(Ptr, DL, CtxI, DT, TLI);
+
+  // Otherwise the pointer must advance by a constant step from a base object
+  // that is dereferenceable over the whole range it covers.
+  const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(SE->getSCEV(Ptr));
+  if (!AR || AR->getLoop() != TheLoop || !AR->isAffine())
+    return false;
+  const SCEVConstant *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(*SE));
+  const SCEVUnknown *Base =
+      dyn_cast<SCEVUnknown>(SE->getPointerBase(AR->getStart()));
+  if (!Step || !Base)
+    return false;
+  const SCEVConstant *Start =
+      dyn_cast<SCEVConstant>(SE->getMinusSCEV(AR->getStart(), Base));
+  if (!Start)
+    return false;
+
+  Type *EltTy = cast<PointerType>(Ptr->getType())->getElementType();
+  int64_t EltSize = DL.getTypeStoreSize(EltTy);
+  int64_t First = Start->getValue()->getSExtValue();
+  int64_t Last =
+      First + Step->getValue()->getSExtValue() * int64_t(TripCount - 1);
+  int64_t Lo = std::min(First, Last);
+  int64_t Hi = std::max(First, Last) + EltSize;
+  if (Lo < 0)
+    return false;
+  return isDereferenceableBytes(Base->getValue(), Hi, DL, CtxI, DT, TLI);
+}
+
+bool LoopVectorizationLegality::canVectorizeEarlyExitMemory() {
+  const SCEVConstant *BTC = cast<SCEVConstant>(getBackedgeTakenCount());
+  uint64_t TripCount = BTC->getValue()->getZExtValue() + 1;
+
+  for (Loop::block_iterator BI = TheLoop->block_begin(),
+         BE = TheLoop->block_end(); BI != BE; ++BI) {
+    for (BasicBlock::iterator I = (*BI)->begin(), E = (*BI)->end(); I != E;
+         ++I) {
+      if (I->mayWriteToMemory() || I->mayThrow()) {
+        emitAnalysis(VectorizationReport(I) <<
+                     "loop with an early exit writes to memory");
+        return false;
+      }
+
+      if (LoadInst *Ld = dyn_cast<LoadInst>(I)) {
+        if (!Ld->isSimple() ||
+            !isDereferenceableInLoop(Ld->getPointerOperand(), TripCount)) {
+          emitAnalysis(VectorizationReport(I) <<
+                       "load past the early exit may not be dereferenceable");
+          return false;
+        }
+        continue;
+      }
+
+      if (isa<PHINode>(I) || isa<BranchInst>(I))
+        continue;
+      if (I->mayReadFromMemory() || !isSafeToSpeculativelyExecute(I)) {
+        emitAnalysis(VectorizationReport(I) <<
+                     "instruction past the early exit cannot be speculated");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool LoopVectorizationLegality::canVectorizeOuterLoop() {
+  // We must have a loop in canonical form with a single backedge, which is
+  // tested at the bottom of the loop.
+  if (!TheLoop->getLoopPreheader() || TheLoop->getNumBackEdges() != 1 ||
+      TheLoop->getExitingBlock() != TheLoop->getLoopLatch()) {
+    emitAnalysis(
+        VectorizationReport() <<
+        "loop control flow is not understood by vectorizer");
+    return false;
+  }
+
+  // The loop must contain a single innermost loop of one block.
+  if (TheLoop->getSubLoops().size() != 1) {
+    emitAnalysis(VectorizationReport() <<
+                 "outer loop does not contain exactly one inner loop");
+    return false;
+  }
+  Loop *Inner = TheLoop->getSubLoops().front();
+  if (!Inner->empty() || Inner->getNumBlocks() != 1 ||
+      !Inner->getLoopPreheader() || !Inner->getExitBlock() ||
+      !isa<BranchInst>(Inner->getHeader()->getTerminator())) {
+    emitAnalysis(VectorizationReport() <<
+                 "inner loop control flow is not understood by vectorizer");
+    return false;
+  }
+
+  DEBUG(dbgs() << "LV: Found an outer loop: " <<
+        TheLoop->getHeader()->getName() << '\n');
+
+  // All the lanes must leave the inner loop in the same iteration, so that
+  // its control flow does not diverge.
+  const SCEV *InnerCount = SE->getBackedgeTakenCount(Inner);
+  if (InnerCount == SE->getCouldNotCompute() ||
+      !SE->isLoopInvariant(InnerCount, TheLoop)) {
+    emitAnalysis(VectorizationReport() <<
+                 "inner loop trip count varies with the outer loop");
+    return false;
+  }
+
+  // ScalarEvolution needs to be able to find the exit count.
+  const SCEV *ExitCount = SE->getBackedgeTakenCount(TheLoop);
+  if (ExitCount == SE->getCouldNotCompute()) {
+    emitAnalysis(VectorizationReport() <<
+                 "could not determine number of loop iterations");
+    return false;
+  }
+
+  // We don't if-convert outer loops: apart from the inner loop, every block
+  // has to execute in each iteration.
+  for (Loop::block_iterator BI = TheLoop->block_begin(),
+         BE = TheLoop->block_end(); BI != BE; ++BI) {
+    BasicBlock *BB = *BI;
+    if (!isa<BranchInst>(BB->getTerminator()) || blockNeedsPredication(BB)) {
+      emitAnalysis(VectorizationReport(BB->getTerminator())
+                   << "control flow in the outer loop cannot be vectorized");
+      return false;
+    }
+  }
+
+  if (!canVectorizeInstrs()) {
+    DEBUG(dbgs() << "LV: Can't vectorize the instructions or CFG\n");
+    return false;
+  }
+
+  if (!Reductions.empty()) {
+    emitAnalysis(VectorizationReport() <<
+                 "reductions in outer loops are not supported");
+    return false;
+  }
+
+  // Symbolic strides are only versioned for innermost loops.
+  Strides.clear();
+  StrideSet.clear();
+
+  if (!canVectorizeOuterLoopMemory()) {
+    DEBUG(dbgs() << "LV: Can't vectorize due to memory conflicts\n");
+    return false;
+  }
+
+  // Collect all of the variables that remain uniform after vectorization.
+  collectLoopUniforms();
+
+  DEBUG(dbgs() << "LV: We can vectorize this outer loop!\n");
+  return true;
+}
+
+bool LoopVectorizationLegality::canVectorizeOuterLoopMemory() {
+  const DataLayout &DL = TheFunction->getParent()->getDataLayout();
+  Loop *Inner = TheLoop->getSubLoops().front();
+  SmallVector<Instruction *, 16> Accesses;
+  SmallVector<StoreInst *, 8> Stores;
+
+  for (Loop::block_iterator BI = TheLoop->block_begin(),
+         BE = TheLoop->block_end(); BI != BE; ++BI)
+    for (Instruction &I : **BI) {
+      if (!I.mayReadOrWriteMemory())
+        continue;
+      if (LoadInst *Ld = dyn_cast<LoadInst>(&I)) {
+        if (Ld->isSimple()) {
+          Accesses.push_back(Ld);
+          continue;
+        }
+      } else if (StoreInst *St = dyn_cast<StoreInst>(&I)) {
+        if (St->isSimple()) {
+          Accesses.push_back(St);
+          Stores.push_back(St);
+          continue;
+        }
+      } else if (!I.mayWriteToMemory()) {
+        // Many math library functions read the rounding mode.
+        CallInst *Call = dyn_cast<CallInst>(&I);
+        if (Call && getIntrinsicIDForCall(Call, TLI))
+          continue;
+      }
+      emitAnalysis(VectorizationReport(&I) <<
+                   "instruction accesses memory in a way that cannot be "
+                   "vectorized in an outer loop");
+      return false;
+    }
+
+  // The user asserted that the outer iterations are independent.
+  if (TheLoop->isAnnotatedParallel())
+    return true;
+
+  for (StoreInst *St : Stores) {
+    Value *Ptr = St->getPointerOperand();
+    const SCEV *PtrSCEV = SE->getSCEV(Ptr);
+    if (!isConsecutivePtr(Ptr) || !SE->isLoopInvariant(PtrSCEV, Inner)) {
+      emitAnalysis(VectorizationReport(St) <<
+                   "store address is not consecutive in the outer loop");
+      return false;
+    }
+
+    uint64_t Size = DL.getTypeStoreSize(St->getValueOperand()->getType());
+    for (Instruction *I : Accesses) {
+      if (I == St)
+        continue;
+      Value *OtherPtr = isa<LoadInst>(I)
+                            ? cast<LoadInst>(I)->getPointerOperand()
+                            : cast<StoreInst>(I)->getPointerOperand();
+      Type *OtherTy = cast<PointerType>(OtherPtr->getType())->getElementType();
+      // An access to the very same address is only ever made by the lane
+      // that stores to it, so it keeps its order with the store.
+      if (SE->getSCEV(OtherPtr) == PtrSCEV &&
+          DL.getTypeStoreSize(OtherTy) == Size)
+        continue;
+      if (AA->alias(MemoryLocation(Ptr), MemoryLocation(OtherPtr)) == NoAlias)
+        continue;
+      emitAnalysis(VectorizationReport(St) <<
+                   "cannot prove that the outer loop iterations access "
+                   "independent memory");
+      return false;
+    }
+  }
+  return true;
+}
+
+namespace {
+/// Finds out whether a SCEV depends on the iteration of a loop, either
+/// through a recurrence of the loop or through a value computed in it.
+struct SCEVLoopVariance {
+  SCEVLoopVariance(const Loop *L) : L(L), IsVariant(false) {}
+
+  bool follow(const SCEV *S) {
+    if (const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr>(S))
+      IsVariant |= AR->getLoop() == L;
+    else if (const SCEVUnknown *U = dyn_cast<SCEVUnknown>(S))
+      if (Instruction *I = dyn_cast<Instruction>(U->getValue()))
+        IsVariant |= L->contains(I);
+    return !IsVariant;
+  }
+  bool isDone() const { return IsVariant; }
+
+  const Loop *L;
+  bool IsVariant;
+};
+}
+
+bool LoopVectorizationLegality::isOuterLoopUniform(Value *V) {
+  if (!SE->isSCEVable(V->getType()))
+    return false;
+  SCEVLoopVariance Variance(TheLoop);
+  visitAll(SE->getSCEV(V), Variance);
+  return !Variance.IsVariant;
+}
+
 static Type *convertPointerToIntegerType(const DataLayout &DL, Type *Ty) {
   if (Ty->isPointerTy())
     return DL.getIntPtrType(Ty);
@@ -3910,15 +4714,20 @@ static Type* getWiderType(const DataLayout &DL, Type *Ty0, Type *Ty1) {
 }
 
 /// \brief Check that the instruction has outside loop users and is not an
-/// identified reduction variable.
+/// identified reduction variable. Values leaving the loop through the early
+/// exit of \p EarlyExiting are computed by the scalar loop and are allowed.
 static bool hasOutsideLoopUser(const Loop *TheLoop, Instruction *Inst,
-                               SmallPtrSetImpl<Value *> &Reductions) {
+                               SmallPtrSetImpl<Value *> &Reductions,
+                               BasicBlock *EarlyExiting) {
   // Reduction instructions are allowed to have exit users. All other
   // instructions must not have external users.
   if (!Reductions.count(Inst))
     //Check that all of the users of the loop are inside the BB.
-    for (User *U : Inst->users()) {
-      Instruction *UI = cast<Instruction>(U);
+    for (Use &U : Inst->uses()) {
+      Instruction *UI = cast<Instruction>(U.getUser());
+      PHINode *PN = dyn_cast<PHINode>(UI);
+      if (PN && EarlyExiting && PN->getIncomingBlock(U) == EarlyExiting)
+        continue;
       // This user may be a reduction exit value.
       if (!TheLoop->contains(UI)) {
         DEBUG(dbgs() << "LV: Found an outside user for : " << *UI << '\n');
@@ -3965,7 +4774,8 @@ bool LoopVectorizationLegality::canVectorizeInstrs() {
         if (*bb != Header) {
           // Check that this instruction has no outside users or is an
           // identified reduction value with an outside user.
-          if (!hasOutsideLoopUser(TheLoop, it, AllowedExit))
+          if (!hasOutsideLoopUser(TheLoop, it, AllowedExit,
+                                  EarlyExitingBlock))
             continue;
           emitAnalysis(VectorizationReport(it) <<
                        "value could not be identified as "
@@ -4008,7 +4818,8 @@ bool LoopVectorizationLegality::canVectorizeInstrs() {
 
           // Until we explicitly handle the case of an induction variable with
           // an outside loop user we have to give up vectorizing this loop.
-          if (hasOutsideLoopUser(TheLoop, it, AllowedExit)) {
+          if (hasOutsideLoopUser(TheLoop, it, AllowedExit,
+                                 EarlyExitingBlock)) {
             emitAnalysis(VectorizationReport(it) <<
                          "use of induction value outside of the "
                          "loop is not handled by vectorizer");
@@ -4085,7 +4896,7 @@ bool LoopVectorizationLegality::canVectorizeInstrs() {
 
       // Reduction instructions are allowed to have exit users.
       // All other instructions must not have external users.
-      if (hasOutsideLoopUser(TheLoop, it, AllowedExit)) {
+      if (hasOutsideLoopUser(TheLoop, it, AllowedExit, EarlyExitingBlock)) {
         emitAnalysis(VectorizationReport(it) <<
                      "value cannot be used outside the loop");
         return false;
@@ -4235,7 +5046,13 @@ bool LoopVectorizationLegality::blockCanBePredicated(BasicBlock *BB,
       if (!LI)
         return false;
       if (!SafePtrs.count(LI->getPointerOperand())) {
-        if (isLegalMaskedLoad(LI->getType(), LI->getPointerOperand())) {
+        // A load from a loop invariant address is scalarized without its
+        // predicate rather than gathered, so it can't be masked.
+        bool isLegalMaskedOp =
+          isLegalMaskedLoad(LI->getType(), LI->getPointerOperand()) ||
+          (isLegalMaskedGather(LI->getType()) &&
+           !isUniform(LI->getPointerOperand()));
+        if (isLegalMaskedOp) {
           MaskedOp.insert(LI);
           continue;
         }
@@ -4260,7 +5077,8 @@ bool LoopVectorizationLegality::blockCanBePredicated(BasicBlock *BB,
         // the block.
         bool isLegalMaskedOp =
           isLegalMaskedStore(SI->getValueOperand()->getType(),
-                             SI->getPointerOperand());
+                             SI->getPointerOperand()) ||
+          isLegalMaskedScatter(SI->getValueOperand()->getType());
         if (isLegalMaskedOp) {
           --NumPredStores;
           MaskedOp.insert(SI);
@@ -4450,7 +5268,8 @@ LoopVectorizationCostModel::VectorizationFactor
 LoopVectorizationCostModel::selectVectorizationFactor(bool OptForSize) {
   // Width 1 means no vectorize
   VectorizationFactor Factor = { 1U, 0U };
-  if (OptForSize && Legal->getRuntimePointerChecking()->Need) {
+  const RuntimePointerChecking *PtrChecking = Legal->getRuntimePointerChecking();
+  if (OptForSize && PtrChecking && PtrChecking->Need) {
     emitAnalysis(VectorizationReport() <<
                  "runtime pointer checks needed. Enable vectorization of this "
                  "loop with '#pragma clang loop vectorize(enable)' when "
@@ -4628,6 +5447,10 @@ unsigned LoopVectorizationCostModel::selectInterleaveCount(bool OptForSize,
   // 3. We don't interleave if we think that we will spill registers to memory
   // due to the increased register pressure.
 
+  // The exit of a loop with an early exit is located within a single vector.
+  if (Legal->getEarlyExitingBlock())
+    return 1;
+
   // Use the user preference, unless 'auto' is selected.
   int UserUF = Hints->getInterleave();
   if (UserUF != 0)
@@ -4921,6 +5744,11 @@ unsigned LoopVectorizationCostModel::expectedCost(unsigned VF) {
     if (VF == 1 && Legal->blockNeedsPredication(*bb))
       BlockCost /= 2;
 
+    // The blocks of an inner loop run once per iteration of that loop.
+    Loop *BBLoop = LI->getLoopFor(BB);
+    if (BBLoop != TheLoop)
+      BlockCost *= getInnerLoopTripCountEstimate(SE, BBLoop);
+
     Cost += BlockCost;
   }
 
@@ -5005,6 +5833,14 @@ LoopVectorizationCostModel::getInstructionCost(Instruction *I, unsigned VF) {
     // instruction cost.
     return 0;
   case Instruction::Br: {
+    // The early exit tests whether any lane of the widened condition is set.
+    if (VF > 1 && I->getParent() == Legal->getEarlyExitingBlock()) {
+      Type *MaskTy = VectorType::get(Type::getInt1Ty(I->getContext()), VF);
+      Type *BitsTy = IntegerType::get(I->getContext(), VF);
+      return TTI.getCFInstrCost(I->getOpcode()) +
+             TTI.getCastInstrCost(Instruction::BitCast, BitsTy, MaskTy) +
+             TTI.getCmpSelInstrCost(Instruction::ICmp, BitsTy);
+    }
     return TTI.getCFInstrCost(I->getOpcode());
   }
   case Instruction::PHI:
@@ -5144,6 +5980,21 @@ LoopVectorizationCostModel::getInstructionCost(Instruction *I, unsigned VF) {
     const DataLayout &DL = I->getModule()->getDataLayout();
     unsigned ScalarAllocatedSize = DL.getTypeAllocSize(ValTy);
     unsigned VectorElementSize = DL.getTypeStoreSize(VectorTy) / VF;
+    bool UniformLoad = LI && Legal->isUniform(Ptr);
+    // Loaded once and broadcast; see vectorizeMemoryInstruction.
+    if (UniformLoad && this->LI->getLoopFor(I->getParent()) != TheLoop)
+      return TTI.getAddressComputationCost(ValTy) +
+             TTI.getMemoryOpCost(I->getOpcode(), ValTy, Alignment, AS) +
+             TTI.getShuffleCost(TargetTransformInfo::SK_Broadcast, VectorTy,
+                                0);
+    if (!ConsecutiveStride && !UniformLoad &&
+        ScalarAllocatedSize == VectorElementSize &&
+        ((LI && Legal->isLegalMaskedGather(ValTy)) ||
+         (SI && Legal->isLegalMaskedScatter(ValTy))))
+      return TTI.getAddressComputationCost(VectorTy) +
+             TTI.getGatherScatterOpCost(I->getOpcode(), VectorTy, Ptr,
+                                        Legal->isMaskRequired(I), Alignment);
+
     if (!ConsecutiveStride || ScalarAllocatedSize != VectorElementSize) {
       bool IsComplexComputation =
         isLikelyComplexAddressComputation(Ptr, Legal, SE, TheLoop);
@@ -5402,3 +6253,122 @@ Value *InnerLoopUnroller::getStepVector(Value *Val, int StartIdx, Value *Step) {
   Constant *C = ConstantInt::get(ITy, StartIdx);
   return Builder.CreateAdd(Val, Builder.CreateMul(C, Step), "induction");
 }
+
+void OuterLoopVectorizer::vectorizeLoop() {
+  // Outer loops have no reductions, so no PHIs are left to fix.
+  PhiVector PHIsToFix;
+  Loop *Inner = OrigLoop->getSubLoops().front();
+
+  // Scan the loop nest in a topological order to ensure that defs are
+  // vectorized before users. The inner loop is emitted as a whole when its
+  // header is reached.
+  LoopBlocksDFS DFS(OrigLoop);
+  DFS.perform(LI);
+
+  for (LoopBlocksDFS::RPOIterator bb = DFS.beginRPO(),
+       be = DFS.endRPO(); bb != be; ++bb) {
+    if (*bb == Inner->getHeader())
+      vectorizeInnerLoop(Inner, &PHIsToFix);
+    else
+      vectorizeBlockInLoop(*bb, &PHIsToFix);
+  }
+  assert(PHIsToFix.empty() && "Unexpected reduction in an outer loop");
+
+  fixLCSSAPHIs();
+
+  // Remove redundant induction instructions.
+  cse(LoopVectorBody);
+}
+
+void OuterLoopVectorizer::vectorizeInnerLoop(Loop *Inner, PhiVector *PV) {
+  BasicBlock *InnerBB = Inner->getHeader();
+  BasicBlock *InnerPH = Inner->getLoopPreheader();
+  BranchInst *InnerBr = cast<BranchInst>(InnerBB->getTerminator());
+
+  // Split the vector body at the insertion point. The code that follows,
+  // including the latch of the vector loop, moves to the new block, which
+  // becomes the vectorized inner loop.
+  BasicBlock *EntryBB = Builder.GetInsertBlock();
+  InnerVectorBody =
+      EntryBB->splitBasicBlock(Builder.GetInsertPoint(), "vector.inner.body");
+  LoopVectorBody.push_back(InnerVectorBody);
+  Builder.SetInsertPoint(InnerVectorBody->getFirstInsertionPt());
+
+  // Create the vector PHIs of the inner loop. Their backedge values are added
+  // once the body is vectorized.
+  for (BasicBlock::iterator I = InnerBB->begin(); isa<PHINode>(I); ++I) {
+    PHINode *P = cast<PHINode>(I);
+    VectorParts &Entry = WidenMap.get(P);
+    VectorParts &Start = getVectorValue(P->getIncomingValueForBlock(InnerPH));
+    for (unsigned Part = 0; Part < UF; ++Part) {
+      PHINode *VecPhi =
+          PHINode::Create(VectorType::get(P->getType(), VF), 2, "vec.phi",
+                          InnerVectorBody->getFirstInsertionPt());
+      VecPhi->addIncoming(Start[Part], EntryBB);
+      Entry[Part] = VecPhi;
+    }
+  }
+
+  vectorizeBlockInLoop(InnerBB, PV);
+
+  // All the lanes leave the inner loop in the same iteration, so the exit
+  // condition of the first lane decides for all of them.
+  Value *Cond = getVectorValue(InnerBr->getCondition())[0];
+  Cond = Builder.CreateExtractElement(Cond, Builder.getInt32(0));
+  InnerVectorExit = InnerVectorBody->splitBasicBlock(Builder.GetInsertPoint(),
+                                                     "vector.inner.exit");
+  LoopVectorBody.push_back(InnerVectorExit);
+  if (InnerBr->getSuccessor(0) == InnerBB)
+    ReplaceInstWithInst(InnerVectorBody->getTerminator(),
+                        BranchInst::Create(InnerVectorBody, InnerVectorExit,
+                                           Cond));
+  else
+    ReplaceInstWithInst(InnerVectorBody->getTerminator(),
+                        BranchInst::Create(InnerVectorExit, InnerVectorBody,
+                                           Cond));
+  Builder.SetInsertPoint(InnerVectorExit->getFirstInsertionPt());
+
+  for (BasicBlock::iterator I = InnerBB->begin(); isa<PHINode>(I); ++I) {
+    PHINode *P = cast<PHINode>(I);
+    VectorParts &Entry = WidenMap.get(P);
+    VectorParts &Next = getVectorValue(P->getIncomingValueForBlock(InnerBB));
+    for (unsigned Part = 0; Part < UF; ++Part)
+      cast<PHINode>(Entry[Part])->addIncoming(Next[Part], InnerVectorBody);
+  }
+
+  // Register the vectorized inner loop.
+  Loop *VectorLoop = LI->getLoopFor(LoopVectorBody[0]);
+  Loop *VectorInner = new Loop();
+  VectorLoop->addChildLoop(VectorInner);
+  VectorInner->addBasicBlockToLoop(InnerVectorBody, *LI);
+  VectorLoop->addBasicBlockToLoop(InnerVectorExit, *LI);
+
+  LoopVectorizeHints Hints(VectorInner, true);
+  Hints.setAlreadyVectorized();
+}
+
+InnerLoopVectorizer::VectorParts
+OuterLoopVectorizer::createBlockInMask(BasicBlock *BB) {
+  // No block of the loop nest is predicated.
+  Value *C = ConstantInt::get(IntegerType::getInt1Ty(BB->getContext()), 1);
+  return getVectorValue(C);
+}
+
+void OuterLoopVectorizer::widenPHIInstruction(Instruction *PN,
+                                              VectorParts &Entry, unsigned UF,
+                                              unsigned VF, PhiVector *PV) {
+  BasicBlock *BB = PN->getParent();
+  // The inductions of the outer loop are widened as usual.
+  if (BB == OrigLoop->getHeader())
+    return InnerLoopVectorizer::widenPHIInstruction(PN, Entry, UF, VF, PV);
+
+  // The PHIs of the inner loop header were created with the inner loop.
+  if (LI->isLoopHeader(BB))
+    return;
+
+  // Anything else is an LCSSA PHI of the inner loop, since outer loops are
+  // not if-converted.
+  PHINode *P = cast<PHINode>(PN);
+  assert(P->getNumIncomingValues() == 1 && "Unexpected PHI in an outer loop");
+  Entry = getVectorValue(P->getIncomingValue(0));
+}
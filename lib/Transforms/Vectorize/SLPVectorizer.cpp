@@ -36,6 +36,7 @@
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/NoFolder.h"
+#include "llvm/IR/PatternMatch.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Verifier.h"
@@ -44,6 +45,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/VectorUtils.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
 #include <algorithm>
 #include <map>
 #include <memory>
@@ -54,6 +56,7 @@ using namespace llvm;
 #define DEBUG_TYPE "SLP"
 
 STATISTIC(NumVectorInstructions, "Number of vector instructions generated");
+STATISTIC(NumSunkStores, "Number of stores moved into a later block");
 
 static cl::opt<int>
     SLPCostThreshold("slp-threshold", cl::init(0), cl::Hidden,
@@ -69,6 +72,11 @@ static cl::opt<bool> ShouldStartVectorizeHorAtStore(
     cl::desc(
         "Attempt to vectorize horizontal reductions feeding into a store"));
 
+static cl::opt<bool> ShouldSinkStoresAcrossBlocks(
+    "slp-cross-block-stores", cl::init(true), cl::Hidden,
+    cl::desc("Attempt to vectorize store chains that are split by an "
+             "if-then or if-then-else"));
+
 static cl::opt<int>
 MaxVectorRegSizeOption("slp-max-reg-size", cl::init(128), cl::Hidden,
     cl::desc("Attempt to vectorize for this register size in bits"));
@@ -365,8 +373,10 @@ public:
   int getSpillCost();
 
   /// \returns the vectorization cost of the subtree that starts at \p VL.
-  /// A negative number means that this is profitable.
-  int getTreeCost();
+  /// A negative number means that this is profitable. The operands of a
+  /// horizontal reduction (\p IsReduction) are worth vectorizing even if they
+  /// form a single bundle.
+  int getTreeCost(bool IsReduction = false);
 
   /// Construct a vectorizable tree that starts at \p Roots, ignoring users for
   /// the purpose of scheduling and extraction in the \p UserIgnoreLst.
@@ -443,7 +453,7 @@ private:
 
   /// \returns whether the VectorizableTree is fully vectoriable and will
   /// be beneficial even the tree height is tiny.
-  bool isFullyVectorizableTinyTree();
+  bool isFullyVectorizableTinyTree(bool IsReduction);
 
   /// \reorder commutative operands in alt shuffle if they result in
   ///  vectorized code.
@@ -1634,10 +1644,14 @@ int BoUpSLP::getEntryCost(TreeEntry *E) {
   }
 }
 
-bool BoUpSLP::isFullyVectorizableTinyTree() {
+bool BoUpSLP::isFullyVectorizableTinyTree(bool IsReduction) {
   DEBUG(dbgs() << "SLP: Check whether the tree with height " <<
         VectorizableTree.size() << " is fully vectorizable .\n");
 
+  // The reduction replaces the users of a single bundle.
+  if (IsReduction && VectorizableTree.size() == 1)
+    return !VectorizableTree[0].NeedToGather;
+
   // We only handle trees of height 2.
   if (VectorizableTree.size() != 2)
     return false;
@@ -1717,13 +1731,14 @@ int BoUpSLP::getSpillCost() {
   return Cost;
 }
 
-int BoUpSLP::getTreeCost() {
+int BoUpSLP::getTreeCost(bool IsReduction) {
   int Cost = 0;
   DEBUG(dbgs() << "SLP: Calculating cost for tree of size " <<
         VectorizableTree.size() << ".\n");
 
   // We only vectorize tiny trees if it is fully vectorizable.
-  if (VectorizableTree.size() < 3 && !isFullyVectorizableTinyTree()) {
+  if (VectorizableTree.size() < 3 &&
+      !isFullyVectorizableTinyTree(IsReduction)) {
     if (VectorizableTree.empty()) {
       assert(!ExternalUses.size() && "We should not have any external users");
     }
@@ -3119,12 +3134,21 @@ struct SLPVectorizer : public FunctionPass {
 
     // Scan the blocks in the function in post order.
     for (auto BB : post_order(&F.getEntryBlock())) {
+      // Move stores that are split from a chain by control flow into the
+      // block that holds the rest of the chain. The move is undone below if
+      // none of them gets vectorized.
+      SmallVector<std::pair<StoreInst *, Instruction *>, 8> SunkStores;
+      if (ShouldSinkStoresAcrossBlocks)
+        sinkStoresIntoBlock(BB, R, SunkStores);
+
       // Vectorize trees that end at stores.
       if (unsigned count = collectStores(BB, R)) {
         (void)count;
         DEBUG(dbgs() << "SLP: Found " << count << " stores to vectorize.\n");
         Changed |= vectorizeStoreChains(R);
       }
+      if (!SunkStores.empty())
+        restoreSunkStores(SunkStores);
 
       // Vectorize trees that end at reductions.
       Changed |= vectorizeChainsInBlock(BB, R);
@@ -3159,6 +3183,20 @@ private:
   /// if we flush the chain creation every time we run into a memory barrier.
   unsigned collectStores(BasicBlock *BB, BoUpSLP &R);
 
+  /// \brief Move the stores at the end of the block that \p BB is control
+  /// equivalent to into \p BB, if they are consecutive with a store in \p BB
+  /// and no memory access between them and \p BB conflicts with them.
+  /// Each moved store is added to \p Sunk along with the instruction that
+  /// followed it.
+  void sinkStoresIntoBlock(
+      BasicBlock *BB, BoUpSLP &R,
+      SmallVectorImpl<std::pair<StoreInst *, Instruction *>> &Sunk);
+
+  /// \brief Move the stores moved by sinkStoresIntoBlock back where they came
+  /// from, unless one of them was vectorized.
+  void restoreSunkStores(
+      ArrayRef<std::pair<StoreInst *, Instruction *>> Sunk);
+
   /// \brief Try to vectorize a chain that starts at two arithmetic instrs.
   bool tryToVectorizePair(Value *A, Value *B, BoUpSLP &R);
 
@@ -3201,6 +3239,16 @@ static bool hasValueBeenRAUWed(ArrayRef<Value *> VL, ArrayRef<WeakVH> VH,
   return !std::equal(VL.begin(), VL.end(), VH.begin());
 }
 
+/// \brief Returns the number of insertelement instructions that \p IE builds
+/// on, i.e. its position in a build vector sequence.
+static unsigned getBuildVectorPosition(Value *IE) {
+  unsigned Pos = 0;
+  while ((IE = dyn_cast<InsertElementInst>(
+              cast<InsertElementInst>(IE)->getOperand(0))))
+    ++Pos;
+  return Pos;
+}
+
 bool SLPVectorizer::vectorizeStoreChain(ArrayRef<Value *> Chain,
                                         int CostThreshold, BoUpSLP &R,
                                         unsigned VecRegSize) {
@@ -3338,6 +3386,147 @@ unsigned SLPVectorizer::collectStores(BasicBlock *BB, BoUpSLP &R) {
   return count;
 }
 
+/// \brief Returns the block that always branches to \p BB, either directly or
+/// through an if-then or if-then-else whose blocks are added to \p Side.
+static BasicBlock *
+getControlEquivalentHead(BasicBlock *BB, SmallVectorImpl<BasicBlock *> &Side) {
+  SmallSetVector<BasicBlock *, 4> Preds(pred_begin(BB), pred_end(BB));
+  if (Preds.size() == 1) {
+    BasicBlock *Head = Preds[0];
+    return Head->getTerminator()->getNumSuccessors() == 1 ? Head : nullptr;
+  }
+  if (Preds.size() != 2)
+    return nullptr;
+
+  // A side block is only entered from the head and only leaves to BB.
+  auto IsSideOf = [BB](BasicBlock *S, BasicBlock *Head) {
+    return S != Head && S->getSinglePredecessor() == Head &&
+           S->getTerminator()->getNumSuccessors() == 1 &&
+           S->getTerminator()->getSuccessor(0) == BB;
+  };
+
+  for (unsigned I = 0; I != 2; ++I) {
+    BasicBlock *Head = Preds[I], *Other = Preds[1 - I];
+    // if-then: Head branches to BB and to the side block.
+    if (IsSideOf(Other, Head)) {
+      Side.push_back(Other);
+      break;
+    }
+    // if-then-else: both predecessors are side blocks of a common head.
+    Head = Other->getSinglePredecessor();
+    if (Head && IsSideOf(Preds[0], Head) && IsSideOf(Preds[1], Head)) {
+      Side.push_back(Preds[0]);
+      Side.push_back(Preds[1]);
+      break;
+    }
+  }
+  if (Side.empty())
+    return nullptr;
+
+  BasicBlock *Head = Side[0]->getSinglePredecessor();
+  TerminatorInst *TI = Head->getTerminator();
+  if (TI->getNumSuccessors() != 2 || isa<InvokeInst>(TI))
+    return nullptr;
+  return Head;
+}
+
+void SLPVectorizer::sinkStoresIntoBlock(
+    BasicBlock *BB, BoUpSLP &R,
+    SmallVectorImpl<std::pair<StoreInst *, Instruction *>> &Moved) {
+  if (BB->isLandingPad() || LI->isLoopHeader(BB))
+    return;
+
+  SmallVector<BasicBlock *, 2> Side;
+  BasicBlock *Head = getControlEquivalentHead(BB, Side);
+  if (!Head || Head == BB || LI->getLoopFor(Head) != LI->getLoopFor(BB))
+    return;
+
+  const DataLayout &DL = BB->getModule()->getDataLayout();
+  SmallVector<StoreInst *, 8> Stores;
+  for (Instruction &I : *BB)
+    if (StoreInst *SI = dyn_cast<StoreInst>(&I))
+      if (SI->isSimple() &&
+          isValidElementType(SI->getValueOperand()->getType()))
+        Stores.push_back(SI);
+  if (Stores.empty())
+    return;
+
+  // The memory accesses that a store moves across.
+  SmallVector<Instruction *, 8> Crossed;
+  for (BasicBlock *S : Side)
+    for (Instruction &I : *S) {
+      if (I.mayThrow())
+        return;
+      if (I.mayReadOrWriteMemory())
+        Crossed.push_back(&I);
+    }
+
+  auto IsConsecutive = [&](StoreInst *SI) {
+    for (StoreInst *Other : Stores)
+      if (R.isConsecutiveAccess(SI, Other, DL) ||
+          R.isConsecutiveAccess(Other, SI, DL))
+        return true;
+    return false;
+  };
+  auto Conflicts = [&](StoreInst *SI) {
+    MemoryLocation Loc = MemoryLocation::get(SI);
+    for (Instruction *I : Crossed)
+      if (AA->getModRefInfo(I, Loc) != AliasAnalysis::NoModRef)
+        return true;
+    return false;
+  };
+
+  // Walk up from the end of the head, collecting the stores to move.
+  SmallVector<StoreInst *, 8> Sunk;
+  for (BasicBlock::iterator I = Head->getTerminator(), E = Head->begin();
+       I != E;) {
+    --I;
+    if (Crossed.size() > AliasedCheckLimit || I->mayThrow())
+      break;
+    StoreInst *SI = dyn_cast<StoreInst>(I);
+    if (SI && SI->isSimple() &&
+        isValidElementType(SI->getValueOperand()->getType()) &&
+        IsConsecutive(SI) && !Conflicts(SI)) {
+      Sunk.push_back(SI);
+      // Later stores of the chain may be consecutive with this one.
+      Stores.push_back(SI);
+      continue;
+    }
+    if (I->mayReadOrWriteMemory())
+      Crossed.push_back(I);
+  }
+  if (Sunk.empty())
+    return;
+
+  // Sunk is ordered bottom up, so each store is followed by an instruction
+  // that is either not moved or is restored before it.
+  for (StoreInst *SI : Sunk)
+    Moved.push_back(std::make_pair(SI, SI->getNextNode()));
+
+  Instruction *InsertBefore = BB->getFirstInsertionPt();
+  for (auto It = Sunk.rbegin(), E = Sunk.rend(); It != E; ++It) {
+    StoreInst *SI = *It;
+    DEBUG(dbgs() << "SLP: Moving " << *SI << " into " << BB->getName()
+                 << ".\n");
+    SI->moveBefore(InsertBefore);
+  }
+}
+
+void SLPVectorizer::restoreSunkStores(
+    ArrayRef<std::pair<StoreInst *, Instruction *>> Sunk) {
+  // Vectorized stores have been removed from their block.
+  for (auto &P : Sunk)
+    if (!P.first->getParent()) {
+      NumSunkStores += Sunk.size();
+      return;
+    }
+
+  for (auto &P : Sunk) {
+    DEBUG(dbgs() << "SLP: Moving " << *P.first << " back.\n");
+    P.first->moveBefore(P.second);
+  }
+}
+
 bool SLPVectorizer::tryToVectorizePair(Value *A, Value *B, BoUpSLP &R) {
   if (!A || !B)
     return false;
@@ -3423,17 +3612,26 @@ bool SLPVectorizer::tryToVectorizeList(ArrayRef<Value *> VL, BoUpSLP &R,
       // way we handle the case where some elements of the vector are undefined.
       //  (return (inserelt <4 xi32> (insertelt undef (opd0) 0) (opd1) 2))
       if (!BuildVectorSlice.empty()) {
+        // The build vector may insert the lanes out of order. Rebuild it in
+        // program order, extracting the lane each instruction inserted.
+        SmallVector<std::pair<unsigned, unsigned>, 16> Inserts;
+        for (unsigned Lane = 0, E = BuildVectorSlice.size(); Lane != E; ++Lane)
+          Inserts.push_back(std::make_pair(
+              getBuildVectorPosition(BuildVectorSlice[Lane]), Lane));
+        std::sort(Inserts.begin(), Inserts.end());
+
         // The insert point is the last build vector instruction. The vectorized
         // root will precede it. This guarantees that we get an instruction. The
         // vectorized tree could have been constant folded.
-        Instruction *InsertAfter = cast<Instruction>(BuildVectorSlice.back());
-        unsigned VecIdx = 0;
-        for (auto &V : BuildVectorSlice) {
+        Instruction *InsertAfter =
+            cast<Instruction>(BuildVectorSlice[Inserts.back().second]);
+        for (auto &P : Inserts) {
           IRBuilder<true, NoFolder> Builder(
               ++BasicBlock::iterator(InsertAfter));
-          InsertElementInst *IE = cast<InsertElementInst>(V);
+          InsertElementInst *IE =
+              cast<InsertElementInst>(BuildVectorSlice[P.second]);
           Instruction *Extract = cast<Instruction>(Builder.CreateExtractElement(
-              VectorizedRoot, Builder.getInt32(VecIdx++)));
+              VectorizedRoot, Builder.getInt32(P.second)));
           IE->setOperand(1, Extract);
           IE->removeFromParent();
           IE->insertAfter(Extract);
@@ -3516,11 +3714,34 @@ static Value *createRdxShuffleMask(unsigned VecLen, unsigned NumEltsToRdx,
 }
 
 
+/// \brief Returns the kind of integer min/max that the select(icmp()) \p V
+/// computes, or MRK_Invalid if \p V isn't such a select.
+static RecurrenceDescriptor::MinMaxRecurrenceKind getMinMaxKind(Value *V) {
+  SelectInst *Select = dyn_cast<SelectInst>(V);
+  if (!Select)
+    return RecurrenceDescriptor::MRK_Invalid;
+  ICmpInst *Cmp = dyn_cast<ICmpInst>(Select->getCondition());
+  if (!Cmp || !Cmp->hasOneUse())
+    return RecurrenceDescriptor::MRK_Invalid;
+
+  using namespace PatternMatch;
+  Value *L, *R;
+  if (match(Select, m_SMax(m_Value(L), m_Value(R))))
+    return RecurrenceDescriptor::MRK_SIntMax;
+  if (match(Select, m_SMin(m_Value(L), m_Value(R))))
+    return RecurrenceDescriptor::MRK_SIntMin;
+  if (match(Select, m_UMax(m_Value(L), m_Value(R))))
+    return RecurrenceDescriptor::MRK_UIntMax;
+  if (match(Select, m_UMin(m_Value(L), m_Value(R))))
+    return RecurrenceDescriptor::MRK_UIntMin;
+  return RecurrenceDescriptor::MRK_Invalid;
+}
+
 /// Model horizontal reductions.
 ///
-/// A horizontal reduction is a tree of reduction operations (currently add and
-/// fadd) that has operations that can be put into a vector as its leaf.
-/// For example, this tree:
+/// A horizontal reduction is a tree of reduction operations (currently add,
+/// fadd and integer min/max) that has operations that can be put into a vector
+/// as its leaf. For example, this tree:
 ///
 /// mul mul mul mul
 ///  \  /    \  /
@@ -3543,15 +3764,19 @@ static Value *createRdxShuffleMask(unsigned VecLen, unsigned NumEltsToRdx,
 ///     |
 ///   *p =
 ///
+/// A min/max reduction node is a select(icmp(a, b), a, b) pair whose operands
+/// are either reduced values or other nodes of the same kind.
 class HorizontalReduction {
   SmallVector<Value *, 16> ReductionOps;
   SmallVector<Value *, 32> ReducedVals;
 
-  BinaryOperator *ReductionRoot;
+  Instruction *ReductionRoot;
   PHINode *ReductionPHI;
 
   /// The opcode of the reduction.
   unsigned ReductionOpcode;
+  /// The kind of min/max computed by the reduction, if its opcode is select.
+  RecurrenceDescriptor::MinMaxRecurrenceKind MinMaxKind;
   /// The opcode of the values we perform a reduction on.
   unsigned ReducedValueOpcode;
   /// The width of one full horizontal reduction operation.
@@ -3563,10 +3788,11 @@ class HorizontalReduction {
 public:
   HorizontalReduction()
     : ReductionRoot(nullptr), ReductionPHI(nullptr), ReductionOpcode(0),
-    ReducedValueOpcode(0), ReduxWidth(0), IsPairwiseReduction(false) {}
+    MinMaxKind(RecurrenceDescriptor::MRK_Invalid), ReducedValueOpcode(0),
+    ReduxWidth(0), IsPairwiseReduction(false) {}
 
   /// \brief Try to find a reduction tree.
-  bool matchAssociativeReduction(PHINode *Phi, BinaryOperator *B) {
+  bool matchAssociativeReduction(PHINode *Phi, Instruction *B) {
     assert((!Phi ||
             std::find(Phi->op_begin(), Phi->op_end(), B) != Phi->op_end()) &&
            "Thi phi needs to use the binary operator");
@@ -3574,13 +3800,15 @@ public:
     // We could have a initial reductions that is not an add.
     //  r *= v1 + v2 + v3 + v4
     // In such a case start looking for a tree rooted in the first '+'.
+    // Likewise, r = max(r, max(v1, ...)) starts at the inner max.
     if (Phi) {
-      if (B->getOperand(0) == Phi) {
+      unsigned FirstOp = isa<SelectInst>(B) ? 1 : 0;
+      if (B->getOperand(FirstOp) == Phi) {
         Phi = nullptr;
-        B = dyn_cast<BinaryOperator>(B->getOperand(1));
-      } else if (B->getOperand(1) == Phi) {
+        B = dyn_cast<Instruction>(B->getOperand(FirstOp + 1));
+      } else if (B->getOperand(FirstOp + 1) == Phi) {
         Phi = nullptr;
-        B = dyn_cast<BinaryOperator>(B->getOperand(0));
+        B = dyn_cast<Instruction>(B->getOperand(FirstOp));
       }
     }
 
@@ -3593,6 +3821,7 @@ public:
 
     const DataLayout &DL = B->getModule()->getDataLayout();
     ReductionOpcode = B->getOpcode();
+    MinMaxKind = getMinMaxKind(B);
     ReducedValueOpcode = 0;
     // FIXME: Register size should be a parameter to this function, so we can
     // try different vectorization factors.
@@ -3603,27 +3832,32 @@ public:
     if (ReduxWidth < 4)
       return false;
 
-    // We currently only support adds.
+    // We currently only support adds and integer min/max.
+    bool IsMinMax = MinMaxKind != RecurrenceDescriptor::MRK_Invalid;
     if (ReductionOpcode != Instruction::Add &&
-        ReductionOpcode != Instruction::FAdd)
+        ReductionOpcode != Instruction::FAdd && !IsMinMax)
+      return false;
+    // A phi in the middle of the tree would have to be a select operand.
+    if (IsMinMax && Phi)
       return false;
 
     // Post order traverse the reduction tree starting at B. We only handle true
-    // trees containing only binary operators.
-    SmallVector<std::pair<BinaryOperator *, unsigned>, 32> Stack;
+    // trees containing only binary operators, or only min/max selects.
+    SmallVector<std::pair<Instruction *, unsigned>, 32> Stack;
     Stack.push_back(std::make_pair(B, 0));
     while (!Stack.empty()) {
-      BinaryOperator *TreeN = Stack.back().first;
+      Instruction *TreeN = Stack.back().first;
       unsigned EdgeToVist = Stack.back().second++;
-      bool IsReducedValue = TreeN->getOpcode() != ReductionOpcode;
+      bool IsReducedValue = !isReductionOp(TreeN);
 
       // Only handle trees in the current basic block.
       if (TreeN->getParent() != B->getParent())
         return false;
 
       // Each tree node needs to have one user except for the ultimate
-      // reduction.
-      if (!TreeN->hasOneUse() && TreeN != B)
+      // reduction. The operands of a min/max are used by its compare too.
+      if (TreeN != B &&
+          !(IsMinMax ? hasMinMaxUsers(TreeN) : TreeN->hasOneUse()))
         return false;
 
       // Postorder vist.
@@ -3636,6 +3870,10 @@ public:
           else if (ReducedValueOpcode != TreeN->getOpcode())
             return false;
           ReducedVals.push_back(TreeN);
+        } else if (IsMinMax) {
+          // Both the select and its compare are replaced by the reduction.
+          ReductionOps.push_back(cast<SelectInst>(TreeN)->getCondition());
+          ReductionOps.push_back(TreeN);
         } else {
           // We need to be able to reassociate the adds.
           if (!TreeN->isAssociative())
@@ -3647,9 +3885,10 @@ public:
         continue;
       }
 
-      // Visit left or right.
-      Value *NextV = TreeN->getOperand(EdgeToVist);
-      BinaryOperator *Next = dyn_cast<BinaryOperator>(NextV);
+      // Visit left or right. The values of a select follow its condition.
+      Value *NextV = TreeN->getOperand(IsMinMax ? EdgeToVist + 1 : EdgeToVist);
+      Instruction *Next = IsMinMax ? dyn_cast<Instruction>(NextV)
+                                   : dyn_cast<BinaryOperator>(NextV);
       if (Next)
         Stack.push_back(std::make_pair(Next, 0));
       else if (NextV != Phi)
@@ -3679,7 +3918,8 @@ public:
       V.buildTree(makeArrayRef(&ReducedVals[i], ReduxWidth), ReductionOps);
 
       // Estimate cost.
-      int Cost = V.getTreeCost() + getReductionCost(TTI, ReducedVals[i]);
+      int Cost = V.getTreeCost(/*IsReduction=*/true) +
+                 getReductionCost(TTI, ReducedVals[i]);
       if (Cost >= -SLPCostThreshold)
         break;
 
@@ -3694,8 +3934,8 @@ public:
       Value *ReducedSubTree = emitReduction(VectorizedRoot, Builder);
       if (VectorizedTree) {
         Builder.SetCurrentDebugLocation(Loc);
-        VectorizedTree = createBinOp(Builder, ReductionOpcode, VectorizedTree,
-                                     ReducedSubTree, "bin.rdx");
+        VectorizedTree = createOp(Builder, VectorizedTree, ReducedSubTree,
+                                  "bin.rdx");
       } else
         VectorizedTree = ReducedSubTree;
     }
@@ -3705,8 +3945,7 @@ public:
       for (; i < NumReducedVals; ++i) {
         Builder.SetCurrentDebugLocation(
           cast<Instruction>(ReducedVals[i])->getDebugLoc());
-        VectorizedTree = createBinOp(Builder, ReductionOpcode, VectorizedTree,
-                                     ReducedVals[i]);
+        VectorizedTree = createOp(Builder, VectorizedTree, ReducedVals[i]);
       }
       // Update users.
       if (ReductionPHI) {
@@ -3721,11 +3960,38 @@ public:
 
 private:
 
+  /// \brief Returns true if \p I is an inner node of the reduction tree.
+  bool isReductionOp(Instruction *I) const {
+    if (MinMaxKind != RecurrenceDescriptor::MRK_Invalid)
+      return getMinMaxKind(I) == MinMaxKind;
+    return I->getOpcode() == ReductionOpcode;
+  }
+
+  /// \brief Returns true if the only users of \p I are a min/max select and
+  /// its compare.
+  static bool hasMinMaxUsers(Instruction *I) {
+    if (!I->hasNUses(2))
+      return false;
+    SelectInst *Select = nullptr;
+    for (User *U : I->users())
+      if ((Select = dyn_cast<SelectInst>(U)))
+        break;
+    if (!Select)
+      return false;
+    for (User *U : I->users())
+      if (U != Select && U != Select->getCondition())
+        return false;
+    return true;
+  }
+
   /// \brief Calcuate the cost of a reduction.
   int getReductionCost(TargetTransformInfo *TTI, Value *FirstReducedVal) {
     Type *ScalarTy = FirstReducedVal->getType();
     Type *VecTy = VectorType::get(ScalarTy, ReduxWidth);
 
+    if (MinMaxKind != RecurrenceDescriptor::MRK_Invalid)
+      return getMinMaxReductionCost(TTI, ScalarTy, VecTy);
+
     int PairwiseRdxCost = TTI->getReductionCost(ReductionOpcode, VecTy, true);
     int SplittingRdxCost = TTI->getReductionCost(ReductionOpcode, VecTy, false);
 
@@ -3744,6 +4010,34 @@ private:
     return VecReduxCost - ScalarReduxCost;
   }
 
+  /// \brief Calculate the cost of a min/max reduction, which is emitted as a
+  /// splitting reduction of vector compares and selects.
+  int getMinMaxReductionCost(TargetTransformInfo *TTI, Type *ScalarTy,
+                             Type *VecTy) {
+    IsPairwiseReduction = false;
+    Type *CondTy = VectorType::get(Type::getInt1Ty(ScalarTy->getContext()),
+                                   ReduxWidth);
+    unsigned NumReduxLevels = Log2_32(ReduxWidth);
+    int VecReduxCost =
+        NumReduxLevels *
+            (TTI->getShuffleCost(TargetTransformInfo::SK_ExtractSubvector,
+                                 VecTy, ReduxWidth / 2, VecTy) +
+             TTI->getCmpSelInstrCost(Instruction::ICmp, VecTy) +
+             TTI->getCmpSelInstrCost(Instruction::Select, VecTy, CondTy)) +
+        TTI->getVectorInstrCost(Instruction::ExtractElement, VecTy, 0);
+    int ScalarReduxCost =
+        ReduxWidth *
+        (TTI->getCmpSelInstrCost(Instruction::ICmp, ScalarTy) +
+         TTI->getCmpSelInstrCost(Instruction::Select, ScalarTy,
+                                 Type::getInt1Ty(ScalarTy->getContext())));
+
+    DEBUG(dbgs() << "SLP: Adding cost " << VecReduxCost - ScalarReduxCost
+                 << " for min/max reduction of " << ReduxWidth
+                 << " elements\n");
+
+    return VecReduxCost - ScalarReduxCost;
+  }
+
   static Value *createBinOp(IRBuilder<> &Builder, unsigned Opcode, Value *L,
                             Value *R, const Twine &Name = "") {
     if (Opcode == Instruction::FAdd)
@@ -3751,6 +4045,14 @@ private:
     return Builder.CreateBinOp((Instruction::BinaryOps)Opcode, L, R, Name);
   }
 
+  /// \brief Emit one reduction operation combining \p L and \p R.
+  Value *createOp(IRBuilder<> &Builder, Value *L, Value *R,
+                  const Twine &Name = "") {
+    if (MinMaxKind != RecurrenceDescriptor::MRK_Invalid)
+      return RecurrenceDescriptor::createMinMaxOp(Builder, MinMaxKind, L, R);
+    return createBinOp(Builder, ReductionOpcode, L, R, Name);
+  }
+
   /// \brief Emit a horizontal reduction of the vectorized value.
   Value *emitReduction(Value *VectorizedValue, IRBuilder<> &Builder) {
     assert(VectorizedValue && "Need to have a vectorized tree node");
@@ -3770,14 +4072,13 @@ private:
         Value *RightShuf = Builder.CreateShuffleVector(
           TmpVec, UndefValue::get(TmpVec->getType()), (RightMask),
           "rdx.shuf.r");
-        TmpVec = createBinOp(Builder, ReductionOpcode, LeftShuf, RightShuf,
-                             "bin.rdx");
+        TmpVec = createOp(Builder, LeftShuf, RightShuf, "bin.rdx");
       } else {
         Value *UpperHalf =
           createRdxShuffleMask(ReduxWidth, i, false, false, Builder);
         Value *Shuf = Builder.CreateShuffleVector(
           TmpVec, UndefValue::get(TmpVec->getType()), UpperHalf, "rdx.shuf");
-        TmpVec = createBinOp(Builder, ReductionOpcode, TmpVec, Shuf, "bin.rdx");
+        TmpVec = createOp(Builder, TmpVec, Shuf, "bin.rdx");
       }
     }
 
@@ -3786,6 +4087,39 @@ private:
   }
 };
 
+/// \brief Sort a complete build vector that fits in a vector register by the
+/// lanes that its insertelement instructions write.
+/// \returns true if this changed the order.
+static bool sortBuildVectorByLane(SmallVectorImpl<Value *> &BuildVector,
+                                  SmallVectorImpl<Value *> &BuildVectorOpds) {
+  VectorType *VecTy = cast<VectorType>(BuildVector[0]->getType());
+  const DataLayout &DL =
+      cast<Instruction>(BuildVector[0])->getModule()->getDataLayout();
+  unsigned NumElts = VecTy->getNumElements();
+  if (BuildVector.size() != NumElts ||
+      DL.getTypeSizeInBits(VecTy) > MinVecRegSize)
+    return false;
+
+  SmallVector<Value *, 16> SortedVector(NumElts, nullptr);
+  SmallVector<Value *, 16> SortedOpds(NumElts, nullptr);
+  for (unsigned I = 0; I != NumElts; ++I) {
+    ConstantInt *Idx =
+        dyn_cast<ConstantInt>(cast<InsertElementInst>(BuildVector[I])
+                                  ->getOperand(2));
+    if (!Idx || Idx->getZExtValue() >= NumElts ||
+        SortedVector[Idx->getZExtValue()])
+      return false;
+    SortedVector[Idx->getZExtValue()] = BuildVector[I];
+    SortedOpds[Idx->getZExtValue()] = BuildVectorOpds[I];
+  }
+  if (std::equal(SortedVector.begin(), SortedVector.end(),
+                 BuildVector.begin()))
+    return false;
+  std::copy(SortedVector.begin(), SortedVector.end(), BuildVector.begin());
+  std::copy(SortedOpds.begin(), SortedOpds.end(), BuildVectorOpds.begin());
+  return true;
+}
+
 /// \brief Recognize construction of vectors like
 ///  %ra = insertelement <4 x float> undef, float %s0, i32 0
 ///  %rb = insertelement <4 x float> %ra, float %s1, i32 1
@@ -3899,6 +4233,19 @@ bool SLPVectorizer::vectorizeChainsInBlock(BasicBlock *BB, BoUpSLP &R) {
                ? (P->getIncomingValue(0))
                : (P->getIncomingBlock(1) == BB ? P->getIncomingValue(1)
                                                : nullptr));
+      // Try to match and vectorize a min/max reduction.
+      if (Rdx && getMinMaxKind(Rdx) != RecurrenceDescriptor::MRK_Invalid) {
+        HorizontalReduction HorRdx;
+        if (ShouldVectorizeHor &&
+            HorRdx.matchAssociativeReduction(P, cast<Instruction>(Rdx)) &&
+            HorRdx.tryToReduce(R, TTI)) {
+          Changed = true;
+          it = BB->begin();
+          e = BB->end();
+        }
+        continue;
+      }
+
       // Check if this is a Binary Operator.
       BinaryOperator *BI = dyn_cast_or_null<BinaryOperator>(Rdx);
       if (!BI)
@@ -3946,6 +4293,22 @@ bool SLPVectorizer::vectorizeChainsInBlock(BasicBlock *BB, BoUpSLP &R) {
           }
         }
 
+    // Try to vectorize min/max reductions feeding into a store or a return.
+    if (((ShouldStartVectorizeHorAtStore && isa<StoreInst>(it)) ||
+         (ShouldVectorizeHor && isa<ReturnInst>(it))) &&
+        it->getNumOperands() != 0 &&
+        getMinMaxKind(it->getOperand(0)) != RecurrenceDescriptor::MRK_Invalid) {
+      HorizontalReduction HorRdx;
+      if (HorRdx.matchAssociativeReduction(
+              nullptr, cast<Instruction>(it->getOperand(0))) &&
+          HorRdx.tryToReduce(R, TTI)) {
+        Changed = true;
+        it = BB->begin();
+        e = BB->end();
+        continue;
+      }
+    }
+
     // Try to vectorize horizontal reductions feeding into a return.
     if (ReturnInst *RI = dyn_cast<ReturnInst>(it))
       if (RI->getNumOperands() != 0)
@@ -3996,8 +4359,11 @@ bool SLPVectorizer::vectorizeChainsInBlock(BasicBlock *BB, BoUpSLP &R) {
 
       // Vectorize starting with the build vector operands ignoring the
       // BuildVector instructions for the purpose of scheduling and user
-      // extraction.
-      if (tryToVectorizeList(BuildVectorOpds, R, BuildVector)) {
+      // extraction. If the lanes are inserted out of order, also try to build
+      // the vector in lane order, which may match the order of its operands.
+      if (tryToVectorizeList(BuildVectorOpds, R, BuildVector) ||
+          (sortBuildVectorByLane(BuildVector, BuildVectorOpds) &&
+           tryToVectorizeList(BuildVectorOpds, R, BuildVector))) {
         Changed = true;
         it = BB->begin();
         e = BB->end();
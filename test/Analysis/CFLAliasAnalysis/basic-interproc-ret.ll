@@ -5,10 +5,9 @@
 
 ; CHECK:     Function: test
 ; CHECK: 4 Total Alias Queries Performed
-; CHECK: 3 no alias responses
-; ^ The 1 MayAlias is due to %arg1. Sadly, we don't currently have machinery
-; in place to check whether %arg1 aliases %a, because BasicAA takes care of 
-; that for us.
+; CHECK: 4 no alias responses
+; ^ @test2 neither lets %arg1 escape nor returns anything derived from it, so
+; its summary keeps %c apart from %a and %b.
 
 define i32* @test2(i32* %arg1) {
   store i32 0, i32* %arg1
@@ -0,0 +1,58 @@
+; This testcase ensures that pointers escaping through a summarized callee,
+; or made to point to memory the caller can't see, are treated conservatively
+; by the caller.
+
+; RUN: opt < %s -cfl-aa -aa-eval -print-may-aliases -disable-output 2>&1 | FileCheck %s
+
+@g = global i32* null
+@h = global i32 0
+
+define void @esc(i32* %p) {
+  store i32* %p, i32** @g
+  ret void
+}
+
+define void @set_global(i32** %p) {
+  store i32* @h, i32** %p
+  ret void
+}
+
+define void @set_slot(i32** %slot, i32* %p) {
+  store i32* %p, i32** %slot
+  ret void
+}
+
+define i32* @load_global() {
+  %v = load i32*, i32** @g
+  ret i32* %v
+}
+
+; CHECK-LABEL: Function: test
+; CHECK-DAG: MayAlias: i32* %a, i32* %q
+; CHECK-DAG: MayAlias: i32* %a, i32* %r
+define void @test() {
+  %a = alloca i32, align 4
+  call void @esc(i32* %a)
+  %q = load i32*, i32** @g
+  %r = call i32* @load_global()
+  store i32 0, i32* %q
+  store i32 0, i32* %r
+  ret void
+}
+
+; CHECK-LABEL: Function: test_contents
+; CHECK-DAG: MayAlias: i32* %v, i32* @h
+; CHECK-DAG: MayAlias: i32* %b, i32* %w
+define void @test_contents() {
+  %slot = alloca i32*, align 8
+  %slot2 = alloca i32*, align 8
+  %b = alloca i32, align 4
+  call void @set_global(i32** %slot)
+  %v = load i32*, i32** %slot
+  call void @set_slot(i32** %slot2, i32* %b)
+  %w = load i32*, i32** %slot2
+  store i32 0, i32* %v
+  store i32 0, i32* %w
+  store i32 0, i32* @h
+  ret void
+}
@@ -0,0 +1,66 @@
+; This testcase ensures that calls are modeled with the summaries of their
+; callees, including callees with external linkage, and that building the
+; summaries bottom-up (optionally in parallel) gives the same answers.
+
+; RUN: opt < %s -cfl-aa -aa-eval -print-no-aliases -print-may-aliases -disable-output 2>&1 | FileCheck %s
+; RUN: opt < %s -cfl-aa -cfl-aa-bottom-up=false -aa-eval -print-no-aliases -print-may-aliases -disable-output 2>&1 | FileCheck %s
+; RUN: opt < %s -cfl-aa -cfl-aa-threads=2 -aa-eval -print-no-aliases -print-may-aliases -disable-output 2>&1 | FileCheck %s
+
+define i32* @fresh(i32* %p) {
+  store i32 0, i32* %p
+  %x = alloca i32, align 4
+  ret i32* %x
+}
+
+define void @touch(i32* %p, i32* %q) {
+  store i32 0, i32* %p
+  store i32 0, i32* %q
+  ret void
+}
+
+define i32* @passthrough(i32* %p) {
+  %q = call i32* @identity(i32* %p)
+  ret i32* %q
+}
+
+define void @ignore(i32* %p) {
+  ret void
+}
+
+define i32* @identity(i32* %p) {
+  ret i32* %p
+}
+
+; A weak definition may be replaced at link time, so its body can't be used.
+define weak i32* @replaceable(i32* %p) {
+  %x = alloca i32, align 4
+  ret i32* %x
+}
+
+; Pointers a callee only stores to or returns a fresh object for don't escape,
+; so they stay apart from each other and from the fresh object. A pointer that
+; flows back out aliases the returned value, and a replaceable callee is
+; treated conservatively.
+; CHECK-LABEL: Function: test
+; CHECK-DAG: NoAlias: i32* %a, i32* %b
+; CHECK-DAG: NoAlias: i32* %a, i32* %r1
+; CHECK-DAG: NoAlias: i32* %a, i32* %x
+; CHECK-DAG: NoAlias: i32* %r1, i32* %x
+; CHECK-DAG: MayAlias: i32* %c, i32* %r2
+; CHECK-DAG: NoAlias: i32* %a, i32* %r2
+; CHECK-DAG: NoAlias: i32* %r2, i32* %x
+; CHECK-DAG: MayAlias: i32* %d, i32* %r3
+; CHECK-DAG: NoAlias: i32* %a, i32* %d
+define void @test() {
+  %a = alloca i32, align 4
+  %b = alloca i32, align 4
+  %c = alloca i32, align 4
+  %d = alloca i32, align 4
+  %x = alloca i32, align 4
+  %r1 = call i32* @fresh(i32* %a)
+  call void @touch(i32* %a, i32* %b)
+  call void @ignore(i32* %x)
+  %r2 = call i32* @passthrough(i32* %c)
+  %r3 = call i32* @replaceable(i32* %d)
+  ret void
+}
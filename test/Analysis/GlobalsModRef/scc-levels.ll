@@ -0,0 +1,84 @@
+; Test that mod/ref info is propagated transitively through the call graph,
+; including through SCCs, whether or not independent SCCs are analyzed in
+; parallel.
+; RUN: opt < %s -basicaa -globalsmodref-aa -gvn -S | FileCheck %s
+; RUN: opt < %s -basicaa -globalsmodref-aa -globalsmodref-aa-threads=4 -gvn -S | FileCheck %s
+
+@X = internal global i32 4
+@Y = internal global i32 4
+@Z = internal global i32 4
+
+define void @writesY() {
+  store i32 1, i32* @Y
+  ret void
+}
+
+define i32 @readsX() {
+  %V = load i32, i32* @X
+  ret i32 %V
+}
+
+define i32 @mid() {
+  call void @writesY()
+  %V = call i32 @readsX()
+  ret i32 %V
+}
+
+define void @ping(i32 %N) {
+  %C = icmp eq i32 %N, 0
+  br i1 %C, label %done, label %more
+
+more:
+  %M = sub i32 %N, 1
+  call void @pong(i32 %M)
+  br label %done
+
+done:
+  ret void
+}
+
+define void @pong(i32 %N) {
+  store i32 %N, i32* @Z
+  call void @ping(i32 %N)
+  ret void
+}
+
+define i32 @test1() {
+; CHECK-LABEL: @test1
+; CHECK:      call i32 @mid()
+; CHECK-NEXT: ret i32 12
+  store i32 12, i32* @X
+  %R = call i32 @mid()
+  %V = load i32, i32* @X
+  ret i32 %V
+}
+
+define i32 @test2() {
+; CHECK-LABEL: @test2
+; CHECK:      call i32 @mid()
+; CHECK-NEXT: %V = load i32, i32* @Y
+  store i32 12, i32* @Y
+  %R = call i32 @mid()
+  %V = load i32, i32* @Y
+  ret i32 %V
+}
+
+define i32 @test3() {
+; CHECK-LABEL: @test3
+; CHECK:      call void @ping(i32 3)
+; CHECK-NEXT: ret i32 12
+  store i32 12, i32* @X
+  call void @ping(i32 3)
+  %V = load i32, i32* @X
+  ret i32 %V
+}
+
+define i32 @test4() {
+; CHECK-LABEL: @test4
+; CHECK:      call void @ping(i32 3)
+; CHECK-NEXT: %V = load i32, i32* @Z
+  store i32 12, i32* @Z
+  call void @ping(i32 3)
+  %V = load i32, i32* @Z
+  ret i32 %V
+}
@@ -0,0 +1,117 @@
+; RUN: llc < %s -verify-machineinstrs -enable-machine-outliner -enable-tail-merge=false | FileCheck %s
+; RUN: llc < %s -enable-tail-merge=false | FileCheck %s --check-prefix=DISABLED
+
+target triple = "x86_64-unknown-linux-gnu"
+
+@a = global i32 0
+@b = global i32 0
+@c = global i32 0
+@d = global i32 0
+@e = global i32 0
+
+declare void @f0()
+declare void @f1()
+declare void @f2()
+
+; The stores repeated before each call are outlined and called.
+
+; CHECK-LABEL: call_sequences:
+; CHECK: callq [[SEQ:.Ltmp[0-9]+]]
+; CHECK-NEXT: callq f0
+; CHECK-NEXT: callq [[SEQ]]
+; CHECK-NEXT: callq f1
+; CHECK-NEXT: callq [[SEQ]]
+; CHECK-NEXT: callq f2
+; CHECK: retq
+; CHECK: [[SEQ]]:
+; CHECK-NEXT: movl $1, a(%rip)
+; CHECK-NEXT: movl $2, b(%rip)
+; CHECK-NEXT: movl $3, c(%rip)
+; CHECK-NEXT: movl $4, d(%rip)
+; CHECK-NEXT: retq
+
+; DISABLED-LABEL: call_sequences:
+; DISABLED-NOT: .Ltmp
+; DISABLED: callq f0
+
+define void @call_sequences() nounwind {
+entry:
+  store i32 1, i32* @a
+  store i32 2, i32* @b
+  store i32 3, i32* @c
+  store i32 4, i32* @d
+  call void @f0()
+  store i32 1, i32* @a
+  store i32 2, i32* @b
+  store i32 3, i32* @c
+  store i32 4, i32* @d
+  call void @f1()
+  store i32 1, i32* @a
+  store i32 2, i32* @b
+  store i32 3, i32* @c
+  store i32 4, i32* @d
+  call void @f2()
+  ret void
+}
+
+; The unwind table of this function wouldn't cover the outlined code, which
+; runs with the stack pointer moved by the call.
+
+; CHECK-LABEL: uwtable_sequences:
+; CHECK-NOT: callq .Ltmp
+; CHECK: .cfi_endproc
+
+define void @uwtable_sequences() nounwind uwtable {
+entry:
+  store i32 1, i32* @a
+  store i32 2, i32* @b
+  store i32 3, i32* @c
+  store i32 4, i32* @d
+  call void @f0()
+  store i32 1, i32* @a
+  store i32 2, i32* @b
+  store i32 3, i32* @c
+  store i32 4, i32* @d
+  call void @f1()
+  store i32 1, i32* @a
+  store i32 2, i32* @b
+  store i32 3, i32* @c
+  store i32 4, i32* @d
+  call void @f2()
+  ret void
+}
+
+; Sequences ending in a return are branched to. This function may use the red
+; zone, so nothing is outlined with a call.
+
+; CHECK-LABEL: tails:
+; CHECK-NOT: callq
+; CHECK: movl $8, e(%rip)
+; CHECK-NEXT: jmp [[TAIL:.LBB[0-9_]+]]
+; CHECK: movl $7, e(%rip)
+; CHECK-NEXT: jmp [[TAIL]]
+; CHECK: [[TAIL]]:
+; CHECK-NEXT: movl $1, a(%rip)
+; CHECK-NEXT: movl $2, b(%rip)
+; CHECK-NEXT: movl $3, c(%rip)
+; CHECK-NEXT: retq
+
+define void @tails(i32 %x) nounwind {
+entry:
+  %cmp = icmp eq i32 %x, 0
+  br i1 %cmp, label %then, label %else
+
+then:
+  store i32 7, i32* @e
+  store i32 1, i32* @a
+  store i32 2, i32* @b
+  store i32 3, i32* @c
+  ret void
+
+else:
+  store i32 8, i32* @e
+  store i32 1, i32* @a
+  store i32 2, i32* @b
+  store i32 3, i32* @c
+  ret void
+}
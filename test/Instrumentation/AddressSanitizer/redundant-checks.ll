@@ -0,0 +1,152 @@
+; Test that AddressSanitizer doesn't check the bytes already checked by a
+; dominating access, and can merge the checks of adjacent accesses.
+; RUN: opt < %s -asan -asan-module -S | FileCheck %s
+; RUN: opt < %s -asan -asan-module -asan-opt-dominating=0 -S | FileCheck %s -check-prefix=NOOPT
+; RUN: opt < %s -asan -asan-module -asan-opt-dominating-max-checks=0 -S | FileCheck %s -check-prefix=NOOPT
+; RUN: opt < %s -asan -asan-module -asan-opt-merge-adjacent -S | FileCheck %s -check-prefix=MERGE
+; RUN: opt < %s -asan -asan-module -asan-opt-merge-adjacent -asan-instrumentation-with-call-threshold=0 -S | FileCheck %s -check-prefix=CALLS
+
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare void @f()
+
+; The load in %then is checked by the one in %entry.
+define i32 @dominated(i32* %p, i1 %c) sanitize_address {
+entry:
+  %a = load i32, i32* %p, align 4
+  br i1 %c, label %then, label %exit
+
+then:
+  %b = load i32, i32* %p, align 4
+  br label %exit
+
+exit:
+  %r = phi i32 [ %a, %entry ], [ %b, %then ]
+  ret i32 %r
+}
+; CHECK-LABEL: @dominated
+; CHECK: __asan_report_load4
+; CHECK-NOT: __asan_report_
+; CHECK: ret i32
+; NOOPT-LABEL: @dominated
+; NOOPT: __asan_report_load4
+; NOOPT: __asan_report_load4
+; NOOPT: ret i32
+
+; A wider access covers the narrower accesses inside of it.
+define i32 @wider(i64* %p, i1 %c) sanitize_address {
+entry:
+  %a = load i64, i64* %p, align 8
+  br i1 %c, label %then, label %exit
+
+then:
+  %q = bitcast i64* %p to i32*
+  %q1 = getelementptr inbounds i32, i32* %q, i64 1
+  store i32 0, i32* %q1, align 4
+  br label %exit
+
+exit:
+  %t = trunc i64 %a to i32
+  ret i32 %t
+}
+; CHECK-LABEL: @wider
+; CHECK: __asan_report_load8
+; CHECK-NOT: __asan_report_
+; CHECK: ret i32
+
+; The call may free %p.
+define i32 @call_between(i32* %p, i1 %c) sanitize_address {
+entry:
+  %a = load i32, i32* %p, align 4
+  br i1 %c, label %then, label %exit
+
+then:
+  call void @f()
+  br label %next
+
+next:
+  %b = load i32, i32* %p, align 4
+  br label %exit
+
+exit:
+  %r = phi i32 [ %a, %entry ], [ %b, %next ]
+  ret i32 %r
+}
+; CHECK-LABEL: @call_between
+; CHECK: __asan_report_load4
+; CHECK: __asan_report_load4
+; CHECK: ret i32
+
+; The call in the loop may free %p before the next iteration.
+define void @call_in_loop(i32* %p, i32 %n) sanitize_address {
+entry:
+  store i32 0, i32* %p, align 4
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop.latch ]
+  %v = load i32, i32* %p, align 4
+  br label %loop.latch
+
+loop.latch:
+  call void @f()
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+; CHECK-LABEL: @call_in_loop
+; CHECK: __asan_report_store4
+; CHECK: __asan_report_load4
+; CHECK: ret void
+
+; When merging is enabled, the stores to the two fields are checked with a
+; single 8 byte check. If it fails, the fields are checked one by one, so that
+; the bad store is reported with its own address and size.
+%pair = type { i32, i32 }
+define void @adjacent(%pair* %p) sanitize_address {
+entry:
+  %x = getelementptr inbounds %pair, %pair* %p, i64 0, i32 0
+  %y = getelementptr inbounds %pair, %pair* %p, i64 0, i32 1
+  store i32 1, i32* %x, align 8
+  store i32 2, i32* %y, align 4
+  ret void
+}
+; CHECK-LABEL: @adjacent
+; CHECK: __asan_report_store4
+; CHECK: __asan_report_store4
+; CHECK-NOT: __asan_report_
+; CHECK: ret void
+; MERGE-LABEL: @adjacent
+; MERGE: %[[ADDR:.*]] = ptrtoint i32* %x to i64
+; MERGE: call void @__asan_report_store4(i64 %[[ADDR]])
+; MERGE: %[[ADDR1:.*]] = add i64 %[[ADDR]], 4
+; MERGE: call void @__asan_report_store4(i64 %[[ADDR1]])
+; MERGE: call void @__asan_report_store8(i64 %[[ADDR]])
+; MERGE: store i32 1, i32* %x
+; MERGE-NEXT: store i32 2, i32* %y
+; MERGE-NEXT: ret void
+; CALLS-LABEL: @adjacent
+; CALLS: %[[ADDR:.*]] = ptrtoint i32* %x to i64
+; CALLS-NEXT: call void @__asan_store4(i64 %[[ADDR]])
+; CALLS-NEXT: %[[ADDR1:.*]] = add i64 %[[ADDR]], 4
+; CALLS-NEXT: call void @__asan_store4(i64 %[[ADDR1]])
+; CALLS-NOT: __asan_store
+; CALLS: ret void
+
+; Without enough alignment the fields are checked separately.
+define void @adjacent_unaligned(%pair* %p) sanitize_address {
+entry:
+  %x = getelementptr inbounds %pair, %pair* %p, i64 0, i32 0
+  %y = getelementptr inbounds %pair, %pair* %p, i64 0, i32 1
+  store i32 1, i32* %x, align 4
+  store i32 2, i32* %y, align 4
+  ret void
+}
+; CHECK-LABEL: @adjacent_unaligned
+; CHECK: __asan_report_store4
+; CHECK: __asan_report_store4
+; CHECK: ret void
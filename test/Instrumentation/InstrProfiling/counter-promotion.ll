@@ -0,0 +1,100 @@
+; RUN: opt < %s -instrprof -S | FileCheck %s --check-prefix=NOPROMO
+; RUN: opt < %s -instrprof -do-counter-promotion -S | FileCheck %s --check-prefix=PROMO
+; RUN: opt < %s -instrprof -instrprof-atomic-counter-update-all -S | FileCheck %s --check-prefix=ATOMIC
+; RUN: opt < %s -instrprof -do-counter-promotion -instrprof-atomic-counter-update-all -S | FileCheck %s --check-prefix=ATOMIC-PROMO
+
+target triple = "x86_64-unknown-linux-gnu"
+
+@__llvm_profile_name_loop = hidden constant [4 x i8] c"loop"
+@__llvm_profile_name_nest = hidden constant [4 x i8] c"nest"
+
+; The counter of the loop body is kept in a register and written back to
+; memory in the exit block.
+
+; NOPROMO-LABEL: @loop(
+; NOPROMO: body:
+; NOPROMO: load i64, i64* getelementptr inbounds ([2 x i64], [2 x i64]* @__llvm_profile_counters_loop, i64 0, i64 1)
+; NOPROMO: store i64
+
+; PROMO-LABEL: @loop(
+; PROMO: entry:
+; PROMO-NEXT: %pgocount = load i64, i64* getelementptr inbounds ([2 x i64], [2 x i64]* @__llvm_profile_counters_loop, i64 0, i64 0)
+; PROMO: body:
+; PROMO-NEXT: %[[PHI:.*]] = phi i64 [ 0, %entry ], [ %pgocount.delta, %body ]
+; PROMO-NEXT: %i = phi
+; PROMO-NEXT: %pgocount.delta = add i64 %[[PHI]], 1
+; PROMO-NOT: @__llvm_profile_counters_loop
+; PROMO: exit:
+; PROMO-NEXT: %[[C:.*]] = load i64, i64* getelementptr inbounds ([2 x i64], [2 x i64]* @__llvm_profile_counters_loop, i64 0, i64 1)
+; PROMO-NEXT: %[[S:.*]] = add i64 %[[C]], %pgocount.delta
+; PROMO-NEXT: store i64 %[[S]], i64* getelementptr inbounds ([2 x i64], [2 x i64]* @__llvm_profile_counters_loop, i64 0, i64 1)
+; PROMO-NEXT: ret void
+
+; ATOMIC-LABEL: @loop(
+; ATOMIC: entry:
+; ATOMIC-NEXT: atomicrmw add i64* getelementptr inbounds ([2 x i64], [2 x i64]* @__llvm_profile_counters_loop, i64 0, i64 0), i64 1 monotonic
+; ATOMIC: body:
+; ATOMIC: atomicrmw add i64* getelementptr inbounds ([2 x i64], [2 x i64]* @__llvm_profile_counters_loop, i64 0, i64 1), i64 1 monotonic
+
+; ATOMIC-PROMO-LABEL: @loop(
+; ATOMIC-PROMO: body:
+; ATOMIC-PROMO-NOT: atomicrmw
+; ATOMIC-PROMO: exit:
+; ATOMIC-PROMO-NEXT: atomicrmw add i64* getelementptr inbounds ([2 x i64], [2 x i64]* @__llvm_profile_counters_loop, i64 0, i64 1), i64 %pgocount.delta monotonic
+; ATOMIC-PROMO-NEXT: ret void
+
+define void @loop(i32 %n) {
+entry:
+  call void @llvm.instrprof.increment(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @__llvm_profile_name_loop, i32 0, i32 0), i64 0, i32 2, i32 0)
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  call void @llvm.instrprof.increment(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @__llvm_profile_name_loop, i32 0, i32 0), i64 0, i32 2, i32 1)
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %body
+
+exit:
+  ret void
+}
+
+; The count flushed at the exit of the inner loop is in turn promoted out of
+; the outer loop.
+
+; PROMO-LABEL: @nest(
+; PROMO: inner:
+; PROMO-NOT: @__llvm_profile_counters_nest
+; PROMO: outer.latch:
+; PROMO-NOT: @__llvm_profile_counters_nest
+; PROMO: exit:
+; PROMO: load i64, i64* getelementptr inbounds ([1 x i64], [1 x i64]* @__llvm_profile_counters_nest, i64 0, i64 0)
+; PROMO-NEXT: add i64
+; PROMO-NEXT: store i64 {{.*}} @__llvm_profile_counters_nest
+; PROMO-NEXT: ret void
+
+define void @nest(i32 %n) {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i32 [ 0, %outer ], [ %j.next, %inner ]
+  call void @llvm.instrprof.increment(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @__llvm_profile_name_nest, i32 0, i32 0), i64 0, i32 1, i32 0)
+  %j.next = add i32 %j, 1
+  %j.done = icmp eq i32 %j.next, %n
+  br i1 %j.done, label %outer.latch, label %inner
+
+outer.latch:
+  %i.next = add i32 %i, 1
+  %i.done = icmp eq i32 %i.next, %n
+  br i1 %i.done, label %exit, label %outer
+
+exit:
+  ret void
+}
+
+declare void @llvm.instrprof.increment(i8*, i64, i32, i32)
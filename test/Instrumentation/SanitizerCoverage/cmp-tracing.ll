@@ -3,6 +3,9 @@
 
 target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64"
 target triple = "x86_64-unknown-linux-gnu"
+
+; CHECK: @__sancov_gen_switch_cases = private constant [4 x i64] [i64 2, i64 16, i64 1, i64 -7]
+
 define i32 @foo(i32 %a, i32 %b) #0 {
 entry:
   %cmp = icmp slt i32 %a, %b
@@ -11,3 +14,24 @@ entry:
   %conv = zext i1 %cmp to i32
   ret i32 %conv
 }
+
+; CHECK-LABEL: @bar(
+define i32 @bar(i16 %x) {
+entry:
+; CHECK: %[[X:.*]] = sext i16 %x to i64
+; CHECK-NEXT: call void @__sanitizer_cov_trace_switch(i64 %[[X]], i64* getelementptr inbounds ([4 x i64], [4 x i64]* @__sancov_gen_switch_cases, i32 0, i32 0))
+; CHECK-NEXT: switch i16 %x
+  switch i16 %x, label %default [
+    i16 1, label %one
+    i16 -7, label %seven
+  ]
+
+one:
+  ret i32 1
+
+seven:
+  ret i32 7
+
+default:
+  ret i32 0
+}
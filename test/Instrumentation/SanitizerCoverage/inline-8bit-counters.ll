@@ -0,0 +1,40 @@
+; Test -sanitizer-coverage-inline-8bit-counters=1
+; RUN: opt < %s -sancov -sanitizer-coverage-level=3 -sanitizer-coverage-inline-8bit-counters=1 -S | FileCheck %s
+; RUN: opt < %s -sancov -sanitizer-coverage-level=3 -sanitizer-coverage-inline-8bit-counters=1 -mtriple=x86_64-apple-macosx -S | FileCheck %s --check-prefix=MACHO
+
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64"
+target triple = "x86_64-unknown-linux-gnu"
+
+; One counter per instrumented block, including the split critical edge, in
+; the counters section.
+; CHECK: @__sancov_gen_cov_counters = private global [4 x i8] zeroinitializer, section "__sancov_cntrs"
+; MACHO: @__sancov_gen_cov_counters = private global [4 x i8] zeroinitializer, section "__DATA,__sancov_cntrs"
+
+; CHECK-LABEL: define void @foo(
+; CHECK: entry:
+; CHECK-NEXT: load i8, i8* getelementptr inbounds ([4 x i8], [4 x i8]* @__sancov_gen_cov_counters, i64 0, i64 0), !nosanitize
+; CHECK-NEXT: add i8 %{{.*}}, 1
+; CHECK-NEXT: store i8 %{{.*}}, i8* getelementptr inbounds ([4 x i8], [4 x i8]* @__sancov_gen_cov_counters, i64 0, i64 0), !nosanitize
+; CHECK-NOT: call void @__sanitizer_cov
+; CHECK: ret void
+
+; The guard checks and their callbacks are gone.
+; CHECK-NOT: call void @__sanitizer_cov(
+; CHECK-NOT: call void @__sanitizer_cov_with_check(
+; CHECK-NOT: @__sanitizer_cov_module_init(
+
+; CHECK-LABEL: define internal void @sancov.module_ctor()
+; CHECK: call void @__sanitizer_cov_8bit_counters_init(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @__sancov_gen_cov_counters, i64 0, i64 0), i8* getelementptr inbounds ([4 x i8], [4 x i8]* @__sancov_gen_cov_counters, i64 1, i64 0))
+
+define void @foo(i32* %a) sanitize_address {
+entry:
+  %tobool = icmp eq i32* %a, null
+  br i1 %tobool, label %if.end, label %if.then
+
+if.then:
+  store i32 0, i32* %a, align 4
+  br label %if.end
+
+if.end:
+  ret void
+}
@@ -0,0 +1,68 @@
+; RUN: opt < %s -basicaa -dse -S | FileCheck %s
+; RUN: opt < %s -basicaa -dse -enable-dse-partial-overwrite-tracking=false -S | FileCheck %s --check-prefix=DISABLED
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+
+define void @write4to7(i32* nocapture %p) {
+; CHECK-LABEL: @write4to7(
+; CHECK: [[GEP:%.*]] = getelementptr inbounds i8, i8* %p3, i64 4
+; CHECK: call void @llvm.memset.p0i8.i64(i8* [[GEP]], i8 0, i64 24, i32 4, i1 false)
+; DISABLED-LABEL: @write4to7(
+; DISABLED: call void @llvm.memset.p0i8.i64(i8* %p3, i8 0, i64 28, i32 4, i1 false)
+entry:
+  %arrayidx0 = getelementptr inbounds i32, i32* %p, i64 1
+  %p3 = bitcast i32* %arrayidx0 to i8*
+  call void @llvm.memset.p0i8.i64(i8* %p3, i8 0, i64 28, i32 4, i1 false)
+  %arrayidx1 = getelementptr inbounds i32, i32* %p, i64 1
+  store i32 1, i32* %arrayidx1, align 4
+  ret void
+}
+
+define void @write0to3(i32* nocapture %p) {
+; CHECK-LABEL: @write0to3(
+; CHECK: [[GEP:%.*]] = getelementptr inbounds i8, i8* %p3, i64 4
+; CHECK: call void @llvm.memset.p0i8.i64(i8* [[GEP]], i8 0, i64 24, i32 4, i1 false)
+entry:
+  %p3 = bitcast i32* %p to i8*
+  call void @llvm.memset.p0i8.i64(i8* %p3, i8 0, i64 28, i32 4, i1 false)
+  store i32 1, i32* %p, align 4
+  ret void
+}
+
+; The source of a memcpy is advanced along with its destination.
+define void @memcpy_write0to7(i64* nocapture %p, i8* nocapture %q) {
+; CHECK-LABEL: @memcpy_write0to7(
+; CHECK: [[DST:%.*]] = getelementptr inbounds i8, i8* %p3, i64 8
+; CHECK: [[SRC:%.*]] = getelementptr inbounds i8, i8* %q, i64 8
+; CHECK: call void @llvm.memcpy.p0i8.p0i8.i64(i8* [[DST]], i8* [[SRC]], i64 24, i32 8, i1 false)
+entry:
+  %p3 = bitcast i64* %p to i8*
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %p3, i8* %q, i64 32, i32 8, i1 false)
+  store i64 1, i64* %p, align 8
+  ret void
+}
+
+; Trimming 4 bytes would break the 16 byte alignment.
+define void @dontwrite0to3_align16(i32* nocapture %p) {
+; CHECK-LABEL: @dontwrite0to3_align16(
+; CHECK: call void @llvm.memset.p0i8.i64(i8* %p3, i8 0, i64 32, i32 16, i1 false)
+entry:
+  %p3 = bitcast i32* %p to i8*
+  call void @llvm.memset.p0i8.i64(i8* %p3, i8 0, i64 32, i32 16, i1 false)
+  store i32 1, i32* %p, align 4
+  ret void
+}
+
+; The overwritten part is read in between.
+define i32 @dontwrite0to3_read(i32* nocapture %p) {
+; CHECK-LABEL: @dontwrite0to3_read(
+; CHECK: call void @llvm.memset.p0i8.i64(i8* %p3, i8 0, i64 28, i32 4, i1 false)
+entry:
+  %p3 = bitcast i32* %p to i8*
+  call void @llvm.memset.p0i8.i64(i8* %p3, i8 0, i64 28, i32 4, i1 false)
+  %v = load i32, i32* %p, align 4
+  store i32 1, i32* %p, align 4
+  ret i32 %v
+}
+
+declare void @llvm.memset.p0i8.i64(i8* nocapture, i8, i64, i32, i1) nounwind
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8* nocapture, i8* nocapture, i64, i32, i1) nounwind
@@ -0,0 +1,141 @@
+; RUN: opt < %s -basicaa -dse -enable-dse-global -S | FileCheck %s
+; RUN: opt < %s -basicaa -dse -S | FileCheck %s --check-prefix=LOCAL
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+
+declare void @use(i32*)
+declare void @may_throw()
+
+; The store in the entry block is overwritten in both successors.
+define void @diamond(i32* %p, i1 %c) {
+; CHECK-LABEL: @diamond(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: br i1 %c
+; LOCAL-LABEL: @diamond(
+; LOCAL: store i32 0, i32* %p
+entry:
+  store i32 0, i32* %p
+  br i1 %c, label %a, label %b
+
+a:
+  store i32 1, i32* %p
+  br label %exit
+
+b:
+  %x = add i32 1, 1
+  br label %b2
+
+b2:
+  store i32 2, i32* %p
+  br label %exit
+
+exit:
+  ret void
+}
+
+; The zeroed memory is completely overwritten in the successor.
+define void @memset_killed(i8* noalias %p) {
+; CHECK-LABEL: @memset_killed(
+; CHECK-NOT: call void @llvm.memset
+; CHECK: call void @llvm.memcpy
+entry:
+  call void @llvm.memset.p0i8.i64(i8* %p, i8 0, i64 16, i32 4, i1 false)
+  br label %next
+
+next:
+  call void @llvm.memcpy.p0i8.p0i8.i64(i8* %p, i8* getelementptr inbounds ([16 x i8], [16 x i8]* @src, i64 0, i64 0), i64 16, i32 4, i1 false)
+  ret void
+}
+
+; One path reads the stored value.
+define i32 @read_on_one_path(i32* %p, i1 %c) {
+; CHECK-LABEL: @read_on_one_path(
+; CHECK: store i32 0, i32* %p
+entry:
+  store i32 0, i32* %p
+  br i1 %c, label %a, label %b
+
+a:
+  store i32 1, i32* %p
+  ret i32 0
+
+b:
+  %v = load i32, i32* %p
+  store i32 2, i32* %p
+  ret i32 %v
+}
+
+; The callers may observe the store on the path that doesn't overwrite it.
+define void @not_killed_on_return(i32* %p, i1 %c) {
+; CHECK-LABEL: @not_killed_on_return(
+; CHECK: store i32 0, i32* %p
+entry:
+  store i32 0, i32* %p
+  br i1 %c, label %a, label %b
+
+a:
+  store i32 1, i32* %p
+  ret void
+
+b:
+  ret void
+}
+
+; Stores to a local are dead when the function returns.
+define void @alloca_return(i1 %c) {
+; CHECK-LABEL: @alloca_return(
+; CHECK: entry:
+; CHECK-NEXT: %a = alloca i32
+; CHECK-NEXT: br i1 %c
+entry:
+  %a = alloca i32
+  store i32 0, i32* %a
+  br i1 %c, label %then, label %exit
+
+then:
+  store i32 1, i32* %a
+  call void @use(i32* %a)
+  br label %exit
+
+exit:
+  ret void
+}
+
+; The exception handler may read the stored value.
+define void @throw_before_kill(i32* %p) {
+; CHECK-LABEL: @throw_before_kill(
+; CHECK: store i32 0, i32* %p
+entry:
+  store i32 0, i32* %p
+  br label %next
+
+next:
+  call void @may_throw() readnone
+  store i32 1, i32* %p
+  ret void
+}
+
+; The store in the loop body is overwritten by the next iteration only through
+; a different address.
+define void @loop(i32* %p, i32 %n) {
+; CHECK-LABEL: @loop(
+; CHECK: body:
+; CHECK: store i32 0, i32* %addr
+entry:
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %body ]
+  %addr = getelementptr inbounds i32, i32* %p, i32 %i
+  store i32 0, i32* %addr
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %body
+
+exit:
+  ret void
+}
+
+@src = global [16 x i8] zeroinitializer
+
+declare void @llvm.memset.p0i8.i64(i8* nocapture, i8, i64, i32, i1) nounwind
+declare void @llvm.memcpy.p0i8.p0i8.i64(i8* nocapture, i8* nocapture, i64, i32, i1) nounwind
@@ -0,0 +1,87 @@
+; RUN: opt < %s -basicaa -dse -S | FileCheck %s
+; RUN: opt < %s -basicaa -dse -enable-dse-partial-store-merging=false -S | FileCheck %s --check-prefix=DISABLED
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+
+%struct.pair = type { i32, i16, i16 }
+
+; Zero initialization followed by the initialization of some fields.
+define void @init_fields(%struct.pair* %p) {
+; CHECK-LABEL: @init_fields(
+; CHECK: store i64 3096224743817258, i64* %wide
+; CHECK-NEXT: ret void
+; DISABLED-LABEL: @init_fields(
+; DISABLED: store i64 0, i64* %wide
+; DISABLED: store i32 42
+; DISABLED: store i16 11
+entry:
+  %wide = bitcast %struct.pair* %p to i64*
+  store i64 0, i64* %wide
+  %a = getelementptr inbounds %struct.pair, %struct.pair* %p, i64 0, i32 0
+  store i32 42, i32* %a
+  %c = getelementptr inbounds %struct.pair, %struct.pair* %p, i64 0, i32 2
+  store i16 11, i16* %c
+  ret void
+}
+
+define void @merge_byte(i32* %p) {
+; CHECK-LABEL: @merge_byte(
+; CHECK: store i32 -16711936, i32* %p
+; CHECK-NEXT: ret void
+entry:
+  store i32 -16777216, i32* %p
+  %b = bitcast i32* %p to i8*
+  %b1 = getelementptr inbounds i8, i8* %b, i64 1
+  store i8 -1, i8* %b1
+  ret void
+}
+
+; The later value may be observed through %q in between.
+define void @dont_merge_read(i32* %p, i8* %q) {
+; CHECK-LABEL: @dont_merge_read(
+; CHECK: store i32 0, i32* %p
+; CHECK: load i8, i8* %q
+; CHECK: store i8 1
+entry:
+  store i32 0, i32* %p
+  %v = load i8, i8* %q
+  %b = bitcast i32* %p to i8*
+  store i8 1, i8* %b
+  store i8 %v, i8* %q
+  ret void
+}
+
+; A store to a possibly aliasing %q lies in between.
+define void @dont_merge_clobber(i32* %p, i8* %q) {
+; CHECK-LABEL: @dont_merge_clobber(
+; CHECK: store i32 0, i32* %p
+; CHECK: store i8 2, i8* %q
+; CHECK: store i8 1
+entry:
+  store i32 0, i32* %p
+  store i8 2, i8* %q
+  %b = bitcast i32* %p to i8*
+  store i8 1, i8* %b
+  ret void
+}
+
+define void @dont_merge_volatile(i32* %p) {
+; CHECK-LABEL: @dont_merge_volatile(
+; CHECK: store volatile i32 0, i32* %p
+; CHECK: store i8 1
+entry:
+  store volatile i32 0, i32* %p
+  %b = bitcast i32* %p to i8*
+  store i8 1, i8* %b
+  ret void
+}
+
+define void @dont_merge_nonconstant(i32* %p, i8 %v) {
+; CHECK-LABEL: @dont_merge_nonconstant(
+; CHECK: store i32 0, i32* %p
+; CHECK: store i8 %v
+entry:
+  store i32 0, i32* %p
+  %b = bitcast i32* %p to i8*
+  store i8 %v, i8* %b
+  ret void
+}
@@ -0,0 +1,144 @@
+; RUN: opt < %s -basicaa -gvn -S | FileCheck %s
+; RUN: opt < %s -basicaa -gvn -gvn-max-pre-insertions=1 -S | FileCheck %s --check-prefix=MAX1
+
+; Partially redundant values are inserted in several predecessors when those
+; are colder than the ones already computing the value.
+
+@G = global i32 0
+
+; CHECK-LABEL: @scalar_cold_preds(
+; CHECK: cold1:
+; CHECK-NEXT: %[[A:.*]] = add i32 %a, %b
+; CHECK-NEXT: br label %join
+; CHECK: cold2:
+; CHECK-NEXT: %[[B:.*]] = add i32 %a, %b
+; CHECK-NEXT: br label %join
+; CHECK: join:
+; CHECK-NEXT: %[[PHI:.*]] = phi i32 [ %[[B]], %cold2 ], [ %[[A]], %cold1 ], [ %v1, %hot ]
+; CHECK-NEXT: ret i32 %[[PHI]]
+
+; MAX1-LABEL: @scalar_cold_preds(
+; MAX1: join:
+; MAX1-NEXT: %v = add i32 %a, %b
+define i32 @scalar_cold_preds(i32 %a, i32 %b, i1 %c1, i1 %c2) {
+entry:
+  br i1 %c1, label %hot, label %cold, !prof !0
+
+hot:
+  %v1 = add i32 %a, %b
+  store i32 %v1, i32* @G
+  br label %join
+
+cold:
+  br i1 %c2, label %cold1, label %cold2
+
+cold1:
+  br label %join
+
+cold2:
+  br label %join
+
+join:
+  %v = add i32 %a, %b
+  ret i32 %v
+}
+
+; The value is only computed on the cold path, so nothing is inserted.
+
+; CHECK-LABEL: @scalar_hot_preds(
+; CHECK: cold1:
+; CHECK-NEXT: br label %join
+; CHECK: join:
+; CHECK-NEXT: %v = add i32 %a, %b
+define i32 @scalar_hot_preds(i32 %a, i32 %b, i1 %c1, i1 %c2) {
+entry:
+  br i1 %c1, label %cold, label %hot, !prof !1
+
+cold:
+  %v1 = add i32 %a, %b
+  store i32 %v1, i32* @G
+  br label %join
+
+hot:
+  br i1 %c2, label %hot1, label %cold1, !prof !0
+
+hot1:
+  br label %join
+
+cold1:
+  br label %join
+
+join:
+  %v = add i32 %a, %b
+  ret i32 %v
+}
+
+; The load is reloaded in the cold predecessor and on the cold critical edge,
+; which is split.
+
+; CHECK-LABEL: @load_cold_preds(
+; CHECK: cold:
+; CHECK-NEXT: br i1 %c2, label %[[SPLIT:.*]], label %cold2
+; CHECK: [[SPLIT]]:
+; CHECK-NEXT: %[[B:.*]] = load i32, i32* %p
+; CHECK-NEXT: br label %join
+; CHECK: cold2:
+; CHECK-NEXT: %[[A:.*]] = load i32, i32* %p
+; CHECK-NEXT: br label %join
+; CHECK: join:
+; CHECK-NEXT: %y = phi i32 [ %[[B]], %[[SPLIT]] ], [ %[[A]], %cold2 ], [ %x, %hot ]
+; CHECK-NEXT: ret i32 %y
+
+; MAX1-LABEL: @load_cold_preds(
+; MAX1: join:
+; MAX1-NEXT: %y = load i32, i32* %p
+define i32 @load_cold_preds(i32* noalias %p, i1 %c1, i1 %c2) {
+entry:
+  br i1 %c1, label %hot, label %cold, !prof !0
+
+hot:
+  %x = load i32, i32* %p
+  store i32 %x, i32* @G
+  br label %join
+
+cold:
+  br i1 %c2, label %join, label %cold2
+
+cold2:
+  br label %join
+
+join:
+  %y = load i32, i32* %p
+  ret i32 %y
+}
+
+; Without profile the edges missing the load are as hot as the one having it.
+
+; CHECK-LABEL: @load_no_profile(
+; CHECK: join:
+; CHECK-NEXT: %y = load i32, i32* %p
+define i32 @load_no_profile(i32* noalias %p, i1 %c1, i1 %c2) {
+entry:
+  br i1 %c1, label %hot, label %cold
+
+hot:
+  %x = load i32, i32* %p
+  store i32 %x, i32* @G
+  br label %join
+
+cold:
+  br i1 %c2, label %cold1, label %cold2
+
+cold1:
+  br label %join
+
+cold2:
+  br label %join
+
+join:
+  %y = load i32, i32* %p
+  ret i32 %y
+}
+
+!0 = !{!"branch_weights", i32 1000, i32 1}
+!1 = !{!"branch_weights", i32 1, i32 1000}
@@ -0,0 +1,127 @@
+; RUN: opt -hotcoldsplit -S < %s | FileCheck %s
+; RUN: opt -hotcoldsplit -hotcoldsplit-threshold=100 -S < %s | FileCheck %s --check-prefix=THRESHOLD
+
+target triple = "x86_64-unknown-linux-gnu"
+
+declare void @sink(i32)
+declare void @report(i32) cold
+declare void @abort() noreturn
+
+; The error path ends in a call to a noreturn function and is outlined; the
+; hot path stays where it is.
+
+; CHECK-LABEL: define i32 @noreturn_path(
+; CHECK: entry:
+; CHECK: br i1 %bad, label %codeRepl, label %ok
+; CHECK: codeRepl:
+; CHECK-NEXT: call void @noreturn_path_fail(i32 %x)
+; CHECK: ok:
+; CHECK: ret i32
+
+; THRESHOLD-LABEL: define i32 @noreturn_path(
+; THRESHOLD: fail:
+; THRESHOLD: call void @abort()
+
+define i32 @noreturn_path(i32 %x) {
+entry:
+  %bad = icmp slt i32 %x, 0
+  br i1 %bad, label %fail, label %ok
+
+fail:
+  %a = mul i32 %x, 3
+  call void @sink(i32 %a)
+  %b = add i32 %a, 7
+  call void @sink(i32 %b)
+  call void @abort()
+  unreachable
+
+ok:
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+; A cold call marks its block and the cold blocks it dominates; the join block
+; is shared with the hot path and is not moved.
+
+; CHECK-LABEL: define i32 @cold_call(
+; CHECK: codeRepl:
+; CHECK-NEXT: call void @cold_call_warn(i32 %x)
+; CHECK-NEXT: br label %join
+; CHECK: join:
+; CHECK: ret i32
+
+define i32 @cold_call(i32 %x) {
+entry:
+  %odd = icmp eq i32 %x, 42
+  br i1 %odd, label %warn, label %join
+
+warn:
+  call void @report(i32 %x)
+  %y = mul i32 %x, %x
+  call void @sink(i32 %y)
+  br label %more
+
+more:
+  %z = add i32 %y, 5
+  call void @sink(i32 %z)
+  br label %join
+
+join:
+  %r = add i32 %x, 2
+  ret i32 %r
+}
+
+; With a profile, a block that ran far less often than the function was
+; entered is outlined even without a cold hint.
+
+; CHECK-LABEL: define i32 @profiled(
+; CHECK: br i1 %rare, label %codeRepl, label %common
+; CHECK: codeRepl:
+; CHECK-NEXT: call void @profiled_slow(i32 %x)
+
+define i32 @profiled(i32 %x) !prof !0 {
+entry:
+  %rare = icmp eq i32 %x, 7
+  br i1 %rare, label %slow, label %common, !prof !1
+
+slow:
+  %a = mul i32 %x, 13
+  call void @sink(i32 %a)
+  %b = xor i32 %a, 5
+  call void @sink(i32 %b)
+  br label %common
+
+common:
+  %r = add i32 %x, 3
+  ret i32 %r
+}
+
+; The same branch without a profile is left alone.
+
+; CHECK-LABEL: define i32 @unprofiled(
+; CHECK-NOT: codeRepl
+; CHECK: ret i32
+
+define i32 @unprofiled(i32 %x) {
+entry:
+  %rare = icmp eq i32 %x, 7
+  br i1 %rare, label %slow, label %common
+
+slow:
+  %a = mul i32 %x, 13
+  call void @sink(i32 %a)
+  %b = xor i32 %a, 5
+  call void @sink(i32 %b)
+  br label %common
+
+common:
+  %r = add i32 %x, 3
+  ret i32 %r
+}
+
+; CHECK: define internal void @noreturn_path_fail(i32 %x) #[[ATTR:[0-9]+]] section ".text.cold"
+; CHECK: define internal void @cold_call_warn(i32 %x) #[[ATTR]] section ".text.cold"
+; CHECK: attributes #[[ATTR]] = { cold minsize noinline }
+
+!0 = !{!"function_entry_count", i64 100000}
+!1 = !{!"branch_weights", i32 1, i32 100000}
@@ -0,0 +1,45 @@
+; REQUIRES: asserts
+; RUN: opt < %s -inline -S | FileCheck %s
+; RUN: opt < %s -inline -disable-output -stats -info-output-file - | \
+; RUN:   FileCheck %s -check-prefix=STATS
+; RUN: opt < %s -inline -disable-inline-cost-cache -disable-output -stats \
+; RUN:   -info-output-file - | FileCheck %s -check-prefix=NOCACHE
+
+; The three calls of @callee with opaque arguments share one cost analysis.
+; The call with a constant argument folds the branch in @callee, so it must
+; be analyzed separately.
+
+; STATS: 2 inline-cost - Number of inline costs found in the cache
+; STATS: 2 inline-cost - Number of inline costs missing in the cache
+; NOCACHE-NOT: Number of inline costs found in the cache
+
+@g = global i32 0
+
+define i32 @callee(i32 %x) {
+entry:
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %zero, label %nonzero
+
+zero:
+  ret i32 0
+
+nonzero:
+  %v = load volatile i32, i32* @g
+  %r = add i32 %v, %x
+  ret i32 %r
+}
+
+define i32 @caller(i32 %a, i32 %b, i32 %c) {
+; CHECK-LABEL: @caller(
+; CHECK-NOT: call i32 @callee
+; CHECK: ret i32
+entry:
+  %r1 = call i32 @callee(i32 %a)
+  %r2 = call i32 @callee(i32 %b)
+  %r3 = call i32 @callee(i32 %c)
+  %r4 = call i32 @callee(i32 0)
+  %s1 = add i32 %r1, %r2
+  %s2 = add i32 %s1, %r3
+  %s3 = add i32 %s2, %r4
+  ret i32 %s3
+}
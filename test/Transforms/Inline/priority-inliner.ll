@@ -0,0 +1,72 @@
+; RUN: opt < %s -inline-priority -inline-priority-budget=100 -S | FileCheck %s
+; RUN: opt < %s -inline-priority -inline-priority-budget=100 \
+; RUN:   -inline-priority-report -disable-output 2>&1 | \
+; RUN:   FileCheck %s -check-prefix=REPORT
+; RUN: opt < %s -inline-priority -inline-priority-budget=1000 -S | \
+; RUN:   FileCheck %s -check-prefix=LARGE
+
+; The budget is only large enough for one copy of @work. The call in the loop
+; of @hot executes far more often than the one in @cold, so it is inlined
+; first and the call in @cold is left alone.
+
+@a = global i32 4
+
+define i32 @work(i32 %x) {
+entry:
+  %a1 = load volatile i32, i32* @a
+  %x1 = add i32 %x, %a1
+  %a2 = load volatile i32, i32* @a
+  %x2 = add i32 %x1, %a2
+  %a3 = load volatile i32, i32* @a
+  %x3 = add i32 %x2, %a3
+  %a4 = load volatile i32, i32* @a
+  %x4 = add i32 %x3, %a4
+  %a5 = load volatile i32, i32* @a
+  %x5 = add i32 %x4, %a5
+  %a6 = load volatile i32, i32* @a
+  %x6 = add i32 %x5, %a6
+  %a7 = load volatile i32, i32* @a
+  %x7 = add i32 %x6, %a7
+  %a8 = load volatile i32, i32* @a
+  %x8 = add i32 %x7, %a8
+  %a9 = load volatile i32, i32* @a
+  %x9 = add i32 %x8, %a9
+  %a10 = load volatile i32, i32* @a
+  %x10 = add i32 %x9, %a10
+  ret i32 %x10
+}
+
+define i32 @cold(i32 %x) {
+; CHECK-LABEL: @cold(
+; CHECK: call i32 @work
+; LARGE-LABEL: @cold(
+; LARGE-NOT: call i32 @work
+entry:
+  %r = call i32 @work(i32 %x)
+  ret i32 %r
+}
+
+define i32 @hot(i32 %n) {
+; CHECK-LABEL: @hot(
+; CHECK-NOT: call i32 @work
+; LARGE-LABEL: @hot(
+; LARGE-NOT: call i32 @work
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %sum = phi i32 [ 0, %entry ], [ %sum.next, %loop ]
+  %r = call i32 @work(i32 %i)
+  %sum.next = add i32 %sum, %r
+  %i.next = add i32 %i, 1
+  %cmp = icmp slt i32 %i.next, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  ret i32 %sum.next
+}
+
+; REPORT: inline-priority: hot -> work: inlined
+; REPORT-NEXT: inline-priority: cold -> work: over budget
+; REPORT-NEXT: inline-priority: growth {{[0-9]+}} of budget {{[0-9]+}} instructions
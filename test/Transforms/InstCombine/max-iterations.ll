@@ -0,0 +1,26 @@
+; RUN: opt < %s -instcombine -S | FileCheck %s
+; RUN: opt < %s -instcombine -instcombine-max-iterations=1 -S | FileCheck %s --check-prefix=CAP
+; RUN: opt < %s -instcombine -instcombine-visit-stats -info-output-file - -disable-output | FileCheck %s --check-prefix=STATS
+
+; With a single iteration, the chain below still folds completely: the users
+; of each combined instruction are revisited through the worklist. The
+; intermediate adds are left dead, as only a new iteration would sweep them.
+
+define i32 @chain(i32 %x) {
+; CHECK-LABEL: @chain(
+; CHECK-NEXT:  %d = add i32 %x, 10
+; CHECK-NEXT:  ret i32 %d
+; CAP-LABEL: @chain(
+; CAP:       %d = add i32 %x, 10
+; CAP-NEXT:  ret i32 %d
+  %a = add i32 %x, 1
+  %b = add i32 %a, 2
+  %c = add i32 %b, 3
+  %d = add i32 %c, 4
+  ret i32 %d
+}
+
+; STATS: Instruction combining visitor statistics
+; STATS: Visits Hits Time (s) Opcode
+; STATS-DAG: {{[0-9]+}} {{[0-9]+}} {{[0-9.]+}} add
+; STATS-DAG: {{[0-9]+}} {{[0-9]+}} {{[0-9.]+}} ret
@@ -0,0 +1,43 @@
+; RUN: opt < %s -jump-threading -S | FileCheck %s
+; RUN: opt < %s -jump-threading -lvi-max-cache-entries=0 -S | FileCheck %s
+; RUN: opt < %s -jump-threading -lvi-max-processed-per-query=1 -S | FileCheck %s --check-prefix=GIVEUP
+
+; LazyValueInfo proves that %x > 5 on the edge from %a, whose predecessor
+; checked %x > 10. Dropping the cache between queries gives the same answer,
+; while a solver not allowed to look past the first block value gives up and
+; nothing is threaded.
+
+; CHECK-LABEL: @lvi(
+; CHECK: merge.thread:
+; CHECK-NEXT: call void @f()
+; CHECK-NEXT: br label %t
+
+; GIVEUP-LABEL: @lvi(
+; GIVEUP-NOT: .thread
+; GIVEUP: merge:
+; GIVEUP-NEXT: %d = icmp sgt i32 %x, 5
+
+declare void @f()
+define i32 @lvi(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 10
+  br i1 %c, label %a, label %b
+
+a:
+  call void @f()
+  br label %merge
+
+b:
+  call void @f()
+  br label %merge
+
+merge:
+  %d = icmp sgt i32 %x, 5
+  br i1 %d, label %t, label %e
+
+t:
+  ret i32 1
+
+e:
+  ret i32 0
+}
@@ -0,0 +1,71 @@
+; RUN: opt < %s -jump-threading -S | FileCheck %s
+; RUN: opt < %s -jump-threading -jump-threading-cold-edge-percent=0 -S | FileCheck %s --check-prefix=NOPROF
+
+declare void @f()
+declare void @g()
+
+; The edge from %rare into %merge is taken once every 10000 entries, so %merge
+; is not duplicated for it.
+
+; CHECK-LABEL: @cold(
+; CHECK-NOT: .thread
+; CHECK: merge:
+; CHECK-NEXT: %p = phi i1 [ %d, %common ], [ true, %entry ]
+; NOPROF-LABEL: @cold(
+; NOPROF: merge.thread:
+; NOPROF-NEXT: call void @f()
+; NOPROF-NEXT: br label %t
+define void @cold(i1 %c, i1 %d, i1 %x) {
+entry:
+  br i1 %c, label %rare, label %common, !prof !0
+
+rare:
+  br label %merge
+
+common:
+  br i1 %x, label %merge, label %e
+
+merge:
+  %p = phi i1 [ true, %rare ], [ %d, %common ]
+  call void @f()
+  br i1 %p, label %t, label %e
+
+t:
+  call void @g()
+  ret void
+
+e:
+  ret void
+}
+
+; The same edge, taken half of the time, is threaded.
+
+; CHECK-LABEL: @hot(
+; CHECK: merge.thread:
+; CHECK-NEXT: call void @f()
+; CHECK-NEXT: br label %t
+define void @hot(i1 %c, i1 %d, i1 %x) {
+entry:
+  br i1 %c, label %left, label %right, !prof !1
+
+left:
+  br label %merge
+
+right:
+  br i1 %x, label %merge, label %e
+
+merge:
+  %p = phi i1 [ true, %left ], [ %d, %right ]
+  call void @f()
+  br i1 %p, label %t, label %e
+
+t:
+  call void @g()
+  ret void
+
+e:
+  ret void
+}
+
+!0 = !{!"branch_weights", i32 1, i32 10000}
+!1 = !{!"branch_weights", i32 1, i32 1}
@@ -0,0 +1,228 @@
+; RUN: opt < %s -basicaa -loop-fuse -S | FileCheck %s
+; RUN: opt < %s -basicaa -loop-fuse -loop-fuse-max-live-values=4 -S | FileCheck %s --check-prefix=PRESSURE
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+
+; a[i] = b[i] + c[i]; d[i] = a[i] * 2 over the same range becomes one loop,
+; which reads a[i] right after writing it.
+
+; CHECK-LABEL: @same_iteration(
+; CHECK: loop1:
+; CHECK-NEXT: %i = phi i64 [ 0, %entry ], [ %i.next, %loop2 ]
+; CHECK-NEXT: %j = phi i64 [ 0, %entry ], [ %j.next, %loop2 ]
+; CHECK: store i32 %sum
+; CHECK-NEXT: %i.next = add nuw nsw i64 %i, 1
+; CHECK-NEXT: br label %loop2
+; CHECK-NOT: between:
+; CHECK: loop2:
+; CHECK: store i32 %dbl
+; CHECK: br i1 %done2, label %exit, label %loop1
+
+; The fused loop would keep too many values live.
+
+; PRESSURE-LABEL: @same_iteration(
+; PRESSURE: between:
+; PRESSURE: br label %loop2
+
+define void @same_iteration(i32* noalias %a, i32* noalias %b, i32* noalias %c, i32* noalias %d) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop1 ]
+  %b.addr = getelementptr inbounds i32, i32* %b, i64 %i
+  %b.val = load i32, i32* %b.addr, align 4
+  %c.addr = getelementptr inbounds i32, i32* %c, i64 %i
+  %c.val = load i32, i32* %c.addr, align 4
+  %sum = add i32 %b.val, %c.val
+  %a.addr = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 %sum, i32* %a.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %done1 = icmp eq i64 %i.next, 1024
+  br i1 %done1, label %between, label %loop1
+
+between:
+  br label %loop2
+
+loop2:
+  %j = phi i64 [ 0, %between ], [ %j.next, %loop2 ]
+  %a.addr2 = getelementptr inbounds i32, i32* %a, i64 %j
+  %a.val = load i32, i32* %a.addr2, align 4
+  %dbl = shl i32 %a.val, 1
+  %d.addr = getelementptr inbounds i32, i32* %d, i64 %j
+  store i32 %dbl, i32* %d.addr, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %done2 = icmp eq i64 %j.next, 1024
+  br i1 %done2, label %exit, label %loop2
+
+exit:
+  ret void
+}
+
+; The second loop reads a[i - 1], which the first loop wrote in an earlier
+; iteration.
+
+; CHECK-LABEL: @reads_behind(
+; CHECK-NOT: between:
+; CHECK: br i1 %done2, label %exit, label %loop1
+
+define void @reads_behind(i32* noalias %a, i32* noalias %b, i32* noalias %c, i32* noalias %d) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i64 [ 1, %entry ], [ %i.next, %loop1 ]
+  %b.addr = getelementptr inbounds i32, i32* %b, i64 %i
+  %b.val = load i32, i32* %b.addr, align 4
+  %c.addr = getelementptr inbounds i32, i32* %c, i64 %i
+  %c.val = load i32, i32* %c.addr, align 4
+  %sum = add i32 %b.val, %c.val
+  %a.addr = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 %sum, i32* %a.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %done1 = icmp eq i64 %i.next, 1024
+  br i1 %done1, label %between, label %loop1
+
+between:
+  br label %loop2
+
+loop2:
+  %j = phi i64 [ 1, %between ], [ %j.next, %loop2 ]
+  %j.behind = add nsw i64 %j, -1
+  %a.addr2 = getelementptr inbounds i32, i32* %a, i64 %j.behind
+  %a.val = load i32, i32* %a.addr2, align 4
+  %dbl = shl i32 %a.val, 1
+  %d.addr = getelementptr inbounds i32, i32* %d, i64 %j
+  store i32 %dbl, i32* %d.addr, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %done2 = icmp eq i64 %j.next, 1024
+  br i1 %done2, label %exit, label %loop2
+
+exit:
+  ret void
+}
+
+; The second loop reads a[i + 1] before the first loop writes it.
+
+; CHECK-LABEL: @reads_ahead(
+; CHECK: between:
+; CHECK: br i1 %done2, label %exit, label %loop2
+
+define void @reads_ahead(i32* noalias %a, i32* noalias %b, i32* noalias %c, i32* noalias %d) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop1 ]
+  %b.addr = getelementptr inbounds i32, i32* %b, i64 %i
+  %b.val = load i32, i32* %b.addr, align 4
+  %c.addr = getelementptr inbounds i32, i32* %c, i64 %i
+  %c.val = load i32, i32* %c.addr, align 4
+  %sum = add i32 %b.val, %c.val
+  %a.addr = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 %sum, i32* %a.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %done1 = icmp eq i64 %i.next, 1024
+  br i1 %done1, label %between, label %loop1
+
+between:
+  br label %loop2
+
+loop2:
+  %j = phi i64 [ 0, %between ], [ %j.next, %loop2 ]
+  %j.ahead = add nuw nsw i64 %j, 1
+  %a.addr2 = getelementptr inbounds i32, i32* %a, i64 %j.ahead
+  %a.val = load i32, i32* %a.addr2, align 4
+  %dbl = shl i32 %a.val, 1
+  %d.addr = getelementptr inbounds i32, i32* %d, i64 %j
+  store i32 %dbl, i32* %d.addr, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %done2 = icmp eq i64 %j.next, 1024
+  br i1 %done2, label %exit, label %loop2
+
+exit:
+  ret void
+}
+
+; The loops run a different number of iterations.
+
+; CHECK-LABEL: @different_trip_counts(
+; CHECK: between:
+; CHECK: br i1 %done2, label %exit, label %loop2
+
+define void @different_trip_counts(i32* noalias %a, i32* noalias %b, i32* noalias %c, i32* noalias %d) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop1 ]
+  %b.addr = getelementptr inbounds i32, i32* %b, i64 %i
+  %b.val = load i32, i32* %b.addr, align 4
+  %c.addr = getelementptr inbounds i32, i32* %c, i64 %i
+  %c.val = load i32, i32* %c.addr, align 4
+  %sum = add i32 %b.val, %c.val
+  %a.addr = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 %sum, i32* %a.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %done1 = icmp eq i64 %i.next, 1024
+  br i1 %done1, label %between, label %loop1
+
+between:
+  br label %loop2
+
+loop2:
+  %j = phi i64 [ 0, %between ], [ %j.next, %loop2 ]
+  %a.addr2 = getelementptr inbounds i32, i32* %a, i64 %j
+  %a.val = load i32, i32* %a.addr2, align 4
+  %dbl = shl i32 %a.val, 1
+  %d.addr = getelementptr inbounds i32, i32* %d, i64 %j
+  store i32 %dbl, i32* %d.addr, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %done2 = icmp eq i64 %j.next, 1000
+  br i1 %done2, label %exit, label %loop2
+
+exit:
+  ret void
+}
+
+; Code between the loops keeps them apart.
+
+; CHECK-LABEL: @code_between(
+; CHECK: between:
+; CHECK: br i1 %done2, label %exit, label %loop2
+
+define void @code_between(i32* noalias %a, i32* noalias %b, i32* noalias %c, i32* noalias %d) {
+entry:
+  br label %loop1
+
+loop1:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop1 ]
+  %b.addr = getelementptr inbounds i32, i32* %b, i64 %i
+  %b.val = load i32, i32* %b.addr, align 4
+  %c.addr = getelementptr inbounds i32, i32* %c, i64 %i
+  %c.val = load i32, i32* %c.addr, align 4
+  %sum = add i32 %b.val, %c.val
+  %a.addr = getelementptr inbounds i32, i32* %a, i64 %i
+  store i32 %sum, i32* %a.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %done1 = icmp eq i64 %i.next, 1024
+  br i1 %done1, label %between, label %loop1
+
+between:
+  store i32 0, i32* %d, align 4
+  br label %loop2
+
+loop2:
+  %j = phi i64 [ 0, %between ], [ %j.next, %loop2 ]
+  %a.addr2 = getelementptr inbounds i32, i32* %a, i64 %j
+  %a.val = load i32, i32* %a.addr2, align 4
+  %dbl = shl i32 %a.val, 1
+  %d.addr = getelementptr inbounds i32, i32* %d, i64 %j
+  store i32 %dbl, i32* %d.addr, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %done2 = icmp eq i64 %j.next, 1024
+  br i1 %done2, label %exit, label %loop2
+
+exit:
+  ret void
+}
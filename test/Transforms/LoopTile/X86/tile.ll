@@ -0,0 +1,203 @@
+; RUN: opt < %s -basicaa -loop-tile -S | FileCheck %s
+; RUN: opt < %s -basicaa -loop-tile -mcpu=atom -S | FileCheck %s --check-prefix=ATOM
+; RUN: opt < %s -basicaa -loop-tile -loop-tile-size=16 -S | FileCheck %s --check-prefix=SIZE16
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@A = global [1024 x [1024 x float]] zeroinitializer, align 16
+@B = global [1024 x [1024 x float]] zeroinitializer, align 16
+
+; for (i = 0; i < 1024; ++i)
+;   for (j = 0; j < 1024; ++j)
+;     B[j][i] = A[i][j];
+;
+; Tiles of 64 x 64 floats of both arrays fill the 32KB L1 cache, 48 x 48 fill
+; the 24KB of Atom.
+
+; CHECK-LABEL: @transpose(
+; CHECK: entry:
+; CHECK-NEXT: br label %tile.i.header
+; CHECK: tile.i.header:
+; CHECK-NEXT: %ii = phi i64 [ 0, %entry ], [ %i.end, %tile.i.latch ]
+; CHECK: tile.j.header:
+; CHECK-NEXT: %jj = phi i64 [ 0, %tile.i.header ], [ %j.end, %tile.j.latch ]
+; CHECK-NEXT: %ii.end = add i64 %ii, 64
+; CHECK-NEXT: %ii.left = sub i64 1024, %ii
+; CHECK-NEXT: [[IL:%.*]] = icmp ugt i64 %ii.left, 64
+; CHECK-NEXT: %i.end = select i1 [[IL]], i64 %ii.end, i64 1024
+; CHECK-NEXT: %jj.end = add i64 %jj, 64
+; CHECK-NEXT: %jj.left = sub i64 1024, %jj
+; CHECK-NEXT: [[JL:%.*]] = icmp ugt i64 %jj.left, 64
+; CHECK-NEXT: %j.end = select i1 [[JL]], i64 %jj.end, i64 1024
+; CHECK-NEXT: br label %outer
+; CHECK: outer:
+; CHECK-NEXT: %i = phi i64 [ %ii, %tile.j.header ], [ %i.next, %outer.latch ]
+; CHECK: inner:
+; CHECK-NEXT: %j = phi i64 [ %jj, %outer ], [ %j.next, %inner ]
+; CHECK: %j.done = icmp eq i64 %j.next, %j.end
+; CHECK: outer.latch:
+; CHECK: %i.done = icmp eq i64 %i.next, %i.end
+; CHECK-NEXT: br i1 %i.done, label %tile.j.latch, label %outer
+; CHECK: tile.j.latch:
+; CHECK-NEXT: [[JC:%.*]] = icmp ne i64 %j.end, 1024
+; CHECK-NEXT: br i1 [[JC]], label %tile.j.header, label %tile.i.latch
+; CHECK: tile.i.latch:
+; CHECK-NEXT: [[IC:%.*]] = icmp ne i64 %i.end, 1024
+; CHECK-NEXT: br i1 [[IC]], label %tile.i.header, label %exit
+
+; ATOM-LABEL: @transpose(
+; ATOM: %ii.end = add i64 %ii, 48
+
+; SIZE16-LABEL: @transpose(
+; SIZE16: %ii.end = add i64 %ii, 16
+
+define void @transpose() {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %src = getelementptr inbounds [1024 x [1024 x float]], [1024 x [1024 x float]]* @A, i64 0, i64 %i, i64 %j
+  %v = load float, float* %src, align 4
+  %dst = getelementptr inbounds [1024 x [1024 x float]], [1024 x [1024 x float]]* @B, i64 0, i64 %j, i64 %i
+  store float %v, float* %dst, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %j.done = icmp eq i64 %j.next, 1024
+  br i1 %j.done, label %outer.latch, label %inner
+
+outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %i.done = icmp eq i64 %i.next, 1024
+  br i1 %i.done, label %exit, label %outer
+
+exit:
+  ret void
+}
+
+; for (i = 1; i < 1024; ++i)
+;   for (j = 0; j < 1023; ++j)
+;     A[i][j] = A[i - 1][j + 1];
+;
+; The dependence runs forwards in i but backwards in j, so the loops cannot
+; be reordered.
+
+; CHECK-LABEL: @skewed_dependence(
+; CHECK-NOT: tile.i.header
+; CHECK: ret void
+
+define void @skewed_dependence() {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 1, %entry ], [ %i.next, %outer.latch ]
+  %i.prev = add nsw i64 %i, -1
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %j.next = add nuw nsw i64 %j, 1
+  %src = getelementptr inbounds [1024 x [1024 x float]], [1024 x [1024 x float]]* @A, i64 0, i64 %i.prev, i64 %j.next
+  %v = load float, float* %src, align 4
+  %dst = getelementptr inbounds [1024 x [1024 x float]], [1024 x [1024 x float]]* @A, i64 0, i64 %i, i64 %j
+  store float %v, float* %dst, align 4
+  %j.done = icmp eq i64 %j.next, 1023
+  br i1 %j.done, label %outer.latch, label %inner
+
+outer.latch:
+  %i.next = add nuw nsw i64 %i, 1
+  %i.done = icmp eq i64 %i.next, 1024
+  br i1 %i.done, label %exit, label %outer
+
+exit:
+  ret void
+}
+
+; The outer loop stores outside of the inner loop.
+
+; CHECK-LABEL: @imperfect(
+; CHECK-NOT: tile.i.header
+; CHECK: ret void
+
+define void @imperfect() {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %j = phi i64 [ 0, %outer ], [ %j.next, %inner ]
+  %src = getelementptr inbounds [1024 x [1024 x float]], [1024 x [1024 x float]]* @A, i64 0, i64 %i, i64 %j
+  %v = load float, float* %src, align 4
+  %dst = getelementptr inbounds [1024 x [1024 x float]], [1024 x [1024 x float]]* @B, i64 0, i64 %j, i64 %i
+  store float %v, float* %dst, align 4
+  %j.next = add nuw nsw i64 %j, 1
+  %j.done = icmp eq i64 %j.next, 1024
+  br i1 %j.done, label %outer.latch, label %inner
+
+outer.latch:
+  %diag = getelementptr inbounds [1024 x [1024 x float]], [1024 x [1024 x float]]* @B, i64 0, i64 %i, i64 %i
+  store float 0.0, float* %diag, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %i.done = icmp eq i64 %i.next, 1024
+  br i1 %i.done, label %exit, label %outer
+
+exit:
+  ret void
+}
+
+; for (i = 0; i < 127; ++i)
+;   for (j = 0; j < 127; ++j)
+;     C[j][i] = D[i][j];
+;
+; With i8 induction variables the second tile would step past 127. The tiles
+; must end at the bound rather than wrap around to -128.
+
+@C = global [128 x [128 x float]] zeroinitializer, align 16
+@D = global [128 x [128 x float]] zeroinitializer, align 16
+
+; SIZE16-LABEL: @near_max(
+; SIZE16: tile.j.header:
+; SIZE16: %ii.end = add i8 %ii, 16
+; SIZE16-NEXT: %ii.left = sub i8 127, %ii
+; SIZE16-NEXT: [[IL:%.*]] = icmp ugt i8 %ii.left, 16
+; SIZE16-NEXT: %i.end = select i1 [[IL]], i8 %ii.end, i8 127
+; SIZE16: tile.i.latch:
+; SIZE16-NEXT: [[IC:%.*]] = icmp ne i8 %i.end, 127
+; SIZE16-NEXT: br i1 [[IC]], label %tile.i.header, label %exit
+
+define void @near_max() {
+entry:
+  br label %outer
+
+outer:
+  %i = phi i8 [ 0, %entry ], [ %i.next, %outer.latch ]
+  %i.ext = zext i8 %i to i64
+  br label %inner
+
+inner:
+  %j = phi i8 [ 0, %outer ], [ %j.next, %inner ]
+  %j.ext = zext i8 %j to i64
+  %src = getelementptr inbounds [128 x [128 x float]], [128 x [128 x float]]* @D, i64 0, i64 %i.ext, i64 %j.ext
+  %v = load float, float* %src, align 4
+  %dst = getelementptr inbounds [128 x [128 x float]], [128 x [128 x float]]* @C, i64 0, i64 %j.ext, i64 %i.ext
+  store float %v, float* %dst, align 4
+  %j.next = add nuw nsw i8 %j, 1
+  %j.done = icmp eq i8 %j.next, 127
+  br i1 %j.done, label %outer.latch, label %inner
+
+outer.latch:
+  %i.next = add nuw nsw i8 %i, 1
+  %i.done = icmp eq i8 %i.next, 127
+  br i1 %i.done, label %exit, label %outer
+
+exit:
+  ret void
+}
@@ -0,0 +1,118 @@
+; RUN: opt < %s -loop-unswitch -S | FileCheck %s
+; RUN: opt < %s -loop-unswitch -loop-unswitch-function-budget=0 -S | FileCheck %s --check-prefix=NOBUDGET
+; RUN: opt < %s -loop-unswitch -loop-unswitch-function-budget=8 -S | FileCheck %s --check-prefix=ONE
+
+; The loop of @cold is entered once every 10000 calls, so it is not cloned.
+
+; CHECK-LABEL: @cold(
+; CHECK-NOT: .us
+; CHECK: loop:
+; CHECK: br i1 %flag, label %then, label %else
+
+; CHECK-LABEL: @hot(
+; CHECK: loop.preheader:
+; CHECK-NEXT: br i1 %flag, label %loop.preheader.split.us
+
+; Without growth budget, no loop is cloned.
+
+; NOBUDGET-LABEL: @hot(
+; NOBUDGET-NOT: .us
+; NOBUDGET: br i1 %flag, label %then, label %else
+
+; The hottest case of the switch is unswitched first, and the budget only
+; allows one copy of the loop.
+
+; CHECK-LABEL: @switch(
+; CHECK: entry:
+; CHECK-NEXT: %0 = icmp eq i32 %k, 2
+; CHECK: %1 = icmp eq i32 %k, 1
+
+; ONE-LABEL: @switch(
+; ONE: %0 = icmp eq i32 %k, 2
+; ONE-NOT: icmp eq i32 %k, 1
+
+declare void @a()
+declare void @b()
+declare void @c()
+
+define void @cold(i32 %n, i1 %flag, i1 %enter) {
+entry:
+  br i1 %enter, label %loop, label %exit, !prof !0
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  br i1 %flag, label %then, label %else
+
+then:
+  call void @a()
+  br label %latch
+
+else:
+  call void @b()
+  br label %latch
+
+latch:
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+define void @hot(i32 %n, i1 %flag, i1 %enter) {
+entry:
+  br i1 %enter, label %loop, label %exit, !prof !1
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  br i1 %flag, label %then, label %else
+
+then:
+  call void @a()
+  br label %latch
+
+else:
+  call void @b()
+  br label %latch
+
+latch:
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+define void @switch(i32 %n, i32 %k) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  switch i32 %k, label %latch [
+    i32 1, label %one
+    i32 2, label %two
+  ], !prof !2
+
+one:
+  call void @a()
+  br label %latch
+
+two:
+  call void @b()
+  br label %latch
+
+latch:
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
+
+!0 = !{!"branch_weights", i32 1, i32 10000}
+!1 = !{!"branch_weights", i32 10000, i32 1}
+!2 = !{!"branch_weights", i32 1, i32 10, i32 1000}
@@ -0,0 +1,136 @@
+; RUN: opt < %s -basicaa -loop-vectorize -force-vector-width=16 -force-vector-interleave=1 -mcpu=knl -S | FileCheck %s -check-prefix=AVX512
+; RUN: opt < %s -basicaa -loop-vectorize -force-vector-width=8 -force-vector-interleave=1 -mcpu=core-avx2 -S | FileCheck %s -check-prefix=AVX2
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; The source code:
+;
+;void foo1(float *in, float *out, int *trigger, int *index) {
+;  for (int i=0; i < 4096; ++i) {
+;    if (trigger[i] > 0) {
+;      out[i] = in[index[i]] + (float) 0.5;
+;    }
+;  }
+;}
+
+; AVX512-LABEL: @foo1
+; AVX512: call <16 x i32> @llvm.masked.load.v16i32
+; AVX512: [[GEP:%.*]] = getelementptr inbounds float, float* %in, <16 x i64>
+; AVX512: call <16 x float> @llvm.masked.gather.v16f32(<16 x float*> [[GEP]]
+; AVX512: call void @llvm.masked.store.v16f32
+; AVX512: ret void
+
+; AVX2-LABEL: @foo1
+; AVX2-NOT: llvm.masked.gather
+; AVX2: ret void
+
+define void @foo1(float* noalias %in, float* noalias %out, i32* noalias %trigger, i32* noalias %index) {
+entry:
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %entry ], [ %indvars.iv.next, %for.inc ]
+  %arrayidx = getelementptr inbounds i32, i32* %trigger, i64 %indvars.iv
+  %0 = load i32, i32* %arrayidx, align 4
+  %cmp1 = icmp sgt i32 %0, 0
+  br i1 %cmp1, label %if.then, label %for.inc
+
+if.then:
+  %arrayidx3 = getelementptr inbounds i32, i32* %index, i64 %indvars.iv
+  %1 = load i32, i32* %arrayidx3, align 4
+  %idxprom4 = sext i32 %1 to i64
+  %arrayidx5 = getelementptr inbounds float, float* %in, i64 %idxprom4
+  %2 = load float, float* %arrayidx5, align 4
+  %add = fadd float %2, 5.000000e-01
+  %arrayidx7 = getelementptr inbounds float, float* %out, i64 %indvars.iv
+  store float %add, float* %arrayidx7, align 4
+  br label %for.inc
+
+for.inc:
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond = icmp eq i64 %indvars.iv.next, 4096
+  br i1 %exitcond, label %for.end, label %for.body
+
+for.end:
+  ret void
+}
+
+; The source code:
+;
+;void foo2(float *out, int *index, float *in) {
+;  for (int i=0; i < 4096; i += 16) {
+;    out[index[i]] = in[i];
+;  }
+;}
+
+; AVX512-LABEL: @foo2
+; AVX512: [[GEP:%.*]] = getelementptr inbounds float, float* %out, <16 x i64>
+; AVX512: call void @llvm.masked.scatter.v16f32(<16 x float> {{.*}}, <16 x float*> [[GEP]], i32 4, <16 x i1> <i1 true
+; AVX512: ret void
+
+; AVX2-LABEL: @foo2
+; AVX2-NOT: llvm.masked.scatter
+; AVX2: ret void
+
+define void @foo2(float* noalias %out, i32* noalias %index, float* noalias %in) {
+entry:
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %entry ], [ %indvars.iv.next, %for.body ]
+  %arrayidx = getelementptr inbounds i32, i32* %index, i64 %indvars.iv
+  %0 = load i32, i32* %arrayidx, align 4
+  %idxprom = sext i32 %0 to i64
+  %arrayidx2 = getelementptr inbounds float, float* %in, i64 %indvars.iv
+  %1 = load float, float* %arrayidx2, align 4
+  %arrayidx4 = getelementptr inbounds float, float* %out, i64 %idxprom
+  store float %1, float* %arrayidx4, align 4
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 16
+  %cmp = icmp ult i64 %indvars.iv.next, 4096
+  br i1 %cmp, label %for.body, label %for.end
+
+for.end:
+  ret void
+}
+
+; The source code:
+;
+;void foo3(int *a, int *c, int *p) {
+;  for (int i=0; i < 4096; ++i) {
+;    if (c[i])
+;      a[i] = *p;
+;  }
+;}
+;
+; The load from the invariant address %p must stay conditional.
+
+; AVX512-LABEL: @foo3
+; AVX512-NOT: vector.body:
+; AVX512: ret void
+
+define void @foo3(i32* noalias %a, i32* noalias %c, i32* noalias %p) {
+entry:
+  br label %for.body
+
+for.body:
+  %indvars.iv = phi i64 [ 0, %entry ], [ %indvars.iv.next, %for.inc ]
+  %arrayidx = getelementptr inbounds i32, i32* %c, i64 %indvars.iv
+  %0 = load i32, i32* %arrayidx, align 4
+  %tobool = icmp eq i32 %0, 0
+  br i1 %tobool, label %for.inc, label %if.then
+
+if.then:
+  %1 = load i32, i32* %p, align 4
+  %arrayidx2 = getelementptr inbounds i32, i32* %a, i64 %indvars.iv
+  store i32 %1, i32* %arrayidx2, align 4
+  br label %for.inc
+
+for.inc:
+  %indvars.iv.next = add nuw nsw i64 %indvars.iv, 1
+  %exitcond = icmp eq i64 %indvars.iv.next, 4096
+  br i1 %exitcond, label %for.end, label %for.body
+
+for.end:
+  ret void
+}
@@ -0,0 +1,94 @@
+; RUN: opt < %s -basicaa -loop-vectorize -enable-outer-loop-vectorization -mcpu=core-avx2 -S | FileCheck %s
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; Three iterations of the inner loop are too few to fill a vector, while the
+; outer loop accesses %in and %out consecutively: vectorize the outer loop.
+
+; CHECK-LABEL: @stencil(
+; CHECK: vector.inner.body:
+; CHECK:   load <8 x float>
+; CHECK: vector.inner.exit:
+; CHECK:   store <8 x float>
+; CHECK: ret void
+define void @stencil(float* noalias %out, float* noalias %in, float* noalias %w, i64 %n) {
+entry:
+  %cmp.entry = icmp sgt i64 %n, 0
+  br i1 %cmp.entry, label %outer.ph, label %exit
+
+outer.ph:
+  br label %outer.header
+
+outer.header:
+  %i = phi i64 [ 0, %outer.ph ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %k = phi i64 [ 0, %outer.header ], [ %k.next, %inner ]
+  %s = phi float [ 0.000000e+00, %outer.header ], [ %s.next, %inner ]
+  %idx = add nsw i64 %i, %k
+  %in.addr = getelementptr inbounds float, float* %in, i64 %idx
+  %in.val = load float, float* %in.addr, align 4
+  %w.addr = getelementptr inbounds float, float* %w, i64 %k
+  %w.val = load float, float* %w.addr, align 4
+  %mul = fmul float %in.val, %w.val
+  %s.next = fadd float %s, %mul
+  %k.next = add nuw nsw i64 %k, 1
+  %inner.cond = icmp eq i64 %k.next, 3
+  br i1 %inner.cond, label %outer.latch, label %inner
+
+outer.latch:
+  %s.lcssa = phi float [ %s.next, %inner ]
+  %out.addr = getelementptr inbounds float, float* %out, i64 %i
+  store float %s.lcssa, float* %out.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.cond = icmp eq i64 %i.next, %n
+  br i1 %outer.cond, label %exit.loopexit, label %outer.header
+
+exit.loopexit:
+  br label %exit
+
+exit:
+  ret void
+}
+
+; Each row is summed by a long inner loop that reads it consecutively, while
+; the outer loop would have to gather with a stride of 1024 elements: leave the
+; outer loop alone and vectorize the inner loop.
+
+; CHECK-LABEL: @rows(
+; CHECK-NOT: vector.inner.body
+; CHECK: load <8 x i32>
+; CHECK: ret void
+define void @rows(i32* noalias %out, i32* noalias %in, i64 %n) {
+entry:
+  br label %outer.header
+
+outer.header:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %outer.latch ]
+  %row = mul nsw i64 %i, 1024
+  br label %inner
+
+inner:
+  %k = phi i64 [ 0, %outer.header ], [ %k.next, %inner ]
+  %s = phi i32 [ 0, %outer.header ], [ %s.next, %inner ]
+  %idx = add nsw i64 %row, %k
+  %in.addr = getelementptr inbounds i32, i32* %in, i64 %idx
+  %in.val = load i32, i32* %in.addr, align 4
+  %s.next = add i32 %s, %in.val
+  %k.next = add nuw nsw i64 %k, 1
+  %inner.cond = icmp eq i64 %k.next, 1024
+  br i1 %inner.cond, label %outer.latch, label %inner
+
+outer.latch:
+  %s.lcssa = phi i32 [ %s.next, %inner ]
+  %out.addr = getelementptr inbounds i32, i32* %out, i64 %i
+  store i32 %s.lcssa, i32* %out.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.cond = icmp eq i64 %i.next, %n
+  br i1 %outer.cond, label %exit, label %outer.header
+
+exit:
+  ret void
+}
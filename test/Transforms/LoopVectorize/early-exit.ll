@@ -0,0 +1,146 @@
+; RUN: opt < %s -loop-vectorize -force-vector-width=4 -force-vector-interleave=1 -enable-early-exit-vectorization -S | FileCheck %s
+; RUN: opt < %s -loop-vectorize -force-vector-width=4 -force-vector-interleave=1 -S | FileCheck %s --check-prefix=DISABLED
+
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+
+@table = global [1024 x i32] zeroinitializer, align 16
+
+; int find(int x) {
+;   for (int i = 0; i < 1024; ++i)
+;     if (table[i] == x)
+;       return i;
+;   return -1;
+; }
+
+; CHECK-LABEL: @find(
+; CHECK: vector.body:
+; CHECK: [[CMP:%.*]] = icmp eq <4 x i32> {{.*}}, {{.*}}
+; CHECK: [[BITS:%.*]] = bitcast <4 x i1> [[CMP]] to i4
+; CHECK: [[ANY:%.*]] = icmp ne i4 [[BITS]], 0
+; CHECK: br i1 [[ANY]], label %vector.early.exit, label %vector.body.continue
+; CHECK: vector.body.continue:
+; CHECK: br i1 {{.*}}, label %middle.block, label %vector.body
+; CHECK: vector.early.exit:
+; CHECK: call i4 @llvm.cttz.i4(i4 [[BITS]], i1 true)
+; CHECK: br label %middle.block
+; CHECK: for.body:
+; CHECK: ret i32
+
+; DISABLED-LABEL: @find(
+; DISABLED-NOT: <4 x i32>
+; DISABLED: ret i32
+
+define i32 @find(i32 %x) {
+entry:
+  br label %for.body
+
+for.body:
+  %iv = phi i64 [ 0, %entry ], [ %iv.next, %for.inc ]
+  %arrayidx = getelementptr inbounds [1024 x i32], [1024 x i32]* @table, i64 0, i64 %iv
+  %0 = load i32, i32* %arrayidx, align 4
+  %cmp = icmp eq i32 %0, %x
+  br i1 %cmp, label %found, label %for.inc
+
+for.inc:
+  %iv.next = add nuw nsw i64 %iv, 1
+  %exitcond = icmp eq i64 %iv.next, 1024
+  br i1 %exitcond, label %not.found, label %for.body
+
+found:
+  %iv.lcssa = phi i64 [ %iv, %for.body ]
+  %res = trunc i64 %iv.lcssa to i32
+  ret i32 %res
+
+not.found:
+  ret i32 -1
+}
+
+; A strlen-like scan of a buffer known to hold 4096 bytes, leaving the loop
+; through a shared exit block.
+
+; CHECK-LABEL: @scan(
+; CHECK: icmp eq <4 x i8>
+; CHECK: bitcast <4 x i1> {{.*}} to i4
+; CHECK: vector.early.exit:
+; CHECK: @llvm.cttz.i4
+; CHECK: ret i64
+
+define i64 @scan(i8* dereferenceable(4096) %s) {
+entry:
+  br label %for.body
+
+for.body:
+  %iv = phi i64 [ 0, %entry ], [ %iv.next, %for.inc ]
+  %p = getelementptr inbounds i8, i8* %s, i64 %iv
+  %c = load i8, i8* %p, align 1
+  %is.nul = icmp eq i8 %c, 0
+  br i1 %is.nul, label %exit, label %for.inc
+
+for.inc:
+  %iv.next = add nuw nsw i64 %iv, 1
+  %done = icmp eq i64 %iv.next, 4096
+  br i1 %done, label %exit, label %for.body
+
+exit:
+  %len = phi i64 [ %iv, %for.body ], [ 4096, %for.inc ]
+  ret i64 %len
+}
+
+; The buffer is not known to be large enough for the lanes past the exit.
+
+; CHECK-LABEL: @scan_too_small(
+; CHECK-NOT: <4 x i8>
+; CHECK: ret i64
+
+define i64 @scan_too_small(i8* dereferenceable(1024) %s) {
+entry:
+  br label %for.body
+
+for.body:
+  %iv = phi i64 [ 0, %entry ], [ %iv.next, %for.inc ]
+  %p = getelementptr inbounds i8, i8* %s, i64 %iv
+  %c = load i8, i8* %p, align 1
+  %is.nul = icmp eq i8 %c, 0
+  br i1 %is.nul, label %exit, label %for.inc
+
+for.inc:
+  %iv.next = add nuw nsw i64 %iv, 1
+  %done = icmp eq i64 %iv.next, 4096
+  br i1 %done, label %exit, label %for.body
+
+exit:
+  %len = phi i64 [ %iv, %for.body ], [ 4096, %for.inc ]
+  ret i64 %len
+}
+
+; Iterations past the exit must not be executed when the loop stores.
+
+; CHECK-LABEL: @find_and_clear(
+; CHECK-NOT: <4 x i32>
+; CHECK: ret i32
+
+define i32 @find_and_clear(i32 %x) {
+entry:
+  br label %for.body
+
+for.body:
+  %iv = phi i64 [ 0, %entry ], [ %iv.next, %for.inc ]
+  %arrayidx = getelementptr inbounds [1024 x i32], [1024 x i32]* @table, i64 0, i64 %iv
+  %0 = load i32, i32* %arrayidx, align 4
+  %cmp = icmp eq i32 %0, %x
+  br i1 %cmp, label %found, label %for.inc
+
+for.inc:
+  store i32 0, i32* %arrayidx, align 4
+  %iv.next = add nuw nsw i64 %iv, 1
+  %exitcond = icmp eq i64 %iv.next, 1024
+  br i1 %exitcond, label %not.found, label %for.body
+
+found:
+  %iv.lcssa = phi i64 [ %iv, %for.body ]
+  %res = trunc i64 %iv.lcssa to i32
+  ret i32 %res
+
+not.found:
+  ret i32 -1
+}
@@ -0,0 +1,163 @@
+; RUN: opt < %s -basicaa -loop-vectorize -enable-outer-loop-vectorization -force-vector-width=4 -force-vector-interleave=1 -S | FileCheck %s
+
+target datalayout = "e-m:e-i64:64-i128:128-n32:64-S128"
+
+; The inner loop is too short to be worth vectorizing, so the outer loop is
+; vectorized instead, running four of its iterations in lockstep.
+;
+; void stencil(float *restrict out, float *restrict in, float *restrict w,
+;              long n) {
+;   for (long i = 0; i < n; ++i) {
+;     float s = 0;
+;     for (long k = 0; k < 3; ++k)
+;       s += in[i + k] * w[k];
+;     out[i] = s;
+;   }
+; }
+
+; CHECK-LABEL: @stencil(
+; CHECK: vector.inner.body:
+; CHECK:   %vec.phi = phi <4 x i64> [ zeroinitializer, %vector.body ]
+; CHECK:   %vec.phi1 = phi <4 x float> [ zeroinitializer, %vector.body ]
+; CHECK:   load <4 x float>
+; CHECK:   [[W:%.*]] = load float, float*
+; CHECK:   insertelement <4 x float> undef, float [[W]], i32 0
+; CHECK:   fmul <4 x float>
+; CHECK:   br i1 {{.*}}, label %vector.inner.exit, label %vector.inner.body
+; CHECK: vector.inner.exit:
+; CHECK:   store <4 x float>
+; CHECK:   br i1 {{.*}}, label %middle.block, label %vector.body
+define void @stencil(float* noalias %out, float* noalias %in, float* noalias %w, i64 %n) {
+entry:
+  %cmp.entry = icmp sgt i64 %n, 0
+  br i1 %cmp.entry, label %outer.ph, label %exit
+
+outer.ph:
+  br label %outer.header
+
+outer.header:
+  %i = phi i64 [ 0, %outer.ph ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %k = phi i64 [ 0, %outer.header ], [ %k.next, %inner ]
+  %s = phi float [ 0.000000e+00, %outer.header ], [ %s.next, %inner ]
+  %idx = add nsw i64 %i, %k
+  %in.addr = getelementptr inbounds float, float* %in, i64 %idx
+  %in.val = load float, float* %in.addr, align 4
+  %w.addr = getelementptr inbounds float, float* %w, i64 %k
+  %w.val = load float, float* %w.addr, align 4
+  %mul = fmul float %in.val, %w.val
+  %s.next = fadd float %s, %mul
+  %k.next = add nuw nsw i64 %k, 1
+  %inner.cond = icmp eq i64 %k.next, 3
+  br i1 %inner.cond, label %outer.latch, label %inner
+
+outer.latch:
+  %s.lcssa = phi float [ %s.next, %inner ]
+  %out.addr = getelementptr inbounds float, float* %out, i64 %i
+  store float %s.lcssa, float* %out.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.cond = icmp eq i64 %i.next, %n
+  br i1 %outer.cond, label %exit.loopexit, label %outer.header
+
+exit.loopexit:
+  br label %exit
+
+exit:
+  ret void
+}
+
+; The trip count of the inner loop depends on the outer loop, so the lanes
+; would leave it at different times.
+
+; CHECK-LABEL: @triangular(
+; CHECK-NOT: vector.inner.body
+; CHECK: ret void
+define void @triangular(float* noalias %out, float* noalias %in, float* noalias %w, i64 %n) {
+entry:
+  %cmp.entry = icmp sgt i64 %n, 0
+  br i1 %cmp.entry, label %outer.ph, label %exit
+
+outer.ph:
+  br label %outer.header
+
+outer.header:
+  %i = phi i64 [ 0, %outer.ph ], [ %i.next, %outer.latch ]
+  %i.next = add nuw nsw i64 %i, 1
+  br label %inner
+
+inner:
+  %k = phi i64 [ 0, %outer.header ], [ %k.next, %inner ]
+  %s = phi float [ 0.000000e+00, %outer.header ], [ %s.next, %inner ]
+  %idx = add nsw i64 %i, %k
+  %in.addr = getelementptr inbounds float, float* %in, i64 %idx
+  %in.val = load float, float* %in.addr, align 4
+  %w.addr = getelementptr inbounds float, float* %w, i64 %k
+  %w.val = load float, float* %w.addr, align 4
+  %mul = fmul float %in.val, %w.val
+  %s.next = fadd float %s, %mul
+  %k.next = add nuw nsw i64 %k, 1
+  %inner.cond = icmp eq i64 %k.next, %i.next
+  br i1 %inner.cond, label %outer.latch, label %inner
+
+outer.latch:
+  %s.lcssa = phi float [ %s.next, %inner ]
+  %out.addr = getelementptr inbounds float, float* %out, i64 %i
+  store float %s.lcssa, float* %out.addr, align 4
+
+  %outer.cond = icmp eq i64 %i.next, %n
+  br i1 %outer.cond, label %exit.loopexit, label %outer.header
+
+exit.loopexit:
+  br label %exit
+
+exit:
+  ret void
+}
+
+; %out may overlap %in and %w.
+
+; CHECK-LABEL: @aliasing(
+; CHECK-NOT: vector.inner.body
+; CHECK: ret void
+define void @aliasing(float* %out, float* %in, float* %w, i64 %n) {
+entry:
+  %cmp.entry = icmp sgt i64 %n, 0
+  br i1 %cmp.entry, label %outer.ph, label %exit
+
+outer.ph:
+  br label %outer.header
+
+outer.header:
+  %i = phi i64 [ 0, %outer.ph ], [ %i.next, %outer.latch ]
+  br label %inner
+
+inner:
+  %k = phi i64 [ 0, %outer.header ], [ %k.next, %inner ]
+  %s = phi float [ 0.000000e+00, %outer.header ], [ %s.next, %inner ]
+  %idx = add nsw i64 %i, %k
+  %in.addr = getelementptr inbounds float, float* %in, i64 %idx
+  %in.val = load float, float* %in.addr, align 4
+  %w.addr = getelementptr inbounds float, float* %w, i64 %k
+  %w.val = load float, float* %w.addr, align 4
+  %mul = fmul float %in.val, %w.val
+  %s.next = fadd float %s, %mul
+  %k.next = add nuw nsw i64 %k, 1
+  %inner.cond = icmp eq i64 %k.next, 3
+  br i1 %inner.cond, label %outer.latch, label %inner
+
+outer.latch:
+  %s.lcssa = phi float [ %s.next, %inner ]
+  %out.addr = getelementptr inbounds float, float* %out, i64 %i
+  store float %s.lcssa, float* %out.addr, align 4
+  %i.next = add nuw nsw i64 %i, 1
+  %outer.cond = icmp eq i64 %i.next, %n
+  br i1 %outer.cond, label %exit.loopexit, label %outer.header
+
+exit.loopexit:
+  br label %exit
+
+exit:
+  ret void
+}
@@ -0,0 +1,43 @@
+; RUN: opt -mergefunc -mergefunc-parametric -mergefunc-parametric-min-size=1 -S < %s | FileCheck %s
+
+; @f1 and @f2 only differ in their callee, but @g1 and @g2 are merged
+; themselves, so they must not become a callee parameter of a merged @f1.
+; Once @g1 and @g2 are merged, @f1 and @f2 only differ in a constant.
+
+; CHECK-LABEL: define i32 @user(
+; CHECK: call i32 @f1.merged(i32 %x, i32 1)
+; CHECK: call i32 @f1.merged(i32 %1, i32 2)
+; CHECK-LABEL: define internal i32 @g1.merged(
+; CHECK: lshr i32 %x, %0
+; CHECK-LABEL: define internal i32 @f1.merged(
+; CHECK: call i32 @g1.merged(i32 %x, i32 %0)
+
+define internal i32 @g1(i32 %x) {
+  %a = lshr i32 %x, 1
+  %b = add i32 %a, %x
+  ret i32 %b
+}
+
+define internal i32 @g2(i32 %x) {
+  %a = lshr i32 %x, 2
+  %b = add i32 %a, %x
+  ret i32 %b
+}
+
+define internal i32 @f1(i32 %x) {
+  %r = call i32 @g1(i32 %x)
+  %s = mul i32 %r, 3
+  ret i32 %s
+}
+
+define internal i32 @f2(i32 %x) {
+  %r = call i32 @g2(i32 %x)
+  %s = mul i32 %r, 3
+  ret i32 %s
+}
+
+define i32 @user(i32 %x) {
+  %1 = call i32 @f1(i32 %x)
+  %2 = call i32 @f2(i32 %1)
+  ret i32 %2
+}
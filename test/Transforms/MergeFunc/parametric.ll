@@ -0,0 +1,119 @@
+; RUN: opt -mergefunc -mergefunc-parametric -S < %s | FileCheck %s
+; RUN: opt -mergefunc -mergefunc-parametric -mergefunc-parametric-max-params=1 -S < %s | FileCheck %s --check-prefix=ONEPARAM
+; RUN: opt -mergefunc -S < %s | FileCheck %s --check-prefix=DISABLED
+
+; These functions differ only in the multiplier and the logging callee, so
+; they are merged into one function taking both as arguments.
+
+; CHECK-NOT: define internal i32 @scale_by_
+; CHECK-LABEL: define i32 @user(
+; CHECK: call i32 @scale_by_3.merged(i32 %x, i32 %y, i32 3, void (i32)* @log_a)
+; CHECK: call i32 @scale_by_3.merged(i32 %1, i32 %y, i32 5, void (i32)* @log_b)
+; CHECK: call i32 @scale_by_3.merged(i32 %2, i32 %y, i32 7, void (i32)* @log_b)
+; CHECK: call i32 @scale_by_9(
+; CHECK-LABEL: define internal i32 @scale_by_3.merged(i32 %x, i32 %y, i32, void (i32)*)
+; CHECK: mul i32 %x, %0
+; CHECK: call void %1(i32 %g)
+
+; With a single extra argument only the two functions calling @log_b merge.
+
+; ONEPARAM: define internal i32 @scale_by_3(
+; ONEPARAM-LABEL: define i32 @user(
+; ONEPARAM: call i32 @scale_by_3(i32 %x, i32 %y)
+; ONEPARAM: call i32 @scale_by_5.merged(i32 %1, i32 %y, i32 5)
+; ONEPARAM: call i32 @scale_by_5.merged(i32 %2, i32 %y, i32 7)
+
+; DISABLED-NOT: .merged
+
+declare void @sink(i32)
+declare void @log_a(i32)
+declare void @log_b(i32)
+
+define internal i32 @scale_by_3(i32 %x, i32 %y) {
+entry:
+  %a = mul i32 %x, 3
+  %b = add i32 %a, %y
+  %c = xor i32 %b, 17
+  call void @sink(i32 %c)
+  %d = mul i32 %c, %a
+  %e = sub i32 %d, %y
+  %f = shl i32 %e, 2
+  %g = or i32 %f, %x
+  call void @log_a(i32 %g)
+  %h = add i32 %g, 100
+  %cmp = icmp sgt i32 %h, 1000
+  %r = select i1 %cmp, i32 %h, i32 %g
+  call void @sink(i32 %r)
+  %s = mul i32 %r, %r
+  %t = add i32 %s, 7
+  ret i32 %t
+}
+
+define internal i32 @scale_by_5(i32 %x, i32 %y) {
+entry:
+  %a = mul i32 %x, 5
+  %b = add i32 %a, %y
+  %c = xor i32 %b, 17
+  call void @sink(i32 %c)
+  %d = mul i32 %c, %a
+  %e = sub i32 %d, %y
+  %f = shl i32 %e, 2
+  %g = or i32 %f, %x
+  call void @log_b(i32 %g)
+  %h = add i32 %g, 100
+  %cmp = icmp sgt i32 %h, 1000
+  %r = select i1 %cmp, i32 %h, i32 %g
+  call void @sink(i32 %r)
+  %s = mul i32 %r, %r
+  %t = add i32 %s, 7
+  ret i32 %t
+}
+
+define internal i32 @scale_by_7(i32 %x, i32 %y) {
+entry:
+  %a = mul i32 %x, 7
+  %b = add i32 %a, %y
+  %c = xor i32 %b, 17
+  call void @sink(i32 %c)
+  %d = mul i32 %c, %a
+  %e = sub i32 %d, %y
+  %f = shl i32 %e, 2
+  %g = or i32 %f, %x
+  call void @log_b(i32 %g)
+  %h = add i32 %g, 100
+  %cmp = icmp sgt i32 %h, 1000
+  %r = select i1 %cmp, i32 %h, i32 %g
+  call void @sink(i32 %r)
+  %s = mul i32 %r, %r
+  %t = add i32 %s, 7
+  ret i32 %t
+}
+
+; An external function keeps its signature and is left alone.
+define i32 @scale_by_9(i32 %x, i32 %y) {
+entry:
+  %a = mul i32 %x, 9
+  %b = add i32 %a, %y
+  %c = xor i32 %b, 17
+  call void @sink(i32 %c)
+  %d = mul i32 %c, %a
+  %e = sub i32 %d, %y
+  %f = shl i32 %e, 2
+  %g = or i32 %f, %x
+  call void @log_b(i32 %g)
+  %h = add i32 %g, 100
+  %cmp = icmp sgt i32 %h, 1000
+  %r = select i1 %cmp, i32 %h, i32 %g
+  call void @sink(i32 %r)
+  %s = mul i32 %r, %r
+  %t = add i32 %s, 7
+  ret i32 %t
+}
+
+define i32 @user(i32 %x, i32 %y) {
+  %1 = call i32 @scale_by_3(i32 %x, i32 %y)
+  %2 = call i32 @scale_by_5(i32 %1, i32 %y)
+  %3 = call i32 @scale_by_7(i32 %2, i32 %y)
+  %4 = call i32 @scale_by_9(i32 %3, i32 %y)
+  ret i32 %4
+}
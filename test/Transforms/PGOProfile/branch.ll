@@ -0,0 +1,79 @@
+; RUN: opt < %s -pgo-instr-gen -S | FileCheck %s --check-prefix=GEN
+; RUN: llvm-profdata merge %S/Inputs/branch.proftext -o %t.profdata
+; RUN: opt < %s -pgo-instr-use -pgo-test-profile-file=%t.profdata -S | FileCheck %s --check-prefix=USE
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; GEN: @__llvm_profile_name_test_br = private constant [7 x i8] c"test_br"
+; GEN: @__llvm_profile_name_test_loop = private constant [9 x i8] c"test_loop"
+
+; Of the six edges of the diamond, including the fake entry and exit edges,
+; only two need a counter.
+
+; GEN-LABEL: @test_br(
+; USE-LABEL: @test_br(
+; USE-SAME: !prof ![[TEST_BR_ENTRY:[0-9]+]]
+define i32 @test_br(i32 %i) {
+entry:
+; GEN: entry:
+; GEN-NOT: llvm.instrprof.increment
+  %cmp = icmp sgt i32 %i, 0
+  br i1 %cmp, label %if.then, label %if.else
+; USE: br i1 %cmp, label %if.then, label %if.else
+; USE-SAME: !prof ![[BW_ENTRY:[0-9]+]]
+
+if.then:
+; GEN: if.then:
+; GEN-NEXT: call void @llvm.instrprof.increment(i8* getelementptr inbounds ([7 x i8], [7 x i8]* @__llvm_profile_name_test_br, i32 0, i32 0), i64 {{[0-9]+}}, i32 2, i32 1)
+  %add = add nsw i32 %i, 2
+  br label %if.end
+
+if.else:
+; GEN: if.else:
+; GEN-NEXT: call void @llvm.instrprof.increment(i8* getelementptr inbounds ([7 x i8], [7 x i8]* @__llvm_profile_name_test_br, i32 0, i32 0), i64 {{[0-9]+}}, i32 2, i32 0)
+  %sub = sub nsw i32 %i, 2
+  br label %if.end
+
+if.end:
+; GEN: if.end:
+; GEN-NOT: llvm.instrprof.increment
+; GEN: ret i32
+  %retv = phi i32 [ %add, %if.then ], [ %sub, %if.else ]
+  ret i32 %retv
+}
+
+; A self loop cannot be in the spanning tree, so its critical backedge is split
+; to count it.
+
+; GEN-LABEL: @test_loop(
+; USE-LABEL: @test_loop(
+; USE-SAME: !prof ![[TEST_LOOP_ENTRY:[0-9]+]]
+define void @test_loop(i32 %n, i32* %p) {
+entry:
+  br label %for.body
+
+for.body:
+  %i = phi i32 [ 0, %entry ], [ %inc, %for.body ]
+  store volatile i32 %i, i32* %p
+  %inc = add nsw i32 %i, 1
+  %cmp = icmp slt i32 %inc, %n
+  br i1 %cmp, label %for.body, label %for.end
+; GEN: br i1 %cmp, label %[[BACKEDGE:.*]], label %for.end
+; USE: br i1 %cmp, label %for.body, label %for.end, !prof ![[BW_LOOP:[0-9]+]]
+
+; GEN: [[BACKEDGE]]:
+; GEN-NEXT: call void @llvm.instrprof.increment(i8* getelementptr inbounds ([9 x i8], [9 x i8]* @__llvm_profile_name_test_loop, i32 0, i32 0), i64 {{[0-9]+}}, i32 2, i32 0)
+; GEN-NEXT: br label %for.body
+
+for.end:
+; GEN: for.end:
+; GEN-NEXT: call void @llvm.instrprof.increment(i8* getelementptr inbounds ([9 x i8], [9 x i8]* @__llvm_profile_name_test_loop, i32 0, i32 0), i64 {{[0-9]+}}, i32 2, i32 1)
+; GEN-NEXT: ret void
+  ret void
+}
+
+; USE-DAG: ![[TEST_BR_ENTRY]] = !{!"function_entry_count", i64 100}
+; USE-DAG: ![[BW_ENTRY]] = !{!"branch_weights", i32 90, i32 10}
+; USE-DAG: ![[TEST_LOOP_ENTRY]] = !{!"function_entry_count", i64 10}
+; USE-DAG: ![[BW_LOOP]] = !{!"branch_weights", i32 990, i32 10}
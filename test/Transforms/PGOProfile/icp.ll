@@ -0,0 +1,154 @@
+; RUN: opt < %s -pgo-icall-prom -S | FileCheck %s
+; RUN: opt < %s -pgo-icall-prom -icp-max-prom=1 -S | FileCheck %s --check-prefix=MAX1
+; RUN: opt < %s -pgo-icall-prom -disable-icp -S | FileCheck %s --check-prefix=DISABLE
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%struct.A = type { i32 }
+%struct.B = type { %struct.A, i32 }
+
+@foo = common global i32 ()* null, align 8
+@afptr = common global i32 (%struct.A*)* null, align 8
+
+define i32 @func1() {
+  ret i32 1
+}
+
+define i32 @func2() {
+  ret i32 2
+}
+
+define i32 @func3() {
+  ret i32 3
+}
+
+define i32 @B_get(%struct.B* %b) {
+  ret i32 4
+}
+
+; The two hottest targets are promoted. The third one is left in the value
+; profile of the remaining indirect call.
+
+; CHECK-LABEL: @bar(
+; CHECK: %[[CMP1:.*]] = icmp eq i32 ()* %tmp, @func1
+; CHECK-NEXT: br i1 %[[CMP1]], label %if.true.direct_targ, label %if.false.orig_indirect, !prof ![[BW1:[0-9]+]]
+; CHECK: if.true.direct_targ:
+; CHECK-NEXT: %[[R1:.*]] = call i32 @func1()
+; CHECK-NEXT: br label %if.end.icp
+; CHECK: if.false.orig_indirect:
+; CHECK-NEXT: %[[CMP2:.*]] = icmp eq i32 ()* %tmp, @func2
+; CHECK-NEXT: br i1 %[[CMP2]], label %if.true.direct_targ1, label %if.false.orig_indirect2, !prof ![[BW2:[0-9]+]]
+; CHECK: if.true.direct_targ1:
+; CHECK-NEXT: %[[R2:.*]] = call i32 @func2()
+; CHECK: if.false.orig_indirect2:
+; CHECK-NEXT: %[[R3:.*]] = call i32 %tmp(), !prof ![[VP:[0-9]+]]
+; CHECK: %[[PHI2:.*]] = phi i32 [ %[[R2]], %if.true.direct_targ1 ], [ %[[R3]], %if.false.orig_indirect2 ]
+; CHECK: %call = phi i32 [ %[[R1]], %if.true.direct_targ ], [ %[[PHI2]], %if.end.icp{{.*}} ]
+; CHECK-NEXT: ret i32 %call
+
+; MAX1-LABEL: @bar(
+; MAX1: icmp eq i32 ()* %tmp, @func1
+; MAX1-NOT: icmp eq i32 ()* %tmp, @func2
+; MAX1: call i32 %tmp(), !prof ![[VP:[0-9]+]]
+
+; DISABLE-LABEL: @bar(
+; DISABLE-NOT: icmp
+; DISABLE: %call = call i32 %tmp(), !prof !0
+
+define i32 @bar() {
+entry:
+  %tmp = load i32 ()*, i32 ()** @foo, align 8
+  %call = call i32 %tmp(), !prof !0
+  ret i32 %call
+}
+
+; The target takes a pointer to a derived type: the argument is cast.
+
+; CHECK-LABEL: @derived(
+; CHECK: icmp eq i32 (%struct.A*)* %f, bitcast (i32 (%struct.B*)* @B_get to i32 (%struct.A*)*)
+; CHECK: if.true.direct_targ:
+; CHECK-NEXT: %[[CAST:.*]] = bitcast %struct.A* %a to %struct.B*
+; CHECK-NEXT: call i32 @B_get(%struct.B* %[[CAST]])
+
+define i32 @derived(i32 (%struct.A*)* %f, %struct.A* %a) {
+entry:
+  %call = call i32 %f(%struct.A* %a), !prof !1
+  ret i32 %call
+}
+
+; Attributes of cast arguments are not copied to the direct call.
+
+; CHECK-LABEL: @derived_attrs(
+; CHECK: if.true.direct_targ:
+; CHECK-NEXT: %[[CAST:.*]] = bitcast %struct.A* %a to %struct.B*
+; CHECK-NEXT: call i32 @B_get(%struct.B* %[[CAST]]){{$}}
+; CHECK: call i32 %f(%struct.A* nonnull dereferenceable(8) %a)
+
+define i32 @derived_attrs(i32 (%struct.A*)* %f, %struct.A* %a) {
+entry:
+  %call = call i32 %f(%struct.A* nonnull dereferenceable(8) %a), !prof !1
+  ret i32 %call
+}
+
+; Pointers in different address spaces are not cast.
+
+; CHECK-LABEL: @addrspace(
+; CHECK-NOT: icmp
+; CHECK: call i32 %f(%struct.A addrspace(1)* %a), !prof
+
+define i32 @addrspace(i32 (%struct.A addrspace(1)*)* %f,
+                      %struct.A addrspace(1)* %a) {
+entry:
+  %call = call i32 %f(%struct.A addrspace(1)* %a), !prof !1
+  ret i32 %call
+}
+
+; A musttail call has to stay right before the return.
+
+; CHECK-LABEL: @musttail(
+; CHECK-NOT: icmp
+; CHECK: musttail call i32 %f(%struct.A* %a), !prof
+
+define i32 @musttail(%struct.A* %a) {
+entry:
+  %f = load i32 (%struct.A*)*, i32 (%struct.A*)** @afptr, align 8
+  %call = musttail call i32 %f(%struct.A* %a), !prof !1
+  ret i32 %call
+}
+
+; The hottest target is not defined in this module.
+
+; CHECK-LABEL: @unknown_target(
+; CHECK-NOT: icmp
+; CHECK: call i32 %f(), !prof ![[UNKNOWN:[0-9]+]]
+
+define i32 @unknown_target(i32 ()* %f) {
+entry:
+  %call = call i32 %f(), !prof !2
+  ret i32 %call
+}
+
+; Not hot enough.
+
+; CHECK-LABEL: @cold(
+; CHECK-NOT: icmp
+; CHECK: call i32 %f(), !prof ![[COLD:[0-9]+]]
+
+define i32 @cold(i32 ()* %f) {
+entry:
+  %call = call i32 %f(), !prof !3
+  ret i32 %call
+}
+
+; CHECK-DAG: ![[BW1]] = !{!"branch_weights", i32 1500, i32 1500}
+; CHECK-DAG: ![[BW2]] = !{!"branch_weights", i32 1200, i32 300}
+; CHECK-DAG: ![[VP]] = !{!"VP", i32 0, i64 300, i64 -6929281286627296573, i64 300}
+; CHECK-DAG: ![[UNKNOWN]] = !{!"VP", i32 0, i64 2000, i64 388451578778231274, i64 2000}
+; CHECK-DAG: ![[COLD]] = !{!"VP", i32 0, i64 900, i64 -2545542355363006406, i64 900}
+; MAX1-DAG: ![[VP]] = !{!"VP", i32 0, i64 1500, i64 -4377547752858689819, i64 1200, i64 -6929281286627296573, i64 300}
+
+!0 = !{!"VP", i32 0, i64 3000, i64 -2545542355363006406, i64 1500, i64 -4377547752858689819, i64 1200, i64 -6929281286627296573, i64 300}
+!1 = !{!"VP", i32 0, i64 2000, i64 -592154785642228409, i64 2000}
+!2 = !{!"VP", i32 0, i64 2000, i64 388451578778231274, i64 2000}
+!3 = !{!"VP", i32 0, i64 900, i64 -2545542355363006406, i64 900}
@@ -0,0 +1,38 @@
+; RUN: llvm-profdata merge %S/Inputs/indirect_call.proftext -o %t.profdata
+; RUN: opt < %s -pgo-instr-use -disable-vp=false -pgo-test-profile-file=%t.profdata -S | FileCheck %s --check-prefix=VP-ANNOTATION
+; RUN: opt < %s -pgo-instr-use -disable-vp=false -pgo-test-profile-file=%t.profdata -icp-max-annotations=2 -S | FileCheck %s --check-prefix=MAX2
+; RUN: opt < %s -pgo-instr-use -disable-vp=false -pgo-test-profile-file=%t.profdata -pgo-icall-prom -icp-count-threshold=50 -S | FileCheck %s --check-prefix=ICP
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@foo = common global i32 ()* null, align 8
+
+define i32 @func1() {
+entry:
+  ret i32 0
+}
+
+define i32 @func2() {
+entry:
+  ret i32 1
+}
+
+define i32 @bar() {
+entry:
+  %tmp = load i32 ()*, i32 ()** @foo, align 8
+; VP-ANNOTATION: %call = call i32 %tmp(), !prof ![[VP:[0-9]+]]
+; ICP: icmp eq i32 ()* %tmp, @func1
+; ICP: call i32 @func1()
+; ICP-NOT: icmp eq i32 ()* %tmp, @func2
+; ICP: call i32 %tmp(), !prof ![[REST:[0-9]+]]
+  %call = call i32 %tmp()
+  ret i32 %call
+}
+
+; The targets are recorded as the hashes of their names, func1, func2 and
+; func3.
+
+; VP-ANNOTATION: ![[VP]] = !{!"VP", i32 0, i64 140, i64 -2545542355363006406, i64 100, i64 -4377547752858689819, i64 30, i64 -6929281286627296573, i64 10}
+; MAX2: !{!"VP", i32 0, i64 140, i64 -2545542355363006406, i64 100, i64 -4377547752858689819, i64 30}
+; ICP: ![[REST]] = !{!"VP", i32 0, i64 40, i64 -4377547752858689819, i64 30, i64 -6929281286627296573, i64 10}
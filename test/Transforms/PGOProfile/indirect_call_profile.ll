@@ -0,0 +1,32 @@
+; RUN: opt < %s -pgo-instr-gen -disable-vp=false -S | FileCheck %s --check-prefix=GEN
+; RUN: opt < %s -pgo-instr-gen -disable-vp=false -instrprof -S | FileCheck %s --check-prefix=LOWER
+; RUN: opt < %s -pgo-instr-gen -S | FileCheck %s --check-prefix=NOVP
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@foo = common global i32 ()* null, align 8
+
+define i32 @func1() {
+entry:
+  ret i32 0
+}
+
+define i32 @bar() {
+entry:
+  %tmp = load i32 ()*, i32 ()** @foo, align 8
+; GEN: [[ICALL_TARGET:%[0-9]+]] = ptrtoint i32 ()* %tmp to i64
+; GEN-NEXT: call void @llvm.instrprof.value.profile(i8* getelementptr inbounds ([3 x i8], [3 x i8]* @__llvm_profile_name_bar, i32 0, i32 0), i64 {{[0-9]+}}, i64 [[ICALL_TARGET]], i32 0, i32 0)
+; GEN-NEXT: %call = call i32 %tmp()
+; LOWER: [[ICALL_TARGET:%[0-9]+]] = ptrtoint i32 ()* %tmp to i64
+; LOWER-NEXT: call void @__llvm_profile_instrument_target(i64 [[ICALL_TARGET]], i8* bitcast ({{.*}}* @__llvm_profile_data_bar to i8*), i32 0)
+; NOVP-NOT: llvm.instrprof.value.profile
+  %call = call i32 %tmp()
+; Direct calls are not profiled.
+; GEN-NOT: call void @llvm.instrprof.value.profile
+  %call1 = call i32 @func1()
+  %add = add i32 %call, %call1
+  ret i32 %add
+}
+
+; LOWER: declare void @__llvm_profile_instrument_target(i64, i8*, i32)
@@ -0,0 +1,20 @@
+; RUN: llvm-profdata merge %S/Inputs/mismatch.proftext -o %t.profdata
+; RUN: opt < %s -pgo-instr-use -pgo-test-profile-file=%t.profdata -S 2>&1 | FileCheck %s
+
+; The profile was collected on a different version of the function.
+
+; CHECK: warning: {{.*}}: Function hash mismatch for function test_br
+; CHECK-NOT: !prof
+
+define i32 @test_br(i32 %i) {
+entry:
+  %cmp = icmp sgt i32 %i, 0
+  br i1 %cmp, label %if.then, label %if.end
+
+if.then:
+  br label %if.end
+
+if.end:
+  %retv = phi i32 [ 1, %if.then ], [ 0, %entry ]
+  ret i32 %retv
+}
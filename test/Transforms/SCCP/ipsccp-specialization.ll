@@ -0,0 +1,77 @@
+; RUN: opt < %s -ipsccp -ipsccp-specialize-functions -S | FileCheck %s
+; RUN: opt < %s -ipsccp -S | FileCheck %s --check-prefix=NOSPEC
+; RUN: opt < %s -ipsccp -ipsccp-specialize-functions -ipsccp-specialization-budget=0 -S | FileCheck %s --check-prefix=NOSPEC
+
+; @apply is called with two different callbacks, so IPSCCP alone cannot
+; propagate them. Each call site gets its own clone, where the callback is
+; called directly.
+
+; CHECK-LABEL: define i32 @caller(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %a = call i32 @[[INC:apply.specialized[.0-9]*]](i32 (i32)* @inc, i32 %x)
+; CHECK-NEXT: %b = call i32 @[[DEC:apply.specialized[.0-9]*]](i32 (i32)* @dec, i32 %x)
+; CHECK-NOT: define internal i32 @apply(
+
+; NOSPEC-LABEL: define i32 @caller(
+; NOSPEC: call i32 @apply(i32 (i32)* @inc, i32 %x)
+; NOSPEC: call i32 @apply(i32 (i32)* @dec, i32 %x)
+; NOSPEC-NOT: specialized
+
+define i32 @caller(i32 %x) {
+entry:
+  %a = call i32 @apply(i32 (i32)* @inc, i32 %x)
+  %b = call i32 @apply(i32 (i32)* @dec, i32 %x)
+  %r = add i32 %a, %b
+  ret i32 %r
+}
+
+define internal i32 @apply(i32 (i32)* %fn, i32 %x) {
+entry:
+  %r = call i32 %fn(i32 %x)
+  ret i32 %r
+}
+
+define internal i32 @inc(i32 %x) {
+  %r = add i32 %x, 1
+  ret i32 %r
+}
+
+define internal i32 @dec(i32 %x) {
+  %r = sub i32 %x, 1
+  ret i32 %r
+}
+
+; The mode flag only folds a compare and a small block away, which is not
+; enough to pay for a clone.
+
+; CHECK-LABEL: define i32 @small_caller(
+; CHECK: call i32 @small(i32 %x, i1 true)
+; CHECK: call i32 @small(i32 %x, i1 false)
+
+; The clones come last.
+
+; CHECK-DAG: define internal i32 @[[INC]](i32 (i32)* %fn, i32 %x) {
+; CHECK-DAG: define internal i32 @[[DEC]](i32 (i32)* %fn, i32 %x) {
+; CHECK-DAG: call i32 @inc(i32 %x)
+; CHECK-DAG: call i32 @dec(i32 %x)
+
+define i32 @small_caller(i32 %x) {
+entry:
+  %a = call i32 @small(i32 %x, i1 true)
+  %b = call i32 @small(i32 %x, i1 false)
+  %r = add i32 %a, %b
+  ret i32 %r
+}
+
+define internal i32 @small(i32 %x, i1 %mode) {
+entry:
+  br i1 %mode, label %then, label %exit
+
+then:
+  %y = mul i32 %x, 3
+  br label %exit
+
+exit:
+  %r = phi i32 [ %x, %entry ], [ %y, %then ]
+  ret i32 %r
+}
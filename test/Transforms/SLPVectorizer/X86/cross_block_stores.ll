@@ -0,0 +1,72 @@
+; RUN: opt < %s -basicaa -slp-vectorizer -S -mtriple=x86_64-apple-macosx -mcpu=corei7-avx | FileCheck %s
+; RUN: opt < %s -basicaa -slp-vectorizer -slp-cross-block-stores=false -S -mtriple=x86_64-apple-macosx -mcpu=corei7-avx | FileCheck %s --check-prefix=DISABLED
+; RUN: opt < %s -basicaa -slp-vectorizer -slp-threshold=100 -S -mtriple=x86_64-apple-macosx -mcpu=corei7-avx | FileCheck %s --check-prefix=UNPROFITABLE
+
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.8.0"
+
+; Consecutive stores split by an if-then are sunk into the join block and
+; vectorized there.
+; CHECK-LABEL: @split_by_if(
+; CHECK: if.end:
+; CHECK-NEXT: bitcast double* %a to <2 x double>*
+; CHECK-NEXT: store <2 x double>
+; CHECK: ret void
+
+; The store is moved back when the chain isn't vectorized after all.
+; UNPROFITABLE-LABEL: @split_by_if(
+; UNPROFITABLE: store double %m0, double* %a, align 8
+; UNPROFITABLE-NEXT: br i1 %c
+; UNPROFITABLE: if.end:
+; UNPROFITABLE-NEXT: store double %m1, double* %a1, align 8
+; UNPROFITABLE-NEXT: ret void
+
+; DISABLED-LABEL: @split_by_if(
+; DISABLED-NOT: <2 x double>
+; DISABLED: ret void
+
+define void @split_by_if(double* noalias %a, double* noalias %b, i32* noalias %count, i1 %c) {
+entry:
+  %b1 = getelementptr inbounds double, double* %b, i64 1
+  %a1 = getelementptr inbounds double, double* %a, i64 1
+  %x0 = load double, double* %b, align 8
+  %x1 = load double, double* %b1, align 8
+  %m0 = fmul double %x0, 2.0
+  %m1 = fmul double %x1, 2.0
+  store double %m0, double* %a, align 8
+  br i1 %c, label %if.then, label %if.end
+
+if.then:
+  %n = load i32, i32* %count, align 4
+  %n.inc = add i32 %n, 1
+  store i32 %n.inc, i32* %count, align 4
+  br label %if.end
+
+if.end:
+  store double %m1, double* %a1, align 8
+  ret void
+}
+
+; CHECK-LABEL: @conflict(
+; CHECK-NOT: <2 x double>
+; CHECK: ret void
+; The side block may write to the stored location.
+define void @conflict(double* %a, double* %b, double* %other, i1 %c) {
+entry:
+  %b1 = getelementptr inbounds double, double* %b, i64 1
+  %a1 = getelementptr inbounds double, double* %a, i64 1
+  %x0 = load double, double* %b, align 8
+  %x1 = load double, double* %b1, align 8
+  %m0 = fmul double %x0, 2.0
+  %m1 = fmul double %x1, 2.0
+  store double %m0, double* %a, align 8
+  br i1 %c, label %if.then, label %if.end
+
+if.then:
+  store double 0.0, double* %other, align 8
+  br label %if.end
+
+if.end:
+  store double %m1, double* %a1, align 8
+  ret void
+}
@@ -0,0 +1,122 @@
+; RUN: opt < %s -slp-vectorizer -slp-vectorize-hor -slp-vectorize-hor-store -S -mtriple=x86_64-apple-macosx -mcpu=corei7-avx | FileCheck %s
+
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.8.0"
+
+; Integer min/max reductions built from icmp+select pairs.
+
+; The eight values are reduced as two vectors of four, whose maximums are
+; then combined.
+; CHECK-LABEL: @smax8(
+; CHECK: [[LO:%.*]] = load <4 x i32>
+; CHECK: [[HI:%.*]] = load <4 x i32>
+; CHECK: icmp sgt <4 x i32> [[LO]]
+; CHECK: [[MLO:%.*]] = extractelement <4 x i32>
+; CHECK: icmp sgt <4 x i32> [[HI]]
+; CHECK: [[MHI:%.*]] = extractelement <4 x i32>
+; CHECK: [[C:%.*]] = icmp sgt i32 [[MLO]], [[MHI]]
+; CHECK: [[M:%.*]] = select i1 [[C]], i32 [[MLO]], i32 [[MHI]]
+; CHECK: ret i32 [[M]]
+
+define i32 @smax8(i32* %p) {
+entry:
+  %p1 = getelementptr inbounds i32, i32* %p, i64 1
+  %p2 = getelementptr inbounds i32, i32* %p, i64 2
+  %p3 = getelementptr inbounds i32, i32* %p, i64 3
+  %p4 = getelementptr inbounds i32, i32* %p, i64 4
+  %p5 = getelementptr inbounds i32, i32* %p, i64 5
+  %p6 = getelementptr inbounds i32, i32* %p, i64 6
+  %p7 = getelementptr inbounds i32, i32* %p, i64 7
+  %v0 = load i32, i32* %p, align 4
+  %v1 = load i32, i32* %p1, align 4
+  %v2 = load i32, i32* %p2, align 4
+  %v3 = load i32, i32* %p3, align 4
+  %v4 = load i32, i32* %p4, align 4
+  %v5 = load i32, i32* %p5, align 4
+  %v6 = load i32, i32* %p6, align 4
+  %v7 = load i32, i32* %p7, align 4
+  %c01 = icmp sgt i32 %v0, %v1
+  %m01 = select i1 %c01, i32 %v0, i32 %v1
+  %c2 = icmp sgt i32 %m01, %v2
+  %m2 = select i1 %c2, i32 %m01, i32 %v2
+  %c3 = icmp sgt i32 %m2, %v3
+  %m3 = select i1 %c3, i32 %m2, i32 %v3
+  %c4 = icmp sgt i32 %m3, %v4
+  %m4 = select i1 %c4, i32 %m3, i32 %v4
+  %c5 = icmp sgt i32 %m4, %v5
+  %m5 = select i1 %c5, i32 %m4, i32 %v5
+  %c6 = icmp sgt i32 %m5, %v6
+  %m6 = select i1 %c6, i32 %m5, i32 %v6
+  %c7 = icmp sgt i32 %m6, %v7
+  %m7 = select i1 %c7, i32 %m6, i32 %v7
+  ret i32 %m7
+}
+
+; A reduction feeding a store.
+; CHECK-LABEL: @umin4(
+; CHECK: load <4 x i32>
+; CHECK: icmp ult <4 x i32>
+; CHECK: rdx.minmax.select
+; CHECK: extractelement <4 x i32>
+; CHECK: store i32
+
+define void @umin4(i32* %p, i32* %out) {
+entry:
+  %p1 = getelementptr inbounds i32, i32* %p, i64 1
+  %p2 = getelementptr inbounds i32, i32* %p, i64 2
+  %p3 = getelementptr inbounds i32, i32* %p, i64 3
+  %v0 = load i32, i32* %p, align 4
+  %v1 = load i32, i32* %p1, align 4
+  %v2 = load i32, i32* %p2, align 4
+  %v3 = load i32, i32* %p3, align 4
+  %c01 = icmp ult i32 %v0, %v1
+  %m01 = select i1 %c01, i32 %v0, i32 %v1
+  %c23 = icmp ult i32 %v2, %v3
+  %m23 = select i1 %c23, i32 %v2, i32 %v3
+  %c = icmp ult i32 %m01, %m23
+  %m = select i1 %c, i32 %m01, i32 %m23
+  store i32 %m, i32* %out, align 4
+  ret void
+}
+
+; A reduction into a loop-carried phi.
+; CHECK-LABEL: @smax_loop(
+; CHECK: load <4 x i32>
+; CHECK: icmp sgt <4 x i32>
+; CHECK: rdx.minmax.select
+; CHECK: extractelement <4 x i32>
+; CHECK: ret i32
+
+define i32 @smax_loop(i32* %p, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %r = phi i32 [ 0, %entry ], [ %r.next, %loop ]
+  %q0 = getelementptr inbounds i32, i32* %p, i64 %i
+  %i1 = add i64 %i, 1
+  %q1 = getelementptr inbounds i32, i32* %p, i64 %i1
+  %i2 = add i64 %i, 2
+  %q2 = getelementptr inbounds i32, i32* %p, i64 %i2
+  %i3 = add i64 %i, 3
+  %q3 = getelementptr inbounds i32, i32* %p, i64 %i3
+  %v0 = load i32, i32* %q0, align 4
+  %v1 = load i32, i32* %q1, align 4
+  %v2 = load i32, i32* %q2, align 4
+  %v3 = load i32, i32* %q3, align 4
+  %c01 = icmp sgt i32 %v0, %v1
+  %m01 = select i1 %c01, i32 %v0, i32 %v1
+  %c2 = icmp sgt i32 %m01, %v2
+  %m2 = select i1 %c2, i32 %m01, i32 %v2
+  %c3 = icmp sgt i32 %m2, %v3
+  %m3 = select i1 %c3, i32 %m2, i32 %v3
+  %cr = icmp sgt i32 %r, %m3
+  %r.next = select i1 %cr, i32 %r, i32 %m3
+  %i.next = add i64 %i, 4
+  %done = icmp uge i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %r.next
+}
@@ -322,4 +322,39 @@ entry:
 ; CHECK-DAG:  %[[I4:.+]] = insertelement <4 x double> %i3, double %[[V11]], i32 0
 ; CHECK:  ret <4 x double> %[[I4]]
 
+; The lanes are inserted in an order that doesn't match the loads. Building
+; the vector in lane order lets the loads be vectorized.
+; ZEROTHRESH-LABEL: @build_out_of_order(
+; ZEROTHRESH: load <4 x float>
+; ZEROTHRESH: load <4 x float>
+; ZEROTHRESH: %[[S:.+]] = fadd <4 x float>
+; ZEROTHRESH: extractelement <4 x float> %[[S]], i32 1
+; ZEROTHRESH: insertelement <4 x float> undef, float %{{.+}}, i32 1
+; ZEROTHRESH: ret <4 x float>
+define <4 x float> @build_out_of_order(float* %a, float* %b) #0 {
+  %a1 = getelementptr inbounds float, float* %a, i64 1
+  %a2 = getelementptr inbounds float, float* %a, i64 2
+  %a3 = getelementptr inbounds float, float* %a, i64 3
+  %b1 = getelementptr inbounds float, float* %b, i64 1
+  %b2 = getelementptr inbounds float, float* %b, i64 2
+  %b3 = getelementptr inbounds float, float* %b, i64 3
+  %x0 = load float, float* %a, align 4
+  %x1 = load float, float* %a1, align 4
+  %x2 = load float, float* %a2, align 4
+  %x3 = load float, float* %a3, align 4
+  %y0 = load float, float* %b, align 4
+  %y1 = load float, float* %b1, align 4
+  %y2 = load float, float* %b2, align 4
+  %y3 = load float, float* %b3, align 4
+  %s0 = fadd float %x0, %y0
+  %s1 = fadd float %x1, %y1
+  %s2 = fadd float %x2, %y2
+  %s3 = fadd float %x3, %y3
+  %v1 = insertelement <4 x float> undef, float %s1, i32 1
+  %v0 = insertelement <4 x float> %v1, float %s0, i32 0
+  %v3 = insertelement <4 x float> %v0, float %s3, i32 3
+  %v2 = insertelement <4 x float> %v3, float %s2, i32 2
+  ret <4 x float> %v2
+}
+
 attributes #0 = { nounwind ssp uwtable "less-precise-fpmad"="false" "no-frame-pointer-elim"="true" "no-frame-pointer-elim-non-leaf"="true" "no-infs-fp-math"="false" "no-nans-fp-math"="false" "stack-protector-buffer-size"="8" "unsafe-fp-math"="false" "use-soft-float"="false" }
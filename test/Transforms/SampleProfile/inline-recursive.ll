@@ -0,0 +1,43 @@
+; RUN: opt < %s -sample-profile -sample-profile-file=%S/Inputs/inline.prof -S | FileCheck %s
+
+; The hot call to sum is inlined once. The recursive call it brings along
+; has no debug info, so it gets the location of the inlined call and must
+; not be mistaken for it.
+
+; CHECK-LABEL: define i32 @main(
+; CHECK: call i32 @_Z3sumii(
+; CHECK-NOT: call i32 @_Z3sumii(
+; CHECK: ret i32
+
+define i32 @_Z3sumii(i32 %x, i32 %y) {
+entry:
+  %cmp = icmp sgt i32 %x, %y
+  br i1 %cmp, label %if.then, label %if.end
+
+if.then:
+  %dec = add i32 %x, -1
+  %r = call i32 @_Z3sumii(i32 %dec, i32 %y)
+  ret i32 %r
+
+if.end:
+  ret i32 %y
+}
+
+define i32 @main(i32 %a, i32 %b) {
+entry:
+  %s = call i32 @_Z3sumii(i32 %a, i32 %b), !dbg !13
+  ret i32 %s, !dbg !14
+}
+
+!llvm.module.flags = !{!8, !9}
+
+!0 = !DICompileUnit(language: DW_LANG_C_plus_plus, producer: "clang version 3.8 ", isOptimized: false, emissionKind: 0, file: !1, enums: !2, retainedTypes: !2, subprograms: !3, globals: !2, imports: !2)
+!1 = !DIFile(filename: "inline-recursive.cc", directory: ".")
+!2 = !{}
+!3 = !{!7}
+!6 = !DISubroutineType(types: !2)
+!7 = !DISubprogram(name: "main", line: 6, isLocal: false, isDefinition: true, flags: DIFlagPrototyped, isOptimized: false, scopeLine: 6, file: !1, scope: !1, type: !6, function: i32 (i32, i32)* @main, variables: !2)
+!8 = !{i32 2, !"Dwarf Version", i32 4}
+!9 = !{i32 1, !"Debug Info Version", i32 3}
+!13 = !DILocation(line: 8, scope: !7)
+!14 = !DILocation(line: 9, scope: !7)
@@ -0,0 +1,67 @@
+; RUN: opt < %s -sample-profile -sample-profile-file=%S/Inputs/inline.prof -S | FileCheck %s
+; RUN: opt < %s -sample-profile -sample-profile-file=%S/Inputs/inline.prof -sample-profile-inline-hot-threshold=100 -S | FileCheck %s --check-prefix=NOINLINE
+; RUN: llvm-profdata merge --sample --binary %S/Inputs/inline.prof -o %t.binprof
+; RUN: opt < %s -sample-profile -sample-profile-file=%t.binprof -S | FileCheck %s
+; RUN: llvm-profdata merge --sample --compbinary %S/Inputs/inline.prof -o %t.compbinprof
+; RUN: opt < %s -sample-profile -sample-profile-file=%t.compbinprof -S | FileCheck %s
+
+; Original C++ test case
+;
+; int sum(int x, int y) {
+;   if (x > y)
+;     return x;
+;   return y;
+; }
+;
+; int main(int a, int b) {
+;   int s;
+;   s = sum(a, b);
+;   return s;
+; }
+;
+; The call to sum was inlined in the profiled binary, so its samples are
+; nested under the call site in the profile. The call is inlined again
+; before annotating main, and the branch of the inlined copy gets the
+; weights of the inlined profile.
+
+define i32 @_Z3sumii(i32 %x, i32 %y) {
+entry:
+  %cmp = icmp sgt i32 %x, %y, !dbg !10
+  br i1 %cmp, label %if.then, label %if.end, !dbg !10
+
+if.then:
+  ret i32 %x, !dbg !11
+
+if.end:
+  ret i32 %y, !dbg !12
+}
+
+; CHECK-LABEL: define i32 @main(
+; CHECK-NOT: call i32 @_Z3sumii
+; CHECK: br i1 %{{.*}}, label %{{.*}}, label %{{.*}}, !dbg !{{[0-9]+}}, !prof ![[WEIGHTS:[0-9]+]]
+; CHECK: ![[WEIGHTS]] = !{!"branch_weights", i32 100, i32 200}
+
+; NOINLINE-LABEL: define i32 @main(
+; NOINLINE: call i32 @_Z3sumii
+define i32 @main(i32 %a, i32 %b) {
+entry:
+  %s = call i32 @_Z3sumii(i32 %a, i32 %b), !dbg !13
+  ret i32 %s, !dbg !14
+}
+
+!llvm.module.flags = !{!8, !9}
+
+!0 = !DICompileUnit(language: DW_LANG_C_plus_plus, producer: "clang version 3.8 ", isOptimized: false, emissionKind: 0, file: !1, enums: !2, retainedTypes: !2, subprograms: !3, globals: !2, imports: !2)
+!1 = !DIFile(filename: "inline.cc", directory: ".")
+!2 = !{}
+!3 = !{!4, !7}
+!4 = !DISubprogram(name: "sum", linkageName: "_Z3sumii", line: 1, isLocal: false, isDefinition: true, flags: DIFlagPrototyped, isOptimized: false, scopeLine: 1, file: !1, scope: !1, type: !6, function: i32 (i32, i32)* @_Z3sumii, variables: !2)
+!6 = !DISubroutineType(types: !2)
+!7 = !DISubprogram(name: "main", line: 6, isLocal: false, isDefinition: true, flags: DIFlagPrototyped, isOptimized: false, scopeLine: 6, file: !1, scope: !1, type: !6, function: i32 (i32, i32)* @main, variables: !2)
+!8 = !{i32 2, !"Dwarf Version", i32 4}
+!9 = !{i32 1, !"Debug Info Version", i32 3}
+!10 = !DILocation(line: 2, scope: !4)
+!11 = !DILocation(line: 3, scope: !4)
+!12 = !DILocation(line: 4, scope: !4)
+!13 = !DILocation(line: 8, scope: !7)
+!14 = !DILocation(line: 9, scope: !7)
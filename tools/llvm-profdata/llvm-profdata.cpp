@@ -59,8 +59,7 @@ static void mergeInstrProfile(const cl::list<std::string> &Inputs,
 
     auto Reader = std::move(ReaderOrErr.get());
     for (const auto &I : *Reader)
-      if (std::error_code EC =
-              Writer.addFunctionCounts(I.Name, I.Hash, I.Counts))
+      if (std::error_code EC = Writer.addRecord(I))
         errs() << Filename << ": " << I.Name << ": " << EC.message() << "\n";
     if (Reader->hasError())
       exitWithError(Reader->getError().message(), Filename);
@@ -119,6 +118,8 @@ static int merge_main(int argc, const char *argv[]) {
       cl::init(sampleprof::SPF_Binary),
       cl::values(clEnumValN(sampleprof::SPF_Binary, "binary",
                             "Binary encoding (default)"),
+                 clEnumValN(sampleprof::SPF_Compact_Binary, "compbinary",
+                            "Compact binary encoding, indexed by function"),
                  clEnumValN(sampleprof::SPF_Text, "text", "Text encoding"),
                  clEnumValN(sampleprof::SPF_GCC, "gcc", "GCC encoding"),
                  clEnumValEnd));
@@ -134,6 +135,7 @@ static int merge_main(int argc, const char *argv[]) {
 }
 
 static int showInstrProfile(std::string Filename, bool ShowCounts,
+                            bool ShowIndirectCallTargets,
                             bool ShowAllFunctions, std::string ShowFunction,
                             raw_fd_ostream &OS) {
   auto ReaderOrErr = InstrProfReader::create(Filename);
@@ -162,6 +164,9 @@ static int showInstrProfile(std::string Filename, bool ShowCounts,
          << "    Hash: " << format("0x%016" PRIx64, Func.Hash) << "\n"
          << "    Counters: " << Func.Counts.size() << "\n"
          << "    Function count: " << Func.Counts[0] << "\n";
+      if (ShowIndirectCallTargets)
+        OS << "    Indirect Call Site Count: "
+           << Func.IndirectCallSites.size() << "\n";
     }
 
     if (Show && ShowCounts)
@@ -174,6 +179,14 @@ static int showInstrProfile(std::string Filename, bool ShowCounts,
     }
     if (Show && ShowCounts)
       OS << "]\n";
+
+    if (Show && ShowIndirectCallTargets) {
+      OS << "    Indirect Target Results: \n";
+      for (size_t I = 0, E = Func.IndirectCallSites.size(); I < E; ++I)
+        for (const InstrProfValueData &VD : Func.IndirectCallSites[I])
+          OS << "\t[ " << I << ", " << format("0x%016" PRIx64, VD.Value)
+             << ", " << VD.Count << " ]\n";
+    }
   }
   if (Reader->hasError())
     exitWithError(Reader->getError().message(), Filename);
@@ -210,6 +223,9 @@ static int show_main(int argc, const char *argv[]) {
 
   cl::opt<bool> ShowCounts("counts", cl::init(false),
                            cl::desc("Show counter values for shown functions"));
+  cl::opt<bool> ShowIndirectCallTargets(
+      "ic-targets", cl::init(false),
+      cl::desc("Show indirect call site target values for shown functions"));
   cl::opt<bool> ShowAllFunctions("all-functions", cl::init(false),
                                  cl::desc("Details for every function"));
   cl::opt<std::string> ShowFunction("function",
@@ -238,8 +254,8 @@ static int show_main(int argc, const char *argv[]) {
     errs() << "warning: -function argument ignored: showing all functions\n";
 
   if (ProfileKind == instr)
-    return showInstrProfile(Filename, ShowCounts, ShowAllFunctions,
-                            ShowFunction, OS);
+    return showInstrProfile(Filename, ShowCounts, ShowIndirectCallTargets,
+                            ShowAllFunctions, ShowFunction, OS);
   else
     return showSampleProfile(Filename, ShowCounts, ShowAllFunctions,
                              ShowFunction, OS);
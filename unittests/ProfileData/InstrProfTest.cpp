@@ -101,4 +101,60 @@ TEST_F(InstrProfTest, get_max_function_count) {
   ASSERT_EQ(1ULL << 63, Reader->getMaximumFunctionCount());
 }
 
+TEST_F(InstrProfTest, write_and_read_value_profile) {
+  InstrProfRecord Record("caller", 0x1234, {1, 2});
+  Record.IndirectCallSites.push_back({{0x1000, 5}, {0x2000, 3}});
+  Record.IndirectCallSites.push_back({});
+  Record.IndirectCallSites.push_back({{0x3000, 7}});
+  Writer.addRecord(Record);
+  Writer.addFunctionCounts("callee", 0x5678, {3});
+  auto Profile = Writer.writeBuffer();
+  readProfile(std::move(Profile));
+
+  ErrorOr<InstrProfRecord> R = Reader->getInstrProfRecord("caller", 0x1234);
+  ASSERT_TRUE(NoError(R.getError()));
+  ASSERT_EQ(2U, R.get().Counts.size());
+  ASSERT_EQ(3U, R.get().IndirectCallSites.size());
+  ASSERT_EQ(2U, R.get().IndirectCallSites[0].size());
+  ASSERT_EQ(0x1000U, R.get().IndirectCallSites[0][0].Value);
+  ASSERT_EQ(5U, R.get().IndirectCallSites[0][0].Count);
+  ASSERT_EQ(0x2000U, R.get().IndirectCallSites[0][1].Value);
+  ASSERT_EQ(3U, R.get().IndirectCallSites[0][1].Count);
+  ASSERT_EQ(0U, R.get().IndirectCallSites[1].size());
+  ASSERT_EQ(1U, R.get().IndirectCallSites[2].size());
+  ASSERT_EQ(0x3000U, R.get().IndirectCallSites[2][0].Value);
+
+  R = Reader->getInstrProfRecord("callee", 0x5678);
+  ASSERT_TRUE(NoError(R.getError()));
+  ASSERT_EQ(0U, R.get().IndirectCallSites.size());
+}
+
+TEST_F(InstrProfTest, merge_value_profile) {
+  InstrProfRecord Record1("caller", 0x1234, {1});
+  Record1.IndirectCallSites.push_back({{0x1000, 5}, {0x2000, 3}});
+  InstrProfRecord Record2("caller", 0x1234, {2});
+  Record2.IndirectCallSites.push_back({{0x2000, 4}, {0x3000, 1}});
+  ASSERT_TRUE(NoError(Writer.addRecord(Record1)));
+  ASSERT_TRUE(NoError(Writer.addRecord(Record2)));
+
+  InstrProfRecord Record3("caller", 0x1234, {3});
+  ASSERT_TRUE(ErrorEquals(instrprof_error::count_mismatch,
+                          Writer.addRecord(Record3)));
+
+  auto Profile = Writer.writeBuffer();
+  readProfile(std::move(Profile));
+
+  ErrorOr<InstrProfRecord> R = Reader->getInstrProfRecord("caller", 0x1234);
+  ASSERT_TRUE(NoError(R.getError()));
+  ASSERT_EQ(1U, R.get().IndirectCallSites.size());
+  const InstrProfValueSite &Site = R.get().IndirectCallSites[0];
+  ASSERT_EQ(3U, Site.size());
+  ASSERT_EQ(0x1000U, Site[0].Value);
+  ASSERT_EQ(5U, Site[0].Count);
+  ASSERT_EQ(0x2000U, Site[1].Value);
+  ASSERT_EQ(7U, Site[1].Count);
+  ASSERT_EQ(0x3000U, Site[2].Value);
+  ASSERT_EQ(1U, Site[2].Count);
+}
+
 } // end anonymous namespace